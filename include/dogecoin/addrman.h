@@ -0,0 +1,101 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2024 The Dogecoin Foundation
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __LIBDOGECOIN_ADDRMAN_H__
+#define __LIBDOGECOIN_ADDRMAN_H__
+
+#include <dogecoin/dogecoin.h>
+#include <dogecoin/chainparams.h>
+#include <dogecoin/protocol.h>
+#include <dogecoin/vector.h>
+
+LIBDOGECOIN_BEGIN_DECL
+
+#define DOGECOIN_ADDRMAN_MAX_ENTRIES 2048 /* the worst entry gets replaced beyond this */
+#define DOGECOIN_ADDRMAN_MAX_ADDR_MSG 1000 /* addresses per addr message */
+#define DOGECOIN_ADDRMAN_RETRY_DELAY 60 /* seconds, doubled with every failed connect */
+#define DOGECOIN_ADDRMAN_BAN_TIME (24 * 60 * 60) /* seconds a misbehaving peer is skipped */
+#define DOGECOIN_ADDRMAN_SAVE_INTERVAL (15 * 60) /* seconds between periodic saves */
+
+/* what we know about a peer address, the counters survive restarts */
+typedef struct dogecoin_addrman_entry_ {
+    unsigned char ip[16]; /* ipv6 or ipv4 mapped */
+    uint16_t port;
+    uint64_t services;
+    uint32_t last_seen; /* announced (addr) or last successful handshake */
+    uint32_t last_attempt;
+    uint32_t last_success;
+    uint32_t last_misbehaved;
+    uint32_t failures; /* connects without handshake since the last success */
+    uint32_t successes;
+    uint32_t misbehaviour;
+    uint32_t latency_ms; /* smoothed connect to verack time, 0 if unknown */
+    uint32_t throughput; /* smoothed block bytes per second, 0 if unknown */
+} dogecoin_addrman_entry;
+
+typedef struct dogecoin_addrman_ {
+    const dogecoin_chainparams* chainparams;
+    vector_t* entries; /* dogecoin_addrman_entry* */
+    char* file_path; /* NULL: memory only */
+    dogecoin_bool dirty; /* changed since the last save */
+    uint64_t last_save;
+} dogecoin_addrman;
+
+LIBDOGECOIN_API dogecoin_addrman* dogecoin_addrman_new(const dogecoin_chainparams* chainparams);
+LIBDOGECOIN_API void dogecoin_addrman_free(dogecoin_addrman* addrman);
+
+/** reads the entries stored at file_path (a missing file is an empty table)
+ * and saves to it from now on */
+LIBDOGECOIN_API dogecoin_bool dogecoin_addrman_load(dogecoin_addrman* addrman, const char* file_path);
+
+/** writes all entries to a temporary file which then replaces the loaded file */
+LIBDOGECOIN_API dogecoin_bool dogecoin_addrman_save(dogecoin_addrman* addrman);
+
+/** learns an address (from addr messages, dns seeds or the command line),
+ * returns the new or refreshed entry or NULL if the address is not usable */
+LIBDOGECOIN_API dogecoin_addrman_entry* dogecoin_addrman_add(dogecoin_addrman* addrman, const dogecoin_p2p_address* addr, uint32_t now);
+LIBDOGECOIN_API dogecoin_addrman_entry* dogecoin_addrman_find(const dogecoin_addrman* addrman, const struct sockaddr* addr);
+
+/* peer events, unknown addresses are added */
+LIBDOGECOIN_API void dogecoin_addrman_attempt(dogecoin_addrman* addrman, const struct sockaddr* addr, uint32_t now);
+LIBDOGECOIN_API void dogecoin_addrman_connected(dogecoin_addrman* addrman, const struct sockaddr* addr, uint64_t services, uint32_t latency_ms, uint32_t now);
+LIBDOGECOIN_API void dogecoin_addrman_block_received(dogecoin_addrman* addrman, const struct sockaddr* addr, uint32_t bytes, uint32_t elapsed_ms);
+LIBDOGECOIN_API void dogecoin_addrman_misbehaved(dogecoin_addrman* addrman, const struct sockaddr* addr, uint32_t now);
+
+/** ranks an entry, higher is better: handshakes that worked, low latency and high
+ * block throughput count for it, failed connects and misbehaviour against it */
+LIBDOGECOIN_API int64_t dogecoin_addrman_score(const dogecoin_addrman_entry* entry, uint32_t now);
+
+/** appends up to max entries to out (not owned) in score order, skipping entries
+ * waiting for a retry or banned and the ones exclude returns true for */
+LIBDOGECOIN_API size_t dogecoin_addrman_select(const dogecoin_addrman* addrman, vector_t* out, size_t max, uint32_t now, dogecoin_bool (*exclude)(void* ctx, const dogecoin_addrman_entry* entry), void* ctx);
+
+/** fills a sockaddr (ipv4 or ipv6) for an entry */
+LIBDOGECOIN_API void dogecoin_addrman_entry_to_addr(const dogecoin_addrman_entry* entry, struct sockaddr* addr_out);
+
+LIBDOGECOIN_END_DECL
+
+#endif // __LIBDOGECOIN_ADDRMAN_H__
@@ -69,6 +69,15 @@ dogecoin_bool arith_uint256_greater_than_or_equal(const arith_uint256* a, const
 dogecoin_bool arith_uint256_less_than(const arith_uint256* a, const arith_uint256* b);
 dogecoin_bool arith_uint256_less_than_or_equal(const arith_uint256* a, const arith_uint256* b);
 
+/* value type API: results are returned by value, nothing is allocated */
+arith_uint256 arith_uint256_from_compact(uint32_t compact, dogecoin_bool *pf_negative, dogecoin_bool *pf_overflow);
+arith_uint256 arith_uint256_from_uint256(const uint256_t a);
+void arith_uint256_to_uint256(const arith_uint256* a, uint256_t out);
+arith_uint256 arith_uint256_add(const arith_uint256* a, const arith_uint256* b);
+arith_uint256 arith_uint256_sub(const arith_uint256* a, const arith_uint256* b);
+arith_uint256 arith_uint256_div(const arith_uint256* a, const arith_uint256* b);
+int arith_uint256_compare(const arith_uint256* a, const arith_uint256* b);
+
 LIBDOGECOIN_END_DECL
 
 #endif // __LIBDOGECOIN_ARITH_UINT256_H__
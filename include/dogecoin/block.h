@@ -79,6 +79,9 @@ LIBDOGECOIN_API int deserialize_dogecoin_auxpow_block(dogecoin_auxpow_block* blo
 LIBDOGECOIN_API void dogecoin_block_header_serialize(cstring* s, const dogecoin_block_header* header);
 LIBDOGECOIN_API void dogecoin_block_header_copy(dogecoin_block_header* dest, const dogecoin_block_header* src);
 LIBDOGECOIN_API dogecoin_bool dogecoin_block_header_hash(dogecoin_block_header* header, uint256_t hash);
+/** computes the merkle root of the transactions following a block header, fails on
+ * malformed or ambiguous (CVE-2012-2459) transaction lists */
+LIBDOGECOIN_API dogecoin_bool dogecoin_block_txs_merkle_root(const struct const_buffer* buf, uint256_t merkle_root);
 
 LIBDOGECOIN_END_DECL
 
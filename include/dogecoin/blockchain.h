@@ -45,6 +45,28 @@ typedef struct dogecoin_blockindex {
     struct dogecoin_blockindex* prev;
 } dogecoin_blockindex;
 
+/**
+ * Open addressing (linear probing) hash table of blockindex pointers keyed
+ * by block hash. Block hashes are uniformly distributed, so the first
+ * 8 hash bytes are used as key without additional mixing.
+ */
+typedef struct dogecoin_blockindex_map_slot {
+    uint64_t key;
+    dogecoin_blockindex* blockindex;
+} dogecoin_blockindex_map_slot;
+
+typedef struct dogecoin_blockindex_map {
+    dogecoin_blockindex_map_slot* slots;
+    size_t capacity; /* always a power of two */
+    size_t count;
+} dogecoin_blockindex_map;
+
+LIBDOGECOIN_API dogecoin_blockindex_map* dogecoin_blockindex_map_new(size_t capacity_hint);
+LIBDOGECOIN_API void dogecoin_blockindex_map_free(dogecoin_blockindex_map* map, void (*free_cb)(void*));
+LIBDOGECOIN_API dogecoin_bool dogecoin_blockindex_map_insert(dogecoin_blockindex_map* map, dogecoin_blockindex* blockindex);
+LIBDOGECOIN_API dogecoin_blockindex* dogecoin_blockindex_map_find(const dogecoin_blockindex_map* map, const uint256_t hash);
+LIBDOGECOIN_API dogecoin_bool dogecoin_blockindex_map_remove(dogecoin_blockindex_map* map, const uint256_t hash);
+
 LIBDOGECOIN_END_DECL
 
 #endif // __LIBDOGECOIN_BLOCKCHAIN_H__
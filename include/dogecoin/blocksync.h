@@ -0,0 +1,105 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2024 The Dogecoin Foundation
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __LIBDOGECOIN_BLOCKSYNC_H__
+#define __LIBDOGECOIN_BLOCKSYNC_H__
+
+#include <dogecoin/dogecoin.h>
+#include <dogecoin/blockchain.h>
+#include <dogecoin/cstr.h>
+
+LIBDOGECOIN_BEGIN_DECL
+
+/* defaults used by the spv client */
+#define DOGECOIN_BLOCKSYNC_WINDOW 16 /* blocks in flight per peer */
+#define DOGECOIN_BLOCKSYNC_CAPACITY 1024 /* blocks ahead of the next block to connect */
+#define DOGECOIN_BLOCKSYNC_STALL_TIMEOUT 60 /* seconds before a requested block gets reassigned */
+
+enum dogecoin_block_request_state {
+    DOGECOIN_BLOCK_REQUEST_PENDING = 0,
+    DOGECOIN_BLOCK_REQUEST_INFLIGHT,
+    DOGECOIN_BLOCK_REQUEST_RECEIVED,
+};
+
+/* one height of the download window */
+typedef struct dogecoin_block_request_ {
+    dogecoin_blockindex index; /* header copy, handed to the sync callbacks */
+    enum dogecoin_block_request_state state;
+    int nodeid; /* peer the block was requested from, or received from */
+    uint64_t request_time;
+    cstring *block; /* raw block while it waits in the reorder buffer */
+} dogecoin_block_request;
+
+/* assigns block heights to peers in ranges of up to window blocks and
+   hands the received blocks back in height order; heights are only
+   requested up to capacity blocks past the next block to connect, which
+   bounds the reorder buffer */
+typedef struct dogecoin_block_scheduler_ {
+    uint32_t next_height; /* next block to connect */
+    uint32_t fill_height; /* first height without a slot */
+    uint32_t target_height; /* last height with a known header */
+    uint32_t window;
+    uint32_t capacity;
+    uint64_t stall_timeout;
+    dogecoin_block_request *slots; /* ring, indexed by height % capacity */
+
+    /* looks up the main chain header at a height */
+    dogecoin_bool (*get_header)(void *ctx, uint32_t height, dogecoin_blockindex *blockindex);
+    void *ctx;
+} dogecoin_block_scheduler;
+
+LIBDOGECOIN_API dogecoin_block_scheduler* dogecoin_block_scheduler_new(uint32_t start_height, uint32_t window, uint32_t capacity, uint64_t stall_timeout, dogecoin_bool (*get_header)(void *ctx, uint32_t height, dogecoin_blockindex *blockindex), void *ctx);
+LIBDOGECOIN_API void dogecoin_block_scheduler_free(dogecoin_block_scheduler* scheduler);
+
+/** extends the download to the given height (headers up to it must be known) */
+LIBDOGECOIN_API void dogecoin_block_scheduler_set_target(dogecoin_block_scheduler* scheduler, uint32_t height);
+
+/** assigns the lowest unrequested heights the peer can serve, up to its free window,
+ * and appends their inv entries (type + hash) to inv; returns the amount of entries */
+LIBDOGECOIN_API uint32_t dogecoin_block_scheduler_assign(dogecoin_block_scheduler* scheduler, int nodeid, uint32_t node_height, uint64_t now, cstring* inv);
+
+/** stores a block received from a peer in the reorder buffer, returns false if it was not requested */
+LIBDOGECOIN_API dogecoin_bool dogecoin_block_scheduler_block_received(dogecoin_block_scheduler* scheduler, int nodeid, const uint256_t hash, const uint8_t* data, size_t len);
+
+/** returns the next block in height order if it was received, the caller owns the block
+ * and passes index to the sync callbacks; nodeid (may be NULL) receives the serving peer */
+LIBDOGECOIN_API cstring* dogecoin_block_scheduler_next(dogecoin_block_scheduler* scheduler, dogecoin_blockindex* index, int* nodeid);
+
+/** returns blocks requested before now - stall_timeout to the pending set, returns the amount */
+LIBDOGECOIN_API uint32_t dogecoin_block_scheduler_check_stalls(dogecoin_block_scheduler* scheduler, uint64_t now);
+
+/** returns all blocks in flight from a peer to the pending set (disconnect, misbehaviour) */
+LIBDOGECOIN_API void dogecoin_block_scheduler_release_node(dogecoin_block_scheduler* scheduler, int nodeid);
+
+/** restarts the download at height, drops everything above (reorg) */
+LIBDOGECOIN_API void dogecoin_block_scheduler_rewind(dogecoin_block_scheduler* scheduler, uint32_t height);
+
+LIBDOGECOIN_API uint32_t dogecoin_block_scheduler_inflight(const dogecoin_block_scheduler* scheduler, int nodeid);
+LIBDOGECOIN_API dogecoin_bool dogecoin_block_scheduler_done(const dogecoin_block_scheduler* scheduler);
+
+LIBDOGECOIN_END_DECL
+
+#endif // __LIBDOGECOIN_BLOCKSYNC_H__
@@ -0,0 +1,78 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2012-2016 The Bitcoin Core developers
+ Copyright (c) 2024 The Dogecoin Foundation
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __LIBDOGECOIN_BLOOM_H__
+#define __LIBDOGECOIN_BLOOM_H__
+
+#include <dogecoin/dogecoin.h>
+#include <dogecoin/buffer.h>
+#include <dogecoin/cstr.h>
+#include <dogecoin/vector.h>
+
+LIBDOGECOIN_BEGIN_DECL
+
+/* BIP37 limits, peers reject larger filters */
+#define DOGECOIN_BLOOM_MAX_FILTER_SIZE 36000 /* bytes */
+#define DOGECOIN_BLOOM_MAX_HASH_FUNCS 50
+
+/* what a peer adds to the filter when an output matches */
+enum dogecoin_bloom_flags {
+    DOGECOIN_BLOOM_UPDATE_NONE = 0,
+    DOGECOIN_BLOOM_UPDATE_ALL = 1, /* the outpoint of every matching output */
+    DOGECOIN_BLOOM_UPDATE_P2PUBKEY_ONLY = 2, /* outpoints of matching pay-to-pubkey and multisig outputs */
+};
+
+/* BIP37 bloom filter as sent with filterload */
+typedef struct dogecoin_bloom_filter_ {
+    uint8_t* data;
+    uint32_t size; /* bytes */
+    uint32_t hash_funcs;
+    uint32_t tweak;
+    uint8_t flags;
+} dogecoin_bloom_filter;
+
+LIBDOGECOIN_API uint32_t dogecoin_murmur3(uint32_t seed, const uint8_t* data, size_t len);
+
+LIBDOGECOIN_API dogecoin_bloom_filter* dogecoin_bloom_filter_new(uint32_t elements, double fp_rate, uint32_t tweak, uint8_t flags);
+LIBDOGECOIN_API void dogecoin_bloom_filter_free(dogecoin_bloom_filter* filter);
+LIBDOGECOIN_API void dogecoin_bloom_filter_insert(dogecoin_bloom_filter* filter, const uint8_t* data, size_t len);
+LIBDOGECOIN_API dogecoin_bool dogecoin_bloom_filter_contains(const dogecoin_bloom_filter* filter, const uint8_t* data, size_t len);
+
+/** inserts an outpoint (txid in internal byte order + vout) */
+LIBDOGECOIN_API void dogecoin_bloom_filter_insert_outpoint(dogecoin_bloom_filter* filter, const uint256_t hash, uint32_t n);
+
+/** serializes the filter as filterload payload */
+LIBDOGECOIN_API void dogecoin_bloom_filter_serialize(cstring* s, const dogecoin_bloom_filter* filter);
+
+/** reads the partial merkle tree of a merkleblock (after the header), computes
+ * its merkle root and adds the matched txids (uint256_t*, internal byte order)
+ * to matches; fails on malformed or ambiguous trees */
+LIBDOGECOIN_API dogecoin_bool dogecoin_merkleblock_extract_matches(struct const_buffer* buf, uint256_t merkle_root, vector_t* matches);
+
+LIBDOGECOIN_END_DECL
+
+#endif // __LIBDOGECOIN_BLOOM_H__
@@ -0,0 +1,110 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2024 The Dogecoin Foundation
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __LIBDOGECOIN_BROADCAST_H__
+#define __LIBDOGECOIN_BROADCAST_H__
+
+#include <dogecoin/dogecoin.h>
+#include <dogecoin/addrman.h>
+#include <dogecoin/chainparams.h>
+#include <dogecoin/net.h>
+#include <dogecoin/tx.h>
+
+LIBDOGECOIN_BEGIN_DECL
+
+/* defaults of a new broadcaster */
+#define DOGECOIN_BROADCAST_INV_INTERVAL_MS 500 /* submitted transactions get announced together */
+#define DOGECOIN_BROADCAST_MAX_INV 1000 /* announcements per inv message */
+#define DOGECOIN_BROADCAST_TX_EXPIRY (30 * 60) /* seconds a transaction is served and tracked */
+#define DOGECOIN_BROADCAST_RECONNECT_S 10 /* seconds between reconnects to lost peers */
+
+/* furthest relay progress of a transaction */
+enum dogecoin_broadcast_state {
+    DOGECOIN_BROADCAST_QUEUED = 0, /* accepted, waits for the next announcement */
+    DOGECOIN_BROADCAST_ANNOUNCED, /* inv sent to at least one peer */
+    DOGECOIN_BROADCAST_REQUESTED, /* a peer asked for it (getdata) and got it */
+    DOGECOIN_BROADCAST_RELAYED, /* announced back to us, it made it into the network */
+    DOGECOIN_BROADCAST_EXPIRED, /* no longer tracked, last report */
+};
+
+typedef struct dogecoin_broadcast_status_ {
+    uint256_t txhash;
+    enum dogecoin_broadcast_state state;
+    uint64_t submit_time;
+    unsigned int announced_to; /* peers that got an inv */
+    unsigned int requested_by; /* getdata received */
+    unsigned int seen_on; /* peers that announced it to us */
+} dogecoin_broadcast_status;
+
+struct dogecoin_broadcast_entry_;
+struct dogecoin_broadcast_queue_;
+
+/* long lived broadcaster: keeps its peers connected, takes transactions from any
+   thread and announces everything submitted within inv_interval_ms with one inv
+   per peer; the peers callbacks and the status callback run on the event loop */
+typedef struct dogecoin_broadcaster_ {
+    dogecoin_node_group* group;
+    dogecoin_addrman* addrman; /* in memory, ranks the peers to reconnect to */
+    char* ips; /* fixed peers, NULL: address manager and dns seeds */
+
+    unsigned int inv_interval_ms;
+    uint64_t tx_expiry; /* seconds */
+    vector_t* txs; /* tracked transactions, oldest first */
+    struct dogecoin_broadcast_entry_* index; /* tracked transactions by hash */
+    vector_t* unannounced; /* tracked transactions waiting for the next inv (not owned) */
+    struct event* flush_timer;
+    uint64_t last_reconnect;
+    struct dogecoin_broadcast_queue_* queue; /* submissions from other threads */
+
+    /* called for every change of a transaction */
+    void (*tx_status_cb)(void* ctx, const dogecoin_broadcast_status* status);
+    void* ctx;
+} dogecoin_broadcaster;
+
+/** creates a broadcaster for up to maxpeers peers, ips is an optional comma separated list */
+LIBDOGECOIN_API dogecoin_broadcaster* dogecoin_broadcaster_new(const dogecoin_chainparams* chainparams, const char* ips, int maxpeers, dogecoin_bool debug);
+
+/** stops the event loop thread if it runs, drops all tracked transactions */
+LIBDOGECOIN_API void dogecoin_broadcaster_free(dogecoin_broadcaster* broadcaster);
+
+/** connects and runs the event loop on a new thread, returns false if it could not be started */
+LIBDOGECOIN_API dogecoin_bool dogecoin_broadcaster_start(dogecoin_broadcaster* broadcaster);
+
+/** connects and runs the event loop on the calling thread until dogecoin_broadcaster_stop */
+LIBDOGECOIN_API void dogecoin_broadcaster_run(dogecoin_broadcaster* broadcaster);
+LIBDOGECOIN_API void dogecoin_broadcaster_stop(dogecoin_broadcaster* broadcaster);
+
+/** queues a batch of transactions, callable from any thread; transactions already
+ * tracked are skipped, returns false if the broadcaster is stopping */
+LIBDOGECOIN_API dogecoin_bool dogecoin_broadcaster_submit(dogecoin_broadcaster* broadcaster, const dogecoin_tx* const* txs, size_t count);
+LIBDOGECOIN_API dogecoin_bool dogecoin_broadcaster_submit_raw(dogecoin_broadcaster* broadcaster, const unsigned char* raw_tx, size_t len);
+
+/** amount of tracked transactions (event loop thread) */
+LIBDOGECOIN_API size_t dogecoin_broadcaster_tracked(const dogecoin_broadcaster* broadcaster);
+
+LIBDOGECOIN_END_DECL
+
+#endif // __LIBDOGECOIN_BROADCAST_H__
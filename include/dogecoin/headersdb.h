@@ -53,6 +53,12 @@ typedef struct dogecoin_headers_db_interface_
     dogecoin_bool (*disconnect_tip)(void *db);
     dogecoin_bool (*has_checkpoint_start)(void *db);
     void (*set_checkpoint_start)(void *db, uint256_t hash, uint32_t height, uint256_t chainwork);
+    void (*begin_batch)(void *db);
+    dogecoin_bool (*commit_batch)(void *db);
+    size_t (*verify_pow_batch)(void *db, const struct const_buffer *buf, uint32_t count);
+    void (*set_disconnect_cb)(void *db, void (*cb)(void *ctx, const dogecoin_blockindex *pindex), void *ctx);
+    dogecoin_bool (*get_header_at_height)(void *db, uint32_t height, dogecoin_blockindex *blockindex);
+    dogecoin_blockindex *(*find)(void *db, uint256_t hash);
 } dogecoin_headers_db_interface;
 
 LIBDOGECOIN_END_DECL
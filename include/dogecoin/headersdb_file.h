@@ -39,7 +39,12 @@
 
 LIBDOGECOIN_BEGIN_DECL
 
-/* filebased headers database (including binary tree option for fast access)
+/* size of a single header record on disk: hash + height + chainwork + header */
+#define DOGECOIN_HEADERS_DB_RECORD_SIZE (32 + 4 + 32 + 80)
+
+struct dogecoin_headers_db_pow_pool_;
+
+/* filebased headers database (including hash table and binary tree options for fast access)
 */
 typedef struct dogecoin_headers_db_
 {
@@ -47,13 +52,44 @@ typedef struct dogecoin_headers_db_
     dogecoin_bool read_write_file;
     void *tree_root;
     dogecoin_bool use_binary_tree;
+    dogecoin_blockindex_map *hash_index;
+    dogecoin_bool use_hash_index;
     unsigned int max_hdr_in_mem;
     const dogecoin_chainparams *params;
     dogecoin_blockindex genesis;
     dogecoin_blockindex *chaintip;
     dogecoin_blockindex *chainbottom;
+
+    /* height indexed storage (file version 4): the main chain is stored as
+       fixed size records where record n holds the header at first_height + n,
+       the file is memory mapped (where supported) for O(1) height lookups */
+    dogecoin_bool use_mmap;
+    uint32_t first_height;
+    uint32_t records;
+    uint8_t *map_base;
+    size_t map_len;
+
+    /* group commit: new records are collected and written with a single
+       write + fsync per batch (see dogecoin_headers_db_begin_batch) or
+       at most once every flush_interval seconds (0 = write immediately) */
+    cstring *write_buffer;
+    dogecoin_bool batch_active;
+    uint32_t flush_interval;
+    int64_t last_flush;
+
+    /* parallel proof of work stage: headers of a headers message are scrypt
+       hashed and checked by pow_threads workers (plus the calling thread)
+       before they are connected (see dogecoin_headers_db_verify_pow_batch) */
+    unsigned int pow_threads;
+    struct dogecoin_headers_db_pow_pool_ *pow_pool;
+
+    /* called for every block leaving the main chain (disconnect or reorg)
+       before its index gets released, lets owners roll back block state */
+    void (*disconnect_cb)(void *ctx, const dogecoin_blockindex *pindex);
+    void *disconnect_ctx;
 } dogecoin_headers_db;
 
+int dogecoin_header_compare(const void *l, const void *r);
 dogecoin_headers_db *dogecoin_headers_db_new(const dogecoin_chainparams* chainparams, dogecoin_bool inmem_only);
 void dogecoin_headers_db_free(dogecoin_headers_db *db);
 dogecoin_bool dogecoin_headers_db_load(dogecoin_headers_db* db, const char *filename, dogecoin_bool prompt);
@@ -64,6 +100,14 @@ dogecoin_blockindex * dogecoin_headersdb_getchaintip(dogecoin_headers_db* db);
 dogecoin_bool dogecoin_headersdb_disconnect_tip(dogecoin_headers_db* db);
 dogecoin_bool dogecoin_headersdb_has_checkpoint_start(dogecoin_headers_db* db);
 void dogecoin_headersdb_set_checkpoint_start(dogecoin_headers_db* db, uint256_t hash, uint32_t height, uint256_t chainwork);
+dogecoin_bool dogecoin_headersdb_get_header_at_height(dogecoin_headers_db* db, uint32_t height, dogecoin_blockindex *blockindex);
+dogecoin_bool dogecoin_headersdb_get_ancestor(dogecoin_headers_db* db, const dogecoin_blockindex *pindex, uint32_t height, dogecoin_blockindex *ancestor);
+void dogecoin_headers_db_begin_batch(dogecoin_headers_db* db);
+dogecoin_bool dogecoin_headers_db_commit_batch(dogecoin_headers_db* db);
+dogecoin_bool dogecoin_headers_db_flush(dogecoin_headers_db* db);
+size_t dogecoin_headers_db_verify_pow_batch(dogecoin_headers_db* db, const struct const_buffer *buf, uint32_t count);
+void dogecoin_headers_db_set_disconnect_cb(dogecoin_headers_db* db, void (*cb)(void *ctx, const dogecoin_blockindex *pindex), void *ctx);
+dogecoin_bool dogecoin_headers_message_last_hash(const struct const_buffer *buf, uint32_t count, uint256_t hash);
 
 static const dogecoin_headers_db_interface dogecoin_headers_db_interface_file = {
     (void* (*)(const dogecoin_chainparams*, dogecoin_bool))dogecoin_headers_db_new,
@@ -74,7 +118,13 @@ static const dogecoin_headers_db_interface dogecoin_headers_db_interface_file =
     (dogecoin_blockindex* (*)(void *))dogecoin_headersdb_getchaintip,
     (dogecoin_bool (*)(void *))dogecoin_headersdb_disconnect_tip,
     (dogecoin_bool (*)(void *))dogecoin_headersdb_has_checkpoint_start,
-    (void (*)(void *, uint256_t, uint32_t, uint256_t))dogecoin_headersdb_set_checkpoint_start
+    (void (*)(void *, uint256_t, uint32_t, uint256_t))dogecoin_headersdb_set_checkpoint_start,
+    (void (*)(void *))dogecoin_headers_db_begin_batch,
+    (dogecoin_bool (*)(void *))dogecoin_headers_db_commit_batch,
+    (size_t (*)(void *, const struct const_buffer *, uint32_t))dogecoin_headers_db_verify_pow_batch,
+    (void (*)(void *, void (*)(void *, const dogecoin_blockindex *), void *))dogecoin_headers_db_set_disconnect_cb,
+    (dogecoin_bool (*)(void *, uint32_t, dogecoin_blockindex *))dogecoin_headersdb_get_header_at_height,
+    (dogecoin_blockindex *(*)(void *, uint256_t))dogecoin_headersdb_find
 };
 
 LIBDOGECOIN_END_DECL
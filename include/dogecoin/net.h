@@ -53,14 +53,22 @@ enum NODE_STATE {
 
 /* basic group-of-nodes structure */
 struct dogecoin_node_;
+struct dogecoin_node_worker_;
+struct dogecoin_addrman_;
+struct evdns_base;
 typedef struct dogecoin_node_group_ {
     void* ctx; /* flexible context usefull in conjunction with the callbacks */
     struct event_base* event_base;
+    struct dogecoin_node_worker_* worker; /* NULL: callbacks run on the event loop thread */
     vector_t* nodes; /* the groups nodes */
     char clientstr[1024];
     int desired_amount_connected_nodes;
     const dogecoin_chainparams* chainparams;
     struct evhttp* http_server; /* HTTP server for processing API requests */
+    struct dogecoin_addrman_* addrman; /* optional, not owned: learns addresses and ranks peers */
+    struct evdns_base* dns_base; /* resolves the dns seeds on event_base, created on first use */
+    int dns_pending; /* seed lookups in flight */
+    struct event* quit_event; /* watches stdin for the quit command, see dogecoin_node_group_quit_on_stdin */
 
     /* callbacks */
     int (*log_write_cb)(const char* format, ...); /* log callback, default=printf */
@@ -91,11 +99,15 @@ typedef struct dogecoin_node_ {
     uint64_t time_started_con;
     uint64_t time_last_request;
     uint256_t last_requested_inv;
+    uint64_t time_connect_ms; /* start of the connect, for the handshake latency */
+    uint64_t time_block_request_ms; /* start of the current block transfer, 0 if none is pending */
+    uint32_t blocks_in_flight; /* blocks and merkleblocks requested with getdata */
 
-    cstring* recvBuffer;
     uint64_t nonce;
     uint64_t services;
+    int32_t version; /* protocol version announced by the peer */
     uint32_t state;
+    dogecoin_bool connected; /* connection is up, written by the event loop thread only */
     int missbehavescore;
     dogecoin_bool version_handshake;
 
@@ -146,6 +158,10 @@ LIBDOGECOIN_API void dogecoin_node_group_free(dogecoin_node_group* group);
 /* disconnect all peers */
 LIBDOGECOIN_API void dogecoin_node_group_shutdown(dogecoin_node_group* group);
 
+/* shuts the group down once 'q' or 'Q' arrives on stdin; the event loop watches
+   stdin (polls the console on windows) until the group is shut down */
+LIBDOGECOIN_API void dogecoin_node_group_quit_on_stdin(dogecoin_node_group* group);
+
 /* add a node to a node group */
 LIBDOGECOIN_API void dogecoin_node_group_add_node(dogecoin_node_group* group, dogecoin_node* node);
 
@@ -155,6 +171,26 @@ LIBDOGECOIN_API void dogecoin_node_group_event_loop(dogecoin_node_group* group);
 /* connect to more nodes */
 LIBDOGECOIN_API dogecoin_bool dogecoin_node_group_connect_next_nodes(dogecoin_node_group* group);
 
+/* moves all callbacks of the group onto a worker thread; the event loop thread then only
+   does socket io, message framing and ping/pong, messages and state changes reach the
+   worker through a queue and its sends, disconnects and connects are queued back.
+   must be called before connecting, returns false if the thread could not be started */
+LIBDOGECOIN_API dogecoin_bool dogecoin_node_group_start_worker(dogecoin_node_group* group);
+
+/* serializes access to the callbacks state (nodes, headers, wallet) with the worker,
+   for code running on other threads than the event loop (no-op without worker) */
+LIBDOGECOIN_API void dogecoin_node_group_lock(dogecoin_node_group* group);
+LIBDOGECOIN_API void dogecoin_node_group_unlock(dogecoin_node_group* group);
+
+/* runs call on the event loop thread with the callbacks state locked, e.g. for http handlers;
+   while the worker is busy the call waits for the end of its job instead of blocking the loop.
+   calls dropped by a shutdown (or freeing the group) get run == false to release ctx */
+LIBDOGECOIN_API void dogecoin_node_group_call_locked(dogecoin_node_group* group, void (*call)(void* ctx, dogecoin_bool run), void* ctx);
+
+/* fills nodes (room for group->nodes->len pointers) with the groups nodes,
+   best ranked by the address manager first, in group order without one */
+LIBDOGECOIN_API void dogecoin_node_group_rank_nodes(dogecoin_node_group* group, dogecoin_node** nodes);
+
 /* get the amount of connected nodes */
 LIBDOGECOIN_API int dogecoin_node_group_amount_of_connected_nodes(dogecoin_node_group* group, enum NODE_STATE state);
 
@@ -164,6 +200,24 @@ LIBDOGECOIN_API void dogecoin_node_send_version(dogecoin_node* node);
 /* send arbitrary data to node */
 LIBDOGECOIN_API void dogecoin_node_send(dogecoin_node* node, cstring* data);
 
+/* frames a message straight into the nodes output buffer (header + one payload copy) */
+LIBDOGECOIN_API void dogecoin_node_send_message(dogecoin_node* node, const char* command, const void* data, uint32_t data_len);
+
+/* serialized message that can be queued on many nodes without copying the payload,
+   freed once the last node has written it out */
+typedef struct dogecoin_p2p_shared_msg_ {
+    unsigned char hdr[24]; /* DOGECOIN_P2P_HDRSZ */
+    cstring* payload;
+    unsigned int refcount;
+} dogecoin_p2p_shared_msg;
+
+/* takes ownership of payload and computes the header (and checksum) once */
+LIBDOGECOIN_API dogecoin_p2p_shared_msg* dogecoin_p2p_shared_msg_new(const unsigned char netmagic[4], const char* command, cstring* payload);
+LIBDOGECOIN_API void dogecoin_p2p_shared_msg_release(dogecoin_p2p_shared_msg* msg);
+
+/* queues a reference to the shared payload on the nodes output buffer */
+LIBDOGECOIN_API void dogecoin_node_send_shared(dogecoin_node* node, dogecoin_p2p_shared_msg* msg);
+
 LIBDOGECOIN_API int dogecoin_node_parse_message(dogecoin_node* node, dogecoin_p2p_msg_hdr* hdr, struct const_buffer* buf);
 LIBDOGECOIN_API void dogecoin_node_connection_state_changed(dogecoin_node* node);
 
@@ -171,11 +225,21 @@ LIBDOGECOIN_API void dogecoin_node_connection_state_changed(dogecoin_node* node)
 /* DNS */
 /* =================================== */
 
+/* adds the comma separated ips, or without ips the best known peers (address manager) and
+   starts resolving the dns seeds on the groups event loop; resolved peers get added and
+   connected as the answers arrive, so this never blocks */
 LIBDOGECOIN_API dogecoin_bool dogecoin_node_group_add_peers_by_ip_or_seed(dogecoin_node_group *group, const char *ips);
+
+/* resolves the dns seeds with the given nameserver (ip[:port]) instead of the system ones */
+LIBDOGECOIN_API dogecoin_bool dogecoin_node_group_set_nameserver(dogecoin_node_group *group, const char *ipport);
+
+/* blocking lookup, for use outside of an event loop */
 LIBDOGECOIN_API size_t dogecoin_get_peers_from_dns(const char* seed, vector_t* ips_out, int port, int family);
 
 struct broadcast_ctx {
     const dogecoin_tx* tx;
+    uint256_t txhash;
+    dogecoin_p2p_shared_msg* tx_msg; /* serialized once, referenced by every requesting peer */
     unsigned int timeout;
     int debuglevel;
     int connected_to_peers;
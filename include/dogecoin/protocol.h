@@ -118,6 +118,7 @@ enum DOGECOIN_INV_TYPE {
 
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
 static const int DOGECOIN_PROTOCOL_VERSION = 70015;
+static const int DOGECOIN_SENDHEADERS_VERSION = 70012; /* peers announce new blocks with headers (BIP130) */
 
 typedef struct dogecoin_p2p_msg_hdr_ {
     unsigned char netmagic[4];
@@ -225,6 +226,9 @@ LIBDOGECOIN_API void dogecoin_p2paddr_to_addr(dogecoin_p2p_address* p2p_addr, st
 /* deserialize the p2p message header from a buffer */
 LIBDOGECOIN_API void dogecoin_p2p_deser_msghdr(dogecoin_p2p_msg_hdr* hdr, struct const_buffer* buf);
 
+/* writes the DOGECOIN_P2P_HDRSZ byte header (with checksum) of a message carrying data */
+LIBDOGECOIN_API void dogecoin_p2p_message_header(unsigned char* hdr, const unsigned char netmagic[4], const char* command, const void* data, uint32_t data_len);
+
 /* dogecoin_p2p_message_new does malloc a cstring, needs cleanup afterwards! */
 LIBDOGECOIN_API cstring* dogecoin_p2p_message_new(const unsigned char netmagic[4], const char* command, const void* data, uint32_t data_len);
 
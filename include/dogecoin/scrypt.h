@@ -4,10 +4,19 @@
 #include <stdint.h>
 
 #define SCRYPT_SCRATCHPAD_SIZE 131072 + 63
+/* scratchpad of a multi lane kernel hashing `lanes` inputs at once */
+#define SCRYPT_LANES_SCRATCHPAD_SIZE(lanes) ((size_t)(lanes) * 131072 + 63)
+#define SCRYPT_MAX_LANES 8
 
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
+/* hashes count consecutive 80 byte inputs into count consecutive 32 byte
+   outputs with a lanes wide kernel (as returned by scrypt_detect_lanes), the
+   caller owns the SCRYPT_LANES_SCRATCHPAD_SIZE(lanes) scratchpad */
+void scrypt_1024_1_1_256_batch(const char *input, char *output, size_t count, unsigned int lanes, char *scratchpad);
+unsigned int scrypt_detect_lanes();
+
 #if defined(USE_SSE2)
 #if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
 #define USE_SSE2_ALWAYS 1
@@ -19,6 +28,11 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 void scrypt_detect_sse2();
 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
 extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
+
+/* multi lane kernels, input holds 4/8 headers and output receives 4/8 hashes */
+void scrypt_1024_1_1_256_sp_sse2_4way(const char *input, char *output, char *scratchpad);
+void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad);
+int scrypt_cpu_has_avx2();
 #else
 #define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
 #endif
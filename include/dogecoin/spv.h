@@ -30,7 +30,10 @@
 #define __LIBDOGECOIN_SPV_H__
 
 #include <dogecoin/dogecoin.h>
+#include <dogecoin/addrman.h>
 #include <dogecoin/blockchain.h>
+#include <dogecoin/blocksync.h>
+#include <dogecoin/bloom.h>
 #include <dogecoin/headersdb.h>
 #include <dogecoin/net.h>
 #include <dogecoin/tx.h>
@@ -40,6 +43,7 @@ LIBDOGECOIN_BEGIN_DECL
 enum SPV_CLIENT_STATE {
     SPV_HEADER_SYNC_FLAG        = (1 << 0),
     SPV_FULLBLOCK_SYNC_FLAG	    = (1 << 1),
+    SPV_PARALLEL_BLOCK_SYNC_FLAG = (1 << 2), /* opt-in full sync catch up: headers first, then blocks from all peers */
 };
 
 typedef struct dogecoin_spv_client_
@@ -64,7 +68,30 @@ typedef struct dogecoin_spv_client_
     void (*sync_completed)(struct dogecoin_spv_client_ *client);
     dogecoin_bool (*header_message_processed)(struct dogecoin_spv_client_ *client, dogecoin_node *node, dogecoin_blockindex *newtip);
     void (*sync_transaction)(void *ctx, dogecoin_tx *tx, unsigned int pos, dogecoin_blockindex *blockindex);
+    /* optional zero-copy variant of sync_transaction, the view is only valid during the call */
+    void (*sync_transaction_view)(void *ctx, const dogecoin_tx_view *txview, unsigned int pos, dogecoin_blockindex *blockindex);
+    /* called with sync_transaction_ctx for each block leaving the main chain (disconnect or reorg) */
+    void (*block_disconnected)(void *ctx, const dogecoin_blockindex *blockindex);
+    /* called with sync_transaction_ctx for each verified merkleblock, before its matched transactions arrive */
+    void (*filtered_block_connected)(void *ctx, const dogecoin_blockindex *blockindex);
     void *sync_transaction_ctx;
+
+    /* BIP37 mode: with a bloom filter set, peers offering NODE_BLOOM serve merkleblocks
+       and only the matched transactions reach the transaction callbacks */
+    dogecoin_bloom_filter *bloom_filter;
+    vector_t *filtered_blocks; /* per peer: merkleblock whose matched transactions are still expected */
+
+    /* parallel block download while SPV_PARALLEL_BLOCK_SYNC_FLAG is set */
+    dogecoin_block_scheduler *block_scheduler;
+    /* last block whose transactions reached the callbacks, the parallel download resumes
+       above it; saved next to the headers database */
+    uint32_t blocks_processed_height;
+    dogecoin_bool blocks_processed_dirty;
+    uint64_t blocks_processed_last_save;
+    char *blocks_processed_path;
+
+    /* known peers and their quality, saved next to the headers database */
+    dogecoin_addrman *addrman;
 } dogecoin_spv_client;
 
 LIBDOGECOIN_API dogecoin_spv_client* dogecoin_spv_client_new(const dogecoin_chainparams *params, dogecoin_bool debug, dogecoin_bool headers_memonly, dogecoin_bool use_checkpoints, dogecoin_bool full_sync, int maxnodes, const char *http_server);
@@ -72,6 +99,8 @@ LIBDOGECOIN_API void dogecoin_spv_client_free(dogecoin_spv_client *client);
 LIBDOGECOIN_API dogecoin_bool dogecoin_spv_client_load(dogecoin_spv_client *client, const char *file_path, dogecoin_bool prompt);
 LIBDOGECOIN_API void dogecoin_spv_client_discover_peers(dogecoin_spv_client *client, const char *ips);
 LIBDOGECOIN_API void dogecoin_spv_client_runloop(dogecoin_spv_client *client);
+/** takes ownership of the filter (NULL returns to full blocks) and loads it into the connected peers */
+LIBDOGECOIN_API void dogecoin_spv_client_set_bloom_filter(dogecoin_spv_client *client, dogecoin_bloom_filter *filter);
 LIBDOGECOIN_API dogecoin_bool dogecoin_net_spv_request_headers(dogecoin_spv_client *client);
 LIBDOGECOIN_API void dogecoin_net_spv_node_request_headers_or_blocks(dogecoin_node *node, dogecoin_bool blocks);
 
@@ -69,6 +69,35 @@ typedef struct dogecoin_tx_ {
     uint32_t locktime;
 } dogecoin_tx;
 
+/* read-only view of a serialized transaction, inputs and outputs
+ * are stored as offsets into the original (not owned) buffer */
+typedef struct dogecoin_tx_view_in_ {
+    size_t prevout_offset;
+    size_t script_offset;
+    size_t script_len;
+} dogecoin_tx_view_in;
+
+typedef struct dogecoin_tx_view_out_ {
+    size_t value_offset;
+    size_t script_offset;
+    size_t script_len;
+} dogecoin_tx_view_out;
+
+typedef struct dogecoin_tx_view_ {
+    const unsigned char* data;
+    size_t len;
+    int32_t version;
+    uint32_t locktime;
+    size_t body_offset; /* start of the non-witness vin/vout section */
+    size_t body_end;
+    size_t vin_count;
+    size_t vout_count;
+    size_t vin_alloc;
+    size_t vout_alloc;
+    dogecoin_tx_view_in* vin;
+    dogecoin_tx_view_out* vout;
+} dogecoin_tx_view;
+
 //!p2pkh utilities
 LIBDOGECOIN_API int dogecoin_tx_out_pubkey_hash_to_p2pkh_address(dogecoin_tx_out* txout, char* p2pkh, int is_mainnet);
 LIBDOGECOIN_API dogecoin_bool dogecoin_pubkey_hash_to_p2pkh_address(char* script_pubkey_hex, size_t script_pubkey_hex_length, char* p2pkh, const dogecoin_chainparams* chain);
@@ -98,6 +127,18 @@ LIBDOGECOIN_API void dogecoin_tx_copy(dogecoin_tx* dest, const dogecoin_tx* src)
 //!deserialize/parse a p2p serialized dogecoin transaction
 LIBDOGECOIN_API int dogecoin_tx_deserialize(const unsigned char* tx_serialized, size_t inlen, dogecoin_tx* tx, size_t* consumed_length);
 
+//!zero-copy transaction view, the parsed buffer must outlive the view
+LIBDOGECOIN_API void dogecoin_tx_view_init(dogecoin_tx_view* view);
+LIBDOGECOIN_API void dogecoin_tx_view_free(dogecoin_tx_view* view);
+LIBDOGECOIN_API dogecoin_bool dogecoin_tx_view_parse(dogecoin_tx_view* view, const unsigned char* tx_serialized, size_t inlen, size_t* consumed_length);
+LIBDOGECOIN_API dogecoin_bool dogecoin_tx_view_get_prevout(const dogecoin_tx_view* view, size_t in_num, dogecoin_tx_outpoint* prevout);
+LIBDOGECOIN_API dogecoin_bool dogecoin_tx_view_get_script_sig(const dogecoin_tx_view* view, size_t in_num, const uint8_t** script, size_t* script_len);
+LIBDOGECOIN_API dogecoin_bool dogecoin_tx_view_get_sequence(const dogecoin_tx_view* view, size_t in_num, uint32_t* sequence);
+LIBDOGECOIN_API dogecoin_bool dogecoin_tx_view_get_value(const dogecoin_tx_view* view, size_t out_num, int64_t* value);
+LIBDOGECOIN_API dogecoin_bool dogecoin_tx_view_get_script_pubkey(const dogecoin_tx_view* view, size_t out_num, const uint8_t** script, size_t* script_len);
+LIBDOGECOIN_API void dogecoin_tx_view_hash(const dogecoin_tx_view* view, uint256_t hashout);
+LIBDOGECOIN_API dogecoin_bool dogecoin_tx_view_to_tx(const dogecoin_tx_view* view, dogecoin_tx* tx);
+
 //!serialize a dogecoin data structure into a p2p serialized buffer
 LIBDOGECOIN_API void dogecoin_tx_serialize(cstring* s, const dogecoin_tx* tx);
 
@@ -35,6 +35,7 @@ LIBDOGECOIN_BEGIN_DECL
 
 #include <dogecoin/base58.h>
 #include <dogecoin/blockchain.h>
+#include <dogecoin/bloom.h>
 #include <dogecoin/bip32.h>
 #include <dogecoin/bip39.h>
 #include <dogecoin/bip44.h>
@@ -51,25 +52,58 @@ LIBDOGECOIN_BEGIN_DECL
 #include <stdint.h>
 #include <stddef.h>
 
+/** compact unspent output, strings are only produced on output (see dogecoin_utxo_get_*) */
 typedef struct dogecoin_utxo_ {
     int index;
     uint256_t txid;
-    int vout;
-    char address[P2PKHLEN];
-    char script_pubkey[SCRIPT_PUBKEY_STRINGLEN];
-    char amount[KOINU_STRINGLEN];
+    uint32_t vout;
+    int64_t koinu;
+    uint8_t script_type; /* enum dogecoin_tx_out_type, DOGECOIN_TX_PUBKEYHASH or DOGECOIN_TX_SCRIPTHASH */
+    uint160_t hash160; /* the script_pubkey is rebuilt from script_type and hash160 */
     int confirmations;
     int height;
     dogecoin_bool spendable;
     dogecoin_bool solvable;
+    dogecoin_bool coinbase;
     UT_hash_handle hh;
+    UT_hash_handle hh_outpoint; /* index keyed by txid (display order) + vout */
 } dogecoin_utxo;
 
+/** running koinu totals of unspent outputs */
+typedef struct dogecoin_balance_ {
+    int64_t confirmed; /* mined and, for coinbase outputs, mature */
+    int64_t immature; /* coinbase outputs with less than COINBASE_MATURITY confirmations */
+    int64_t total; /* every unspent output, including unconfirmed ones */
+} dogecoin_balance;
+
 DISABLE_WARNING_PUSH
 DISABLE_WARNING(-Wunused-variable)
 static dogecoin_utxo* utxos = NULL;
 DISABLE_WARNING_POP
 
+/** raw byte pre-filter over the watched hash160s and owned txids,
+ * two 64k bit maps keyed by the first four bytes of each entry
+ * reject almost every position before the sorted tables are searched */
+typedef struct dogecoin_wallet_prefilter_ {
+    uint8_t bitmap_lo[8192];
+    uint8_t bitmap_hi[8192];
+    uint8_t* hash160s;
+    size_t hash160_count;
+    uint8_t* txids;
+    size_t txid_count;
+    uint64_t waddr_generation; /* wallet state the filter was built from */
+    uint64_t wtx_generation;
+} dogecoin_wallet_prefilter;
+
+/** utxo changes of one connected block, replayed backwards when
+ * the block gets disconnected so the wallet rolls back without a rescan */
+typedef struct dogecoin_wallet_block_undo_ {
+    uint256_t blockhash;
+    uint32_t height;
+    vector_t* records; /* utxo record payloads (cstring) in connect order */
+    UT_hash_handle hh;
+} dogecoin_wallet_block_undo;
+
 /** single key/value record */
 typedef struct dogecoin_wallet_ {
     const char filename[311]; // max path length
@@ -82,19 +116,31 @@ typedef struct dogecoin_wallet_ {
     /* use binary trees for in-memory mapping for wtxs, keys */
     void* hdkeys_rbtree;
     dogecoin_utxo* utxos;
+    struct dogecoin_utxo_table_* utxo_table; /* outpoint index and running balances of utxos */
     void* unspent_rbtree;
     void* spends_rbtree;
     vector_t *vec_wtxes;
     void* wtxes_rbtree;
     vector_t *waddr_vector; //points to the addr objects managed by the waddr_rbtree [in order]
     void* waddr_rbtree;
+    uint8_t* hash160_set; /* sorted pubkey hashes of waddr_vector for is-mine checks */
+    size_t hash160_set_len;
+    uint64_t hash160_set_generation; /* waddr_generation the set was built from */
+    int64_t balance_credit; /* available credit of all non-coinbase wtxes */
+    uint64_t balance_waddr_generation; /* waddr_generation balance_credit was computed for */
+    vector_t *vec_coinbase_wtxes; /* coinbase wtxes, their credit depends on the best height */
+    dogecoin_wallet_prefilter* prefilter;
+    uint64_t waddr_generation; /* bumped on every change of waddr_vector */
+    uint64_t wtx_generation; /* bumped on every change of vec_wtxes */
+    dogecoin_wallet_block_undo* block_undo; /* undo data of the recent blocks, keyed by block hash */
 } dogecoin_wallet;
 
 typedef struct dogecoin_wtx_ {
     uint256_t tx_hash_cache;
     uint256_t blockhash;
     uint32_t height;
-    dogecoin_tx* tx;
+    dogecoin_tx* tx; //NULL for a lazily loaded wtx until dogecoin_wallet_wtx_get_tx() is called
+    cstring* tx_raw; //serialized tx of a lazily loaded wtx
     dogecoin_bool ignore; //if set, transaction will be ignored (soft-delete)
 } dogecoin_wtx;
 
@@ -115,18 +161,28 @@ LIBDOGECOIN_API dogecoin_wtx* dogecoin_wallet_wtx_new();
 LIBDOGECOIN_API void dogecoin_wallet_wtx_free(dogecoin_wtx* wtx);
 LIBDOGECOIN_API void dogecoin_wallet_wtx_serialize(cstring* s, const dogecoin_wtx* wtx);
 LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_wtx_deserialize(dogecoin_wtx* wtx, struct const_buffer* buf);
+/** returns the transaction of a wtx, deserializes it on first use if the wtx was loaded lazily
+ * returns NULL if the serialized transaction is corrupt */
+LIBDOGECOIN_API dogecoin_tx* dogecoin_wallet_wtx_get_tx(dogecoin_wtx* wtx);
 /** ------------------------------------ */
 
 /** wallet utxo functions */
 LIBDOGECOIN_API dogecoin_utxo* dogecoin_wallet_utxo_new();
+/** the wallet-less functions below work on a standalone table, every wallet keeps its own */
 LIBDOGECOIN_API int start_dogecoin_utxo();
 LIBDOGECOIN_API void add_dogecoin_utxo(dogecoin_utxo* utxo_external);
 LIBDOGECOIN_API dogecoin_utxo* find_dogecoin_utxo(int index);
+LIBDOGECOIN_API dogecoin_utxo* find_dogecoin_utxo_by_outpoint(dogecoin_wallet* wallet, const uint256_t txid, uint32_t vout);
 LIBDOGECOIN_API void remove_dogecoin_utxo(dogecoin_utxo* utxo);
 LIBDOGECOIN_API void remove_all_utxos();
 LIBDOGECOIN_API void dogecoin_wallet_utxo_free(dogecoin_utxo* utxo);
+LIBDOGECOIN_API dogecoin_bool dogecoin_utxo_get_address(const dogecoin_utxo* utxo, const dogecoin_chainparams* chain, char* address_out, size_t len);
+LIBDOGECOIN_API dogecoin_bool dogecoin_utxo_get_script_pubkey_hex(const dogecoin_utxo* utxo, char* hex_out, size_t len);
+LIBDOGECOIN_API void dogecoin_utxo_get_amount_str(const dogecoin_utxo* utxo, char amount_out[KOINU_STRINGLEN]);
 LIBDOGECOIN_API void dogecoin_wallet_scrape_utxos(dogecoin_wallet* wallet, dogecoin_wtx* wtx);
-LIBDOGECOIN_API void dogecoin_wallet_utxos_update_confirmations(int height);
+LIBDOGECOIN_API void dogecoin_wallet_utxos_update_confirmations(dogecoin_wallet* wallet, int height);
+LIBDOGECOIN_API void dogecoin_wallet_utxos_get_balance(dogecoin_wallet* wallet, dogecoin_balance* balance);
+LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_utxos_get_address_balance(dogecoin_wallet* wallet, const char* address, dogecoin_balance* balance);
 /** ------------------------------------ */
 
 /** wallet addr functions */
@@ -154,6 +210,12 @@ LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_replace(dogecoin_wallet* wallet, c
 /** writes the wallet state to disk */
 LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_flush(dogecoin_wallet* wallet);
 
+/** rewrites the wallet file as a snapshot record of the live state followed by a fresh log tail */
+LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_compact(dogecoin_wallet* wallet);
+
+/** removes a watched address and its utxos from memory, dogecoin_wallet_compact persists the removal */
+LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_remove_address(dogecoin_wallet* wallet, const char* address);
+
 /** set the master key of new created wallet
  consuming app needs to ensure that we don't override exiting masterkeys */
 LIBDOGECOIN_API void dogecoin_wallet_set_master_key_copy(dogecoin_wallet* wallet, const dogecoin_hdnode* master_xpub);
@@ -185,6 +247,13 @@ LIBDOGECOIN_API int64_t dogecoin_wallet_wtx_get_available_credit(dogecoin_wallet
 /** checks if a transaction outpoint is owned by the wallet */
 LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_txout_is_mine(dogecoin_wallet* wallet, dogecoin_tx_out* tx_out);
 
+/** checks if a raw 20 byte pubkey hash is watched by the wallet */
+LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_have_key(dogecoin_wallet* wallet, const uint160_t hash160);
+
+/** checks if a transaction pays to or spends from the wallet */
+LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_is_mine(dogecoin_wallet* wallet, const dogecoin_tx *tx);
+LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_is_from_me(dogecoin_wallet *wallet, const dogecoin_tx *tx);
+
 /** checks if a transaction outpoint is owned by the wallet */
 LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_is_spent(dogecoin_wallet* wallet, uint256_t hash, uint32_t n);
 LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_get_unspents(dogecoin_wallet* wallet, vector_t* unspents);
@@ -193,6 +262,21 @@ LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_get_unspent(vector_t* unspents);
 /** checks a transaction or relevance to the wallet */
 LIBDOGECOIN_API void dogecoin_wallet_check_transaction(void *ctx, dogecoin_tx *tx, unsigned int pos, dogecoin_blockindex *pindex);
 
+/** checks a transaction view for relevance, only candidates of the raw byte pre-filter get deserialized */
+LIBDOGECOIN_API void dogecoin_wallet_check_transaction_view(void *ctx, const dogecoin_tx_view *txview, unsigned int pos, dogecoin_blockindex *pindex);
+
+/** rolls back the utxos and transactions of a block leaving the main chain */
+LIBDOGECOIN_API void dogecoin_wallet_block_disconnected(void *ctx, const dogecoin_blockindex *pindex);
+
+/** updates the confirmations for a merkleblock, its matched transactions arrive separately */
+LIBDOGECOIN_API void dogecoin_wallet_filtered_block_connected(void *ctx, const dogecoin_blockindex *pindex);
+
+/** builds a BIP37 filter of all watched hash160s and unspent outpoints (caller frees) */
+LIBDOGECOIN_API dogecoin_bloom_filter* dogecoin_wallet_bloom_filter_new(dogecoin_wallet* wallet, double fp_rate, uint32_t tweak);
+
+/** scans raw bytes for any watched hash160 or owned txid (rebuilds the filter if the wallet changed) */
+LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_prefilter_match(dogecoin_wallet* wallet, const uint8_t* data, size_t len);
+
 /** returns wtx based on given hash
  * may return NULL if transaction could not be found
  * memory is managed by the transaction tree
@@ -200,6 +284,16 @@ LIBDOGECOIN_API void dogecoin_wallet_check_transaction(void *ctx, dogecoin_tx *t
 LIBDOGECOIN_API dogecoin_wtx * dogecoin_wallet_get_wtx(dogecoin_wallet* wallet, const uint256_t hash);
 
 LIBDOGECOIN_API dogecoin_wallet* dogecoin_wallet_read(char* address);
+
+/** long-lived wallet handle, queries are answered from memory until the next refresh */
+LIBDOGECOIN_API dogecoin_wallet* dogecoin_wallet_open(const char* address);
+LIBDOGECOIN_API dogecoin_bool dogecoin_wallet_refresh(dogecoin_wallet* wallet);
+LIBDOGECOIN_API void dogecoin_wallet_close(dogecoin_wallet* wallet);
+LIBDOGECOIN_API uint64_t dogecoin_wallet_address_balance(dogecoin_wallet* wallet, const char* address);
+LIBDOGECOIN_API unsigned int dogecoin_wallet_address_utxos_length(dogecoin_wallet* wallet, const char* address);
+/** index is 1-based, the utxo is owned by the wallet */
+LIBDOGECOIN_API dogecoin_utxo* dogecoin_wallet_address_utxo(dogecoin_wallet* wallet, const char* address, unsigned int index);
+
 LIBDOGECOIN_API int dogecoin_register_watch_address_with_node(char* address);
 LIBDOGECOIN_API int dogecoin_unregister_watch_address_with_node(char* address);
 LIBDOGECOIN_API int dogecoin_get_utxo_vector(char* address, vector_t* utxo_vec);
@@ -0,0 +1,501 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2024 The Dogecoin Foundation
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dogecoin/addrman.h>
+#include <dogecoin/cstr.h>
+#include <dogecoin/mem.h>
+#include <dogecoin/serialize.h>
+
+static const unsigned char file_hdr_magic[4] = {0xA8, 0xF0, 0x11, 0xC6}; /* peers file magic */
+static const uint32_t current_version = 1;
+
+#define DOGECOIN_ADDRMAN_RECORD_SIZE (16 + 2 + 8 + 4 * 9) /* ip, port, services and nine counters */
+
+/* entries older than this without a successful handshake rank lower */
+static const uint32_t stale_after = 7 * 24 * 60 * 60;
+
+/**
+ * @brief This function creates an empty, memory only address manager.
+ *
+ * @param chainparams The chain the addresses belong to.
+ *
+ * @return The new address manager.
+ */
+dogecoin_addrman* dogecoin_addrman_new(const dogecoin_chainparams* chainparams) {
+    dogecoin_addrman* addrman = dogecoin_calloc(1, sizeof(*addrman));
+    addrman->chainparams = chainparams;
+    addrman->entries = vector_new(64, dogecoin_free);
+    addrman->file_path = NULL;
+    addrman->dirty = false;
+    addrman->last_save = 0;
+    return addrman;
+}
+
+/**
+ * @brief This function frees the address manager without saving it.
+ *
+ * @param addrman The address manager.
+ */
+void dogecoin_addrman_free(dogecoin_addrman* addrman) {
+    if (!addrman) return;
+    vector_free(addrman->entries, true);
+    if (addrman->file_path) {
+        dogecoin_free(addrman->file_path);
+    }
+    dogecoin_free(addrman);
+}
+
+/**
+ * @brief This function compares the address of an entry with an
+ * address in the p2p format.
+ */
+static dogecoin_bool dogecoin_addrman_entry_matches(const dogecoin_addrman_entry* entry, const unsigned char ip[16], uint16_t port) {
+    return entry->port == port && memcmp(entry->ip, ip, 16) == 0;
+}
+
+/**
+ * @brief This function looks up an entry by its p2p address.
+ */
+static dogecoin_addrman_entry* dogecoin_addrman_lookup(const dogecoin_addrman* addrman, const unsigned char ip[16], uint16_t port) {
+    size_t i;
+    for (i = 0; i < addrman->entries->len; i++) {
+        dogecoin_addrman_entry* entry = vector_idx(addrman->entries, i);
+        if (dogecoin_addrman_entry_matches(entry, ip, port)) return entry;
+    }
+    return NULL;
+}
+
+/**
+ * @brief This function removes the lowest ranked entry to make
+ * room for a new one.
+ */
+static void dogecoin_addrman_evict(dogecoin_addrman* addrman, uint32_t now) {
+    size_t worst = 0, i;
+    int64_t worst_score = 0;
+    for (i = 0; i < addrman->entries->len; i++) {
+        int64_t score = dogecoin_addrman_score(vector_idx(addrman->entries, i), now);
+        if (i == 0 || score < worst_score) {
+            worst = i;
+            worst_score = score;
+        }
+    }
+    vector_remove_idx(addrman->entries, worst);
+}
+
+/**
+ * @brief This function learns an address or refreshes the last
+ * seen time and services of a known one. Addresses without a port,
+ * unspecified addresses and timestamps from the future (more than
+ * ten minutes) or the distant past are handled like bitcoin core
+ * does, the latter two get a last seen time of five days ago.
+ *
+ * @param addrman The address manager.
+ * @param addr The announced address.
+ * @param now The current time.
+ *
+ * @return The entry or NULL if the address was not usable.
+ */
+dogecoin_addrman_entry* dogecoin_addrman_add(dogecoin_addrman* addrman, const dogecoin_p2p_address* addr, uint32_t now) {
+    static const unsigned char zero[16] = {0};
+    static const unsigned char ipv4_any[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 0, 0, 0, 0};
+    if (addr->port == 0 || memcmp(addr->ip, zero, 16) == 0 || memcmp(addr->ip, ipv4_any, 16) == 0) {
+        return NULL;
+    }
+
+    uint32_t seen = addr->time;
+    if (seen < 100000000 || seen > now + 10 * 60) {
+        seen = now - 5 * 24 * 60 * 60;
+    }
+
+    dogecoin_addrman_entry* entry = dogecoin_addrman_lookup(addrman, addr->ip, addr->port);
+    if (entry) {
+        if (seen > entry->last_seen) entry->last_seen = seen;
+        if (addr->services) entry->services = addr->services;
+        addrman->dirty = true;
+        return entry;
+    }
+
+    if (addrman->entries->len >= DOGECOIN_ADDRMAN_MAX_ENTRIES) {
+        dogecoin_addrman_evict(addrman, now);
+    }
+    entry = dogecoin_calloc(1, sizeof(*entry));
+    memcpy(entry->ip, addr->ip, 16);
+    entry->port = addr->port;
+    entry->services = addr->services;
+    entry->last_seen = seen;
+    vector_add(addrman->entries, entry);
+    addrman->dirty = true;
+    return entry;
+}
+
+/**
+ * @brief This function looks up the entry of a socket address.
+ *
+ * @param addrman The address manager.
+ * @param addr The ipv4 or ipv6 socket address.
+ *
+ * @return The entry or NULL if the address is unknown.
+ */
+dogecoin_addrman_entry* dogecoin_addrman_find(const dogecoin_addrman* addrman, const struct sockaddr* addr) {
+    dogecoin_p2p_address p2p_addr;
+    dogecoin_p2p_address_init(&p2p_addr);
+    dogecoin_addr_to_p2paddr((struct sockaddr*)addr, &p2p_addr);
+    return dogecoin_addrman_lookup(addrman, p2p_addr.ip, p2p_addr.port);
+}
+
+/**
+ * @brief This function returns the entry of a peer we talk to,
+ * adding peers we did not learn about from an announcement.
+ */
+static dogecoin_addrman_entry* dogecoin_addrman_peer(dogecoin_addrman* addrman, const struct sockaddr* addr, uint32_t now) {
+    dogecoin_p2p_address p2p_addr;
+    dogecoin_p2p_address_init(&p2p_addr);
+    dogecoin_addr_to_p2paddr((struct sockaddr*)addr, &p2p_addr);
+    dogecoin_addrman_entry* entry = dogecoin_addrman_lookup(addrman, p2p_addr.ip, p2p_addr.port);
+    if (!entry) {
+        p2p_addr.time = now;
+        p2p_addr.services = 0;
+        entry = dogecoin_addrman_add(addrman, &p2p_addr, now);
+    }
+    if (entry) addrman->dirty = true;
+    return entry;
+}
+
+/**
+ * @brief This function smooths a measurement, the latest sample
+ * weighs a quarter.
+ */
+static uint32_t dogecoin_addrman_smooth(uint32_t average, uint64_t sample) {
+    if (sample > UINT32_MAX) sample = UINT32_MAX;
+    if (average == 0) return (uint32_t)sample;
+    return (uint32_t)(((uint64_t)average * 3 + sample) / 4);
+}
+
+/**
+ * @brief This function records a connection attempt, it counts
+ * as failed until the handshake completes.
+ *
+ * @param addrman The address manager.
+ * @param addr The peer.
+ * @param now The current time.
+ */
+void dogecoin_addrman_attempt(dogecoin_addrman* addrman, const struct sockaddr* addr, uint32_t now) {
+    dogecoin_addrman_entry* entry = dogecoin_addrman_peer(addrman, addr, now);
+    if (!entry) return;
+    entry->last_attempt = now;
+    entry->failures++;
+}
+
+/**
+ * @brief This function records a completed version handshake.
+ *
+ * @param addrman The address manager.
+ * @param addr The peer.
+ * @param services The services the peer announced.
+ * @param latency_ms Time from the connect to the verack.
+ * @param now The current time.
+ */
+void dogecoin_addrman_connected(dogecoin_addrman* addrman, const struct sockaddr* addr, uint64_t services, uint32_t latency_ms, uint32_t now) {
+    dogecoin_addrman_entry* entry = dogecoin_addrman_peer(addrman, addr, now);
+    if (!entry) return;
+    entry->services = services;
+    entry->last_seen = now;
+    entry->last_success = now;
+    entry->failures = 0;
+    entry->successes++;
+    entry->latency_ms = dogecoin_addrman_smooth(entry->latency_ms, latency_ms > 0 ? latency_ms : 1);
+}
+
+/**
+ * @brief This function records the transfer rate of a block.
+ *
+ * @param addrman The address manager.
+ * @param addr The peer that sent the block.
+ * @param bytes The size of the block.
+ * @param elapsed_ms The time the block took since it was requested
+ * or since the previous block of the same request arrived.
+ */
+void dogecoin_addrman_block_received(dogecoin_addrman* addrman, const struct sockaddr* addr, uint32_t bytes, uint32_t elapsed_ms) {
+    dogecoin_addrman_entry* entry = dogecoin_addrman_find(addrman, addr);
+    if (!entry) return;
+    uint64_t rate = (uint64_t)bytes * 1000 / (elapsed_ms > 0 ? elapsed_ms : 1);
+    entry->throughput = dogecoin_addrman_smooth(entry->throughput, rate > 0 ? rate : 1);
+    addrman->dirty = true;
+}
+
+/**
+ * @brief This function records misbehaviour, the peer gets skipped
+ * for DOGECOIN_ADDRMAN_BAN_TIME.
+ *
+ * @param addrman The address manager.
+ * @param addr The peer.
+ * @param now The current time.
+ */
+void dogecoin_addrman_misbehaved(dogecoin_addrman* addrman, const struct sockaddr* addr, uint32_t now) {
+    dogecoin_addrman_entry* entry = dogecoin_addrman_peer(addrman, addr, now);
+    if (!entry) return;
+    entry->misbehaviour++;
+    entry->last_misbehaved = now;
+}
+
+/**
+ * @brief This function ranks an entry. A completed handshake is worth
+ * 1000, latency costs up to 500 (a point per 10ms), throughput adds up
+ * to 1000 (a point per KiB/s), every failed connect costs 250 and every
+ * misbehaviour 2000; entries not seen for a week lose 100.
+ *
+ * @param entry The entry.
+ * @param now The current time.
+ *
+ * @return The score, higher is better.
+ */
+int64_t dogecoin_addrman_score(const dogecoin_addrman_entry* entry, uint32_t now) {
+    int64_t score = 0;
+    if (entry->successes > 0) score += 1000;
+    if (entry->latency_ms > 0) score -= entry->latency_ms >= 5000 ? 500 : entry->latency_ms / 10;
+    score += (entry->throughput >> 10) >= 1000 ? 1000 : (entry->throughput >> 10);
+    score -= (int64_t)entry->failures * 250;
+    score -= (int64_t)entry->misbehaviour * 2000;
+    if (entry->last_seen + stale_after < now) score -= 100;
+    return score;
+}
+
+/**
+ * @brief This function checks whether an entry may be connected to,
+ * failed entries wait DOGECOIN_ADDRMAN_RETRY_DELAY seconds doubled per
+ * failure (up to about 17 hours).
+ */
+static dogecoin_bool dogecoin_addrman_usable(const dogecoin_addrman_entry* entry, uint32_t now) {
+    if (entry->misbehaviour > 0 && entry->last_misbehaved + DOGECOIN_ADDRMAN_BAN_TIME > now) {
+        return false;
+    }
+    if (entry->failures > 0) {
+        uint64_t delay = (uint64_t)DOGECOIN_ADDRMAN_RETRY_DELAY << (entry->failures > 10 ? 10 : entry->failures - 1);
+        if ((uint64_t)entry->last_attempt + delay > now) return false;
+    }
+    return true;
+}
+
+typedef struct dogecoin_addrman_ranked_ {
+    dogecoin_addrman_entry* entry;
+    int64_t score;
+    size_t index;
+} dogecoin_addrman_ranked;
+
+static int dogecoin_addrman_ranked_cmp(const void* a, const void* b) {
+    const dogecoin_addrman_ranked* ra = (const dogecoin_addrman_ranked*)a;
+    const dogecoin_addrman_ranked* rb = (const dogecoin_addrman_ranked*)b;
+    if (ra->score != rb->score) return ra->score > rb->score ? -1 : 1;
+    /* equal scores keep the table order, recently learned entries last */
+    return ra->index < rb->index ? -1 : (ra->index > rb->index ? 1 : 0);
+}
+
+/**
+ * @brief This function picks the best entries to connect to.
+ *
+ * @param addrman The address manager.
+ * @param out The vector the entries get appended to.
+ * @param max The maximum amount of entries.
+ * @param now The current time.
+ * @param exclude Optional filter, returns true for entries to skip.
+ * @param ctx The context passed to exclude.
+ *
+ * @return The amount of appended entries.
+ */
+size_t dogecoin_addrman_select(const dogecoin_addrman* addrman, vector_t* out, size_t max, uint32_t now, dogecoin_bool (*exclude)(void* ctx, const dogecoin_addrman_entry* entry), void* ctx) {
+    if (addrman->entries->len == 0 || max == 0) return 0;
+    dogecoin_addrman_ranked* ranked = dogecoin_calloc(addrman->entries->len, sizeof(*ranked));
+    size_t count = 0, i;
+    for (i = 0; i < addrman->entries->len; i++) {
+        dogecoin_addrman_entry* entry = vector_idx(addrman->entries, i);
+        if (!dogecoin_addrman_usable(entry, now) || (exclude && exclude(ctx, entry))) continue;
+        ranked[count].entry = entry;
+        ranked[count].score = dogecoin_addrman_score(entry, now);
+        ranked[count].index = i;
+        count++;
+    }
+    qsort(ranked, count, sizeof(*ranked), dogecoin_addrman_ranked_cmp);
+    if (count > max) count = max;
+    for (i = 0; i < count; i++) {
+        vector_add(out, ranked[i].entry);
+    }
+    dogecoin_free(ranked);
+    return count;
+}
+
+/**
+ * @brief This function converts an entry to a socket address, the
+ * caller provides a sockaddr_in6 sized buffer for ipv6 entries.
+ *
+ * @param entry The entry.
+ * @param addr_out The socket address to fill.
+ */
+void dogecoin_addrman_entry_to_addr(const dogecoin_addrman_entry* entry, struct sockaddr* addr_out) {
+    dogecoin_p2p_address p2p_addr;
+    dogecoin_p2p_address_init(&p2p_addr);
+    memcpy(p2p_addr.ip, entry->ip, 16);
+    p2p_addr.port = entry->port;
+    dogecoin_p2paddr_to_addr(&p2p_addr, addr_out);
+}
+
+/**
+ * @brief This function reads the peers file. Files of another
+ * version or chain are ignored and get replaced on the next save.
+ *
+ * @param addrman The address manager.
+ * @param file_path The peers file.
+ *
+ * @return false if the file exists but could not be read.
+ */
+dogecoin_bool dogecoin_addrman_load(dogecoin_addrman* addrman, const char* file_path) {
+    if (addrman->file_path) {
+        dogecoin_free(addrman->file_path);
+    }
+    addrman->file_path = dogecoin_calloc(1, strlen(file_path) + 1);
+    memcpy(addrman->file_path, file_path, strlen(file_path));
+
+    FILE* file = fopen(file_path, "rb");
+    if (!file) {
+        return true;
+    }
+
+    dogecoin_bool ret = true;
+    unsigned char hdr[16];
+    if (fread(hdr, sizeof(hdr), 1, file) != 1) {
+        fclose(file);
+        return true;
+    }
+    struct const_buffer hdr_buf = {hdr + 4, sizeof(hdr) - 4};
+    uint32_t version = 0, count = 0;
+    unsigned char netmagic[4];
+    deser_u32(&version, &hdr_buf);
+    deser_bytes(netmagic, &hdr_buf, 4);
+    deser_u32(&count, &hdr_buf);
+    if (memcmp(hdr, file_hdr_magic, 4) != 0 || version != current_version ||
+        memcmp(netmagic, addrman->chainparams->netmagic, 4) != 0) {
+        fprintf(stderr, "Ignoring peers file %s of another version or chain\n", file_path);
+        fclose(file);
+        return true;
+    }
+    if (count > DOGECOIN_ADDRMAN_MAX_ENTRIES) {
+        count = DOGECOIN_ADDRMAN_MAX_ENTRIES;
+    }
+
+    unsigned char record[DOGECOIN_ADDRMAN_RECORD_SIZE];
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        if (fread(record, DOGECOIN_ADDRMAN_RECORD_SIZE, 1, file) != 1) {
+            fprintf(stderr, "Peers file %s is truncated\n", file_path);
+            ret = false;
+            break;
+        }
+        struct const_buffer buf = {record, DOGECOIN_ADDRMAN_RECORD_SIZE};
+        dogecoin_addrman_entry* entry = dogecoin_calloc(1, sizeof(*entry));
+        deser_bytes(entry->ip, &buf, 16);
+        deser_u16(&entry->port, &buf);
+        deser_u64(&entry->services, &buf);
+        deser_u32(&entry->last_seen, &buf);
+        deser_u32(&entry->last_attempt, &buf);
+        deser_u32(&entry->last_success, &buf);
+        deser_u32(&entry->last_misbehaved, &buf);
+        deser_u32(&entry->failures, &buf);
+        deser_u32(&entry->successes, &buf);
+        deser_u32(&entry->misbehaviour, &buf);
+        deser_u32(&entry->latency_ms, &buf);
+        deser_u32(&entry->throughput, &buf);
+        if (dogecoin_addrman_lookup(addrman, entry->ip, entry->port)) {
+            dogecoin_free(entry);
+            continue;
+        }
+        vector_add(addrman->entries, entry);
+    }
+    fclose(file);
+    addrman->dirty = false;
+    return ret;
+}
+
+/**
+ * @brief This function writes the peers file, the previous file
+ * stays intact until the new one is complete.
+ *
+ * @param addrman The address manager.
+ *
+ * @return true if the file was written (or there is no file).
+ */
+dogecoin_bool dogecoin_addrman_save(dogecoin_addrman* addrman) {
+    if (!addrman->file_path) {
+        return true;
+    }
+
+    cstring* s = cstr_new_sz(16 + addrman->entries->len * DOGECOIN_ADDRMAN_RECORD_SIZE);
+    ser_bytes(s, file_hdr_magic, 4);
+    ser_u32(s, current_version);
+    ser_bytes(s, addrman->chainparams->netmagic, 4);
+    ser_u32(s, (uint32_t)addrman->entries->len);
+    size_t i;
+    for (i = 0; i < addrman->entries->len; i++) {
+        const dogecoin_addrman_entry* entry = vector_idx(addrman->entries, i);
+        ser_bytes(s, entry->ip, 16);
+        ser_u16(s, entry->port);
+        ser_u64(s, entry->services);
+        ser_u32(s, entry->last_seen);
+        ser_u32(s, entry->last_attempt);
+        ser_u32(s, entry->last_success);
+        ser_u32(s, entry->last_misbehaved);
+        ser_u32(s, entry->failures);
+        ser_u32(s, entry->successes);
+        ser_u32(s, entry->misbehaviour);
+        ser_u32(s, entry->latency_ms);
+        ser_u32(s, entry->throughput);
+    }
+
+    cstring* tmp_path = cstr_new(addrman->file_path);
+    cstr_append_buf(tmp_path, ".tmp", 4);
+    dogecoin_bool ret = false;
+    FILE* file = fopen(tmp_path->str, "wb");
+    if (file) {
+        ret = fwrite(s->str, s->len, 1, file) == 1;
+        ret = (fclose(file) == 0) && ret;
+#ifdef _WIN32
+        // rename does not replace existing files on windows
+        if (ret) remove(addrman->file_path);
+#endif
+        ret = ret && rename(tmp_path->str, addrman->file_path) == 0;
+        if (!ret) remove(tmp_path->str);
+    }
+    if (!ret) {
+        fprintf(stderr, "Could not write peers file %s\n", addrman->file_path);
+    } else {
+        addrman->dirty = false;
+    }
+    cstr_free(tmp_path, true);
+    cstr_free(s, true);
+    return ret;
+}
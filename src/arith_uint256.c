@@ -84,20 +84,59 @@ void arith_shift_right(arith_uint256* input, unsigned int shift) {
 }
 
 arith_uint256* set_compact(arith_uint256* hash, uint32_t compact, dogecoin_bool *pf_negative, dogecoin_bool *pf_overflow) {
+    *hash = arith_uint256_from_compact(compact, pf_negative, pf_overflow);
+    return hash;
+}
+
+/**
+ * Decodes a compact ("nBits") representation of a 256 bit number.
+ *
+ * @param compact The compact representation.
+ * @param pf_negative Set to true if the sign bit is set (may be NULL).
+ * @param pf_overflow Set to true if the value doesn't fit 256 bits (may be NULL).
+ *
+ * @return The decoded number.
+ */
+arith_uint256 arith_uint256_from_compact(uint32_t compact, dogecoin_bool *pf_negative, dogecoin_bool *pf_overflow) {
+    arith_uint256 result;
     int size = compact >> 24;
     uint32_t word = compact & 0x007fffff;
+    memset(&result, 0, sizeof(result));
     if (size <= 3) {
         word >>= 8 * (3 - size);
-        hash->pn[0] = word;
+        result.pn[0] = word;
     } else {
-        hash->pn[0] = word;
-        arith_shift_left(hash, 8 * (size - 3));
+        result.pn[0] = word;
+        arith_shift_left(&result, 8 * (size - 3));
     }
     if (pf_negative) *pf_negative = word != 0 && (compact & 0x00800000) != 0;
     if (pf_overflow) *pf_overflow = word != 0 && ((size > 34) ||
                                                   (word > 0xff && size > 33) ||
                                                   (word > 0xffff && size > 32));
-    return hash;
+    return result;
+}
+
+/**
+ * Converts a little endian uint256 (e.g. a stored chainwork) into a number.
+ *
+ * @param a The uint256.
+ *
+ * @return The number.
+ */
+arith_uint256 arith_uint256_from_uint256(const uint256_t a) {
+    arith_uint256 result;
+    memcpy(result.pn, a, sizeof(result.pn));
+    return result;
+}
+
+/**
+ * Converts a number into a little endian uint256.
+ *
+ * @param a The number.
+ * @param out The uint256 to write to.
+ */
+void arith_uint256_to_uint256(const arith_uint256* a, uint256_t out) {
+    memcpy(out, a->pn, sizeof(a->pn));
 }
 
 arith_uint256* uint_to_arith(const uint256_t* a)
@@ -118,65 +157,119 @@ arith_uint256* div_arith_uint256(arith_uint256* a, arith_uint256* b) {
         // Handle division by zero if necessary
         return NULL;
     }
-
     arith_uint256* quotient = init_arith_uint256();
-    arith_uint256* remainder = init_arith_uint256();
+    *quotient = arith_uint256_div(a, b);
+    return quotient;
+}
+
+arith_uint256* add_arith_uint256(arith_uint256* a, arith_uint256* b) {
+    arith_uint256* result = init_arith_uint256();
+    *result = arith_uint256_add(a, b);
+    return result;
+}
+
+arith_uint256* sub_arith_uint256(arith_uint256* a, arith_uint256* b) {
+    if (arith_uint256_less_than(a, b)) {
+        // Handle underflow if necessary
+        return NULL;
+    }
+    arith_uint256* result = init_arith_uint256();
+    *result = arith_uint256_sub(a, b);
+    return result;
+}
 
-    for (int i = WIDTH * 32 - 1; i >= 0; i--) {
-        // Left shift remainder by 1 bit
-        arith_shift_left(remainder, 1);
+/**
+ * Divides two numbers (shift and subtract long division).
+ *
+ * @param a The dividend.
+ * @param b The divisor.
+ *
+ * @return The quotient, zero if b is zero.
+ */
+arith_uint256 arith_uint256_div(const arith_uint256* a, const arith_uint256* b) {
+    arith_uint256 quotient, remainder;
+    memset(&quotient, 0, sizeof(quotient));
+    memset(&remainder, 0, sizeof(remainder));
+    if (arith_uint256_is_zero(b)) {
+        return quotient;
+    }
 
-        // Set the least significant bit of remainder to bit i of a
+    // skip the leading zero bits of the dividend
+    int i = WIDTH * 32 - 1;
+    while (i >= 0 && (a->pn[i / 32] & (1u << (i % 32))) == 0) {
+        i--;
+    }
+    for (; i >= 0; i--) {
+        // Left shift remainder by 1 bit and bring down bit i of a
+        arith_shift_left(&remainder, 1);
         int word_idx = i / 32;
         int bit_idx = i % 32;
-        if ((a->pn[word_idx] & (1 << bit_idx)) != 0) {
-            remainder->pn[0] |= 1;
+        if ((a->pn[word_idx] & (1u << bit_idx)) != 0) {
+            remainder.pn[0] |= 1;
         }
-
-        // Compare remainder with b
-        if (arith_uint256_greater_than_or_equal(remainder, b)) {
-            // Subtract b from remainder
-            arith_uint256* temp = sub_arith_uint256(remainder, b);
-            memcpy(remainder, temp, sizeof(arith_uint256));
-            free(temp);
-
-            // Set bit i of quotient
-            quotient->pn[word_idx] |= (1 << bit_idx);
+        if (arith_uint256_compare(&remainder, b) >= 0) {
+            remainder = arith_uint256_sub(&remainder, b);
+            quotient.pn[word_idx] |= (1u << bit_idx);
         }
     }
-
-    free(remainder);
     return quotient;
 }
 
-arith_uint256* add_arith_uint256(arith_uint256* a, arith_uint256* b) {
-    arith_uint256* result = init_arith_uint256();
+/**
+ * Adds two numbers (modulo 2^256).
+ *
+ * @param a The first number.
+ * @param b The second number.
+ *
+ * @return The sum.
+ */
+arith_uint256 arith_uint256_add(const arith_uint256* a, const arith_uint256* b) {
+    arith_uint256 result;
     uint64_t carry = 0;
     for (int i = 0; i < WIDTH; i++) {
         uint64_t sum = (uint64_t)a->pn[i] + b->pn[i] + carry;
-        result->pn[i] = (uint32_t)sum; // This will only keep the lower 32 bits
+        result.pn[i] = (uint32_t)sum; // This will only keep the lower 32 bits
         carry = sum >> 32; // Carry is the upper 32 bits
     }
     return result;
 }
 
-arith_uint256* sub_arith_uint256(arith_uint256* a, arith_uint256* b) {
-    if (arith_uint256_less_than(a, b)) {
-        // Handle underflow if necessary
-        return NULL;
-    }
-    arith_uint256* result = init_arith_uint256();
+/**
+ * Subtracts two numbers (modulo 2^256).
+ *
+ * @param a The minuend.
+ * @param b The subtrahend.
+ *
+ * @return The difference.
+ */
+arith_uint256 arith_uint256_sub(const arith_uint256* a, const arith_uint256* b) {
+    arith_uint256 result;
     uint64_t borrow = 0;
     for (int i = 0; i < WIDTH; i++) {
         uint64_t diff = (uint64_t)a->pn[i] - b->pn[i] - borrow;
-        result->pn[i] = (uint32_t)diff; // Keep only lower 32 bits
+        result.pn[i] = (uint32_t)diff; // Keep only lower 32 bits
         // If diff is less than zero when interpreted as signed, there's a borrow.
-        // Note: This checks the high bit of the 64-bit diff calculation for borrow.
         borrow = (diff > (uint64_t)UINT32_MAX) ? 1 : 0;
     }
     return result;
 }
 
+/**
+ * Compares two numbers.
+ *
+ * @param a The first number.
+ * @param b The second number.
+ *
+ * @return -1 if a < b, 0 if a == b, 1 if a > b.
+ */
+int arith_uint256_compare(const arith_uint256* a, const arith_uint256* b) {
+    for (int i = WIDTH - 1; i >= 0; i--) {
+        if (a->pn[i] < b->pn[i]) return -1;
+        if (a->pn[i] > b->pn[i]) return 1;
+    }
+    return 0;
+}
+
 dogecoin_bool arith_uint256_is_zero(const arith_uint256* a) {
     for (int i = 0; i < WIDTH; i++) {
         if (a->pn[i] != 0) return false;
@@ -24,6 +24,11 @@
 
 #include <dogecoin/sha2.h>
 #include <dogecoin/scrypt.h>
+#ifdef WITH_NET
+#include <dogecoin/blockchain.h>
+#include <dogecoin/headersdb_file.h>
+#include <dogecoin/utils.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -71,7 +76,7 @@ uint64_t perf_cpucycles(void) {
 #endif
 }
 
-void run_benchmark(void (*benchmark_function)(benchmark_context *), const char *name) {
+double run_benchmark(void (*benchmark_function)(benchmark_context *), const char *name) {
     benchmark_context ctx;
     ctx.input = (uint8_t*)calloc(BUFFER_SIZE, sizeof(uint8_t));
     ctx.output = (uint8_t*)malloc(HASH_SIZE);
@@ -108,6 +113,7 @@ void run_benchmark(void (*benchmark_function)(benchmark_context *), const char *
 
     free(ctx.input);
     free(ctx.output);
+    return ctx.totalTime / ctx.count;
 }
 
 void sha256_benchmark_function(benchmark_context *ctx) {
@@ -126,6 +132,145 @@ void scrypt_benchmark_function(benchmark_context *ctx) {
     ctx->totalCycles += ctx->endCycles - ctx->startCycles;
 }
 
+/* every lanes benchmark iteration hashes SCRYPT_MAX_LANES headers */
+static char scrypt_lanes_input[SCRYPT_MAX_LANES * 80];
+static char scrypt_lanes_output[SCRYPT_MAX_LANES * 32];
+static char *scrypt_lanes_scratchpad = NULL;
+
+static void scrypt_lanes_benchmark_done(benchmark_context *ctx) {
+    ctx->end = gettimedouble();
+    ctx->endCycles = perf_cpucycles();
+    ctx->totalTime += ctx->end - ctx->start;
+    ctx->totalCycles += ctx->endCycles - ctx->startCycles;
+}
+
+void scrypt_generic_x1_benchmark_function(benchmark_context *ctx) {
+    int i;
+    for (i = 0; i < SCRYPT_MAX_LANES; i++) {
+        scrypt_1024_1_1_256_sp_generic(scrypt_lanes_input + i * 80, scrypt_lanes_output + i * 32, scrypt_lanes_scratchpad);
+    }
+    scrypt_lanes_benchmark_done(ctx);
+}
+
+#if defined(USE_SSE2)
+void scrypt_sse2_x1_benchmark_function(benchmark_context *ctx) {
+    int i;
+    for (i = 0; i < SCRYPT_MAX_LANES; i++) {
+        scrypt_1024_1_1_256_sp_sse2(scrypt_lanes_input + i * 80, scrypt_lanes_output + i * 32, scrypt_lanes_scratchpad);
+    }
+    scrypt_lanes_benchmark_done(ctx);
+}
+
+void scrypt_sse2_x4_benchmark_function(benchmark_context *ctx) {
+    int i;
+    for (i = 0; i < SCRYPT_MAX_LANES; i += 4) {
+        scrypt_1024_1_1_256_sp_sse2_4way(scrypt_lanes_input + i * 80, scrypt_lanes_output + i * 32, scrypt_lanes_scratchpad);
+    }
+    scrypt_lanes_benchmark_done(ctx);
+}
+
+void scrypt_avx2_x8_benchmark_function(benchmark_context *ctx) {
+    scrypt_1024_1_1_256_sp_avx2_8way(scrypt_lanes_input, scrypt_lanes_output, scrypt_lanes_scratchpad);
+    scrypt_lanes_benchmark_done(ctx);
+}
+#endif
+
+static void run_scrypt_lanes_benchmark(void (*benchmark_function)(benchmark_context *), const char *name) {
+    double avg = run_benchmark(benchmark_function, name);
+    printf("%-10s %.1f hashes/s\n", "", SCRYPT_MAX_LANES / avg);
+}
+
+/* scrypt throughput of the single and multi lane kernels per instruction set */
+void run_scrypt_lanes_benchmarks(void) {
+    scrypt_lanes_scratchpad = (char*)malloc(SCRYPT_LANES_SCRATCHPAD_SIZE(SCRYPT_MAX_LANES));
+    if (!scrypt_lanes_scratchpad) return;
+    run_scrypt_lanes_benchmark(scrypt_generic_x1_benchmark_function, "ScryptGen");
+#if defined(USE_SSE2)
+    run_scrypt_lanes_benchmark(scrypt_sse2_x1_benchmark_function, "ScryptSSE2");
+    run_scrypt_lanes_benchmark(scrypt_sse2_x4_benchmark_function, "SSE2x4");
+    if (scrypt_cpu_has_avx2()) {
+        run_scrypt_lanes_benchmark(scrypt_avx2_x8_benchmark_function, "AVX2x8");
+    }
+#endif
+    free(scrypt_lanes_scratchpad);
+    scrypt_lanes_scratchpad = NULL;
+}
+
+#ifdef WITH_NET
+#define BLOCKINDEX_BENCH_COUNT 5000000
+#define BLOCKINDEX_BENCH_LOOKUPS 100000
+
+static dogecoin_blockindex *bench_blocks = NULL;
+static void *bench_tree = NULL;
+static dogecoin_blockindex_map *bench_map = NULL;
+static uint32_t bench_lookup_pos = 0;
+
+static dogecoin_blockindex *bench_next_block(void) {
+    // stride through the headers in a cache unfriendly order
+    bench_lookup_pos = (bench_lookup_pos + 2654435761u) % BLOCKINDEX_BENCH_COUNT;
+    return &bench_blocks[bench_lookup_pos];
+}
+
+void btree_find_benchmark_function(benchmark_context *ctx) {
+    int i;
+    for (i = 0; i < BLOCKINDEX_BENCH_LOOKUPS; i++) {
+        dogecoin_blockindex *key = bench_next_block();
+        if (!dogecoin_btree_tfind(key, &bench_tree, dogecoin_header_compare)) abort();
+    }
+    ctx->end = gettimedouble();
+    ctx->endCycles = perf_cpucycles();
+    ctx->totalTime += ctx->end - ctx->start;
+    ctx->totalCycles += ctx->endCycles - ctx->startCycles;
+}
+
+void hashmap_find_benchmark_function(benchmark_context *ctx) {
+    int i;
+    for (i = 0; i < BLOCKINDEX_BENCH_LOOKUPS; i++) {
+        dogecoin_blockindex *key = bench_next_block();
+        if (!dogecoin_blockindex_map_find(bench_map, key->hash)) abort();
+    }
+    ctx->end = gettimedouble();
+    ctx->endCycles = perf_cpucycles();
+    ctx->totalTime += ctx->end - ctx->start;
+    ctx->totalCycles += ctx->endCycles - ctx->startCycles;
+}
+
+/* compares the headers db lookup indexes, times are per batch of BLOCKINDEX_BENCH_LOOKUPS lookups */
+void run_blockindex_benchmarks(void) {
+    uint32_t i;
+    bench_blocks = (dogecoin_blockindex*)calloc(BLOCKINDEX_BENCH_COUNT, sizeof(dogecoin_blockindex));
+    if (!bench_blocks) {
+        printf("Skipping blockindex benchmarks (out of memory)\n");
+        return;
+    }
+    for (i = 0; i < BLOCKINDEX_BENCH_COUNT; i++) {
+        bench_blocks[i].height = i;
+        sha256_raw((const uint8_t *)&i, sizeof(i), bench_blocks[i].hash);
+    }
+
+    double start = gettimedouble();
+    for (i = 0; i < BLOCKINDEX_BENCH_COUNT; i++) {
+        dogecoin_btree_tsearch(&bench_blocks[i], &bench_tree, dogecoin_header_compare);
+    }
+    double tree_insert = gettimedouble() - start;
+
+    start = gettimedouble();
+    bench_map = dogecoin_blockindex_map_new(0);
+    for (i = 0; i < BLOCKINDEX_BENCH_COUNT; i++) {
+        dogecoin_blockindex_map_insert(bench_map, &bench_blocks[i]);
+    }
+    double map_insert = gettimedouble() - start;
+
+    run_benchmark(btree_find_benchmark_function, "BTreeFind");
+    run_benchmark(hashmap_find_benchmark_function, "HashFind");
+    printf("Blockindex insert (%d headers): BTree %f s, Hash %f s\n", BLOCKINDEX_BENCH_COUNT, tree_insert, map_insert);
+
+    dogecoin_btree_tdestroy(bench_tree, NULL);
+    dogecoin_blockindex_map_free(bench_map, NULL);
+    free(bench_blocks);
+}
+#endif
+
 int main() {
     printf("%-10s %-8s %-10s %-10s %-10s %-12s %-12s %-12s\n",
            "#Benchmark", "Count", "Min Time", "Max Time", "Avg Time",
@@ -133,6 +278,10 @@ int main() {
 
     run_benchmark(sha256_benchmark_function, "SHA256");
     run_benchmark(scrypt_benchmark_function, "Scrypt");
+    run_scrypt_lanes_benchmarks();
+#ifdef WITH_NET
+    run_blockindex_benchmarks();
+#endif
 
     printf("\nOptions:\n");
     #if defined(__AVX2__) && USE_AVX2
@@ -144,6 +293,7 @@ int main() {
     #if defined(__SSE2__) && USE_SSE2
     printf("SSE2 Scrypt\n");
     #endif
+    printf("Scrypt batch lanes: %u\n", scrypt_detect_lanes());
 
     return 0;
 }
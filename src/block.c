@@ -500,3 +500,59 @@ dogecoin_bool dogecoin_block_header_hash(dogecoin_block_header* header, uint256_
     dogecoin_bool ret = true;
     return ret;
     }
+
+/**
+ * @brief This function computes the merkle root of the transactions
+ * of a block message. The caller compares it with the merkle root of
+ * the block header.
+ *
+ * @param buf The transactions of the block (amount followed by the
+ * serialized transactions), the buffer is not consumed.
+ * @param merkle_root The computed merkle root.
+ *
+ * @return 1 if all transactions were parsed and the tree is not
+ * ambiguous, 0 otherwise.
+ */
+dogecoin_bool dogecoin_block_txs_merkle_root(const struct const_buffer* buf, uint256_t merkle_root) {
+    struct const_buffer txs = { buf->p, buf->len };
+    uint32_t amount_of_txs;
+    // every transaction takes more than 32 bytes, which bounds the allocation
+    if (!deser_varlen(&amount_of_txs, &txs) || amount_of_txs == 0 || amount_of_txs > txs.len / sizeof(uint256_t)) return false;
+
+    uint256_t* hashes = dogecoin_calloc(amount_of_txs, sizeof(uint256_t));
+    dogecoin_tx_view txview;
+    dogecoin_tx_view_init(&txview);
+    size_t consumedlength = 0;
+    uint32_t i;
+    for (i = 0; i < amount_of_txs; i++) {
+        if (!dogecoin_tx_view_parse(&txview, txs.p, txs.len, &consumedlength)) {
+            dogecoin_tx_view_free(&txview);
+            dogecoin_free(hashes);
+            return false;
+        }
+        dogecoin_tx_view_hash(&txview, hashes[i]);
+        deser_skip(&txs, consumedlength);
+    }
+    dogecoin_tx_view_free(&txview);
+
+    dogecoin_bool mutated = false;
+    uint32_t width = amount_of_txs;
+    while (width > 1) {
+        uint8_t pair[2 * sizeof(uint256_t)];
+        for (i = 0; i < width; i += 2) {
+            memcpy(pair, hashes[i], sizeof(uint256_t));
+            if (i + 1 < width) {
+                // identical siblings allow a second tree with the same root (CVE-2012-2459)
+                if (memcmp(hashes[i], hashes[i + 1], sizeof(uint256_t)) == 0) mutated = true;
+                memcpy(pair + sizeof(uint256_t), hashes[i + 1], sizeof(uint256_t));
+            } else {
+                memcpy(pair + sizeof(uint256_t), hashes[i], sizeof(uint256_t));
+            }
+            dogecoin_dblhash(pair, sizeof(pair), hashes[i / 2]);
+        }
+        width = (width + 1) / 2;
+    }
+    memcpy(merkle_root, hashes[0], sizeof(uint256_t));
+    dogecoin_free(hashes);
+    return !mutated;
+}
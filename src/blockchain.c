@@ -0,0 +1,213 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2025 The Dogecoin Foundation
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <string.h>
+
+#include <dogecoin/blockchain.h>
+#include <dogecoin/mem.h>
+
+#define BLOCKINDEX_MAP_MIN_CAPACITY 1024
+
+/**
+ * Reads the probe key from a block hash. The hash is the output of
+ * sha256d and therefore already uniformly distributed.
+ *
+ * @param hash The block hash.
+ *
+ * @return The first 8 bytes of the hash.
+ */
+static inline uint64_t dogecoin_blockindex_map_key(const uint8_t* hash) {
+    uint64_t key;
+    memcpy(&key, hash, sizeof(key));
+    return key;
+}
+
+/**
+ * Inserts an entry into a slot array known to have a free slot and
+ * no entry with the same hash.
+ */
+static void dogecoin_blockindex_map_place(dogecoin_blockindex_map_slot* slots, size_t capacity, uint64_t key, dogecoin_blockindex* blockindex) {
+    size_t mask = capacity - 1;
+    size_t i = (size_t)key & mask;
+    while (slots[i].blockindex) {
+        i = (i + 1) & mask;
+    }
+    slots[i].key = key;
+    slots[i].blockindex = blockindex;
+}
+
+/**
+ * Doubles the capacity of the map and re-inserts all entries.
+ *
+ * @param map The blockindex map.
+ *
+ * @return true if the map was grown, false if out of memory.
+ */
+static dogecoin_bool dogecoin_blockindex_map_grow(dogecoin_blockindex_map* map) {
+    size_t capacity = map->capacity << 1;
+    dogecoin_blockindex_map_slot* slots = dogecoin_calloc(capacity, sizeof(dogecoin_blockindex_map_slot));
+    if (!slots) {
+        return false;
+    }
+    size_t i;
+    for (i = 0; i < map->capacity; i++) {
+        if (map->slots[i].blockindex) {
+            dogecoin_blockindex_map_place(slots, capacity, map->slots[i].key, map->slots[i].blockindex);
+        }
+    }
+    dogecoin_free(map->slots);
+    map->slots = slots;
+    map->capacity = capacity;
+    return true;
+}
+
+/**
+ * Creates a new, empty blockindex map.
+ *
+ * @param capacity_hint The expected amount of entries (0 for a default).
+ *
+ * @return A pointer to the new map.
+ */
+dogecoin_blockindex_map* dogecoin_blockindex_map_new(size_t capacity_hint) {
+    dogecoin_blockindex_map* map = dogecoin_calloc(1, sizeof(*map));
+    size_t capacity = BLOCKINDEX_MAP_MIN_CAPACITY;
+    // keep the load factor at or below 1/2
+    while (capacity < capacity_hint * 2) {
+        capacity <<= 1;
+    }
+    map->slots = dogecoin_calloc(capacity, sizeof(dogecoin_blockindex_map_slot));
+    map->capacity = capacity;
+    map->count = 0;
+    return map;
+}
+
+/**
+ * Frees the map and optionally all blockindex objects it references.
+ *
+ * @param map The blockindex map.
+ * @param free_cb Called for each blockindex if not NULL.
+ */
+void dogecoin_blockindex_map_free(dogecoin_blockindex_map* map, void (*free_cb)(void*)) {
+    if (!map) {
+        return;
+    }
+    if (free_cb) {
+        size_t i;
+        for (i = 0; i < map->capacity; i++) {
+            if (map->slots[i].blockindex) {
+                free_cb(map->slots[i].blockindex);
+            }
+        }
+    }
+    dogecoin_free(map->slots);
+    dogecoin_free(map);
+}
+
+/**
+ * Looks up a blockindex by block hash.
+ *
+ * @param map The blockindex map.
+ * @param hash The block hash to look up.
+ *
+ * @return The blockindex or NULL if not found.
+ */
+dogecoin_blockindex* dogecoin_blockindex_map_find(const dogecoin_blockindex_map* map, const uint256_t hash) {
+    uint64_t key = dogecoin_blockindex_map_key(hash);
+    size_t mask = map->capacity - 1;
+    size_t i = (size_t)key & mask;
+    while (map->slots[i].blockindex) {
+        if (map->slots[i].key == key && memcmp(map->slots[i].blockindex->hash, hash, sizeof(uint256_t)) == 0) {
+            return map->slots[i].blockindex;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * Adds a blockindex to the map (keyed by its hash).
+ *
+ * @param map The blockindex map.
+ * @param blockindex The blockindex to add.
+ *
+ * @return true if added, false if a blockindex with the same hash already exists.
+ */
+dogecoin_bool dogecoin_blockindex_map_insert(dogecoin_blockindex_map* map, dogecoin_blockindex* blockindex) {
+    if (dogecoin_blockindex_map_find(map, blockindex->hash)) {
+        return false;
+    }
+    if ((map->count + 1) * 2 > map->capacity && !dogecoin_blockindex_map_grow(map)) {
+        return false;
+    }
+    dogecoin_blockindex_map_place(map->slots, map->capacity, dogecoin_blockindex_map_key(blockindex->hash), blockindex);
+    map->count++;
+    return true;
+}
+
+/**
+ * Removes the blockindex with the given hash from the map (the blockindex
+ * itself is not freed). Uses backward shift deletion, so lookups never
+ * need to skip tombstones.
+ *
+ * @param map The blockindex map.
+ * @param hash The hash of the blockindex to remove.
+ *
+ * @return true if an entry was removed, false if not found.
+ */
+dogecoin_bool dogecoin_blockindex_map_remove(dogecoin_blockindex_map* map, const uint256_t hash) {
+    uint64_t key = dogecoin_blockindex_map_key(hash);
+    size_t mask = map->capacity - 1;
+    size_t i = (size_t)key & mask;
+    while (map->slots[i].blockindex) {
+        if (map->slots[i].key == key && memcmp(map->slots[i].blockindex->hash, hash, sizeof(uint256_t)) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    if (!map->slots[i].blockindex) {
+        return false;
+    }
+
+    // shift following entries of the probe sequence back into the gap
+    size_t gap = i;
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (!map->slots[j].blockindex) {
+            break;
+        }
+        size_t home = (size_t)map->slots[j].key & mask;
+        // move the entry if its home slot is not cyclically within (gap, j]
+        if (((j - home) & mask) >= ((j - gap) & mask)) {
+            map->slots[gap] = map->slots[j];
+            gap = j;
+        }
+    }
+    map->slots[gap].key = 0;
+    map->slots[gap].blockindex = NULL;
+    map->count--;
+    return true;
+}
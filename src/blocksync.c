@@ -0,0 +1,234 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2024 The Dogecoin Foundation
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <string.h>
+
+#include <dogecoin/blocksync.h>
+#include <dogecoin/mem.h>
+#include <dogecoin/protocol.h>
+#include <dogecoin/serialize.h>
+
+/**
+ * @brief This function creates a block download scheduler starting
+ * at the given height.
+ *
+ * @param start_height The first block to download.
+ * @param window The maximum amount of blocks in flight per peer.
+ * @param capacity The maximum amount of blocks ahead of the next block to connect.
+ * @param stall_timeout Seconds after which a requested block gets reassigned.
+ * @param get_header Looks up the main chain header at a height.
+ * @param ctx The context passed to get_header.
+ *
+ * @return The new scheduler.
+ */
+dogecoin_block_scheduler* dogecoin_block_scheduler_new(uint32_t start_height, uint32_t window, uint32_t capacity, uint64_t stall_timeout, dogecoin_bool (*get_header)(void *ctx, uint32_t height, dogecoin_blockindex *blockindex), void *ctx) {
+    dogecoin_block_scheduler* scheduler = dogecoin_calloc(1, sizeof(*scheduler));
+    scheduler->next_height = start_height;
+    scheduler->fill_height = start_height;
+    scheduler->target_height = start_height > 0 ? start_height - 1 : 0;
+    scheduler->window = window > 0 ? window : 1;
+    scheduler->capacity = capacity > scheduler->window ? capacity : scheduler->window;
+    scheduler->stall_timeout = stall_timeout;
+    scheduler->slots = dogecoin_calloc(scheduler->capacity, sizeof(dogecoin_block_request));
+    scheduler->get_header = get_header;
+    scheduler->ctx = ctx;
+    return scheduler;
+}
+
+/**
+ * @brief This function frees the scheduler including all blocks
+ * of the reorder buffer.
+ *
+ * @param scheduler The scheduler to free.
+ *
+ * @return Nothing.
+ */
+void dogecoin_block_scheduler_free(dogecoin_block_scheduler* scheduler) {
+    if (!scheduler) return;
+    dogecoin_block_scheduler_rewind(scheduler, scheduler->next_height);
+    dogecoin_free(scheduler->slots);
+    dogecoin_free(scheduler);
+}
+
+static dogecoin_block_request* dogecoin_block_scheduler_slot(const dogecoin_block_scheduler* scheduler, uint32_t height) {
+    return &scheduler->slots[height % scheduler->capacity];
+}
+
+void dogecoin_block_scheduler_set_target(dogecoin_block_scheduler* scheduler, uint32_t height) {
+    if (height > scheduler->target_height) {
+        scheduler->target_height = height;
+    }
+}
+
+uint32_t dogecoin_block_scheduler_inflight(const dogecoin_block_scheduler* scheduler, int nodeid) {
+    uint32_t count = 0;
+    uint32_t height;
+    for (height = scheduler->next_height; height < scheduler->fill_height; height++) {
+        const dogecoin_block_request* slot = dogecoin_block_scheduler_slot(scheduler, height);
+        if (slot->state == DOGECOIN_BLOCK_REQUEST_INFLIGHT && slot->nodeid == nodeid) count++;
+    }
+    return count;
+}
+
+/**
+ * @brief This function assigns the next range of blocks to a peer.
+ * Stalled and released blocks are handed out again before new heights,
+ * so the block holding up the reorder buffer is always requested first.
+ *
+ * @param scheduler The scheduler.
+ * @param nodeid The peer to assign the blocks to.
+ * @param node_height The best known height of the peer.
+ * @param now The current time.
+ * @param inv The getdata payload to append the inv entries to.
+ *
+ * @return The amount of assigned blocks.
+ */
+uint32_t dogecoin_block_scheduler_assign(dogecoin_block_scheduler* scheduler, int nodeid, uint32_t node_height, uint64_t now, cstring* inv) {
+    // look up the headers of the heights entering the window
+    while (scheduler->fill_height <= scheduler->target_height &&
+           scheduler->fill_height - scheduler->next_height < scheduler->capacity) {
+        dogecoin_block_request* slot = dogecoin_block_scheduler_slot(scheduler, scheduler->fill_height);
+        dogecoin_mem_zero(slot, sizeof(*slot));
+        if (!scheduler->get_header(scheduler->ctx, scheduler->fill_height, &slot->index)) break;
+        slot->index.prev = NULL;
+        slot->state = DOGECOIN_BLOCK_REQUEST_PENDING;
+        slot->nodeid = -1;
+        scheduler->fill_height++;
+    }
+
+    uint32_t inflight = dogecoin_block_scheduler_inflight(scheduler, nodeid);
+    if (inflight >= scheduler->window) return 0;
+
+    uint32_t count = 0;
+    uint32_t height;
+    for (height = scheduler->next_height; height < scheduler->fill_height && inflight + count < scheduler->window; height++) {
+        if (height > node_height) break;
+        dogecoin_block_request* slot = dogecoin_block_scheduler_slot(scheduler, height);
+        if (slot->state != DOGECOIN_BLOCK_REQUEST_PENDING) {
+            // ranges are contiguous, the next gap starts another request
+            if (count > 0) break;
+            continue;
+        }
+        slot->state = DOGECOIN_BLOCK_REQUEST_INFLIGHT;
+        slot->nodeid = nodeid;
+        slot->request_time = now;
+        ser_u32(inv, DOGECOIN_INV_TYPE_BLOCK);
+        ser_u256(inv, slot->index.hash);
+        count++;
+    }
+    return count;
+}
+
+dogecoin_bool dogecoin_block_scheduler_block_received(dogecoin_block_scheduler* scheduler, int nodeid, const uint256_t hash, const uint8_t* data, size_t len) {
+    uint32_t height;
+    for (height = scheduler->next_height; height < scheduler->fill_height; height++) {
+        dogecoin_block_request* slot = dogecoin_block_scheduler_slot(scheduler, height);
+        if (memcmp(slot->index.hash, hash, sizeof(uint256_t)) != 0) continue;
+        // a reassigned block may arrive twice, keep the first copy
+        if (slot->state != DOGECOIN_BLOCK_REQUEST_RECEIVED) {
+            slot->block = cstr_new_buf(data, len);
+            slot->state = DOGECOIN_BLOCK_REQUEST_RECEIVED;
+            slot->nodeid = nodeid;
+        }
+        return true;
+    }
+    return false;
+}
+
+cstring* dogecoin_block_scheduler_next(dogecoin_block_scheduler* scheduler, dogecoin_blockindex* index, int* nodeid) {
+    if (scheduler->next_height >= scheduler->fill_height) return NULL;
+    dogecoin_block_request* slot = dogecoin_block_scheduler_slot(scheduler, scheduler->next_height);
+    if (slot->state != DOGECOIN_BLOCK_REQUEST_RECEIVED) return NULL;
+
+    cstring* block = slot->block;
+    *index = slot->index;
+    if (nodeid) *nodeid = slot->nodeid;
+    dogecoin_mem_zero(slot, sizeof(*slot));
+    scheduler->next_height++;
+    return block;
+}
+
+uint32_t dogecoin_block_scheduler_check_stalls(dogecoin_block_scheduler* scheduler, uint64_t now) {
+    uint32_t count = 0;
+    uint32_t height;
+    for (height = scheduler->next_height; height < scheduler->fill_height; height++) {
+        dogecoin_block_request* slot = dogecoin_block_scheduler_slot(scheduler, height);
+        if (slot->state == DOGECOIN_BLOCK_REQUEST_INFLIGHT && now >= slot->request_time + scheduler->stall_timeout) {
+            slot->state = DOGECOIN_BLOCK_REQUEST_PENDING;
+            slot->nodeid = -1;
+            count++;
+        }
+    }
+    return count;
+}
+
+void dogecoin_block_scheduler_release_node(dogecoin_block_scheduler* scheduler, int nodeid) {
+    uint32_t height;
+    for (height = scheduler->next_height; height < scheduler->fill_height; height++) {
+        dogecoin_block_request* slot = dogecoin_block_scheduler_slot(scheduler, height);
+        if (slot->state == DOGECOIN_BLOCK_REQUEST_INFLIGHT && slot->nodeid == nodeid) {
+            slot->state = DOGECOIN_BLOCK_REQUEST_PENDING;
+            slot->nodeid = -1;
+        }
+    }
+}
+
+/**
+ * @brief This function drops all scheduled blocks from the given
+ * height on, the headers above it are looked up again on the next
+ * assignment. Blocks below next_height were already connected and
+ * have to be rolled back by the caller.
+ *
+ * @param scheduler The scheduler.
+ * @param height The first height to download again.
+ *
+ * @return Nothing.
+ */
+void dogecoin_block_scheduler_rewind(dogecoin_block_scheduler* scheduler, uint32_t height) {
+    uint32_t from = height > scheduler->next_height ? height : scheduler->next_height;
+    uint32_t h;
+    for (h = from; h < scheduler->fill_height; h++) {
+        dogecoin_block_request* slot = dogecoin_block_scheduler_slot(scheduler, h);
+        if (slot->block) {
+            cstr_free(slot->block, true);
+        }
+        dogecoin_mem_zero(slot, sizeof(*slot));
+    }
+    if (from < scheduler->fill_height) {
+        scheduler->fill_height = from;
+    }
+    if (height < scheduler->next_height) {
+        scheduler->next_height = height;
+        scheduler->fill_height = height;
+    }
+    if (scheduler->target_height >= height) {
+        scheduler->target_height = height > 0 ? height - 1 : 0;
+    }
+}
+
+dogecoin_bool dogecoin_block_scheduler_done(const dogecoin_block_scheduler* scheduler) {
+    return scheduler->next_height > scheduler->target_height;
+}
@@ -0,0 +1,304 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2012-2016 The Bitcoin Core developers
+ Copyright (c) 2024 The Dogecoin Foundation
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <string.h>
+
+#include <dogecoin/bloom.h>
+#include <dogecoin/hash.h>
+#include <dogecoin/mem.h>
+#include <dogecoin/serialize.h>
+
+/* a block of at most 1MB cannot hold more transactions than this */
+#define DOGECOIN_MERKLEBLOCK_MAX_TXS (1000000 / 60)
+
+#define DOGECOIN_BLOOM_LN2 0.6931471805599453094172321214581765680755001343602552
+
+static inline uint32_t rotl32(uint32_t x, int8_t r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+/**
+ * @brief This function computes the 32 bit MurmurHash3 used by
+ * BIP37 bloom filters.
+ *
+ * @param seed The hash seed.
+ * @param data The data to hash.
+ * @param len The length of the data.
+ *
+ * @return The hash.
+ */
+uint32_t dogecoin_murmur3(uint32_t seed, const uint8_t* data, size_t len) {
+    uint32_t h1 = seed;
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+    const size_t nblocks = len / 4;
+    size_t i;
+
+    for (i = 0; i < nblocks; i++) {
+        const uint8_t* block = data + i * 4;
+        uint32_t k1 = (uint32_t)block[0] | ((uint32_t)block[1] << 8) | ((uint32_t)block[2] << 16) | ((uint32_t)block[3] << 24);
+        k1 *= c1;
+        k1 = rotl32(k1, 15);
+        k1 *= c2;
+        h1 ^= k1;
+        h1 = rotl32(h1, 13);
+        h1 = h1 * 5 + 0xe6546b64;
+    }
+
+    const uint8_t* tail = data + nblocks * 4;
+    uint32_t k1 = 0;
+    switch (len & 3) {
+        case 3:
+            k1 ^= (uint32_t)tail[2] << 16;
+            /* fall through */
+        case 2:
+            k1 ^= (uint32_t)tail[1] << 8;
+            /* fall through */
+        case 1:
+            k1 ^= tail[0];
+            k1 *= c1;
+            k1 = rotl32(k1, 15);
+            k1 *= c2;
+            h1 ^= k1;
+    }
+
+    h1 ^= (uint32_t)len;
+    h1 ^= h1 >> 16;
+    h1 *= 0x85ebca6b;
+    h1 ^= h1 >> 13;
+    h1 *= 0xc2b2ae35;
+    h1 ^= h1 >> 16;
+    return h1;
+}
+
+/* natural logarithm for 0 < x <= 1, keeps the library free of libm */
+static double dogecoin_bloom_ln(double x) {
+    int k = 0;
+    while (x < 0.5) {
+        x *= 2.0;
+        k++;
+    }
+    // ln(x) = 2 * atanh((x - 1) / (x + 1)), converges fast for x in [0.5, 1]
+    double y = (x - 1.0) / (x + 1.0);
+    double y2 = y * y;
+    double term = y;
+    double sum = 0.0;
+    int i;
+    for (i = 1; i < 40; i += 2) {
+        sum += term / i;
+        term *= y2;
+    }
+    return 2.0 * sum - k * DOGECOIN_BLOOM_LN2;
+}
+
+/**
+ * @brief This function creates a bloom filter sized for the given
+ * amount of elements and false positive rate, capped to the BIP37
+ * limits.
+ *
+ * @param elements The expected amount of elements.
+ * @param fp_rate The false positive rate (0 < fp_rate < 1).
+ * @param tweak The random value mixed into the hash seeds.
+ * @param flags One of dogecoin_bloom_flags.
+ *
+ * @return The new filter.
+ */
+dogecoin_bloom_filter* dogecoin_bloom_filter_new(uint32_t elements, double fp_rate, uint32_t tweak, uint8_t flags) {
+    if (elements == 0) elements = 1;
+    if (fp_rate <= 0.0 || fp_rate >= 1.0) fp_rate = 0.0001;
+    double bytes = -1.0 / (DOGECOIN_BLOOM_LN2 * DOGECOIN_BLOOM_LN2) * elements * dogecoin_bloom_ln(fp_rate) / 8.0;
+    uint32_t size = bytes > DOGECOIN_BLOOM_MAX_FILTER_SIZE ? DOGECOIN_BLOOM_MAX_FILTER_SIZE : (bytes < 1.0 ? 1 : (uint32_t)bytes);
+    double funcs = size * 8.0 / elements * DOGECOIN_BLOOM_LN2;
+    uint32_t hash_funcs = funcs > DOGECOIN_BLOOM_MAX_HASH_FUNCS ? DOGECOIN_BLOOM_MAX_HASH_FUNCS : (funcs < 1.0 ? 1 : (uint32_t)funcs);
+
+    dogecoin_bloom_filter* filter = dogecoin_calloc(1, sizeof(*filter));
+    filter->data = dogecoin_calloc(1, size);
+    filter->size = size;
+    filter->hash_funcs = hash_funcs;
+    filter->tweak = tweak;
+    filter->flags = flags;
+    return filter;
+}
+
+void dogecoin_bloom_filter_free(dogecoin_bloom_filter* filter) {
+    if (!filter) return;
+    dogecoin_free(filter->data);
+    dogecoin_free(filter);
+}
+
+static inline uint32_t dogecoin_bloom_filter_bit(const dogecoin_bloom_filter* filter, uint32_t hash_num, const uint8_t* data, size_t len) {
+    return dogecoin_murmur3(hash_num * 0xFBA4C795 + filter->tweak, data, len) % (filter->size * 8);
+}
+
+void dogecoin_bloom_filter_insert(dogecoin_bloom_filter* filter, const uint8_t* data, size_t len) {
+    uint32_t i;
+    for (i = 0; i < filter->hash_funcs; i++) {
+        uint32_t bit = dogecoin_bloom_filter_bit(filter, i, data, len);
+        filter->data[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+    }
+}
+
+dogecoin_bool dogecoin_bloom_filter_contains(const dogecoin_bloom_filter* filter, const uint8_t* data, size_t len) {
+    uint32_t i;
+    for (i = 0; i < filter->hash_funcs; i++) {
+        uint32_t bit = dogecoin_bloom_filter_bit(filter, i, data, len);
+        if (!(filter->data[bit >> 3] & (1 << (bit & 7)))) return false;
+    }
+    return true;
+}
+
+void dogecoin_bloom_filter_insert_outpoint(dogecoin_bloom_filter* filter, const uint256_t hash, uint32_t n) {
+    uint8_t outpoint[sizeof(uint256_t) + sizeof(uint32_t)];
+    memcpy(outpoint, hash, sizeof(uint256_t));
+    outpoint[32] = (uint8_t)n;
+    outpoint[33] = (uint8_t)(n >> 8);
+    outpoint[34] = (uint8_t)(n >> 16);
+    outpoint[35] = (uint8_t)(n >> 24);
+    dogecoin_bloom_filter_insert(filter, outpoint, sizeof(outpoint));
+}
+
+void dogecoin_bloom_filter_serialize(cstring* s, const dogecoin_bloom_filter* filter) {
+    ser_varlen(s, filter->size);
+    ser_bytes(s, filter->data, filter->size);
+    ser_u32(s, filter->hash_funcs);
+    ser_u32(s, filter->tweak);
+    ser_bytes(s, &filter->flags, 1);
+}
+
+/* state of a partial merkle tree traversal */
+typedef struct dogecoin_pmt_ {
+    uint32_t total;
+    const uint8_t* hashes;
+    uint32_t hash_count;
+    uint32_t hashes_used;
+    const uint8_t* flags;
+    uint32_t flag_bits;
+    uint32_t bits_used;
+    dogecoin_bool bad;
+    vector_t* matches;
+} dogecoin_pmt;
+
+static uint32_t dogecoin_pmt_width(const dogecoin_pmt* pmt, int height) {
+    return (pmt->total + (1u << height) - 1) >> height;
+}
+
+/**
+ * @brief This function walks the partial merkle tree depth first,
+ * the way it was serialized, and computes the hash of the node at
+ * height and pos.
+ *
+ * @param pmt The traversal state.
+ * @param height The height of the node (0 = transactions).
+ * @param pos The position of the node on its level.
+ * @param hash_out The computed node hash.
+ *
+ * @return Nothing, pmt->bad gets set on malformed input.
+ */
+static void dogecoin_pmt_traverse(dogecoin_pmt* pmt, int height, uint32_t pos, uint256_t hash_out) {
+    if (pmt->bits_used >= pmt->flag_bits) {
+        pmt->bad = true;
+        return;
+    }
+    dogecoin_bool parent_of_match = (pmt->flags[pmt->bits_used / 8] >> (pmt->bits_used % 8)) & 1;
+    pmt->bits_used++;
+    if (height == 0 || !parent_of_match) {
+        // leaf or pruned subtree, the hash is given
+        if (pmt->hashes_used >= pmt->hash_count) {
+            pmt->bad = true;
+            return;
+        }
+        memcpy(hash_out, pmt->hashes + (size_t)pmt->hashes_used * sizeof(uint256_t), sizeof(uint256_t));
+        pmt->hashes_used++;
+        if (height == 0 && parent_of_match && pmt->matches) {
+            uint256_t* match = dogecoin_calloc(1, sizeof(uint256_t));
+            memcpy(match, hash_out, sizeof(uint256_t));
+            vector_add(pmt->matches, match);
+        }
+        return;
+    }
+
+    uint8_t pair[2 * sizeof(uint256_t)];
+    dogecoin_pmt_traverse(pmt, height - 1, pos * 2, pair);
+    if (pmt->bad) return;
+    if (pos * 2 + 1 < dogecoin_pmt_width(pmt, height - 1)) {
+        dogecoin_pmt_traverse(pmt, height - 1, pos * 2 + 1, pair + sizeof(uint256_t));
+        if (pmt->bad) return;
+        // identical siblings allow a second tree with the same root (CVE-2012-2459)
+        if (memcmp(pair, pair + sizeof(uint256_t), sizeof(uint256_t)) == 0) {
+            pmt->bad = true;
+            return;
+        }
+    } else {
+        memcpy(pair + sizeof(uint256_t), pair, sizeof(uint256_t));
+    }
+    dogecoin_dblhash(pair, sizeof(pair), hash_out);
+}
+
+/**
+ * @brief This function reads the partial merkle tree of a
+ * merkleblock message. The caller compares the computed root with
+ * the merkle root of the block header.
+ *
+ * @param buf The message buffer, positioned after the block header.
+ * @param merkle_root The computed merkle root.
+ * @param matches Receives a copy of every matched txid, may be NULL.
+ *
+ * @return 1 if the tree is well formed, 0 otherwise.
+ */
+dogecoin_bool dogecoin_merkleblock_extract_matches(struct const_buffer* buf, uint256_t merkle_root, vector_t* matches) {
+    dogecoin_pmt pmt;
+    dogecoin_mem_zero(&pmt, sizeof(pmt));
+    uint32_t flag_bytes = 0;
+
+    if (!deser_u32(&pmt.total, buf) || !deser_varlen(&pmt.hash_count, buf)) return false;
+    if (pmt.total == 0 || pmt.total > DOGECOIN_MERKLEBLOCK_MAX_TXS || pmt.hash_count > pmt.total) return false;
+    if (buf->len < (size_t)pmt.hash_count * sizeof(uint256_t)) return false;
+    pmt.hashes = (const uint8_t*)buf->p;
+    deser_skip(buf, (size_t)pmt.hash_count * sizeof(uint256_t));
+
+    if (!deser_varlen(&flag_bytes, buf) || buf->len < flag_bytes) return false;
+    pmt.flags = (const uint8_t*)buf->p;
+    pmt.flag_bits = flag_bytes * 8;
+    deser_skip(buf, flag_bytes);
+    if (pmt.flag_bits < pmt.hash_count) return false;
+
+    int height = 0;
+    while (dogecoin_pmt_width(&pmt, height) > 1) height++;
+
+    size_t matches_before = matches ? matches->len : 0;
+    pmt.matches = matches;
+    dogecoin_pmt_traverse(&pmt, height, 0, merkle_root);
+
+    // every hash and every flag byte has to be consumed
+    if (pmt.bad || (pmt.bits_used + 7) / 8 != flag_bytes || pmt.hashes_used != pmt.hash_count) {
+        while (matches && matches->len > matches_before) {
+            vector_remove_idx(matches, matches->len - 1);
+        }
+        return false;
+    }
+    return true;
+}
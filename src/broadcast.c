@@ -0,0 +1,617 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2024 The Dogecoin Foundation
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifdef _MSC_VER
+#define HAVE_STRUCT_TIMESPEC
+#include <win/pthread.h>
+#else
+#include <pthread.h>
+#endif
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+#include <string.h>
+#include <time.h>
+
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include <dogecoin/broadcast.h>
+#include <dogecoin/hash.h>
+#include <dogecoin/mem.h>
+#include <dogecoin/serialize.h>
+#include <dogecoin/uthash.h>
+
+#define UNUSED(x) (void)(x)
+
+/* a tracked transaction */
+typedef struct dogecoin_broadcast_entry_ {
+    dogecoin_broadcast_status status;
+    dogecoin_p2p_shared_msg* tx_msg; /* serialized once, referenced by every requesting peer */
+    UT_hash_handle hh;
+} dogecoin_broadcast_entry;
+
+/* a submitted transaction on its way to the event loop thread */
+typedef struct dogecoin_broadcast_item_ {
+    uint256_t txhash;
+    cstring* tx_ser;
+    struct dogecoin_broadcast_item_* next;
+} dogecoin_broadcast_item;
+
+struct dogecoin_broadcast_queue_ {
+    pthread_mutex_t lock; /* guards the items and stop */
+    dogecoin_broadcast_item* head;
+    dogecoin_broadcast_item* tail;
+    dogecoin_bool stop;
+    evutil_socket_t wake[2]; /* a byte on wake[1] gets the event loop to drain the items */
+    struct event* wake_event;
+    pthread_t thread;
+    dogecoin_bool running; /* the event loop runs on thread */
+};
+
+static void dogecoin_broadcast_entry_free(void* obj)
+{
+    dogecoin_broadcast_entry* entry = (dogecoin_broadcast_entry*)obj;
+    dogecoin_p2p_shared_msg_release(entry->tx_msg);
+    dogecoin_free(entry);
+}
+
+static void dogecoin_broadcast_item_free(dogecoin_broadcast_item* item)
+{
+    if (item->tx_ser) {
+        cstr_free(item->tx_ser, true);
+    }
+    dogecoin_free(item);
+}
+
+static void dogecoin_broadcaster_report(dogecoin_broadcaster* broadcaster, const dogecoin_broadcast_entry* entry)
+{
+    if (broadcaster->tx_status_cb) {
+        broadcaster->tx_status_cb(broadcaster->ctx, &entry->status);
+    }
+}
+
+/* states only move forward, a getdata after the relay is still counted but keeps RELAYED */
+static void dogecoin_broadcast_entry_advance(dogecoin_broadcast_entry* entry, enum dogecoin_broadcast_state state)
+{
+    if (entry->status.state < state) {
+        entry->status.state = state;
+    }
+}
+
+/**
+ * Sends inv messages for the entries (up to DOGECOIN_BROADCAST_MAX_INV each)
+ * to every node with a completed handshake, or only to the given node
+ *
+ * @param broadcaster the broadcaster
+ * @param entries the entries to announce
+ * @param count amount of entries
+ * @param node a single node, NULL for all nodes
+ */
+static void dogecoin_broadcaster_announce(dogecoin_broadcaster* broadcaster, dogecoin_broadcast_entry** entries, size_t count, dogecoin_node* node)
+{
+    dogecoin_node_group* group = broadcaster->group;
+    size_t i, j;
+    for (i = 0; i < count; i += DOGECOIN_BROADCAST_MAX_INV) {
+        size_t batch = count - i < DOGECOIN_BROADCAST_MAX_INV ? count - i : DOGECOIN_BROADCAST_MAX_INV;
+        cstring* payload = cstr_new_sz(9 + batch * 36);
+        ser_varlen(payload, (uint32_t)batch);
+        for (j = 0; j < batch; j++) {
+            dogecoin_p2p_inv_msg inv_msg;
+            dogecoin_p2p_msg_inv_init(&inv_msg, DOGECOIN_INV_TYPE_TX, entries[i + j]->status.txhash);
+            dogecoin_p2p_msg_inv_ser(&inv_msg, payload);
+        }
+
+        /* one serialized inv for all peers */
+        dogecoin_p2p_shared_msg* msg = dogecoin_p2p_shared_msg_new(group->chainparams->netmagic, DOGECOIN_MSG_INV, payload);
+        unsigned int peers = 0;
+        if (node) {
+            dogecoin_node_send_shared(node, msg);
+            peers++;
+        } else {
+            for (j = 0; j < group->nodes->len; j++) {
+                dogecoin_node* peer = vector_idx(group->nodes, j);
+                if ((peer->state & NODE_CONNECTED) == NODE_CONNECTED && peer->version_handshake) {
+                    dogecoin_node_send_shared(peer, msg);
+                    peers++;
+                }
+            }
+        }
+        dogecoin_p2p_shared_msg_release(msg);
+
+        if (peers == 0) continue;
+        for (j = 0; j < batch; j++) {
+            dogecoin_broadcast_entry* entry = entries[i + j];
+            entry->status.announced_to += peers;
+            dogecoin_broadcast_entry_advance(entry, DOGECOIN_BROADCAST_ANNOUNCED);
+            dogecoin_broadcaster_report(broadcaster, entry);
+        }
+    }
+}
+
+/**
+ * Drops the transactions older than the expiry, they are reported one last time
+ *
+ * @param broadcaster the broadcaster
+ * @param now current time in seconds
+ */
+static void dogecoin_broadcaster_expire(dogecoin_broadcaster* broadcaster, uint64_t now)
+{
+    /* the vector is in submit order, the expired ones are at its front */
+    size_t expired = 0;
+    while (expired < broadcaster->txs->len) {
+        dogecoin_broadcast_entry* entry = vector_idx(broadcaster->txs, expired);
+        if (entry->status.submit_time + broadcaster->tx_expiry > now) break;
+        HASH_DEL(broadcaster->index, entry);
+        entry->status.state = DOGECOIN_BROADCAST_EXPIRED;
+        dogecoin_broadcaster_report(broadcaster, entry);
+        expired++;
+    }
+    if (expired > 0) {
+        vector_remove_range(broadcaster->txs, 0, expired);
+    }
+}
+
+/**
+ * Gets lost peers connected again; without fixed ips new candidates come
+ * from the address manager or the dns seeds
+ *
+ * @param broadcaster the broadcaster
+ */
+static void dogecoin_broadcaster_reconnect(dogecoin_broadcaster* broadcaster)
+{
+    dogecoin_node_group* group = broadcaster->group;
+    if (dogecoin_node_group_amount_of_connected_nodes(group, NODE_CONNECTED) >= group->desired_amount_connected_nodes) {
+        return;
+    }
+
+    int candidates = 0;
+    size_t i;
+    for (i = 0; i < group->nodes->len; i++) {
+        dogecoin_node* node = vector_idx(group->nodes, i);
+        if ((node->state & NODE_MISSBEHAVED) == NODE_MISSBEHAVED) continue;
+        candidates++;
+        if ((node->state & NODE_CONNECTED) == NODE_CONNECTED || (node->state & NODE_CONNECTING) == NODE_CONNECTING || node->state == 0) {
+            continue;
+        }
+        /* errored, timed out or disconnected: release what is left and make it connectable */
+        dogecoin_node_disconnect(node);
+        node->state = 0;
+        node->version_handshake = false;
+    }
+
+    if (!broadcaster->ips && candidates < group->desired_amount_connected_nodes && group->dns_pending == 0) {
+        dogecoin_node_group_add_peers_by_ip_or_seed(group, NULL);
+    }
+    dogecoin_node_group_connect_next_nodes(group);
+}
+
+/**
+ * Announces the transactions submitted since the last run, expires old ones
+ * and reconnects lost peers
+ */
+#if defined(_WIN32) && defined(__x86_64__)
+static void dogecoin_broadcaster_flush_cb(long long int fd, short int event, void* ctx)
+#else
+static void dogecoin_broadcaster_flush_cb(int fd, short int event, void* ctx)
+#endif
+{
+    UNUSED(fd);
+    UNUSED(event);
+    dogecoin_broadcaster* broadcaster = (dogecoin_broadcaster*)ctx;
+    uint64_t now = time(NULL);
+
+    /* peers that connect later get everything tracked with their handshake */
+    if (broadcaster->unannounced->len > 0) {
+        dogecoin_broadcaster_announce(broadcaster, (dogecoin_broadcast_entry**)broadcaster->unannounced->data, broadcaster->unannounced->len, NULL);
+        vector_remove_range(broadcaster->unannounced, 0, broadcaster->unannounced->len);
+    }
+
+    dogecoin_broadcaster_expire(broadcaster, now);
+
+    if (broadcaster->last_reconnect + DOGECOIN_BROADCAST_RECONNECT_S <= now) {
+        broadcaster->last_reconnect = now;
+        dogecoin_broadcaster_reconnect(broadcaster);
+    }
+}
+
+/**
+ * Takes the submitted transactions into the tracked set (event loop thread)
+ */
+#if defined(_WIN32) && defined(__x86_64__)
+static void dogecoin_broadcaster_wake_cb(long long int fd, short int event, void* ctx)
+#else
+static void dogecoin_broadcaster_wake_cb(int fd, short int event, void* ctx)
+#endif
+{
+    UNUSED(event);
+    dogecoin_broadcaster* broadcaster = (dogecoin_broadcaster*)ctx;
+    struct dogecoin_broadcast_queue_* queue = broadcaster->queue;
+    char bytes[64];
+    while (recv(fd, bytes, sizeof(bytes), 0) > 0) {
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    dogecoin_broadcast_item* item = queue->head;
+    queue->head = queue->tail = NULL;
+    dogecoin_bool stop = queue->stop;
+    pthread_mutex_unlock(&queue->lock);
+
+    uint64_t now = time(NULL);
+    while (item) {
+        dogecoin_broadcast_item* next = item->next;
+        dogecoin_broadcast_entry* entry = NULL;
+        HASH_FIND(hh, broadcaster->index, item->txhash, sizeof(uint256_t), entry);
+        if (!entry) {
+            entry = dogecoin_calloc(1, sizeof(*entry));
+            memcpy(entry->status.txhash, item->txhash, sizeof(uint256_t));
+            entry->status.state = DOGECOIN_BROADCAST_QUEUED;
+            entry->status.submit_time = now;
+            entry->tx_msg = dogecoin_p2p_shared_msg_new(broadcaster->group->chainparams->netmagic, DOGECOIN_MSG_TX, item->tx_ser);
+            item->tx_ser = NULL;
+            HASH_ADD(hh, broadcaster->index, status.txhash, sizeof(uint256_t), entry);
+            vector_add(broadcaster->txs, entry);
+            vector_add(broadcaster->unannounced, entry);
+            dogecoin_broadcaster_report(broadcaster, entry);
+        }
+        dogecoin_broadcast_item_free(item);
+        item = next;
+    }
+
+    if (stop) {
+        event_base_loopbreak(broadcaster->group->event_base);
+    }
+}
+
+/**
+ * Announces every tracked transaction to a freshly connected peer
+ *
+ * @param node the node that completed the handshake
+ */
+static void dogecoin_broadcaster_handshake_done(dogecoin_node* node)
+{
+    dogecoin_broadcaster* broadcaster = (dogecoin_broadcaster*)node->nodegroup->ctx;
+    node->nodegroup->log_write_cb("broadcaster connected to node %d\n", node->nodeid);
+    if (broadcaster->txs->len > 0) {
+        dogecoin_broadcaster_announce(broadcaster, (dogecoin_broadcast_entry**)broadcaster->txs->data, broadcaster->txs->len, node);
+    }
+}
+
+/**
+ * Serves getdata requests for tracked transactions and records the
+ * transactions peers announce back
+ *
+ * @param node the node that sent the message
+ * @param hdr the message header
+ * @param buf the message payload
+ */
+static void dogecoin_broadcaster_postcmd(dogecoin_node* node, dogecoin_p2p_msg_hdr* hdr, struct const_buffer* buf)
+{
+    dogecoin_broadcaster* broadcaster = (dogecoin_broadcaster*)node->nodegroup->ctx;
+    dogecoin_bool getdata = strcmp(hdr->command, DOGECOIN_MSG_GETDATA) == 0;
+    if (!getdata && strcmp(hdr->command, DOGECOIN_MSG_INV) != 0) {
+        return;
+    }
+
+    struct const_buffer inv_buf = {buf->p, buf->len};
+    uint32_t vsize;
+    if (!deser_varlen(&vsize, &inv_buf) || vsize > 50000) {
+        dogecoin_node_misbehave(node);
+        return;
+    }
+    uint32_t i;
+    for (i = 0; i < vsize; i++) {
+        dogecoin_p2p_inv_msg inv_msg;
+        if (!dogecoin_p2p_msg_inv_deser(&inv_msg, &inv_buf)) {
+            dogecoin_node_misbehave(node);
+            return;
+        }
+        if ((inv_msg.type & MSG_TYPE_MASK) != DOGECOIN_INV_TYPE_TX) continue;
+
+        dogecoin_broadcast_entry* entry = NULL;
+        HASH_FIND(hh, broadcaster->index, inv_msg.hash, sizeof(uint256_t), entry);
+        if (!entry) continue;
+        if (getdata) {
+            dogecoin_node_send_shared(node, entry->tx_msg);
+            entry->status.requested_by++;
+            dogecoin_broadcast_entry_advance(entry, DOGECOIN_BROADCAST_REQUESTED);
+        } else {
+            entry->status.seen_on++;
+            dogecoin_broadcast_entry_advance(entry, DOGECOIN_BROADCAST_RELAYED);
+        }
+        dogecoin_broadcaster_report(broadcaster, entry);
+    }
+}
+
+static dogecoin_bool dogecoin_broadcaster_should_connect_more(dogecoin_node* node)
+{
+    dogecoin_node_group* group = node->nodegroup;
+    return dogecoin_node_group_amount_of_connected_nodes(group, NODE_CONNECTED) < group->desired_amount_connected_nodes;
+}
+
+/**
+ * Creates a broadcaster, nothing gets connected before it runs
+ *
+ * @param chainparams the chain parameters
+ * @param ips comma separated ip:port list or NULL for the address manager and the dns seeds
+ * @param maxpeers the amount of peers to keep connected
+ * @param debug log the network traffic to stdout
+ *
+ * @return dogecoin_broadcaster* or NULL if the event loop could not be set up
+ */
+dogecoin_broadcaster* dogecoin_broadcaster_new(const dogecoin_chainparams* chainparams, const char* ips, int maxpeers, dogecoin_bool debug)
+{
+    dogecoin_broadcaster* broadcaster = dogecoin_calloc(1, sizeof(*broadcaster));
+    broadcaster->group = dogecoin_node_group_new(chainparams);
+    if (!broadcaster->group) {
+        dogecoin_free(broadcaster);
+        return NULL;
+    }
+    struct dogecoin_broadcast_queue_* queue = dogecoin_calloc(1, sizeof(*queue));
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, queue->wake) != 0) {
+        dogecoin_free(queue);
+        dogecoin_node_group_free(broadcaster->group);
+        dogecoin_free(broadcaster);
+        return NULL;
+    }
+    evutil_make_socket_nonblocking(queue->wake[0]);
+    evutil_make_socket_nonblocking(queue->wake[1]);
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->wake_event = event_new(broadcaster->group->event_base, queue->wake[0], EV_READ | EV_PERSIST, dogecoin_broadcaster_wake_cb, broadcaster);
+    broadcaster->queue = queue;
+
+    dogecoin_node_group* group = broadcaster->group;
+    group->ctx = broadcaster;
+    group->desired_amount_connected_nodes = maxpeers;
+    group->postcmd_cb = dogecoin_broadcaster_postcmd;
+    group->handshake_done_cb = dogecoin_broadcaster_handshake_done;
+    group->should_connect_to_more_nodes_cb = dogecoin_broadcaster_should_connect_more;
+    if (debug) {
+        group->log_write_cb = net_write_log_printf;
+    }
+    broadcaster->addrman = dogecoin_addrman_new(group->chainparams);
+    group->addrman = broadcaster->addrman;
+    if (ips) {
+        broadcaster->ips = dogecoin_malloc(strlen(ips) + 1);
+        memcpy(broadcaster->ips, ips, strlen(ips) + 1);
+    }
+
+    broadcaster->inv_interval_ms = DOGECOIN_BROADCAST_INV_INTERVAL_MS;
+    broadcaster->tx_expiry = DOGECOIN_BROADCAST_TX_EXPIRY;
+    broadcaster->txs = vector_new(64, dogecoin_broadcast_entry_free);
+    broadcaster->unannounced = vector_new(64, NULL);
+    broadcaster->index = NULL;
+    broadcaster->flush_timer = event_new(group->event_base, -1, EV_PERSIST, dogecoin_broadcaster_flush_cb, broadcaster);
+    return broadcaster;
+}
+
+/**
+ * Stops the broadcaster and frees it with its peers and tracked transactions
+ *
+ * @param broadcaster the broadcaster
+ */
+void dogecoin_broadcaster_free(dogecoin_broadcaster* broadcaster)
+{
+    if (!broadcaster)
+        return;
+    dogecoin_broadcaster_stop(broadcaster);
+
+    struct dogecoin_broadcast_queue_* queue = broadcaster->queue;
+    dogecoin_broadcast_item* item = queue->head;
+    while (item) {
+        dogecoin_broadcast_item* next = item->next;
+        dogecoin_broadcast_item_free(item);
+        item = next;
+    }
+    event_free(queue->wake_event);
+    event_free(broadcaster->flush_timer);
+    evutil_closesocket(queue->wake[0]);
+    evutil_closesocket(queue->wake[1]);
+    pthread_mutex_destroy(&queue->lock);
+    dogecoin_free(queue);
+
+    /* queued sends keep their own reference on the transactions */
+    dogecoin_node_group_free(broadcaster->group);
+    dogecoin_addrman_free(broadcaster->addrman);
+    HASH_CLEAR(hh, broadcaster->index);
+    vector_free(broadcaster->unannounced, true);
+    vector_free(broadcaster->txs, true);
+    if (broadcaster->ips) {
+        dogecoin_free(broadcaster->ips);
+    }
+    dogecoin_free(broadcaster);
+}
+
+/**
+ * Connects to the peers and runs the event loop until dogecoin_broadcaster_stop
+ *
+ * @param broadcaster the broadcaster
+ */
+void dogecoin_broadcaster_run(dogecoin_broadcaster* broadcaster)
+{
+    dogecoin_node_group* group = broadcaster->group;
+    struct timeval tv;
+    tv.tv_sec = broadcaster->inv_interval_ms / 1000;
+    tv.tv_usec = (broadcaster->inv_interval_ms % 1000) * 1000;
+    event_add(broadcaster->flush_timer, &tv);
+    event_add(broadcaster->queue->wake_event, NULL);
+
+    broadcaster->last_reconnect = time(NULL);
+    dogecoin_node_group_add_peers_by_ip_or_seed(group, broadcaster->ips);
+    dogecoin_node_group_connect_next_nodes(group);
+
+    /* the timers keep the loop alive while no peer is connected */
+    event_base_dispatch(group->event_base);
+
+    event_del(broadcaster->flush_timer);
+    event_del(broadcaster->queue->wake_event);
+    dogecoin_node_group_shutdown(group);
+}
+
+static void* dogecoin_broadcaster_main(void* arg)
+{
+    dogecoin_broadcaster_run((dogecoin_broadcaster*)arg);
+    return NULL;
+}
+
+/**
+ * Runs the broadcaster on a thread of its own
+ *
+ * @param broadcaster the broadcaster
+ *
+ * @return true if the thread is running
+ */
+dogecoin_bool dogecoin_broadcaster_start(dogecoin_broadcaster* broadcaster)
+{
+    struct dogecoin_broadcast_queue_* queue = broadcaster->queue;
+    if (queue->running) return true;
+    if (pthread_create(&queue->thread, NULL, dogecoin_broadcaster_main, broadcaster) != 0) {
+        return false;
+    }
+    queue->running = true;
+    return true;
+}
+
+/**
+ * Ends the event loop once the submitted transactions are taken over,
+ * waits for the broadcasters thread unless called from it
+ *
+ * @param broadcaster the broadcaster
+ */
+void dogecoin_broadcaster_stop(dogecoin_broadcaster* broadcaster)
+{
+    struct dogecoin_broadcast_queue_* queue = broadcaster->queue;
+    pthread_mutex_lock(&queue->lock);
+    queue->stop = true;
+    pthread_mutex_unlock(&queue->lock);
+    send(queue->wake[1], "s", 1, 0);
+
+    if (queue->running && !pthread_equal(pthread_self(), queue->thread)) {
+        pthread_join(queue->thread, NULL);
+        queue->running = false;
+    }
+}
+
+/**
+ * Hands a list of items to the event loop thread
+ *
+ * @return false if the broadcaster is stopping, the items are freed then
+ */
+static dogecoin_bool dogecoin_broadcaster_enqueue(dogecoin_broadcaster* broadcaster, dogecoin_broadcast_item* head, dogecoin_broadcast_item* tail)
+{
+    struct dogecoin_broadcast_queue_* queue = broadcaster->queue;
+    pthread_mutex_lock(&queue->lock);
+    dogecoin_bool stop = queue->stop;
+    if (!stop) {
+        if (queue->tail) {
+            queue->tail->next = head;
+        } else {
+            queue->head = head;
+        }
+        queue->tail = tail;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    if (stop) {
+        while (head) {
+            dogecoin_broadcast_item* next = head->next;
+            dogecoin_broadcast_item_free(head);
+            head = next;
+        }
+        return false;
+    }
+    send(queue->wake[1], "t", 1, 0);
+    return true;
+}
+
+/**
+ * Queues a batch of transactions for the next announcement
+ *
+ * @param broadcaster the broadcaster
+ * @param txs the transactions, copied
+ * @param count amount of transactions
+ *
+ * @return false if the broadcaster is stopping
+ */
+dogecoin_bool dogecoin_broadcaster_submit(dogecoin_broadcaster* broadcaster, const dogecoin_tx* const* txs, size_t count)
+{
+    /* serialized and hashed on the callers thread */
+    dogecoin_broadcast_item* head = NULL;
+    dogecoin_broadcast_item* tail = NULL;
+    size_t i;
+    for (i = 0; i < count; i++) {
+        dogecoin_broadcast_item* item = dogecoin_calloc(1, sizeof(*item));
+        item->tx_ser = cstr_new_sz(1024);
+        dogecoin_tx_serialize(item->tx_ser, txs[i]);
+        dogecoin_hash((const unsigned char*)item->tx_ser->str, item->tx_ser->len, item->txhash);
+        if (tail) {
+            tail->next = item;
+        } else {
+            head = item;
+        }
+        tail = item;
+    }
+    if (!head) return true;
+    return dogecoin_broadcaster_enqueue(broadcaster, head, tail);
+}
+
+/**
+ * Queues a serialized transaction for the next announcement
+ *
+ * @param broadcaster the broadcaster
+ * @param raw_tx the serialized transaction
+ * @param len its length
+ *
+ * @return false if it does not parse as one transaction or the broadcaster is stopping
+ */
+dogecoin_bool dogecoin_broadcaster_submit_raw(dogecoin_broadcaster* broadcaster, const unsigned char* raw_tx, size_t len)
+{
+    dogecoin_tx* tx = dogecoin_tx_new();
+    size_t consumed = 0;
+    dogecoin_bool valid = dogecoin_tx_deserialize(raw_tx, len, tx, &consumed) && consumed == len;
+    dogecoin_tx_free(tx);
+    if (!valid) return false;
+
+    /* relayed as given */
+    dogecoin_broadcast_item* item = dogecoin_calloc(1, sizeof(*item));
+    item->tx_ser = cstr_new_buf(raw_tx, len);
+    dogecoin_hash(raw_tx, len, item->txhash);
+    return dogecoin_broadcaster_enqueue(broadcaster, item, item);
+}
+
+/**
+ * Returns the amount of tracked transactions
+ *
+ * @param broadcaster the broadcaster
+ *
+ * @return size_t
+ */
+size_t dogecoin_broadcaster_tracked(const dogecoin_broadcaster* broadcaster)
+{
+    return broadcaster->txs->len;
+}
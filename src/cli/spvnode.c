@@ -192,6 +192,9 @@ static struct option long_options[] = {
         {"master_key", no_argument, NULL, 'k'},
         {"http_server", required_argument, NULL, 'u'},
         {"daemon", no_argument, NULL, 'z'},
+        {"bloom_filter", no_argument, NULL, 'e'},
+        {"worker", no_argument, NULL, 'g'},
+        {"parallel_sync", no_argument, NULL, 'o'},
         {NULL, 0, NULL, 0} };
 
 /**
@@ -209,7 +212,7 @@ static void print_usage() {
     printf("Usage: spvnode (-c|continuous) (-i|--ips <ip,ip,...>) (-m[--maxpeers] <int>) (-f <headersfile|0 for in mem only>) \
 (-a|--address <address>) (-n|--mnemonic <seed_phrase>) (-s|[--pass_phrase]) (-y|--encrypted_file <file_num 0-999>) \
 (-w|--wallet_file <filename>) (-h|--headers_file <filename>) (-l|[--no_prompt]) (-b[--full_sync]) (-p[--checkpoint]) (-k[--master_key]) (-j[--use_tpm]) \
-(-u|--http_server <ip:port>) (-t[--testnet]) (-r[--regtest]) (-d[--debug]) <command>\n");
+(-e[--bloom_filter]) (-g[--worker]) (-o[--parallel_sync]) (-u|--http_server <ip:port>) (-t[--testnet]) (-r[--regtest]) (-d[--debug]) <command>\n");
     printf("Supported commands:\n");
     printf("        scan      (scan blocks up to the tip, creates header.db file)\n");
     printf("\nExamples: \n");
@@ -233,6 +236,8 @@ static void print_usage() {
     printf("> ./spvnode -d -f 0 -c -y 0 -s -b scan\n\n");
     printf("Sync up, with encrypted mnemonic 0, BIP39 passphrase, show debug info, don't store headers in file, wait for new blocks, use TPM:\n");
     printf("> ./spvnode -d -f 0 -c -y 0 -s -j -b scan\n\n");
+    printf("Sync up, with an address, download merkleblocks and matched transactions only (BIP37):\n");
+    printf("> ./spvnode -f 0 -a \"DSVw8wkkTXccdq78etZ3UwELrmpfvAiVt1\" -e -b scan\n\n");
     printf("Sync up, with encrypted key 0, show debug info, don't store headers in file, wait for new blocks, use master key:\n");
     printf("> ./spvnode -d -f 0 -c -y 0 -k -b scan\n\n");
     printf("Sync up, with encrypted key 0, show debug info, don't store headers in file, wait for new blocks, use master key, use TPM:\n");
@@ -320,6 +325,9 @@ int main(int argc, char* argv[]) {
     dogecoin_bool encrypted = false;
     dogecoin_bool master_key = false;
     dogecoin_bool tpm = false;
+    dogecoin_bool bloom_filter = false;
+    dogecoin_bool worker = false;
+    dogecoin_bool parallel_sync = false;
     char* http_server = NULL;
     int file_num = NO_FILE;
 
@@ -331,7 +339,7 @@ int main(int argc, char* argv[]) {
     data = argv[argc - 1];
 
     /* get arguments */
-    while ((opt = getopt_long_only(argc, argv, "i:ctrdsm:n:f:y:u:w:h:a:lbpzkj:", long_options, &long_index)) != -1) {
+    while ((opt = getopt_long_only(argc, argv, "i:ctrdsm:n:f:y:u:w:h:a:lbpzkj:ego", long_options, &long_index)) != -1) {
         switch (opt) {
                 case 'c':
                     quit_when_synced = false;
@@ -398,6 +406,15 @@ int main(int argc, char* argv[]) {
                 case 'z':
                     have_decl_daemon = true;
                     break;
+                case 'e':
+                    bloom_filter = true;
+                    break;
+                case 'g':
+                    worker = true;
+                    break;
+                case 'o':
+                    parallel_sync = true;
+                    break;
                 case 'v':
                     print_version();
                     exit(EXIT_SUCCESS);
@@ -416,6 +433,12 @@ int main(int argc, char* argv[]) {
         }
         client->header_message_processed = spv_header_message_processed;
         client->sync_completed = spv_sync_completed;
+        if (full_sync && parallel_sync) {
+            client->stateflags |= SPV_PARALLEL_BLOCK_SYNC_FLAG;
+        }
+        if (worker && !dogecoin_node_group_start_worker(client->nodegroup)) {
+            printf("Could not start the validation worker, validating on the network thread\n");
+        }
         signal(SIGINT, handle_sigint);
 
 #if WITH_WALLET
@@ -437,8 +460,15 @@ int main(int argc, char* argv[]) {
             dogecoin_free(pass);
             }
         print_utxos(wallet);
-        client->sync_transaction = dogecoin_wallet_check_transaction;
+        client->sync_transaction_view = dogecoin_wallet_check_transaction_view;
+        client->block_disconnected = dogecoin_wallet_block_disconnected;
         client->sync_transaction_ctx = wallet;
+        if (bloom_filter) {
+            uint32_t tweak = 0;
+            dogecoin_random_bytes((uint8_t*)&tweak, sizeof(tweak), 0);
+            client->filtered_block_connected = dogecoin_wallet_filtered_block_connected;
+            dogecoin_spv_client_set_bloom_filter(client, dogecoin_wallet_bloom_filter_new(wallet, 0.0001, tweak));
+        }
 #endif
         char* header_suffix = "_headers.db";
         char* header_prefix = (char*)chain->chainname;
@@ -549,31 +579,41 @@ int main(int argc, char* argv[]) {
 
         char *ptr;
         char* temp_address_copy = address_copy;
+        dogecoin_wallet* handle = NULL;
 
         while((ptr = strtok_r(temp_address_copy, delim, &temp_address_copy))) {
             int res = dogecoin_register_watch_address_with_node(ptr);
             printf("registered:     %d %s\n", res, ptr);
-            uint64_t amount = dogecoin_get_balance(ptr);
+            // registering rewrote the wallet file, reload the handle once per address
+            if (!handle) {
+                handle = dogecoin_wallet_open(ptr);
+            } else if (!dogecoin_wallet_refresh(handle)) {
+                dogecoin_wallet_close(handle);
+                handle = NULL;
+            }
+            uint64_t amount = handle ? dogecoin_wallet_address_balance(handle, ptr) : 0;
             if (amount > 0) {
-                char* amount_str = dogecoin_get_balance_str(ptr);
+                char amount_str[21];
+                koinu_to_coins_str(amount, amount_str);
                 printf("total:          %s\n", amount_str);
-                unsigned int utxo_count = dogecoin_get_utxos_length(ptr);
+                unsigned int utxo_count = dogecoin_wallet_address_utxos_length(handle, ptr);
                 if (utxo_count) {
                     printf("utxo count:     %d\n", utxo_count);
                     unsigned int i = 1;
                     for (; i <= utxo_count; i++) {
-                        printf("txid:           %s\n", dogecoin_get_utxo_txid_str(ptr, i));
-                        printf("vout:           %d\n", dogecoin_get_utxo_vout(ptr, i));
-                        char* utxo_amount_str = dogecoin_get_utxo_amount(ptr, i);
+                        dogecoin_utxo* utxo = dogecoin_wallet_address_utxo(handle, ptr, i);
+                        printf("txid:           %s\n", utils_uint8_to_hex(utxo->txid, DOGECOIN_HASH_LENGTH));
+                        char utxo_amount_str[KOINU_STRINGLEN];
+                        dogecoin_utxo_get_amount_str(utxo, utxo_amount_str);
+                        printf("vout:           %u\n", utxo->vout);
                         printf("amount:         %s\n", utxo_amount_str);
-                        dogecoin_free(utxo_amount_str);
                     }
                 }
-                dogecoin_free(amount_str);
             }
             res = dogecoin_unregister_watch_address_with_node(ptr);
             printf("unregistered:   %s\n", res ? "true" : "false");
         }
+        dogecoin_wallet_close(handle);
 
         if ((file = fopen("tmp.bin", "r"))) {
             fclose(file);
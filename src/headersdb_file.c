@@ -27,17 +27,43 @@
 */
 
 #include <sys/stat.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#include <windows.h>
+#endif
+#ifdef _MSC_VER
+#define HAVE_STRUCT_TIMESPEC
+#include <win/pthread.h>
+#else
+#include <pthread.h>
+#endif
 
 #include <dogecoin/headersdb_file.h>
 #include <dogecoin/blockchain.h>
 #include <dogecoin/common.h>
+#include <dogecoin/hash.h>
 #include <dogecoin/pow.h>
+#include <dogecoin/scrypt.h>
 #include <dogecoin/serialize.h>
+#include <dogecoin/tx.h>
 #include <dogecoin/utils.h>
 #include <dogecoin/validation.h>
 
 static const unsigned char file_hdr_magic[4] = {0xA8, 0xF0, 0x11, 0xC5}; /* header magic */
-static const uint32_t current_version = 3; /* 3: added chainwork */
+static const uint32_t current_version = 4; /* 3: added chainwork, 4: height indexed records */
+static const uint32_t height_indexed_version = 4;
+static const size_t file_hdr_len = sizeof(file_hdr_magic) + sizeof(current_version);
+
+static void dogecoin_headers_db_unmap(dogecoin_headers_db* db);
+static dogecoin_bool dogecoin_headers_db_truncate(dogecoin_headers_db* db, uint32_t records);
+static dogecoin_bool dogecoin_headers_db_sync_tip(dogecoin_headers_db* db);
+static dogecoin_bool dogecoin_headers_db_flush_due(dogecoin_headers_db* db);
+static void dogecoin_headers_db_pow_pool_free(struct dogecoin_headers_db_pow_pool_ *pool);
+static unsigned int dogecoin_headers_db_cpu_count(void);
 
 /**
  * "Compare two block headers by their hashes."
@@ -71,6 +97,36 @@ int dogecoin_header_compare(const void *l, const void *r)
     return 0;
 }
 
+/**
+ * Adds a blockindex to the lookup index (hash table or binary tree)
+ *
+ * @param db The headers database.
+ * @param blockindex The blockindex to add.
+ */
+static void dogecoin_headers_db_index_add(dogecoin_headers_db* db, dogecoin_blockindex *blockindex) {
+    if (db->use_hash_index) {
+        dogecoin_blockindex_map_insert(db->hash_index, blockindex);
+    }
+    if (db->use_binary_tree) {
+        dogecoin_btree_tsearch(blockindex, &db->tree_root, dogecoin_header_compare);
+    }
+}
+
+/**
+ * Removes a blockindex from the lookup index (hash table or binary tree)
+ *
+ * @param db The headers database.
+ * @param blockindex The blockindex to remove.
+ */
+static void dogecoin_headers_db_index_remove(dogecoin_headers_db* db, dogecoin_blockindex *blockindex) {
+    if (db->use_hash_index) {
+        dogecoin_blockindex_map_remove(db->hash_index, blockindex->hash);
+    }
+    if (db->use_binary_tree) {
+        dogecoin_btree_tdelete(blockindex, &db->tree_root, dogecoin_header_compare);
+    }
+}
+
 /**
  * The function creates a new dogecoin_headers_db object and initializes it
  *
@@ -83,9 +139,17 @@ dogecoin_headers_db* dogecoin_headers_db_new(const dogecoin_chainparams* chainpa
     dogecoin_headers_db* db;
     db = dogecoin_calloc(1, sizeof(*db));
     db->read_write_file = !inmem_only;
-    db->use_binary_tree = true;
+    db->use_binary_tree = false;
+    db->use_hash_index = true;
     db->max_hdr_in_mem = 1440;
     db->params = chainparams;
+    db->use_mmap = true;
+    db->write_buffer = cstr_new_sz(DOGECOIN_HEADERS_DB_RECORD_SIZE);
+    db->batch_active = false;
+    db->flush_interval = 0;
+    db->last_flush = time(NULL);
+    db->pow_threads = dogecoin_headers_db_cpu_count() - 1;
+    db->pow_pool = NULL;
     db->genesis.height = 0;
     db->genesis.prev = NULL;
     memcpy_safe(db->genesis.hash, chainparams->genesisblockhash, DOGECOIN_HASH_LENGTH);
@@ -96,6 +160,9 @@ dogecoin_headers_db* dogecoin_headers_db_new(const dogecoin_chainparams* chainpa
     if (db->use_binary_tree) {
         db->tree_root = 0;
     }
+    if (db->use_hash_index) {
+        db->hash_index = dogecoin_blockindex_map_new(db->max_hdr_in_mem * 2);
+    }
 
     return db;
 }
@@ -110,6 +177,15 @@ void dogecoin_headers_db_free(dogecoin_headers_db* db) {
     if (!db)
         return;
 
+    // write out records that are still waiting for a group commit
+    dogecoin_headers_db_flush(db);
+    dogecoin_headers_db_unmap(db);
+
+    if (db->pow_pool) {
+        dogecoin_headers_db_pow_pool_free(db->pow_pool);
+        db->pow_pool = NULL;
+    }
+
     if (db->headers_tree_file)
     {
         fclose(db->headers_tree_file);
@@ -117,16 +193,301 @@ void dogecoin_headers_db_free(dogecoin_headers_db* db) {
     }
 
     if (db->tree_root) {
-        dogecoin_btree_tdestroy(db->tree_root, dogecoin_free);
+        dogecoin_btree_tdestroy(db->tree_root, db->hash_index ? NULL : dogecoin_free);
         db->tree_root = NULL;
     }
 
+    if (db->hash_index) {
+        dogecoin_blockindex_map_free(db->hash_index, dogecoin_free);
+        db->hash_index = NULL;
+    }
+
+    if (db->write_buffer) {
+        cstr_free(db->write_buffer, true);
+        db->write_buffer = NULL;
+    }
+
     db->chaintip = NULL;
     db->chainbottom = NULL;
 
     dogecoin_free(db);
 }
 
+/**
+ * Releases the memory mapping of a height indexed headers file
+ *
+ * @param db The headers database.
+ */
+static void dogecoin_headers_db_unmap(dogecoin_headers_db* db) {
+#ifndef _WIN32
+    if (db->map_base) {
+        munmap(db->map_base, db->map_len);
+    }
+#endif
+    db->map_base = NULL;
+    db->map_len = 0;
+}
+
+/**
+ * Maps the headers file into memory. The mapping is reserved with some
+ * headroom beyond the current end of file so appended records become
+ * visible without remapping on every new header. On platforms without
+ * mmap the records are read through the file handle instead.
+ *
+ * @param db The headers database.
+ *
+ * @return true if the file is mapped, false otherwise.
+ */
+static dogecoin_bool dogecoin_headers_db_remap(dogecoin_headers_db* db) {
+    dogecoin_headers_db_unmap(db);
+#ifndef _WIN32
+    struct stat st;
+    if (!db->headers_tree_file || fstat(fileno(db->headers_tree_file), &st) != 0) {
+        return false;
+    }
+    size_t len = (size_t)st.st_size + 65536 * DOGECOIN_HEADERS_DB_RECORD_SIZE;
+    void *base = mmap(NULL, len, PROT_READ, MAP_SHARED, fileno(db->headers_tree_file), 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    db->map_base = base;
+    db->map_len = len;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Copies the record with the given index (not height) from the headers file
+ *
+ * @param db The headers database.
+ * @param index The zero based index of the record.
+ * @param rec The buffer to copy the record into.
+ *
+ * @return true if the record could be read, false otherwise.
+ */
+static dogecoin_bool dogecoin_headers_db_read_record_at(dogecoin_headers_db* db, uint32_t index, uint8_t *rec) {
+    size_t offset = file_hdr_len + (size_t)index * DOGECOIN_HEADERS_DB_RECORD_SIZE;
+    if (offset + DOGECOIN_HEADERS_DB_RECORD_SIZE > db->map_len) {
+        fflush(db->headers_tree_file);
+        dogecoin_headers_db_remap(db);
+    }
+    if (db->map_base && offset + DOGECOIN_HEADERS_DB_RECORD_SIZE <= db->map_len) {
+        memcpy(rec, db->map_base + offset, DOGECOIN_HEADERS_DB_RECORD_SIZE);
+        return true;
+    }
+    if (fseek(db->headers_tree_file, (long)offset, SEEK_SET) != 0) {
+        return false;
+    }
+    return fread(rec, DOGECOIN_HEADERS_DB_RECORD_SIZE, 1, db->headers_tree_file) == 1;
+}
+
+/**
+ * Decodes a headers file record into a blockindex (without the prev link)
+ *
+ * @param rec The raw record.
+ * @param blockindex The blockindex to fill.
+ *
+ * @return true if the record could be decoded, false otherwise.
+ */
+static dogecoin_bool dogecoin_headers_db_parse_record(const uint8_t *rec, dogecoin_blockindex *blockindex) {
+    struct const_buffer cbuf = {rec, DOGECOIN_HEADERS_DB_RECORD_SIZE};
+    return deser_u256(blockindex->hash, &cbuf) &&
+           deser_u32(&blockindex->height, &cbuf) &&
+           deser_u256(blockindex->chainwork, &cbuf) &&
+           deser_s32(&blockindex->header.version, &cbuf) &&
+           deser_u256(blockindex->header.prev_block, &cbuf) &&
+           deser_u256(blockindex->header.merkle_root, &cbuf) &&
+           deser_u32(&blockindex->header.timestamp, &cbuf) &&
+           deser_u32(&blockindex->header.bits, &cbuf) &&
+           deser_u32(&blockindex->header.nonce, &cbuf);
+}
+
+/**
+ * Serializes a blockindex into the on-disk record format
+ *
+ * @param rec The cstring to append the record to.
+ * @param blockindex The blockindex to serialize.
+ */
+static void dogecoin_headers_db_serialize_record(cstring *rec, const dogecoin_blockindex *blockindex) {
+    ser_u256(rec, blockindex->hash);
+    ser_u32(rec, blockindex->height);
+    ser_u256(rec, blockindex->chainwork);
+    dogecoin_block_header_serialize(rec, &blockindex->header);
+}
+
+/**
+ * Truncates a height indexed headers file to the given amount of records
+ *
+ * @param db The headers database.
+ * @param records The amount of records to keep.
+ *
+ * @return true if the file was truncated, false otherwise.
+ */
+static dogecoin_bool dogecoin_headers_db_truncate(dogecoin_headers_db* db, uint32_t records) {
+    long size = (long)(file_hdr_len + (size_t)records * DOGECOIN_HEADERS_DB_RECORD_SIZE);
+    fflush(db->headers_tree_file);
+#ifdef _WIN32
+    int res = _chsize_s(_fileno(db->headers_tree_file), size);
+#else
+    int res = ftruncate(fileno(db->headers_tree_file), size);
+#endif
+    if (res != 0) {
+        return false;
+    }
+    db->records = records;
+    dogecoin_file_commit(db->headers_tree_file);
+    return true;
+}
+
+/**
+ * Returns the height of the last header stored in a height indexed headers
+ * file (or the chain bottom if the file holds no records yet)
+ *
+ * @param db The headers database.
+ *
+ * @return The height of the last record on disk.
+ */
+static uint32_t dogecoin_headers_db_disk_height(dogecoin_headers_db* db) {
+    return db->records ? db->first_height + db->records - 1 : db->chainbottom->height;
+}
+
+/**
+ * Writes all main chain headers that are not yet on disk to a height
+ * indexed headers file, each one at the slot of its height. Usually this
+ * is only the new tip, after a reorg it is the new branch above the fork
+ * point (the old branch was already truncated by disconnecting it).
+ * All records are serialized into one buffer and written with a single
+ * write and fsync, so a crash leaves at most a partial trailing batch.
+ *
+ * @param db The headers database.
+ *
+ * @return true if all records were written, false otherwise.
+ */
+static dogecoin_bool dogecoin_headers_db_sync_tip(dogecoin_headers_db* db) {
+    uint32_t disk_height = dogecoin_headers_db_disk_height(db);
+    if (db->chaintip->height <= disk_height) {
+        return true;
+    }
+
+    uint32_t count = db->chaintip->height - disk_height;
+    dogecoin_blockindex **pending = dogecoin_calloc(count, sizeof(dogecoin_blockindex *));
+    dogecoin_blockindex *scan = db->chaintip;
+    uint32_t i = count;
+    while (i > 0 && scan) {
+        pending[--i] = scan;
+        scan = scan->prev;
+    }
+
+    dogecoin_bool ret = (i == 0);
+    if (ret && db->records == 0) {
+        db->first_height = pending[0]->height;
+    }
+    if (ret && fseek(db->headers_tree_file, (long)(file_hdr_len + (size_t)db->records * DOGECOIN_HEADERS_DB_RECORD_SIZE), SEEK_SET) != 0) {
+        ret = false;
+    }
+
+    cstr_resize(db->write_buffer, 0);
+    for (i = 0; ret && i < count; i++) {
+        dogecoin_headers_db_serialize_record(db->write_buffer, pending[i]);
+    }
+    if (ret && fwrite(db->write_buffer->str, db->write_buffer->len, 1, db->headers_tree_file) != 1) {
+        ret = false;
+    }
+    if (ret) {
+        db->records += count;
+    }
+    cstr_resize(db->write_buffer, 0);
+    dogecoin_free(pending);
+    dogecoin_file_commit(db->headers_tree_file);
+    return ret;
+}
+
+/**
+ * Loads a height indexed headers file. Only the most recent headers (up to
+ * max_hdr_in_mem) are materialized as blockindex objects, older headers are
+ * served from the mapping on demand. No proof of work is re-validated since
+ * the records were validated before they were written.
+ *
+ * @param db The headers database.
+ * @param file_size The size of the headers file in bytes.
+ *
+ * @return true if the file could be loaded, false otherwise.
+ */
+static dogecoin_bool dogecoin_headers_db_load_records(dogecoin_headers_db* db, uint64_t file_size) {
+    uint64_t records = (file_size - file_hdr_len) / DOGECOIN_HEADERS_DB_RECORD_SIZE;
+    if ((file_size - file_hdr_len) % DOGECOIN_HEADERS_DB_RECORD_SIZE != 0) {
+        // drop a partially written record (e.g. after a crash), the remaining prefix is consistent
+        if (!dogecoin_headers_db_truncate(db, (uint32_t)records)) {
+            fprintf(stderr, "Error truncating database file\n");
+            return false;
+        }
+    }
+    db->records = (uint32_t)records;
+    dogecoin_headers_db_remap(db);
+    if (db->records == 0) {
+        printf("\nConnected 0 headers, now at height: %d\n", db->chaintip->height);
+        return true;
+    }
+
+    uint8_t rec[DOGECOIN_HEADERS_DB_RECORD_SIZE];
+    dogecoin_blockindex first;
+    dogecoin_mem_zero(&first, sizeof(first));
+    if (!dogecoin_headers_db_read_record_at(db, 0, rec) || !dogecoin_headers_db_parse_record(rec, &first)) {
+        fprintf(stderr, "Error reading database file\n");
+        return false;
+    }
+    db->first_height = first.height;
+
+    uint32_t in_mem = db->records;
+    if (db->max_hdr_in_mem > 0 && in_mem > db->max_hdr_in_mem) {
+        in_mem = db->max_hdr_in_mem;
+    }
+
+    dogecoin_blockindex *prev = NULL;
+    uint32_t i;
+    for (i = db->records - in_mem; i < db->records; i++) {
+        dogecoin_blockindex *blockindex = dogecoin_calloc(1, sizeof(dogecoin_blockindex));
+        uint256_t hash;
+        dogecoin_bool valid = dogecoin_headers_db_read_record_at(db, i, rec) && dogecoin_headers_db_parse_record(rec, blockindex);
+        if (valid) {
+            dogecoin_block_header_hash(&blockindex->header, hash);
+            valid = blockindex->height == db->first_height + i &&
+                    memcmp(hash, blockindex->hash, DOGECOIN_HASH_LENGTH) == 0 &&
+                    (!prev || memcmp(blockindex->header.prev_block, prev->hash, DOGECOIN_HASH_LENGTH) == 0);
+        }
+        if (!valid) {
+            dogecoin_free(blockindex);
+            if (!prev) {
+                fprintf(stderr, "\nError: Invalid data found at record %u.\n", i);
+                return false;
+            }
+            // a torn group commit, keep the consistent prefix
+            fprintf(stderr, "\nDropping %u incomplete records.\n", db->records - i);
+            if (!dogecoin_headers_db_truncate(db, i)) {
+                fprintf(stderr, "Error truncating database file\n");
+                return false;
+            }
+            break;
+        }
+        if (!prev) {
+            if (blockindex->height == 1 && memcmp(blockindex->header.prev_block, db->genesis.hash, DOGECOIN_HASH_LENGTH) == 0) {
+                blockindex->prev = &db->genesis;
+            }
+            db->chainbottom = blockindex;
+        } else {
+            blockindex->prev = prev;
+        }
+        dogecoin_headers_db_index_add(db, blockindex);
+        prev = blockindex;
+    }
+    db->chaintip = prev;
+
+    printf("\nLoaded %u headers, now at height: %d\n", db->records, db->chaintip->height);
+    return true;
+}
+
 /**
  * Loads the headers database from disk
  *
@@ -181,13 +542,19 @@ dogecoin_bool dogecoin_headers_db_load(dogecoin_headers_db* db, const char *file
         }
     }
 
-    db->headers_tree_file = fopen(file_path_local, create ? "a+b" : "r+b");
+    // height indexed files are rewritten in place, so they can't be opened in append mode
+    db->headers_tree_file = fopen(file_path_local, create ? (db->use_mmap ? "w+b" : "a+b") : "r+b");
     cstr_free(path_ret, true);
+    if (!db->headers_tree_file) {
+        fprintf(stderr, "Error opening database file\n");
+        return false;
+    }
     if (create) {
         // write file-header-magic
         fwrite(file_hdr_magic, 4, 1, db->headers_tree_file);
-        uint32_t v = htole32(current_version);
+        uint32_t v = htole32(db->use_mmap ? height_indexed_version : 3);
         fwrite(&v, sizeof(v), 1, db->headers_tree_file); /* uint32_t, LE */
+        dogecoin_file_commit(db->headers_tree_file);
     } else {
         // check file-header-magic
         uint8_t buf[sizeof(file_hdr_magic)+sizeof(current_version)];
@@ -198,10 +565,18 @@ dogecoin_bool dogecoin_headers_db_load(dogecoin_headers_db* db, const char *file
             fprintf(stderr, "Error reading database file\n");
             return false;
         }
-        if (le32toh(*(buf+sizeof(file_hdr_magic))) > current_version) {
+        uint32_t version;
+        memcpy(&version, buf+sizeof(file_hdr_magic), sizeof(version));
+        version = le32toh(version);
+        if (version > current_version) {
             fprintf(stderr, "Unsupported file version\n");
             return false;
         }
+        // the storage mode follows the existing file, not the db default
+        db->use_mmap = (version == height_indexed_version);
+        if (db->use_mmap) {
+            return dogecoin_headers_db_load_records(db, (uint64_t)buffer.st_size);
+        }
     }
     dogecoin_bool firstblock = true;
     size_t connected_headers_count = 0;
@@ -243,9 +618,7 @@ dogecoin_bool dogecoin_headers_db_load(dogecoin_headers_db* db, const char *file
                     dogecoin_block_header_hash(&chainheader->header, (uint8_t *)&chainheader->hash);
                     chainheader->prev = NULL;
                     db->chaintip = chainheader;
-                    if (db->use_binary_tree) {
-                        dogecoin_btree_tsearch(chainheader, &db->tree_root, dogecoin_header_compare);
-                    }
+                    dogecoin_headers_db_index_add(db, chainheader);
                     firstblock = false;
                 } else {
                     dogecoin_blockindex *pindex = dogecoin_headers_db_connect_hdr(db, &cbuf_all, true, &connected);
@@ -261,31 +634,399 @@ dogecoin_bool dogecoin_headers_db_load(dogecoin_headers_db* db, const char *file
                 memcpy(db->chaintip->chainwork, chainwork, sizeof(uint256_t));
             }
         }
+        if ((buffer.st_size - file_hdr_len) % DOGECOIN_HEADERS_DB_RECORD_SIZE != 0) {
+            // drop a partially written record so new records are appended at a record boundary
+            uint32_t records = (uint32_t)((buffer.st_size - file_hdr_len) / DOGECOIN_HEADERS_DB_RECORD_SIZE);
+            if (!dogecoin_headers_db_truncate(db, records) || fseek(db->headers_tree_file, 0, SEEK_END) != 0) {
+                fprintf(stderr, "Error truncating database file\n");
+                return false;
+            }
+            db->records = 0;
+        }
     }
     printf("\nConnected %ld headers, now at height: %d\n",  connected_headers_count, db->chaintip->height);
     return (db->headers_tree_file != NULL);
 }
 
 /**
- * The function takes a block index and writes it to the headers database
+ * The function takes a block index and queues it for the headers database,
+ * the record is written right away unless a group commit is pending
  *
  * @param db the headers database
  * @param blockindex The block index to write to the database.
  *
- * @return Nothing.
+ * @return true if the record was written or queued, false on a write error.
  */
 dogecoin_bool dogecoin_headers_db_write(dogecoin_headers_db* db, dogecoin_blockindex *blockindex) {
-    cstring *rec = cstr_new_sz(148); // hash + height + chainwork + header
-    ser_u256(rec, blockindex->hash);
-    ser_u32(rec, blockindex->height);
-    ser_u256(rec, blockindex->chainwork);
-    dogecoin_block_header_serialize(rec, &blockindex->header);
-    size_t res = fwrite(rec->str, rec->len, 1, db->headers_tree_file);
+    dogecoin_headers_db_serialize_record(db->write_buffer, blockindex);
+    if (!dogecoin_headers_db_flush_due(db)) {
+        return true;
+    }
+    return dogecoin_headers_db_flush(db);
+}
+
+/**
+ * Checks whether pending records should be written now, this is the case
+ * when no batch is open and the flush interval (if any) has elapsed.
+ *
+ * @param db The headers database.
+ *
+ * @return true if the pending records should be flushed, false otherwise.
+ */
+static dogecoin_bool dogecoin_headers_db_flush_due(dogecoin_headers_db* db) {
+    if (db->batch_active) {
+        return false;
+    }
+    return db->flush_interval == 0 || (int64_t)time(NULL) - db->last_flush >= (int64_t)db->flush_interval;
+}
+
+/**
+ * Writes all pending records to the headers file with a single write
+ * followed by a single fsync. Records are only ever appended in chain
+ * order, so an interrupted write leaves a consistent prefix on disk
+ * (a partial trailing record is dropped on the next load).
+ *
+ * @param db The headers database.
+ *
+ * @return true if the pending records were written, false otherwise.
+ */
+dogecoin_bool dogecoin_headers_db_flush(dogecoin_headers_db* db) {
+    if (!db->read_write_file || !db->headers_tree_file) {
+        return true;
+    }
+    db->last_flush = time(NULL);
+    if (db->use_mmap) {
+        return dogecoin_headers_db_sync_tip(db);
+    }
+    if (db->write_buffer->len == 0) {
+        return true;
+    }
+    size_t res = fwrite(db->write_buffer->str, db->write_buffer->len, 1, db->headers_tree_file);
     dogecoin_file_commit(db->headers_tree_file);
-    cstr_free(rec, true);
+    cstr_resize(db->write_buffer, 0);
     return (res == 1);
 }
 
+/**
+ * Starts a group commit, records of all headers connected until
+ * dogecoin_headers_db_commit_batch is called are written at once
+ * (e.g. all headers of a single headers message).
+ *
+ * @param db The headers database.
+ */
+void dogecoin_headers_db_begin_batch(dogecoin_headers_db* db) {
+    db->batch_active = true;
+}
+
+/**
+ * Ends a group commit and writes the collected records unless a flush
+ * interval is configured that has not yet elapsed.
+ *
+ * @param db The headers database.
+ *
+ * @return true if the records were written (or are still pending), false on a write error.
+ */
+dogecoin_bool dogecoin_headers_db_commit_batch(dogecoin_headers_db* db) {
+    db->batch_active = false;
+    if (!dogecoin_headers_db_flush_due(db)) {
+        return true;
+    }
+    return dogecoin_headers_db_flush(db);
+}
+
+/* a plain (non auxpow) header of a headers message queued for proof of work verification */
+typedef struct dogecoin_headers_db_pow_item_ {
+    uint8_t header[80];
+    uint256_t hash;
+    uint256_t chainwork;
+    dogecoin_bool valid;
+} dogecoin_headers_db_pow_item;
+
+struct dogecoin_headers_db_pow_pool_ {
+    pthread_t *threads;
+    unsigned int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    dogecoin_bool shutdown;
+    unsigned int lanes; /* headers hashed at once by the multi lane scrypt kernel */
+    char *scratchpad; /* scrypt scratchpad of the calling thread, each worker has its own */
+    const dogecoin_chainparams *params;
+    dogecoin_headers_db_pow_item *items;
+    size_t items_alloc;
+    size_t count;    /* items of the current batch */
+    size_t next;     /* next item to be picked up */
+    size_t done;     /* items verified */
+    size_t consumed; /* lookup position of dogecoin_headers_db_take_pow */
+};
+
+/**
+ * Returns the number of online processors
+ *
+ * @return The number of processors (at least 1).
+ */
+static unsigned int dogecoin_headers_db_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (unsigned int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned int)count : 1;
+#endif
+}
+
+/**
+ * Scrypt hashes queued headers with the multi lane kernel and checks them
+ * against their targets
+ *
+ * @param pool The proof of work pool.
+ * @param items The queued headers, receive the results.
+ * @param count The amount of headers (at most pool->lanes).
+ * @param scratchpad The scrypt scratchpad of the calling thread.
+ */
+static void dogecoin_headers_db_pow_verify_items(struct dogecoin_headers_db_pow_pool_ *pool, dogecoin_headers_db_pow_item *items, size_t count, char *scratchpad) {
+    char input[SCRYPT_MAX_LANES * 80];
+    uint256_t hashes[SCRYPT_MAX_LANES];
+    size_t i;
+    for (i = 0; i < count; i++) {
+        memcpy(input + i * 80, items[i].header, 80);
+    }
+    // lanes past the last header never reach a kernel, keep them defined anyway
+    memset(input + count * 80, 0, (SCRYPT_MAX_LANES - count) * 80);
+    scrypt_1024_1_1_256_batch(input, (char *)hashes, count, pool->lanes, scratchpad);
+    for (i = 0; i < count; i++) {
+        uint32_t bits;
+        memcpy(&bits, items[i].header + 72, sizeof(bits));
+        items[i].valid = check_pow(&hashes[i], le32toh(bits), pool->params, &items[i].chainwork);
+    }
+}
+
+/**
+ * Verifies queued headers until the current batch is exhausted, the pool
+ * lock must be held and is released while hashing
+ *
+ * @param pool The proof of work pool.
+ * @param scratchpad The scrypt scratchpad of the calling thread.
+ */
+static void dogecoin_headers_db_pow_drain(struct dogecoin_headers_db_pow_pool_ *pool, char *scratchpad) {
+    while (pool->next < pool->count) {
+        dogecoin_headers_db_pow_item *items = &pool->items[pool->next];
+        size_t count = pool->count - pool->next;
+        if (count > pool->lanes) {
+            count = pool->lanes;
+        }
+        pool->next += count;
+        pthread_mutex_unlock(&pool->lock);
+        dogecoin_headers_db_pow_verify_items(pool, items, count, scratchpad);
+        pthread_mutex_lock(&pool->lock);
+        pool->done += count;
+        if (pool->done == pool->count) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+}
+
+static void *dogecoin_headers_db_pow_worker(void *arg) {
+    struct dogecoin_headers_db_pow_pool_ *pool = arg;
+    char *scratchpad = dogecoin_malloc(SCRYPT_LANES_SCRATCHPAD_SIZE(pool->lanes));
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->shutdown) {
+        if (pool->next < pool->count) {
+            dogecoin_headers_db_pow_drain(pool, scratchpad);
+        } else {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    dogecoin_free(scratchpad);
+    return NULL;
+}
+
+/**
+ * Creates the proof of work pool and starts db->pow_threads workers
+ *
+ * @param db The headers database.
+ *
+ * @return The pool.
+ */
+static struct dogecoin_headers_db_pow_pool_ *dogecoin_headers_db_pow_pool_new(dogecoin_headers_db* db) {
+    struct dogecoin_headers_db_pow_pool_ *pool = dogecoin_calloc(1, sizeof(*pool));
+    pool->params = db->params;
+    pool->lanes = scrypt_detect_lanes();
+    pool->scratchpad = dogecoin_malloc(SCRYPT_LANES_SCRATCHPAD_SIZE(pool->lanes));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    if (db->pow_threads > 0) {
+        pool->threads = dogecoin_calloc(db->pow_threads, sizeof(pthread_t));
+    }
+    unsigned int i;
+    for (i = 0; i < db->pow_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, dogecoin_headers_db_pow_worker, pool) != 0) {
+            // carry on with the workers we have, the calling thread always participates
+            break;
+        }
+        pool->thread_count++;
+    }
+    return pool;
+}
+
+static void dogecoin_headers_db_pow_pool_free(struct dogecoin_headers_db_pow_pool_ *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    unsigned int i;
+    for (i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+    if (pool->threads) dogecoin_free(pool->threads);
+    if (pool->items) dogecoin_free(pool->items);
+    dogecoin_free(pool->scratchpad);
+    dogecoin_free(pool);
+}
+
+/**
+ * Skips the auxpow payload following an auxpow block header
+ *
+ * @param buf The buffer positioned after the 80 byte header.
+ *
+ * @return true if the payload could be skipped, false otherwise.
+ */
+static dogecoin_bool dogecoin_headers_db_skip_auxpow(struct const_buffer *buf) {
+    size_t consumed = 0;
+    uint32_t count;
+    dogecoin_tx *tx = dogecoin_tx_new();
+    dogecoin_bool ret = dogecoin_tx_deserialize(buf->p, buf->len, tx, &consumed) && consumed > 0;
+    dogecoin_tx_free(tx);
+    return ret && deser_skip(buf, consumed) && deser_skip(buf, 32) && /* parent coinbase, parent hash */
+           deser_varlen(&count, buf) && deser_skip(buf, (size_t)count * 32) && deser_skip(buf, 4) && /* coinbase branch */
+           deser_varlen(&count, buf) && deser_skip(buf, (size_t)count * 32) && deser_skip(buf, 4) && /* chain branch */
+           deser_skip(buf, 80); /* parent header */
+}
+
+/**
+ * Scrypt hashes and checks the proof of work of all plain headers of a
+ * headers message in parallel. The results are consumed by
+ * dogecoin_headers_db_connect_hdr, which then only has to link the
+ * headers. Auxpow headers are left to the regular (sequential) path and
+ * already known headers are skipped.
+ *
+ * @param db The headers database.
+ * @param buf The headers message payload after the header count, it is not consumed.
+ * @param count The amount of headers in the message.
+ *
+ * @return The amount of headers verified ahead.
+ */
+size_t dogecoin_headers_db_verify_pow_batch(dogecoin_headers_db* db, const struct const_buffer *buf, uint32_t count) {
+    if (!db->pow_pool) {
+        db->pow_pool = dogecoin_headers_db_pow_pool_new(db);
+    }
+    struct dogecoin_headers_db_pow_pool_ *pool = db->pow_pool;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->items_alloc < count) {
+        pool->items = dogecoin_realloc(pool->items, count * sizeof(dogecoin_headers_db_pow_item));
+        pool->items_alloc = count;
+    }
+
+    struct const_buffer scan = *buf;
+    size_t queued = 0;
+    uint32_t i;
+    for (i = 0; i < count && scan.len >= 80; i++) {
+        dogecoin_headers_db_pow_item *item = &pool->items[queued];
+        int32_t version;
+        uint32_t tx_count;
+        memcpy(item->header, scan.p, sizeof(item->header));
+        memcpy(&version, item->header, sizeof(version));
+        deser_skip(&scan, sizeof(item->header));
+        if (is_auxpow(le32toh(version))) {
+            if (!dogecoin_headers_db_skip_auxpow(&scan)) break;
+        } else {
+            dogecoin_dblhash(item->header, sizeof(item->header), item->hash);
+            if (!dogecoin_headersdb_find(db, item->hash)) {
+                queued++;
+            }
+        }
+        if (!deser_varlen(&tx_count, &scan)) break;
+    }
+
+    pool->count = queued;
+    pool->next = 0;
+    pool->done = 0;
+    pool->consumed = 0;
+    pthread_cond_broadcast(&pool->work_cond);
+    dogecoin_headers_db_pow_drain(pool, pool->scratchpad);
+    while (pool->done < pool->count) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return queued;
+}
+
+/**
+ * Finds the hash of the last header of a headers message without
+ * validating any of them, so the next headers can be requested while
+ * the message is still being connected.
+ *
+ * @param buf The headers message payload after the header count, it is not consumed.
+ * @param count The amount of headers in the message.
+ * @param hash Receives the hash of the last header.
+ *
+ * @return true if all headers could be walked, false otherwise.
+ */
+dogecoin_bool dogecoin_headers_message_last_hash(const struct const_buffer *buf, uint32_t count, uint256_t hash) {
+    struct const_buffer scan = *buf;
+    const uint8_t *last = NULL;
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        int32_t version;
+        uint32_t tx_count;
+        if (scan.len < 80) return false;
+        last = scan.p;
+        memcpy(&version, last, sizeof(version));
+        deser_skip(&scan, 80);
+        if (is_auxpow(le32toh(version)) && !dogecoin_headers_db_skip_auxpow(&scan)) return false;
+        if (!deser_varlen(&tx_count, &scan)) return false;
+    }
+    if (!last) return false;
+    // the block hash only covers the 80 byte header, not the auxpow
+    dogecoin_dblhash(last, 80, hash);
+    return true;
+}
+
+/**
+ * Looks up the result of the parallel proof of work stage for a header
+ *
+ * @param db The headers database.
+ * @param hash The block hash of the header.
+ * @param valid Receives whether the proof of work is valid.
+ * @param chainwork Receives the work of the header.
+ *
+ * @return true if the header was verified ahead, false otherwise.
+ */
+static dogecoin_bool dogecoin_headers_db_take_pow(dogecoin_headers_db* db, const uint256_t hash, dogecoin_bool *valid, uint256_t chainwork) {
+    struct dogecoin_headers_db_pow_pool_ *pool = db->pow_pool;
+    if (!pool) {
+        return false;
+    }
+    // headers are connected in message order, so this usually matches the first candidate
+    size_t i;
+    for (i = pool->consumed; i < pool->count; i++) {
+        if (memcmp(pool->items[i].hash, hash, DOGECOIN_HASH_LENGTH) == 0) {
+            *valid = pool->items[i].valid;
+            memcpy(chainwork, pool->items[i].chainwork, sizeof(uint256_t));
+            pool->consumed = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * The function takes a pointer to a blockindex and checks if the block is in the blockchain. If it is,
  * it returns the pointer to the block. If it isn't, it returns a null pointer
@@ -336,12 +1077,16 @@ dogecoin_blockindex * dogecoin_headers_db_connect_hdr(dogecoin_headers_db* db, s
     if (connect_at != NULL) {
         // Check the proof of work
         if (!is_auxpow(blockindex->header.version)) {
-            uint256_t hash = {0};
-            cstring* s = cstr_new_sz(64);
-            dogecoin_block_header_serialize(s, (const dogecoin_block_header*) &blockindex->header);
-            dogecoin_block_header_scrypt_hash(s, &hash);
-            cstr_free(s, true);
-            if (!check_pow(&hash, blockindex->header.bits, db->params, &blockindex->chainwork)) {
+            dogecoin_bool pow_valid;
+            if (!dogecoin_headers_db_take_pow(db, blockindex->hash, &pow_valid, blockindex->chainwork)) {
+                uint256_t hash = {0};
+                cstring* s = cstr_new_sz(64);
+                dogecoin_block_header_serialize(s, (const dogecoin_block_header*) &blockindex->header);
+                dogecoin_block_header_scrypt_hash(s, &hash);
+                cstr_free(s, true);
+                pow_valid = check_pow(&hash, blockindex->header.bits, db->params, &blockindex->chainwork);
+            }
+            if (!pow_valid) {
                 printf("%s:%d:%s : non-AUX proof of work failed : %s\n", __FILE__, __LINE__, __func__, strerror(errno));
                 return blockindex;
             }
@@ -350,24 +1095,17 @@ dogecoin_blockindex * dogecoin_headers_db_connect_hdr(dogecoin_headers_db* db, s
         blockindex->prev = connect_at;
         blockindex->height = connect_at->height+1;
 
-        arith_uint256* connect_at_chainwork = init_arith_uint256();
-        memcpy(connect_at_chainwork, connect_at->chainwork, sizeof(connect_at->chainwork));
-        arith_uint256* blockindex_chainwork = init_arith_uint256();
-        memcpy(blockindex_chainwork, blockindex->chainwork, sizeof(blockindex->chainwork));
-        arith_uint256* chaintip_chainwork = init_arith_uint256();
-        memcpy(chaintip_chainwork, db->chaintip->chainwork, sizeof(db->chaintip->chainwork));
-
-        arith_uint256* added_chainwork = add_arith_uint256(connect_at_chainwork, blockindex_chainwork);
-        memcpy(blockindex->chainwork, (const arith_uint256*) added_chainwork, sizeof(blockindex->chainwork));
-
-        // Free the dynamically allocated memory
-        dogecoin_free(connect_at_chainwork);
-        dogecoin_free(blockindex_chainwork);
+        arith_uint256 connect_at_chainwork = arith_uint256_from_uint256(connect_at->chainwork);
+        arith_uint256 blockindex_chainwork = arith_uint256_from_uint256(blockindex->chainwork);
+        arith_uint256 chaintip_chainwork = arith_uint256_from_uint256(db->chaintip->chainwork);
+        arith_uint256 added_chainwork = arith_uint256_add(&connect_at_chainwork, &blockindex_chainwork);
+        arith_uint256_to_uint256(&added_chainwork, blockindex->chainwork);
+        int chainwork_cmp = arith_uint256_compare(&added_chainwork, &chaintip_chainwork);
 
         // Chain reorganization if necessary
         if (fork_from_block && blockindex->height > db->chaintip->height &&
-            (arith_uint256_greater_than(added_chainwork, chaintip_chainwork) ||
-             (arith_uint256_equal(added_chainwork, chaintip_chainwork) && blockindex->header.timestamp > db->chaintip->header.timestamp))) {
+            (chainwork_cmp > 0 ||
+             (chainwork_cmp == 0 && blockindex->header.timestamp > db->chaintip->header.timestamp))) {
 
             // Identify the common ancestor
             dogecoin_blockindex* common_ancestor = db->chaintip;
@@ -384,8 +1122,6 @@ dogecoin_blockindex * dogecoin_headers_db_connect_hdr(dogecoin_headers_db* db, s
                 // Break the loop if either reaches the start of the chain
                 if (!common_ancestor || !fork_chain) {
                     fprintf(stderr, "Unable to find common ancestor.\n");
-                    dogecoin_free(chaintip_chainwork);
-                    dogecoin_free(added_chainwork);
                     return blockindex;
                 }
             }
@@ -405,14 +1141,10 @@ dogecoin_blockindex * dogecoin_headers_db_connect_hdr(dogecoin_headers_db* db, s
                     fprintf(stderr, "Previous block in the chain not found.\n");
 
                     // Add the current_block to the tree if it's not already part of the main chain
-                    if (db->use_binary_tree && current_block != blockindex) {
-                        fprintf(stderr, "Adding block to tree.\n");
-                        dogecoin_btree_tsearch(current_block, &db->tree_root, dogecoin_header_compare);
+                    if (current_block != blockindex) {
+                        fprintf(stderr, "Adding block to index.\n");
+                        dogecoin_headers_db_index_add(db, current_block);
                     }
-
-                    // Free the dynamically allocated memory
-                    dogecoin_free(chaintip_chainwork);
-                    dogecoin_free(added_chainwork);
                     return blockindex;
                 }
 
@@ -430,19 +1162,17 @@ dogecoin_blockindex * dogecoin_headers_db_connect_hdr(dogecoin_headers_db* db, s
             db->chaintip = blockindex;
         }
 
-        // Free the dynamically allocated memory
-        dogecoin_free(chaintip_chainwork);
-        dogecoin_free(added_chainwork);
-
         if (!load_process && db->read_write_file)
         {
-            if (!dogecoin_headers_db_write(db, blockindex)) {
+            if (db->use_mmap) {
+                if (dogecoin_headers_db_flush_due(db) && !dogecoin_headers_db_flush(db)) {
+                    fprintf(stderr, "Error writing blockheader to database\n");
+                }
+            } else if (!dogecoin_headers_db_write(db, blockindex)) {
                 fprintf(stderr, "Error writing blockheader to database\n");
             }
         }
-        if (db->use_binary_tree) {
-            dogecoin_btree_tsearch(blockindex, &db->tree_root, dogecoin_header_compare);
-        }
+        dogecoin_headers_db_index_add(db, blockindex);
 
         if (db->max_hdr_in_mem > 0) {
             // de-allocate no longer required headers
@@ -459,7 +1189,13 @@ dogecoin_blockindex * dogecoin_headers_db_connect_hdr(dogecoin_headers_db* db, s
 
                 if (scan_tip && i == db->max_hdr_in_mem && scan_tip != &db->genesis) {
                     if (scan_tip->prev && scan_tip->prev != &db->genesis) {
-                        dogecoin_btree_tdelete(scan_tip->prev, &db->tree_root, dogecoin_header_compare);
+                        // pending height indexed records are serialized from memory, write them out first
+                        if (db->use_mmap && !load_process && db->read_write_file && db->headers_tree_file &&
+                            scan_tip->prev->height > dogecoin_headers_db_disk_height(db) &&
+                            !dogecoin_headers_db_flush(db)) {
+                            fprintf(stderr, "Error writing blockheader to database\n");
+                        }
+                        dogecoin_headers_db_index_remove(db, scan_tip->prev);
                         dogecoin_free(scan_tip->prev);
                         scan_tip->prev = NULL;
                         db->chainbottom = scan_tip;
@@ -510,15 +1246,18 @@ void dogecoin_headers_db_fill_block_locator(dogecoin_headers_db* db, vector_t *b
  * @return A pointer to the blockindex.
  */
 dogecoin_blockindex * dogecoin_headersdb_find(dogecoin_headers_db* db, uint256_t hash) {
+    if (db->use_hash_index)
+    {
+        return dogecoin_blockindex_map_find(db->hash_index, hash);
+    }
     if (db->use_binary_tree)
     {
-        dogecoin_blockindex *blockindex = dogecoin_calloc(1, sizeof(dogecoin_blockindex));
-        memcpy_safe(blockindex->hash, hash, sizeof(uint256_t));
-        dogecoin_blockindex *blockindex_f = dogecoin_btree_tfind(blockindex, &db->tree_root, dogecoin_header_compare); /* read */
+        dogecoin_blockindex key;
+        memcpy_safe(key.hash, hash, sizeof(uint256_t));
+        dogecoin_blockindex *blockindex_f = dogecoin_btree_tfind(&key, &db->tree_root, dogecoin_header_compare); /* read */
         if (blockindex_f) {
             blockindex_f = *(dogecoin_blockindex **)blockindex_f;
         }
-        dogecoin_free(blockindex);
         return blockindex_f;
     }
     return NULL;
@@ -548,13 +1287,34 @@ dogecoin_bool dogecoin_headersdb_disconnect_tip(dogecoin_headers_db* db) {
     {
         dogecoin_blockindex *oldtip = db->chaintip;
         db->chaintip = db->chaintip->prev;
-        dogecoin_btree_tdelete(oldtip, &db->tree_root, dogecoin_header_compare);
+        if (db->disconnect_cb) {
+            db->disconnect_cb(db->disconnect_ctx, oldtip);
+        }
+        if (db->use_mmap && db->headers_tree_file && db->records > 0 &&
+            oldtip->height >= db->first_height && oldtip->height - db->first_height < db->records) {
+            dogecoin_headers_db_truncate(db, oldtip->height - db->first_height);
+        }
+        dogecoin_headers_db_index_remove(db, oldtip);
         dogecoin_free(oldtip);
         return true;
     }
     return false;
 }
 
+/**
+ * Sets the function called for every block that gets disconnected
+ * from the main chain, directly or during a reorganization. The
+ * callback runs while the block index is still valid.
+ *
+ * @param db The headers database.
+ * @param cb The callback or NULL to remove it.
+ * @param ctx The context passed to the callback.
+ */
+void dogecoin_headers_db_set_disconnect_cb(dogecoin_headers_db* db, void (*cb)(void *ctx, const dogecoin_blockindex *pindex), void *ctx) {
+    db->disconnect_cb = cb;
+    db->disconnect_ctx = ctx;
+}
+
 /**
  * "Check if the headers database has a checkpoint start."
  *
@@ -583,3 +1343,76 @@ void dogecoin_headersdb_set_checkpoint_start(dogecoin_headers_db* db, uint256_t
     memcpy_safe(db->chainbottom->chainwork, chainwork, sizeof(uint256_t));
     db->chaintip = db->chainbottom;
 }
+
+/**
+ * Get the main chain header at the given height. With a height indexed
+ * headers file this is a single record lookup, otherwise the in-memory
+ * chain is walked from the tip.
+ *
+ * @param db The headers database.
+ * @param height The height of the header.
+ * @param blockindex The blockindex to copy the header into (prev is only set for in-memory headers).
+ *
+ * @return true if the header was found, false otherwise.
+ */
+dogecoin_bool dogecoin_headersdb_get_header_at_height(dogecoin_headers_db* db, uint32_t height, dogecoin_blockindex *blockindex) {
+    if (!db || !blockindex || height > db->chaintip->height) {
+        return false;
+    }
+
+    if (db->use_mmap && db->headers_tree_file) {
+        uint8_t rec[DOGECOIN_HEADERS_DB_RECORD_SIZE];
+        if (height >= db->first_height && height - db->first_height < db->records &&
+            dogecoin_headers_db_read_record_at(db, height - db->first_height, rec)) {
+            dogecoin_mem_zero(blockindex, sizeof(*blockindex));
+            return dogecoin_headers_db_parse_record(rec, blockindex);
+        }
+    }
+
+    dogecoin_blockindex *scan = db->chaintip;
+    while (scan && scan->height > height) {
+        scan = scan->prev;
+    }
+    if (scan && scan->height == height) {
+        *blockindex = *scan;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Get the ancestor of a blockindex at the given height. Ancestors of main
+ * chain blocks are read directly from the height index, ancestors of
+ * side chain blocks are resolved in memory down to the fork point.
+ *
+ * @param db The headers database.
+ * @param pindex The blockindex to start from.
+ * @param height The height of the requested ancestor.
+ * @param ancestor The blockindex to copy the ancestor into.
+ *
+ * @return true if the ancestor was found, false otherwise.
+ */
+dogecoin_bool dogecoin_headersdb_get_ancestor(dogecoin_headers_db* db, const dogecoin_blockindex *pindex, uint32_t height, dogecoin_blockindex *ancestor) {
+    if (!db || !pindex || !ancestor || height > pindex->height) {
+        return false;
+    }
+
+    if (db->use_mmap && db->headers_tree_file) {
+        dogecoin_blockindex main_chain;
+        if (dogecoin_headersdb_get_header_at_height(db, pindex->height, &main_chain) &&
+            memcmp(main_chain.hash, pindex->hash, DOGECOIN_HASH_LENGTH) == 0) {
+            return dogecoin_headersdb_get_header_at_height(db, height, ancestor);
+        }
+    }
+
+    const dogecoin_blockindex *scan = pindex;
+    while (scan->height > height && scan->prev) {
+        scan = scan->prev;
+    }
+    if (scan->height == height) {
+        *ancestor = *scan;
+        return true;
+    }
+    // the remaining ancestors are below the in-memory window, hence main chain
+    return dogecoin_headersdb_get_header_at_height(db, height, ancestor);
+}
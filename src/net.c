@@ -39,10 +39,12 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <windows.h>
+#include <conio.h>
 #else
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <unistd.h>
 #endif
 #include <assert.h>
 #include <inttypes.h>
@@ -58,8 +60,10 @@
 #include <event2/util.h>
 #include <event2/buffer.h>
 #include <event2/bufferevent.h>
+#include <event2/dns.h>
 #include <event2/http.h>
 
+#include <dogecoin/addrman.h>
 #include <dogecoin/buffer.h>
 #include <dogecoin/chainparams.h>
 #include <dogecoin/cstr.h>
@@ -74,6 +78,499 @@
 static const int DOGECOIN_PERIODICAL_NODE_TIMER_S = 3;
 static const int DOGECOIN_PING_INTERVAL_S = 120;
 static const int DOGECOIN_CONNECT_TIMEOUT_S = 10;
+static const int DOGECOIN_ADDRMAN_CONNECT_CANDIDATES = 32; /* nodes added from the address manager at once */
+
+static void dogecoin_node_group_resolve_seeds(dogecoin_node_group* group);
+
+/**
+ * Returns the wall clock in milliseconds, for peer latency and throughput
+ *
+ * @return uint64_t
+ */
+static uint64_t dogecoin_node_time_ms()
+{
+    struct timeval tv;
+    evutil_gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+}
+
+/* =================================== */
+/* WORKER */
+/* =================================== */
+
+enum dogecoin_worker_item_type {
+    /* event loop -> worker */
+    DOGECOIN_WORKER_MESSAGE = 0,
+    DOGECOIN_WORKER_STATE_CHANGED,
+    DOGECOIN_WORKER_TIMER,
+    /* worker -> event loop */
+    DOGECOIN_WORKER_SEND,
+    DOGECOIN_WORKER_DISCONNECT,
+    DOGECOIN_WORKER_MISBEHAVE,
+    DOGECOIN_WORKER_CONNECT_NEXT,
+    DOGECOIN_WORKER_RESOLVE_SEEDS,
+    DOGECOIN_WORKER_SHUTDOWN,
+    DOGECOIN_WORKER_DONE, /* one per processed job */
+    /* deferred on the event loop until the worker finished its job */
+    DOGECOIN_WORKER_EVENT,
+    DOGECOIN_WORKER_CALL,
+};
+
+typedef struct dogecoin_worker_item_ {
+    enum dogecoin_worker_item_type type;
+    dogecoin_node* node;
+    dogecoin_p2p_msg_hdr hdr;
+    cstring* data; /* message payload or framed message to send */
+    uint64_t now;
+    dogecoin_bool errored;
+    short events; /* bufferevent events */
+    void (*call)(void* ctx, dogecoin_bool run);
+    void* ctx;
+    struct dogecoin_worker_item_* next;
+} dogecoin_worker_item;
+
+typedef struct dogecoin_worker_queue_ {
+    dogecoin_worker_item* head;
+    dogecoin_worker_item* tail;
+} dogecoin_worker_queue;
+
+struct dogecoin_node_worker_ {
+    dogecoin_node_group* group;
+    pthread_t thread;
+    pthread_mutex_t queue_lock; /* guards both queues, stop and loop_waiting */
+    pthread_cond_t queue_cond;
+    dogecoin_worker_queue inbound;
+    dogecoin_worker_queue outbound;
+    dogecoin_bool stop;
+    dogecoin_bool loop_waiting; /* the worker pauses after its job until the deferred operations ran */
+
+    /* held by the worker while it runs callbacks and by the event loop thread
+       while it changes node state or runs its own state logic */
+    pthread_mutex_t state_lock;
+
+    evutil_socket_t wake[2]; /* the worker writes a byte to wake[1] after queuing outbound items */
+    struct event* wake_event;
+    unsigned int pending; /* jobs not acknowledged yet, event loop thread only */
+
+    /* event loop thread only: operations waiting for the state lock */
+    dogecoin_worker_queue deferred;
+    dogecoin_bool running_deferred;
+    dogecoin_bool shutdown; /* the group was shut down, operations of the worker get dropped */
+};
+
+static void dogecoin_node_handle_event(dogecoin_node* node, short type);
+
+static void dogecoin_worker_queue_push(dogecoin_worker_queue* queue, dogecoin_worker_item* item)
+{
+    item->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = item;
+    } else {
+        queue->head = item;
+    }
+    queue->tail = item;
+}
+
+static dogecoin_worker_item* dogecoin_worker_queue_pop(dogecoin_worker_queue* queue)
+{
+    dogecoin_worker_item* item = queue->head;
+    if (item) {
+        queue->head = item->next;
+        if (!queue->head) queue->tail = NULL;
+    }
+    return item;
+}
+
+static void dogecoin_worker_item_free(dogecoin_worker_item* item)
+{
+    if (item->data) cstr_free(item->data, true);
+    if (item->call) item->call(item->ctx, false);
+    dogecoin_free(item);
+}
+
+static dogecoin_worker_item* dogecoin_worker_item_new(enum dogecoin_worker_item_type type, dogecoin_node* node)
+{
+    dogecoin_worker_item* item = dogecoin_calloc(1, sizeof(*item));
+    item->type = type;
+    item->node = node;
+    return item;
+}
+
+/**
+ * Checks if the caller runs on the worker thread of the group
+ *
+ * @param group The node group.
+ *
+ * @return true if calls into the network have to be queued
+ */
+static dogecoin_bool dogecoin_node_group_on_worker(const dogecoin_node_group* group)
+{
+    return group->worker && pthread_equal(pthread_self(), group->worker->thread);
+}
+
+/**
+ * Queues a job for the worker (event loop thread), keeps the wake event
+ * registered while jobs are outstanding so the event loop does not exit
+ *
+ * @param worker The worker.
+ * @param item The job, owned by the queue afterwards.
+ */
+static void dogecoin_worker_dispatch(struct dogecoin_node_worker_* worker, dogecoin_worker_item* item)
+{
+    if (worker->pending++ == 0) {
+        event_add(worker->wake_event, NULL);
+    }
+    pthread_mutex_lock(&worker->queue_lock);
+    dogecoin_worker_queue_push(&worker->inbound, item);
+    pthread_cond_signal(&worker->queue_cond);
+    pthread_mutex_unlock(&worker->queue_lock);
+}
+
+/**
+ * Queues a network operation for the event loop thread (worker thread)
+ *
+ * @param worker The worker.
+ * @param item The operation, owned by the queue afterwards.
+ */
+static void dogecoin_worker_post(struct dogecoin_node_worker_* worker, dogecoin_worker_item* item)
+{
+    pthread_mutex_lock(&worker->queue_lock);
+    dogecoin_bool was_empty = worker->outbound.head == NULL;
+    dogecoin_worker_queue_push(&worker->outbound, item);
+    pthread_mutex_unlock(&worker->queue_lock);
+    if (was_empty) {
+        // a full socket buffer means a wakeup is pending already
+        char byte = 0;
+        send(worker->wake[1], &byte, 1, 0);
+    }
+}
+
+/**
+ * Runs a job on the worker thread
+ *
+ * @param item The job.
+ */
+static void dogecoin_worker_run(dogecoin_worker_item* item)
+{
+    dogecoin_node* node = item->node;
+    dogecoin_node_group* group = node->nodegroup;
+    if (item->type == DOGECOIN_WORKER_MESSAGE) {
+        struct const_buffer buf = {item->data->str, item->data->len};
+        dogecoin_node_parse_message(node, &item->hdr, &buf);
+    } else if (item->type == DOGECOIN_WORKER_STATE_CHANGED) {
+        if (group->node_connection_state_changed_cb) {
+            group->node_connection_state_changed_cb(node);
+        }
+        if (item->errored && group->should_connect_to_more_nodes_cb && group->should_connect_to_more_nodes_cb(node)) {
+            dogecoin_node_group_connect_next_nodes(group);
+        }
+    } else if (item->type == DOGECOIN_WORKER_TIMER) {
+        if (group->periodic_timer_cb) {
+            group->periodic_timer_cb(node, &item->now);
+        }
+    }
+}
+
+/**
+ * The worker thread, processes jobs in order until it gets stopped
+ *
+ * @param arg The worker.
+ */
+static void* dogecoin_worker_main(void* arg)
+{
+    struct dogecoin_node_worker_* worker = (struct dogecoin_node_worker_*)arg;
+    for (;;) {
+        pthread_mutex_lock(&worker->queue_lock);
+        // the event loop thread waits for the state lock, its operations go first
+        while ((!worker->inbound.head || worker->loop_waiting) && !worker->stop) {
+            pthread_cond_wait(&worker->queue_cond, &worker->queue_lock);
+        }
+        dogecoin_worker_item* item = dogecoin_worker_queue_pop(&worker->inbound);
+        pthread_mutex_unlock(&worker->queue_lock);
+        if (!item) break;
+
+        pthread_mutex_lock(&worker->state_lock);
+        dogecoin_worker_run(item);
+        pthread_mutex_unlock(&worker->state_lock);
+
+        item->type = DOGECOIN_WORKER_DONE;
+        if (item->data) {
+            cstr_free(item->data, true);
+            item->data = NULL;
+        }
+        dogecoin_worker_post(worker, item);
+    }
+    return NULL;
+}
+
+/**
+ * Frees a framed message once libevent wrote it out
+ */
+static void dogecoin_worker_cstr_cleanup(const void* data, size_t datalen, void* extra)
+{
+    UNUSED(data);
+    UNUSED(datalen);
+    cstr_free((cstring*)extra, true);
+}
+
+/**
+ * Runs an operation that changes node state, the state lock is held
+ * (event loop thread)
+ *
+ * @param worker The worker.
+ * @param item The operation.
+ */
+static void dogecoin_worker_run_deferred_item(struct dogecoin_node_worker_* worker, dogecoin_worker_item* item)
+{
+    dogecoin_node* node = item->node;
+    switch (item->type) {
+        case DOGECOIN_WORKER_DISCONNECT:
+            dogecoin_node_disconnect(node);
+            break;
+        case DOGECOIN_WORKER_MISBEHAVE:
+            dogecoin_node_misbehave(node);
+            break;
+        case DOGECOIN_WORKER_CONNECT_NEXT:
+            dogecoin_node_group_connect_next_nodes(worker->group);
+            break;
+        case DOGECOIN_WORKER_RESOLVE_SEEDS:
+            dogecoin_node_group_resolve_seeds(worker->group);
+            break;
+        case DOGECOIN_WORKER_SHUTDOWN:
+            dogecoin_node_group_shutdown(worker->group);
+            break;
+        case DOGECOIN_WORKER_EVENT:
+            dogecoin_node_handle_event(node, item->events);
+            break;
+        case DOGECOIN_WORKER_CALL:
+            item->call(item->ctx, true);
+            item->call = NULL;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Runs the deferred operations if the worker is not in the middle of
+ * a job, otherwise the worker pauses after its job and wakes the event
+ * loop (event loop thread)
+ *
+ * @param worker The worker.
+ */
+static void dogecoin_worker_run_deferred(struct dogecoin_node_worker_* worker)
+{
+    if (!worker->deferred.head || worker->running_deferred) return;
+    if (pthread_mutex_trylock(&worker->state_lock) != 0) {
+        pthread_mutex_lock(&worker->queue_lock);
+        worker->loop_waiting = true;
+        pthread_mutex_unlock(&worker->queue_lock);
+        event_add(worker->wake_event, NULL);
+        return;
+    }
+
+    worker->running_deferred = true;
+    dogecoin_worker_item* item;
+    while ((item = dogecoin_worker_queue_pop(&worker->deferred)) != NULL) {
+        // everything queued behind a shutdown gets dropped
+        if (!worker->shutdown) {
+            dogecoin_worker_run_deferred_item(worker, item);
+        }
+        dogecoin_worker_item_free(item);
+    }
+    worker->running_deferred = false;
+    pthread_mutex_unlock(&worker->state_lock);
+
+    pthread_mutex_lock(&worker->queue_lock);
+    worker->loop_waiting = false;
+    pthread_cond_broadcast(&worker->queue_cond);
+    pthread_mutex_unlock(&worker->queue_lock);
+}
+
+/**
+ * Queues an operation that changes node state behind the current job
+ * of the worker, runs it right away if the worker is idle (event loop
+ * thread)
+ *
+ * @param worker The worker.
+ * @param item The operation, owned by the queue afterwards.
+ */
+static void dogecoin_worker_defer(struct dogecoin_node_worker_* worker, dogecoin_worker_item* item)
+{
+    dogecoin_worker_queue_push(&worker->deferred, item);
+    dogecoin_worker_run_deferred(worker);
+}
+
+/**
+ * Executes the network operations queued by the worker (event loop thread),
+ * sends go out right away, state changes wait until the worker finished
+ * its job so the event loop never blocks on it
+ */
+#if defined(_WIN32) && defined(__x86_64__)
+static void dogecoin_worker_wake_cb(long long int fd, short int event, void* ctx)
+#else
+static void dogecoin_worker_wake_cb(int fd, short int event, void* ctx)
+#endif
+{
+    UNUSED(event);
+    struct dogecoin_node_worker_* worker = (struct dogecoin_node_worker_*)ctx;
+    char bytes[64];
+    while (recv(fd, bytes, sizeof(bytes), 0) > 0) {
+    }
+
+    pthread_mutex_lock(&worker->queue_lock);
+    dogecoin_worker_queue items = worker->outbound;
+    worker->outbound.head = worker->outbound.tail = NULL;
+    pthread_mutex_unlock(&worker->queue_lock);
+
+    dogecoin_worker_item* item;
+    while ((item = dogecoin_worker_queue_pop(&items)) != NULL) {
+        dogecoin_node* node = item->node;
+        if (item->type == DOGECOIN_WORKER_DONE) {
+            worker->pending--;
+        } else if (worker->shutdown) {
+            // the connections are gone
+        } else if (item->type == DOGECOIN_WORKER_SEND) {
+            if (node->connected &&
+                evbuffer_add_reference(bufferevent_get_output(node->event_bev), item->data->str, item->data->len, dogecoin_worker_cstr_cleanup, item->data) == 0) {
+                node->nodegroup->log_write_cb("sending message to node %d: %s\n", node->nodeid, item->data->str + 4);
+                item->data = NULL;
+            }
+        } else {
+            dogecoin_worker_queue_push(&worker->deferred, item);
+            continue;
+        }
+        dogecoin_worker_item_free(item);
+    }
+    dogecoin_worker_run_deferred(worker);
+
+    if (worker->pending == 0 && !worker->deferred.head) {
+        event_del(worker->wake_event);
+    }
+}
+
+/**
+ * Starts a worker thread for the callbacks of the group
+ *
+ * @param group The node group, not connected yet.
+ *
+ * @return true if the worker is running
+ */
+dogecoin_bool dogecoin_node_group_start_worker(dogecoin_node_group* group)
+{
+    if (group->worker) return true;
+    struct dogecoin_node_worker_* worker = dogecoin_calloc(1, sizeof(*worker));
+    worker->group = group;
+    if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, worker->wake) != 0) {
+        dogecoin_free(worker);
+        return false;
+    }
+    evutil_make_socket_nonblocking(worker->wake[0]);
+    evutil_make_socket_nonblocking(worker->wake[1]);
+    worker->wake_event = event_new(group->event_base, worker->wake[0], EV_READ | EV_PERSIST, dogecoin_worker_wake_cb, worker);
+    pthread_mutex_init(&worker->queue_lock, NULL);
+    pthread_cond_init(&worker->queue_cond, NULL);
+    pthread_mutex_init(&worker->state_lock, NULL);
+    if (pthread_create(&worker->thread, NULL, dogecoin_worker_main, worker) != 0) {
+        pthread_mutex_destroy(&worker->state_lock);
+        pthread_cond_destroy(&worker->queue_cond);
+        pthread_mutex_destroy(&worker->queue_lock);
+        event_free(worker->wake_event);
+        evutil_closesocket(worker->wake[0]);
+        evutil_closesocket(worker->wake[1]);
+        dogecoin_free(worker);
+        return false;
+    }
+    group->worker = worker;
+    return true;
+}
+
+/**
+ * Stops the worker after it processed its queue, drops unsent operations
+ *
+ * @param group The node group.
+ */
+static void dogecoin_node_group_stop_worker(dogecoin_node_group* group)
+{
+    struct dogecoin_node_worker_* worker = group->worker;
+    if (!worker) return;
+
+    pthread_mutex_lock(&worker->queue_lock);
+    worker->stop = true;
+    pthread_cond_broadcast(&worker->queue_cond);
+    pthread_mutex_unlock(&worker->queue_lock);
+    pthread_join(worker->thread, NULL);
+    group->worker = NULL;
+
+    dogecoin_worker_item* item;
+    while ((item = dogecoin_worker_queue_pop(&worker->outbound)) != NULL) {
+        dogecoin_worker_item_free(item);
+    }
+    while ((item = dogecoin_worker_queue_pop(&worker->deferred)) != NULL) {
+        dogecoin_worker_item_free(item);
+    }
+    pthread_mutex_destroy(&worker->state_lock);
+    pthread_cond_destroy(&worker->queue_cond);
+    pthread_mutex_destroy(&worker->queue_lock);
+    event_free(worker->wake_event);
+    evutil_closesocket(worker->wake[0]);
+    evutil_closesocket(worker->wake[1]);
+    dogecoin_free(worker);
+}
+
+/**
+ * Locks the callback state against the worker
+ *
+ * @param group The node group.
+ */
+void dogecoin_node_group_lock(dogecoin_node_group* group)
+{
+    if (group->worker && !dogecoin_node_group_on_worker(group)) {
+        pthread_mutex_lock(&group->worker->state_lock);
+    }
+}
+
+/**
+ * Unlocks the callback state
+ *
+ * @param group The node group.
+ */
+void dogecoin_node_group_unlock(dogecoin_node_group* group)
+{
+    struct dogecoin_node_worker_* worker = group->worker;
+    if (worker && !dogecoin_node_group_on_worker(group)) {
+        pthread_mutex_unlock(&worker->state_lock);
+        pthread_mutex_lock(&worker->queue_lock);
+        dogecoin_bool loop_waiting = worker->loop_waiting;
+        pthread_mutex_unlock(&worker->queue_lock);
+        if (loop_waiting) {
+            // the event loop thread deferred operations while this thread held the lock
+            char byte = 0;
+            send(worker->wake[1], &byte, 1, 0);
+        }
+    }
+}
+
+/**
+ * Runs a function with the callback state locked against the worker,
+ * deferred behind the current job if the worker is busy (event loop
+ * thread)
+ *
+ * @param group The node group.
+ * @param call The function, called with run false if it gets dropped.
+ * @param ctx The argument of the function.
+ */
+void dogecoin_node_group_call_locked(dogecoin_node_group* group, void (*call)(void* ctx, dogecoin_bool run), void* ctx)
+{
+    if (!group->worker) {
+        call(ctx, true);
+        return;
+    }
+    dogecoin_worker_item* item = dogecoin_worker_item_new(DOGECOIN_WORKER_CALL, NULL);
+    item->call = call;
+    item->ctx = ctx;
+    dogecoin_worker_defer(group->worker, item);
+}
 
 /**
  * Initializes the HTTP server part of the node group.
@@ -144,12 +641,48 @@ int net_write_log_null(const char* format, ...)
 }
 
 /**
- * If we have a complete message, parse it
+ * Checks if the connection of a node is up, as seen by the event loop
+ * thread; with a worker the state belongs to the callbacks and the
+ * event loop thread keeps its own flag
+ *
+ * @param node The node.
+ *
+ * @return true if messages can be sent and received
+ */
+static dogecoin_bool dogecoin_node_loop_connected(const dogecoin_node* node)
+{
+    if (node->nodegroup->worker) {
+        return node->connected;
+    }
+    return (node->state & NODE_CONNECTED) == NODE_CONNECTED;
+}
+
+/**
+ * Marks a node that sent an unreadable message as misbehaving
+ * and stops reading from it (event loop thread)
+ *
+ * @param node The node.
+ */
+static void dogecoin_node_read_failed(dogecoin_node* node)
+{
+    struct dogecoin_node_worker_* worker = node->nodegroup->worker;
+    if (!worker) {
+        dogecoin_node_misbehave(node);
+        return;
+    }
+    node->connected = false;
+    bufferevent_disable(node->event_bev, EV_READ);
+    dogecoin_worker_defer(worker, dogecoin_worker_item_new(DOGECOIN_WORKER_MISBEHAVE, node));
+}
+
+/**
+ * Frames the messages straight from the input buffer of the connection.
+ * Only the 24 byte header of a pending message is peeked, the read
+ * watermark then holds back further callbacks until the whole payload
+ * arrived, which gets made contiguous once and parsed in place.
  *
  * @param bev The bufferevent that is being read from.
  * @param ctx The node object.
- *
- * @return dogecoin_bool (uint8_t)
  */
 void read_cb(struct bufferevent* bev, void* ctx)
 {
@@ -157,65 +690,68 @@ void read_cb(struct bufferevent* bev, void* ctx)
     if (!input)
         return;
 
-    size_t length = evbuffer_get_length(input);
     dogecoin_node* node = (dogecoin_node*)ctx;
+    struct dogecoin_node_worker_* worker = node->nodegroup->worker;
+    size_t wait_for = DOGECOIN_P2P_HDRSZ;
 
-    if ((node->state & NODE_CONNECTED) != NODE_CONNECTED) {
-        // ignore messages from disconnected peers
-        return;
-    }
-    // expand the cstring buffer if required
-    cstr_alloc_minsize(node->recvBuffer, node->recvBuffer->len + length);
-
-    // copy direct to cstring, avoid another heap buffer
-    evbuffer_copyout(input, node->recvBuffer->str + node->recvBuffer->len, length);
-    node->recvBuffer->len += length;
-
-    // drain the event buffer
-    evbuffer_drain(input, length);
-
-    struct const_buffer buf = {node->recvBuffer->str, node->recvBuffer->len};
-    dogecoin_p2p_msg_hdr hdr;
-    char* read_upto = NULL;
-
-    do {
-        if (buf.len < DOGECOIN_P2P_HDRSZ) {
+    // messages of a dropped connection do not get dispatched anymore
+    while (dogecoin_node_loop_connected(node)) {
+        size_t length = evbuffer_get_length(input);
+        if (length < DOGECOIN_P2P_HDRSZ) {
             break;
         }
 
-        dogecoin_p2p_deser_msghdr(&hdr, &buf);
+        unsigned char hdr_data[DOGECOIN_P2P_HDRSZ];
+        evbuffer_copyout(input, hdr_data, DOGECOIN_P2P_HDRSZ);
+        struct const_buffer hdr_buf = {hdr_data, DOGECOIN_P2P_HDRSZ};
+        dogecoin_p2p_msg_hdr hdr;
+        dogecoin_p2p_deser_msghdr(&hdr, &hdr_buf);
         if (hdr.data_len > DOGECOIN_MAX_P2P_MSG_SIZE) {
-            dogecoin_node_misbehave(node);
+            dogecoin_node_read_failed(node);
             return;
         }
-        if (buf.len < hdr.data_len) {
+
+        size_t msg_len = DOGECOIN_P2P_HDRSZ + hdr.data_len;
+        if (length < msg_len) {
+            wait_for = msg_len;
             break;
         }
-        if (buf.len >= hdr.data_len) {
-            struct const_buffer cmd_data_buf = {buf.p, buf.len};
-            if ((node->state & NODE_CONNECTED) != NODE_CONNECTED) {
-                return;
-            }
-            dogecoin_node_parse_message(node, &hdr, &cmd_data_buf);
-
-            buf.p = (const unsigned char*)buf.p + hdr.data_len;
-            buf.len -= hdr.data_len;
 
-            read_upto = (void*)buf.p;
+        unsigned char* msg = evbuffer_pullup(input, msg_len);
+        if (!msg) {
+            dogecoin_node_read_failed(node);
+            return;
         }
-        if (buf.len == 0) {
-            node->recvBuffer->len = 0;
-            break;
+        if (worker) {
+            if (strcmp(hdr.command, DOGECOIN_MSG_PING) == 0) {
+                // answered here so a busy worker does not time the peer out
+                if (hdr.data_len >= 8) {
+                    dogecoin_node_send_message(node, DOGECOIN_MSG_PONG, msg + DOGECOIN_P2P_HDRSZ, 8);
+                }
+            } else {
+                dogecoin_worker_item* item = dogecoin_worker_item_new(DOGECOIN_WORKER_MESSAGE, node);
+                item->hdr = hdr;
+                item->data = cstr_new_buf(msg + DOGECOIN_P2P_HDRSZ, hdr.data_len);
+                dogecoin_worker_dispatch(worker, item);
+            }
+            evbuffer_drain(input, msg_len);
+            continue;
         }
-    } while (1);
+        struct const_buffer cmd_data_buf = {msg + DOGECOIN_P2P_HDRSZ, hdr.data_len};
+        dogecoin_node_parse_message(node, &hdr, &cmd_data_buf);
 
-    if (read_upto != NULL && node->recvBuffer->len != 0 && read_upto != (node->recvBuffer->str + node->recvBuffer->len)) {
-        char* end = node->recvBuffer->str + node->recvBuffer->len;
-        size_t available_chunk_data = end - read_upto;
-        cstring* tmp = cstr_new_buf(read_upto, available_chunk_data);
-        cstr_free(node->recvBuffer, true);
-        node->recvBuffer = tmp;
+        // the callbacks may have dropped the connection, its buffers die with it
+        if ((node->state & NODE_CONNECTED) != NODE_CONNECTED) {
+            return;
+        }
+        evbuffer_drain(input, msg_len);
     }
+
+    // ignore messages from disconnected peers
+    if (!dogecoin_node_loop_connected(node)) {
+        return;
+    }
+    bufferevent_setwatermark(bev, EV_READ, wait_for, 0);
 }
 
 /**
@@ -249,42 +785,57 @@ void node_periodical_timer(int fd, short int event, void* ctx)
     UNUSED(fd);
     UNUSED(event);
     dogecoin_node* node = (dogecoin_node*)ctx;
+    struct dogecoin_node_worker_* worker = node->nodegroup->worker;
     uint64_t now = time(NULL);
 
-    if (node->nodegroup->periodic_timer_cb)
-        if (!node->nodegroup->periodic_timer_cb(node, &now))
-            return;
+    if (worker) {
+        // the callback runs on the worker, the internal logic always runs here
+        if (node->nodegroup->periodic_timer_cb) {
+            dogecoin_worker_item* item = dogecoin_worker_item_new(DOGECOIN_WORKER_TIMER, node);
+            item->now = now;
+            dogecoin_worker_dispatch(worker, item);
+        }
+        // the connect timeout can wait for the next tick if the worker is busy
+        if (pthread_mutex_trylock(&worker->state_lock) == 0) {
+            if (node->time_started_con + DOGECOIN_CONNECT_TIMEOUT_S < now && ((node->state & NODE_CONNECTING) == NODE_CONNECTING)) {
+                node->state = 0;
+                node->time_started_con = 0;
+                node->state |= NODE_TIMEOUT;
+                dogecoin_node_connection_state_changed(node);
+            }
+            pthread_mutex_unlock(&worker->state_lock);
+        }
+    } else {
+        if (node->nodegroup->periodic_timer_cb)
+            if (!node->nodegroup->periodic_timer_cb(node, &now))
+                return;
 
-    if (node->time_started_con + DOGECOIN_CONNECT_TIMEOUT_S < now && ((node->state & NODE_CONNECTING) == NODE_CONNECTING)) {
-        node->state = 0;
-        node->time_started_con = 0;
-        node->state |= NODE_TIMEOUT;
-        dogecoin_node_connection_state_changed(node);
+        if (node->time_started_con + DOGECOIN_CONNECT_TIMEOUT_S < now && ((node->state & NODE_CONNECTING) == NODE_CONNECTING)) {
+            node->state = 0;
+            node->time_started_con = 0;
+            node->state |= NODE_TIMEOUT;
+            dogecoin_node_connection_state_changed(node);
+        }
     }
 
     /* This is checking if the node is connected and if the last ping time is greater than the current
     time plus the ping interval. */
-    if (((node->state & NODE_CONNECTED) == NODE_CONNECTED) && node->lastping + DOGECOIN_PING_INTERVAL_S < now) {
+    if (dogecoin_node_loop_connected(node) && node->lastping + DOGECOIN_PING_INTERVAL_S < now) {
         uint64_t nonce;
         dogecoin_cheap_random_bytes((uint8_t*)&nonce, sizeof(nonce));
-        cstring* pingmsg = dogecoin_p2p_message_new(node->nodegroup->chainparams->netmagic, DOGECOIN_MSG_PING, &nonce, sizeof(nonce));
-        dogecoin_node_send(node, pingmsg);
-        cstr_free(pingmsg, true);
+        dogecoin_node_send_message(node, DOGECOIN_MSG_PING, &nonce, sizeof(nonce));
         node->lastping = now;
     }
 }
 
 /**
- * When the event callback is called it sets the node's state with the type of event that happened.
+ * Sets the node's state with the type of event that happened.
  *
- * @param ev The bufferevent structure.
+ * @param node The node.
  * @param type The event type.
- * @param ctx The node object.
  */
-void event_cb(struct bufferevent* ev, short type, void* ctx)
+static void dogecoin_node_handle_event(dogecoin_node* node, short type)
 {
-    UNUSED(ev);
-    dogecoin_node* node = (dogecoin_node*)ctx;
     node->nodegroup->log_write_cb("Event callback on node %d\n", node->nodeid);
 
     if (((type & BEV_EVENT_TIMEOUT) != 0) && ((node->state & NODE_CONNECTING) == NODE_CONNECTING)) {
@@ -292,12 +843,14 @@ void event_cb(struct bufferevent* ev, short type, void* ctx)
         node->state = 0;
         node->state |= NODE_ERRORED;
         node->state |= NODE_TIMEOUT;
+        node->connected = false;
         dogecoin_node_connection_state_changed(node);
     } else if (((type & BEV_EVENT_EOF) != 0) ||
                ((type & BEV_EVENT_ERROR) != 0)) {
         node->state = 0;
         node->state |= NODE_ERRORED;
         node->state |= NODE_DISCONNECTED;
+        node->connected = false;
         if ((type & BEV_EVENT_EOF) != 0) {
             node->nodegroup->log_write_cb("Disconnected from the remote peer %d.\n", node->nodeid);
             node->state |= NODE_DISCONNECTED_FROM_REMOTE_PEER;
@@ -311,11 +864,40 @@ void event_cb(struct bufferevent* ev, short type, void* ctx)
         node->state |= NODE_CONNECTED;
         node->state &= ~NODE_CONNECTING;
         node->state &= ~NODE_ERRORED;
+        node->connected = true;
         dogecoin_node_connection_state_changed(node);
     }
     node->nodegroup->log_write_cb("Connected nodes: %d\n", dogecoin_node_group_amount_of_connected_nodes(node->nodegroup, NODE_CONNECTED));
 }
 
+/**
+ * When the event callback is called it sets the node's state with the type of event that happened,
+ * with a worker the state change is deferred until the worker finished its job.
+ *
+ * @param ev The bufferevent structure.
+ * @param type The event type.
+ * @param ctx The node object.
+ */
+void event_cb(struct bufferevent* ev, short type, void* ctx)
+{
+    UNUSED(ev);
+    dogecoin_node* node = (dogecoin_node*)ctx;
+    struct dogecoin_node_worker_* worker = node->nodegroup->worker;
+    if (worker) {
+        // sends follow the connection right away, the state change waits for the worker
+        if ((type & BEV_EVENT_CONNECTED) != 0) {
+            node->connected = true;
+        } else if ((type & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) != 0) {
+            node->connected = false;
+        }
+        dogecoin_worker_item* item = dogecoin_worker_item_new(DOGECOIN_WORKER_EVENT, node);
+        item->events = type;
+        dogecoin_worker_defer(worker, item);
+        return;
+    }
+    dogecoin_node_handle_event(node, type);
+}
+
 /**
  * Initializes a new dogecoin_node
  *
@@ -327,14 +909,18 @@ dogecoin_node* dogecoin_node_new()
     node = dogecoin_calloc(1, sizeof(*node));
     node->version_handshake = false;
     node->state = 0;
+    node->connected = false;
     node->nonce = 0;
     node->services = 0;
+    node->version = 0;
     node->lastping = 0;
     node->time_started_con = 0;
     node->time_last_request = 0;
     dogecoin_hash_clear(node->last_requested_inv);
+    node->time_connect_ms = 0;
+    node->time_block_request_ms = 0;
+    node->blocks_in_flight = 0;
 
-    node->recvBuffer = cstr_new_sz(DOGECOIN_P2P_MESSAGE_CHUNK_SIZE);
     node->hints = 0;
     return node;
 }
@@ -382,7 +968,14 @@ void dogecoin_node_release_events(dogecoin_node* node)
  */
 dogecoin_bool dogecoin_node_misbehave(dogecoin_node* node)
 {
+    if (dogecoin_node_group_on_worker(node->nodegroup)) {
+        dogecoin_worker_post(node->nodegroup->worker, dogecoin_worker_item_new(DOGECOIN_WORKER_MISBEHAVE, node));
+        return 0;
+    }
     node->nodegroup->log_write_cb("Mark node %d as missbehaved\n", node->nodeid);
+    if (node->nodegroup->addrman && (node->state & NODE_MISSBEHAVED) != NODE_MISSBEHAVED) {
+        dogecoin_addrman_misbehaved(node->nodegroup->addrman, &node->addr, (uint32_t)time(NULL));
+    }
     node->state |= NODE_MISSBEHAVED;
     dogecoin_node_connection_state_changed(node);
     return 0;
@@ -395,6 +988,10 @@ dogecoin_bool dogecoin_node_misbehave(dogecoin_node* node)
  */
 void dogecoin_node_disconnect(dogecoin_node* node)
 {
+    if (dogecoin_node_group_on_worker(node->nodegroup)) {
+        dogecoin_worker_post(node->nodegroup->worker, dogecoin_worker_item_new(DOGECOIN_WORKER_DISCONNECT, node));
+        return;
+    }
     if ((node->state & NODE_CONNECTED) == NODE_CONNECTED || (node->state & NODE_CONNECTING) == NODE_CONNECTING) {
         node->nodegroup->log_write_cb("Disconnect node %d\n", node->nodeid);
     }
@@ -403,8 +1000,11 @@ void dogecoin_node_disconnect(dogecoin_node* node)
     node->state &= ~NODE_CONNECTING;
     node->state &= ~NODE_CONNECTED;
     node->state |= NODE_DISCONNECTED;
+    node->connected = false;
 
     node->time_started_con = 0;
+    node->time_block_request_ms = 0;
+    node->blocks_in_flight = 0;
 }
 
 /**
@@ -415,7 +1015,6 @@ void dogecoin_node_disconnect(dogecoin_node* node)
 void dogecoin_node_free(dogecoin_node* node)
 {
     dogecoin_node_disconnect(node);
-    cstr_free(node->recvBuffer, true);
     dogecoin_free(node);
 }
 
@@ -492,16 +1091,120 @@ dogecoin_node_group* dogecoin_node_group_new(const dogecoin_chainparams* chainpa
     node_group->log_write_cb = net_write_log_null;
     node_group->desired_amount_connected_nodes = 8;
     node_group->http_server = NULL;
+    node_group->addrman = NULL;
+    node_group->dns_base = NULL;
+    node_group->dns_pending = 0;
+    node_group->quit_event = NULL;
 
     return node_group;
 }
 
 /**
- * Shut down all the nodes in the group.
+ * Stops watching stdin for the quit command and puts stdin back into
+ * blocking mode (event loop thread)
+ *
+ * @param group The node group.
+ */
+static void dogecoin_node_group_stop_quit_on_stdin(dogecoin_node_group* group)
+{
+    if (!group->quit_event) return;
+    event_free(group->quit_event);
+    group->quit_event = NULL;
+#ifndef _WIN32
+    int stdin_flags = fcntl(STDIN_FILENO, F_GETFL);
+    fcntl(STDIN_FILENO, F_SETFL, stdin_flags & ~O_NONBLOCK);
+#endif
+}
+
+static void dogecoin_node_group_quit_call(void* ctx, dogecoin_bool run)
+{
+    if (run) {
+        printf("Disconnecting...\n");
+        dogecoin_node_group_shutdown((dogecoin_node_group*)ctx);
+    }
+}
+
+/**
+ * Reads what arrived on stdin and shuts the group down on a 'q' or 'Q'
+ * (event loop thread)
+ *
+ * @param fd The stdin file descriptor (unused on windows).
+ * @param event The triggered event.
+ * @param ctx The node group.
+ */
+static void dogecoin_node_group_stdin_cb(evutil_socket_t fd, short event, void* ctx)
+{
+    (void)event;
+    dogecoin_node_group* group = (dogecoin_node_group*)ctx;
+    dogecoin_bool quit = false;
+#ifdef _WIN32
+    (void)fd;
+    while (_kbhit()) {
+        int c = _getch();
+        if (c == 'q' || c == 'Q') quit = true;
+    }
+#else
+    char buf[64];
+    ssize_t len = read(fd, buf, sizeof(buf));
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (len <= 0) {
+        // stdin was closed, nobody can quit this way anymore
+        dogecoin_node_group_stop_quit_on_stdin(group);
+        return;
+    }
+    quit = memchr(buf, 'q', len) != NULL || memchr(buf, 'Q', len) != NULL;
+#endif
+    if (!quit) return;
+    dogecoin_node_group_stop_quit_on_stdin(group);
+    // the shutdown waits for the job the worker is running
+    dogecoin_node_group_call_locked(group, dogecoin_node_group_quit_call, group);
+}
+
+/**
+ * Shuts the group down once 'q' or 'Q' arrives on stdin. The event loop
+ * watches stdin, so message processing never polls it.
+ *
+ * @param group The node group.
+ */
+void dogecoin_node_group_quit_on_stdin(dogecoin_node_group* group)
+{
+    if (group->quit_event) return;
+#ifdef _WIN32
+    // console handles can't be watched by the event loop, poll the keyboard instead
+    struct timeval tv = {0, 100000};
+    group->quit_event = event_new(group->event_base, -1, EV_PERSIST, dogecoin_node_group_stdin_cb, group);
+    if (group->quit_event && event_add(group->quit_event, &tv) != 0) {
+        dogecoin_node_group_stop_quit_on_stdin(group);
+    }
+#else
+    group->quit_event = event_new(group->event_base, STDIN_FILENO, EV_READ | EV_PERSIST, dogecoin_node_group_stdin_cb, group);
+    // stdin may be closed or a regular file the loop can't watch
+    if (!group->quit_event || event_add(group->quit_event, NULL) != 0) {
+        if (group->quit_event) event_free(group->quit_event);
+        group->quit_event = NULL;
+        return;
+    }
+    int stdin_flags = fcntl(STDIN_FILENO, F_GETFL);
+    fcntl(STDIN_FILENO, F_SETFL, stdin_flags | O_NONBLOCK);
+#endif
+}
+
+/**
+ * Shut down all the nodes in the group, called from the worker the
+ * shutdown is queued to the event loop thread.
  *
  * @param group The group to shutdown.
  */
 void dogecoin_node_group_shutdown(dogecoin_node_group *group) {
+    if (dogecoin_node_group_on_worker(group)) {
+        // the connections and the http server belong to the event loop thread
+        dogecoin_worker_post(group->worker, dogecoin_worker_item_new(DOGECOIN_WORKER_SHUTDOWN, NULL));
+        return;
+    }
+    if (group->worker) {
+        group->worker->shutdown = true;
+    }
+    dogecoin_node_group_stop_quit_on_stdin(group);
     size_t i = 0;
     for (; i < group->nodes->len; i++) {
         dogecoin_node* node = vector_idx(group->nodes, i);
@@ -523,13 +1226,24 @@ void dogecoin_node_group_free(dogecoin_node_group* group)
     if (!group)
         return;
 
-    if (group->event_base) {
-        event_base_free(group->event_base);
+    /* queued jobs still reference the nodes */
+    dogecoin_node_group_stop_worker(group);
+    dogecoin_node_group_stop_quit_on_stdin(group);
+
+    /* pending seed lookups fail, their callbacks only count them down */
+    if (group->dns_base) {
+        evdns_base_free(group->dns_base, 1);
+        group->dns_base = NULL;
     }
 
+    /* nodes still holding a bufferevent release it against the base */
     if (group->nodes) {
         vector_free(group->nodes, true);
     }
+
+    if (group->event_base) {
+        event_base_free(group->event_base);
+    }
     dogecoin_free(group);
 }
 
@@ -576,6 +1290,49 @@ int dogecoin_node_group_amount_of_connected_nodes(dogecoin_node_group* group, en
     return count;
 }
 
+typedef struct dogecoin_node_rank_ {
+    dogecoin_node* node;
+    int64_t score;
+} dogecoin_node_rank;
+
+static int dogecoin_node_rank_cmp(const void* a, const void* b)
+{
+    const dogecoin_node_rank* ra = (const dogecoin_node_rank*)a;
+    const dogecoin_node_rank* rb = (const dogecoin_node_rank*)b;
+    if (ra->score != rb->score) return ra->score > rb->score ? -1 : 1;
+    return ra->node->nodeid - rb->node->nodeid;
+}
+
+/**
+ * Orders the nodes of the group by their address manager score,
+ * nodes without an entry rank like a new address
+ *
+ * @param group the node group
+ * @param nodes the array to fill, group->nodes->len entries
+ */
+void dogecoin_node_group_rank_nodes(dogecoin_node_group* group, dogecoin_node** nodes)
+{
+    size_t i;
+    if (!group->addrman) {
+        for (i = 0; i < group->nodes->len; i++) {
+            nodes[i] = vector_idx(group->nodes, i);
+        }
+        return;
+    }
+    uint32_t now = (uint32_t)time(NULL);
+    dogecoin_node_rank* ranks = dogecoin_calloc(group->nodes->len + 1, sizeof(*ranks));
+    for (i = 0; i < group->nodes->len; i++) {
+        ranks[i].node = vector_idx(group->nodes, i);
+        dogecoin_addrman_entry* entry = dogecoin_addrman_find(group->addrman, &ranks[i].node->addr);
+        ranks[i].score = entry ? dogecoin_addrman_score(entry, now) : 0;
+    }
+    qsort(ranks, group->nodes->len, sizeof(*ranks), dogecoin_node_rank_cmp);
+    for (i = 0; i < group->nodes->len; i++) {
+        nodes[i] = ranks[i].node;
+    }
+    dogecoin_free(ranks);
+}
+
 /**
  * Try to connect to a node that is not connected, not in connecting state, and has not
  * been connected for more than DOGECOIN_PERIODICAL_NODE_TIMER_S seconds.
@@ -586,15 +1343,22 @@ int dogecoin_node_group_amount_of_connected_nodes(dogecoin_node_group* group, en
  */
 dogecoin_bool dogecoin_node_group_connect_next_nodes(dogecoin_node_group* group)
 {
+    if (dogecoin_node_group_on_worker(group)) {
+        dogecoin_worker_post(group->worker, dogecoin_worker_item_new(DOGECOIN_WORKER_CONNECT_NEXT, NULL));
+        return true;
+    }
     dogecoin_bool connected_at_least_to_one_node = false;
     int connect_amount = group->desired_amount_connected_nodes - dogecoin_node_group_amount_of_connected_nodes(group, NODE_CONNECTED);
     if (connect_amount <= 0)
         return true;
 
     connect_amount = connect_amount*3;
+    /* the best known peers get tried first */
+    dogecoin_node** ranked = dogecoin_calloc(group->nodes->len + 1, sizeof(dogecoin_node*));
+    dogecoin_node_group_rank_nodes(group, ranked);
     size_t i = 0;
     for (; i < group->nodes->len; i++) {
-        dogecoin_node* node = vector_idx(group->nodes, i);
+        dogecoin_node* node = ranked[i];
         if (
             !((node->state & NODE_CONNECTED) == NODE_CONNECTED) &&
             !((node->state & NODE_DISCONNECTED) == NODE_DISCONNECTED) &&
@@ -608,11 +1372,16 @@ dogecoin_bool dogecoin_node_group_connect_next_nodes(dogecoin_node_group* group)
                     bufferevent_free(node->event_bev);
                     node->event_bev = NULL;
                 }
+                dogecoin_free(ranked);
                 return false;
             }
 
             /* setup periodic timer */
             node->time_started_con = time(NULL);
+            node->time_connect_ms = dogecoin_node_time_ms();
+            if (group->addrman) {
+                dogecoin_addrman_attempt(group->addrman, &node->addr, (uint32_t)node->time_started_con);
+            }
             struct timeval tv;
             tv.tv_sec = DOGECOIN_PERIODICAL_NODE_TIMER_S;
             tv.tv_usec = 0;
@@ -623,9 +1392,10 @@ dogecoin_bool dogecoin_node_group_connect_next_nodes(dogecoin_node_group* group)
             node->nodegroup->log_write_cb("Trying to connect to %d...\n", node->nodeid);
             connect_amount--;
             if (connect_amount <= 0)
-                return true;
+                break;
         }
     }
+    dogecoin_free(ranked);
     return connected_at_least_to_one_node;
 }
 
@@ -637,14 +1407,20 @@ dogecoin_bool dogecoin_node_group_connect_next_nodes(dogecoin_node_group* group)
  */
 void dogecoin_node_connection_state_changed(dogecoin_node* node)
 {
-    /* connect to more nodes are required */
-    if (node->nodegroup->node_connection_state_changed_cb) {
+    struct dogecoin_node_worker_* worker = node->nodegroup->worker;
+    if (worker) {
+        /* the callbacks (and a possible reconnect) run on the worker */
+        dogecoin_worker_item* item = dogecoin_worker_item_new(DOGECOIN_WORKER_STATE_CHANGED, node);
+        item->errored = (node->state & NODE_ERRORED) == NODE_ERRORED;
+        dogecoin_worker_dispatch(worker, item);
+    } else if (node->nodegroup->node_connection_state_changed_cb) {
+        /* connect to more nodes are required */
         node->nodegroup->node_connection_state_changed_cb(node);
     }
 
     if ((node->state & NODE_ERRORED) == NODE_ERRORED) {
         dogecoin_node_release_events(node);
-        if (node->nodegroup->should_connect_to_more_nodes_cb) {
+        if (!worker && node->nodegroup->should_connect_to_more_nodes_cb) {
             if (node->nodegroup->should_connect_to_more_nodes_cb(node)) {
                 dogecoin_node_group_connect_next_nodes(node->nodegroup);
             }
@@ -668,7 +1444,13 @@ void dogecoin_node_connection_state_changed(dogecoin_node* node)
  */
 void dogecoin_node_send(dogecoin_node* node, cstring* data)
 {
-    if ((node->state & NODE_CONNECTED) != NODE_CONNECTED)
+    if (dogecoin_node_group_on_worker(node->nodegroup)) {
+        dogecoin_worker_item* item = dogecoin_worker_item_new(DOGECOIN_WORKER_SEND, node);
+        item->data = cstr_new_cstr(data);
+        dogecoin_worker_post(node->nodegroup->worker, item);
+        return;
+    }
+    if (!dogecoin_node_loop_connected(node))
         return;
 
     bufferevent_write(node->event_bev, data->str, data->len);
@@ -676,6 +1458,137 @@ void dogecoin_node_send(dogecoin_node* node, cstring* data)
     node->nodegroup->log_write_cb("sending message to node %d: %s\n", node->nodeid, dummy);
 }
 
+/**
+ * Counts the blocks requested by a getdata, the transfer clock starts
+ * when the first block is requested from an idle peer
+ *
+ * @param node the node the getdata goes to
+ * @param data The getdata payload.
+ * @param data_len The length of the payload.
+ */
+static void dogecoin_node_track_block_requests(dogecoin_node* node, const void* data, uint32_t data_len)
+{
+    struct const_buffer buf = {data, data_len};
+    uint32_t count = 0, blocks = 0, type = 0;
+    if (!deser_varlen(&count, &buf)) return;
+    while (count-- > 0 && deser_u32(&type, &buf) && deser_skip(&buf, 32)) {
+        if (type == DOGECOIN_INV_TYPE_BLOCK || type == DOGECOIN_INV_TYPE_FILTERED_BLOCK) blocks++;
+    }
+    if (blocks == 0) return;
+    if (node->blocks_in_flight == 0) {
+        node->time_block_request_ms = dogecoin_node_time_ms();
+    }
+    node->blocks_in_flight += blocks;
+}
+
+/**
+ * Send a message to a node without building it in an intermediate buffer;
+ * the header is written next to the payload in the nodes output buffer
+ *
+ * @param node the node that is sending the message
+ * @param command The command string.
+ * @param data The payload.
+ * @param data_len The length of the payload.
+ */
+void dogecoin_node_send_message(dogecoin_node* node, const char* command, const void* data, uint32_t data_len)
+{
+    if (node->nodegroup->addrman && strcmp(command, DOGECOIN_MSG_GETDATA) == 0) {
+        dogecoin_node_track_block_requests(node, data, data_len);
+    }
+    if (dogecoin_node_group_on_worker(node->nodegroup)) {
+        // framed (and hashed) on the worker, handed over without another copy
+        dogecoin_worker_item* item = dogecoin_worker_item_new(DOGECOIN_WORKER_SEND, node);
+        item->data = dogecoin_p2p_message_new(node->nodegroup->chainparams->netmagic, command, data, data_len);
+        dogecoin_worker_post(node->nodegroup->worker, item);
+        return;
+    }
+    if (!dogecoin_node_loop_connected(node))
+        return;
+
+    unsigned char hdr[DOGECOIN_P2P_HDRSZ];
+    dogecoin_p2p_message_header(hdr, node->nodegroup->chainparams->netmagic, command, data, data_len);
+
+    struct evbuffer* output = bufferevent_get_output(node->event_bev);
+    evbuffer_add(output, hdr, DOGECOIN_P2P_HDRSZ);
+    if (data_len > 0)
+        evbuffer_add(output, data, data_len);
+    node->nodegroup->log_write_cb("sending message to node %d: %s\n", node->nodeid, command);
+}
+
+/**
+ * Create a message that can be sent to many nodes, the payload is hashed once
+ *
+ * @param netmagic The magic number of the network.
+ * @param command The command string.
+ * @param payload The serialized payload, owned by the message afterwards.
+ *
+ * @return dogecoin_p2p_shared_msg* with a single reference held by the caller
+ */
+dogecoin_p2p_shared_msg* dogecoin_p2p_shared_msg_new(const unsigned char netmagic[4], const char* command, cstring* payload)
+{
+    dogecoin_p2p_shared_msg* msg = dogecoin_calloc(1, sizeof(*msg));
+    dogecoin_p2p_message_header(msg->hdr, netmagic, command, payload->str, payload->len);
+    msg->payload = payload;
+    msg->refcount = 1;
+    return msg;
+}
+
+/**
+ * Drop a reference to a shared message, the last one frees it
+ *
+ * @param msg The message.
+ */
+void dogecoin_p2p_shared_msg_release(dogecoin_p2p_shared_msg* msg)
+{
+    if (!msg || --msg->refcount > 0)
+        return;
+    cstr_free(msg->payload, true);
+    dogecoin_free(msg);
+}
+
+/**
+ * Called by libevent once a referenced payload has been written or its
+ * buffer got freed
+ */
+static void dogecoin_p2p_shared_msg_cleanup(const void* data, size_t datalen, void* extra)
+{
+    (void)data;
+    (void)datalen;
+    dogecoin_p2p_shared_msg_release((dogecoin_p2p_shared_msg*)extra);
+}
+
+/**
+ * Queue a shared message on a node, the payload is referenced, not copied
+ *
+ * @param node the node that is sending the message
+ * @param msg The message.
+ */
+void dogecoin_node_send_shared(dogecoin_node* node, dogecoin_p2p_shared_msg* msg)
+{
+    if (dogecoin_node_group_on_worker(node->nodegroup)) {
+        // the refcount belongs to the event loop thread, the worker hands over a copy
+        dogecoin_worker_item* item = dogecoin_worker_item_new(DOGECOIN_WORKER_SEND, node);
+        item->data = cstr_new_sz(DOGECOIN_P2P_HDRSZ + msg->payload->len);
+        cstr_append_buf(item->data, msg->hdr, DOGECOIN_P2P_HDRSZ);
+        cstr_append_buf(item->data, msg->payload->str, msg->payload->len);
+        dogecoin_worker_post(node->nodegroup->worker, item);
+        return;
+    }
+    if (!dogecoin_node_loop_connected(node))
+        return;
+
+    struct evbuffer* output = bufferevent_get_output(node->event_bev);
+    evbuffer_add(output, msg->hdr, DOGECOIN_P2P_HDRSZ);
+    if (msg->payload->len > 0) {
+        msg->refcount++;
+        if (evbuffer_add_reference(output, msg->payload->str, msg->payload->len, dogecoin_p2p_shared_msg_cleanup, msg) != 0) {
+            msg->refcount--;
+            return;
+        }
+    }
+    node->nodegroup->log_write_cb("sending message to node %d: %s\n", node->nodeid, (const char*)msg->hdr + 4);
+}
+
 /**
  * Send a version message to the remote node
  *
@@ -703,15 +1616,11 @@ void dogecoin_node_send_version(dogecoin_node* node)
     dogecoin_p2p_msg_version_init(&version_msg, &fromAddr, &toAddr, node->nodegroup->clientstr, true);
     dogecoin_p2p_msg_version_ser(&version_msg, version_msg_cstr);
 
-    /* create p2p message */
-    cstring* p2p_msg = dogecoin_p2p_message_new(node->nodegroup->chainparams->netmagic, DOGECOIN_MSG_VERSION, version_msg_cstr->str, version_msg_cstr->len);
-
     /* send message */
-    dogecoin_node_send(node, p2p_msg);
+    dogecoin_node_send_message(node, DOGECOIN_MSG_VERSION, version_msg_cstr->str, version_msg_cstr->len);
 
     /* cleanup */
     cstr_free(version_msg_cstr, true);
-    cstr_free(p2p_msg, true);
 }
 
 /**
@@ -730,6 +1639,18 @@ int dogecoin_node_parse_message(dogecoin_node* node, dogecoin_p2p_msg_hdr* hdr,
         return dogecoin_node_misbehave(node);
     }
 
+    dogecoin_addrman* addrman = node->nodegroup->addrman;
+    if (addrman && node->blocks_in_flight > 0 &&
+        (strcmp(hdr->command, DOGECOIN_MSG_BLOCK) == 0 || strcmp(hdr->command, DOGECOIN_MSG_MERKLEBLOCK) == 0)) {
+        /* the transfer of the next requested block starts once this one is in */
+        uint64_t now_ms = dogecoin_node_time_ms();
+        if (strcmp(hdr->command, DOGECOIN_MSG_BLOCK) == 0) {
+            dogecoin_addrman_block_received(addrman, &node->addr, hdr->data_len, (uint32_t)(now_ms - node->time_block_request_ms));
+        }
+        node->blocks_in_flight--;
+        node->time_block_request_ms = node->blocks_in_flight > 0 ? now_ms : 0;
+    }
+
     /* send the header and buffer to the possible callback */
     if (!node->nodegroup->parse_cmd_cb || node->nodegroup->parse_cmd_cb(node, hdr, buf)) {
         if (strcmp(hdr->command, DOGECOIN_MSG_VERSION) == 0) {
@@ -741,14 +1662,19 @@ int dogecoin_node_parse_message(dogecoin_node* node, dogecoin_p2p_msg_hdr* hdr,
                 dogecoin_node_disconnect(node);
             }
             node->bestknownheight = v_msg_check.start_height;
+            node->services = v_msg_check.services;
+            node->version = v_msg_check.version;
             node->nodegroup->log_write_cb("Connected to node %d: %s (%d)\n", node->nodeid, v_msg_check.useragent, v_msg_check.start_height);
             /* confirm version via verack */
-            cstring* verack = dogecoin_p2p_message_new(node->nodegroup->chainparams->netmagic, DOGECOIN_MSG_VERACK, NULL, 0);
-            dogecoin_node_send(node, verack);
-            cstr_free(verack, true);
+            dogecoin_node_send_message(node, DOGECOIN_MSG_VERACK, NULL, 0);
         } else if (strcmp(hdr->command, DOGECOIN_MSG_VERACK) == 0) {
             /* complete handshake if verack has been received */
             node->version_handshake = true;
+            if (addrman) {
+                uint64_t latency = node->time_connect_ms ? dogecoin_node_time_ms() - node->time_connect_ms : 0;
+                dogecoin_addrman_connected(addrman, &node->addr, node->services, (uint32_t)latency, (uint32_t)time(NULL));
+                dogecoin_node_send_message(node, DOGECOIN_MSG_GETADDR, NULL, 0);
+            }
             if (node->nodegroup->handshake_done_cb)
                 node->nodegroup->handshake_done_cb(node);
         } else if (strcmp(hdr->command, DOGECOIN_MSG_PING) == 0) {
@@ -756,9 +1682,21 @@ int dogecoin_node_parse_message(dogecoin_node* node, dogecoin_p2p_msg_hdr* hdr,
             if (!deser_u64(&nonce, buf)) {
                 return dogecoin_node_misbehave(node);
             }
-            cstring* pongmsg = dogecoin_p2p_message_new(node->nodegroup->chainparams->netmagic, DOGECOIN_MSG_PONG, &nonce, 8);
-            dogecoin_node_send(node, pongmsg);
-            cstr_free(pongmsg, true);
+            dogecoin_node_send_message(node, DOGECOIN_MSG_PONG, &nonce, 8);
+        } else if (strcmp(hdr->command, DOGECOIN_MSG_ADDR) == 0 && addrman) {
+            /* parsed on a copy, the callbacks get the whole message */
+            struct const_buffer addr_buf = {buf->p, buf->len};
+            uint32_t count = 0;
+            if (!deser_varlen(&count, &addr_buf) || count > DOGECOIN_ADDRMAN_MAX_ADDR_MSG) {
+                return dogecoin_node_misbehave(node);
+            }
+            uint32_t now = (uint32_t)time(NULL);
+            dogecoin_p2p_address addr;
+            while (count-- > 0 && dogecoin_p2p_deser_addr(node->version, &addr, &addr_buf)) {
+                if ((addr.services & DOGECOIN_NODE_NETWORK) == DOGECOIN_NODE_NETWORK) {
+                    dogecoin_addrman_add(addrman, &addr, now);
+                }
+            }
         }
     }
 
@@ -822,7 +1760,222 @@ size_t dogecoin_get_peers_from_dns(const char* seed, vector_t* ips_out, int port
 }
 
 /**
- * It takes a comma seperated list of IPs and adds them to the group
+ * Checks if the group already has a node for an address
+ *
+ * @param group the node group
+ * @param addr the ipv4 address
+ *
+ * @return dogecoin_bool (uint8_t)
+ */
+static dogecoin_bool dogecoin_node_group_has_addr(dogecoin_node_group* group, const struct sockaddr* addr)
+{
+    const struct sockaddr_in* sin = (const struct sockaddr_in*)addr;
+    size_t i;
+    for (i = 0; i < group->nodes->len; i++) {
+        const dogecoin_node* node = vector_idx(group->nodes, i);
+        const struct sockaddr_in* node_sin = (const struct sockaddr_in*)&node->addr;
+        if (node->addr.sa_family == addr->sa_family && node_sin->sin_port == sin->sin_port &&
+            memcmp(&node_sin->sin_addr, &sin->sin_addr, sizeof(sin->sin_addr)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Skips address manager entries that can't become a node of the group:
+ * ipv6 (the node address only holds ipv4), nodes without NODE_NETWORK
+ * and addresses the group already has
+ */
+static dogecoin_bool dogecoin_node_group_exclude_entry(void* ctx, const dogecoin_addrman_entry* entry)
+{
+    static const unsigned char ipv4_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    if (memcmp(entry->ip, ipv4_prefix, sizeof(ipv4_prefix)) != 0) return true;
+    if (entry->services && (entry->services & DOGECOIN_NODE_NETWORK) != DOGECOIN_NODE_NETWORK) return true;
+    struct sockaddr addr;
+    dogecoin_mem_zero(&addr, sizeof(addr));
+    dogecoin_addrman_entry_to_addr(entry, &addr);
+    return dogecoin_node_group_has_addr((dogecoin_node_group*)ctx, &addr);
+}
+
+/**
+ * Adds the best ranked addresses of the address manager to the group
+ *
+ * @param group the node group with an address manager
+ *
+ * @return size_t the amount of added nodes
+ */
+static size_t dogecoin_node_group_add_peers_from_addrman(dogecoin_node_group* group)
+{
+    vector_t* entries = vector_new(DOGECOIN_ADDRMAN_CONNECT_CANDIDATES, NULL);
+    dogecoin_addrman_select(group->addrman, entries, DOGECOIN_ADDRMAN_CONNECT_CANDIDATES, (uint32_t)time(NULL), dogecoin_node_group_exclude_entry, group);
+    size_t i;
+    for (i = 0; i < entries->len; i++) {
+        dogecoin_node* node = dogecoin_node_new();
+        dogecoin_addrman_entry_to_addr(vector_idx(entries, i), &node->addr);
+        dogecoin_node_group_add_node(group, node);
+    }
+    size_t added = entries->len;
+    vector_free(entries, true);
+    return added;
+}
+
+/* one dns seed lookup */
+typedef struct dogecoin_seed_lookup_ {
+    dogecoin_node_group* group;
+    dogecoin_bool in_call; /* answered from within evdns_getaddrinfo */
+    struct evutil_addrinfo* res;
+} dogecoin_seed_lookup;
+
+/**
+ * Adds the resolved peers of a dns seed and connects to them
+ *
+ * @param ctx the dogecoin_seed_lookup, freed
+ * @param run false if the group shut down meanwhile
+ */
+static void dogecoin_node_group_seed_add_peers(void* ctx, dogecoin_bool run)
+{
+    dogecoin_seed_lookup* lookup = (dogecoin_seed_lookup*)ctx;
+    dogecoin_node_group* group = lookup->group;
+    if (!run) {
+        evutil_freeaddrinfo(lookup->res);
+        dogecoin_free(lookup);
+        return;
+    }
+    uint32_t now = (uint32_t)time(NULL);
+    int added = 0;
+    struct evutil_addrinfo* ai;
+    for (ai = lookup->res; ai != NULL; ai = ai->ai_next) {
+        if (ai->ai_family != AF_INET || ai->ai_addrlen < sizeof(struct sockaddr_in)) continue;
+        dogecoin_node* node = dogecoin_node_new();
+        memcpy(&node->addr, ai->ai_addr, sizeof(struct sockaddr_in));
+        ((struct sockaddr_in*)&node->addr)->sin_port = htons(group->chainparams->default_port);
+        if (dogecoin_node_group_has_addr(group, &node->addr)) {
+            dogecoin_free(node);
+            continue;
+        }
+        if (group->addrman) {
+            dogecoin_p2p_address addr;
+            dogecoin_p2p_address_init(&addr);
+            dogecoin_addr_to_p2paddr(&node->addr, &addr);
+            addr.time = now;
+            addr.services = DOGECOIN_NODE_NETWORK;
+            dogecoin_addrman_add(group->addrman, &addr, now);
+        }
+        dogecoin_node_group_add_node(group, node);
+        added++;
+    }
+    evutil_freeaddrinfo(lookup->res);
+    group->log_write_cb("DNS seed resolved to %d new peers\n", added);
+    if (added > 0 && !lookup->in_call) {
+        dogecoin_node_group_connect_next_nodes(group);
+    }
+    dogecoin_free(lookup);
+}
+
+/**
+ * Adds the peers a dns seed resolved to and connects to them
+ *
+ * @param result 0 or the getaddrinfo error
+ * @param res the resolved addresses
+ * @param ctx the dogecoin_seed_lookup
+ */
+static void dogecoin_node_group_seed_resolved(int result, struct evutil_addrinfo* res, void* ctx)
+{
+    dogecoin_seed_lookup* lookup = (dogecoin_seed_lookup*)ctx;
+    dogecoin_node_group* group = lookup->group;
+    group->dns_pending--;
+    if (result != 0) {
+        group->log_write_cb("DNS seed lookup failed: %s\n", evutil_gai_strerror(result));
+        if (res) evutil_freeaddrinfo(res);
+        dogecoin_free(lookup);
+        return;
+    }
+
+    /* answers from the event loop race the worker, answers from within the request
+       run in the context that started the lookup */
+    lookup->res = res;
+    if (lookup->in_call) {
+        dogecoin_node_group_seed_add_peers(lookup, true);
+    } else {
+        dogecoin_node_group_call_locked(group, dogecoin_node_group_seed_add_peers, lookup);
+    }
+}
+
+/**
+ * Starts resolving all dns seeds of the chain on the groups event base,
+ * unless earlier lookups are still running
+ *
+ * @param group the node group
+ */
+static void dogecoin_node_group_resolve_seeds(dogecoin_node_group* group)
+{
+    if (dogecoin_node_group_on_worker(group)) {
+        dogecoin_worker_post(group->worker, dogecoin_worker_item_new(DOGECOIN_WORKER_RESOLVE_SEEDS, NULL));
+        return;
+    }
+    if (group->dns_pending > 0) {
+        return;
+    }
+    if (!group->dns_base) {
+        group->dns_base = evdns_base_new(group->event_base, EVDNS_BASE_INITIALIZE_NAMESERVERS | EVDNS_BASE_DISABLE_WHEN_INACTIVE);
+        if (!group->dns_base) {
+            group->log_write_cb("Could not set up the DNS resolver\n");
+            return;
+        }
+    }
+
+    struct evutil_addrinfo hints;
+    dogecoin_mem_zero(&hints, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    unsigned int seed_index;
+    /* dogecoin_chainparams has up to 8 dns seeds */
+    for (seed_index = 0; seed_index < 8; seed_index++) {
+        const char* domain = group->chainparams->dnsseeds[seed_index].domain;
+        if (strlen(domain) == 0) {
+            continue;
+        }
+        dogecoin_seed_lookup* lookup = dogecoin_calloc(1, sizeof(*lookup));
+        lookup->group = group;
+        lookup->in_call = true;
+        group->dns_pending++;
+        /* NULL: already answered (and lookup freed) */
+        if (evdns_getaddrinfo(group->dns_base, domain, NULL, &hints, dogecoin_node_group_seed_resolved, lookup) != NULL) {
+            lookup->in_call = false;
+        }
+    }
+}
+
+/**
+ * Points the seed lookups of the group to a nameserver
+ *
+ * @param group the node group
+ * @param ipport the nameserver, ip with optional port
+ *
+ * @return dogecoin_bool (uint8_t)
+ */
+dogecoin_bool dogecoin_node_group_set_nameserver(dogecoin_node_group* group, const char* ipport)
+{
+    if (group->dns_pending > 0) {
+        return false;
+    }
+    if (group->dns_base) {
+        evdns_base_free(group->dns_base, 0);
+    }
+    group->dns_base = evdns_base_new(group->event_base, EVDNS_BASE_DISABLE_WHEN_INACTIVE);
+    if (!group->dns_base) {
+        return false;
+    }
+    return evdns_base_nameserver_ip_add(group->dns_base, ipport) == 0;
+}
+
+/**
+ * It takes a comma seperated list of IPs and adds them to the group.
+ * Without a list the group's address manager provides the best known
+ * peers, the dns seeds are only queried if it knows too few. The seeds
+ * are resolved asynchronously on the groups event loop.
  *
  * @param group the node group to add the nodes to
  * @param ips comma seperated list of ip addresses
@@ -831,34 +1984,12 @@ size_t dogecoin_get_peers_from_dns(const char* seed, vector_t* ips_out, int port
  */
 dogecoin_bool dogecoin_node_group_add_peers_by_ip_or_seed(dogecoin_node_group *group, const char *ips) {
     if (ips == NULL) {
-        /* === DNS QUERY === */
-        vector_t* ips_dns = vector_new(10, free);
-        unsigned int seed_index;
-        /* dogecoin_chainparams has up to 8 dns seeds */
-        for (seed_index = 0; seed_index < 8; seed_index++) {
-            const dogecoin_dns_seed seed = group->chainparams->dnsseeds[seed_index];
-            if (strlen(seed.domain) == 0) {
-                continue;
-            }
-            /* todo: make sure we have enough peers, eventually */
-            dogecoin_get_peers_from_dns(seed.domain, ips_dns, group->chainparams->default_port, AF_INET);
-            unsigned int i;
-            for (i = 0; i < ips_dns->len; i++) {
-                char* ip = (char*)vector_idx(ips_dns, i);
-
-                /* create a node */
-                dogecoin_node* node = dogecoin_node_new();
-                if (dogecoin_node_set_ipport(node, ip) > 0) {
-                    /* add the node to the group */
-                    dogecoin_node_group_add_node(group, node);
-                }
-            }
-            /* exit if we get peers from a seed */
-            if (ips_dns->len > 0) {
-                break;
-            }
+        if (group->addrman && dogecoin_node_group_add_peers_from_addrman(group) >= (size_t)group->desired_amount_connected_nodes) {
+            return true;
         }
-        vector_free(ips_dns, true);
+
+        /* === DNS QUERY === */
+        dogecoin_node_group_resolve_seeds(group);
     } else {
         // add comma seperated ips (nodes)
         char working_str[64];
@@ -935,18 +2066,14 @@ void broadcast_handshake_done(struct dogecoin_node_* node) {
     dogecoin_p2p_inv_msg inv_msg;
     dogecoin_mem_zero(&inv_msg, sizeof(inv_msg));
 
-    uint256_t hash;
-    dogecoin_tx_hash(ctx->tx, hash);
-    dogecoin_p2p_msg_inv_init(&inv_msg, DOGECOIN_INV_TYPE_TX, hash);
+    dogecoin_p2p_msg_inv_init(&inv_msg, DOGECOIN_INV_TYPE_TX, ctx->txhash);
 
     /* serialize the inv count (1) */
     ser_varlen(inv_msg_cstr, 1);
     dogecoin_p2p_msg_inv_ser(&inv_msg, inv_msg_cstr);
 
-    cstring* p2p_msg = dogecoin_p2p_message_new(node->nodegroup->chainparams->netmagic, DOGECOIN_MSG_INV, inv_msg_cstr->str, inv_msg_cstr->len);
+    dogecoin_node_send_message(node, DOGECOIN_MSG_INV, inv_msg_cstr->str, inv_msg_cstr->len);
     cstr_free(inv_msg_cstr, true);
-    dogecoin_node_send(node, p2p_msg);
-    cstr_free(p2p_msg, true);
 
     /* INV sent */
     node->hints |= (1 << 0);
@@ -982,11 +2109,6 @@ dogecoin_bool broadcast_should_connect_more(dogecoin_node* node) {
 void broadcast_post_cmd(struct dogecoin_node_* node, dogecoin_p2p_msg_hdr* hdr, struct const_buffer* buf) {
     struct broadcast_ctx* ctx = (struct broadcast_ctx*)node->nodegroup->ctx;
     if (strcmp(hdr->command, DOGECOIN_MSG_INV) == 0) {
-        /* hash the tx */
-        /* TODO: cache the hash */
-        uint256_t hash;
-        dogecoin_tx_hash(ctx->tx, hash);
-
         uint32_t vsize;
         if (!deser_varlen(&vsize, buf)) {
             dogecoin_node_misbehave(node);
@@ -998,7 +2120,7 @@ void broadcast_post_cmd(struct dogecoin_node_* node, dogecoin_p2p_msg_hdr* hdr,
                 dogecoin_node_misbehave(node);
                 return;
                 }
-            if (memcmp(hash, inv_msg.hash, sizeof(hash)) == 0) {
+            if (memcmp(ctx->txhash, inv_msg.hash, sizeof(ctx->txhash)) == 0) {
                 /* tx found on peer */
                 node->hints |= (1 << 2);
                 printf("node %d has the tx\n", node->nodeid);
@@ -1024,12 +2146,7 @@ void broadcast_post_cmd(struct dogecoin_node_* node, dogecoin_p2p_msg_hdr* hdr,
             };
 
         /* send the tx */
-        cstring* tx_ser = cstr_new_sz(1024);
-        dogecoin_tx_serialize(tx_ser, ctx->tx);
-        cstring* p2p_msg = dogecoin_p2p_message_new(node->nodegroup->chainparams->netmagic, DOGECOIN_MSG_TX, tx_ser->str, tx_ser->len);
-        cstr_free(tx_ser, true);
-        dogecoin_node_send(node, p2p_msg);
-        cstr_free(p2p_msg, true);
+        dogecoin_node_send_shared(node, ctx->tx_msg);
 
         /* tx sent */
         node->hints |= (1 << 1);
@@ -1061,8 +2178,12 @@ dogecoin_bool broadcast_tx(const dogecoin_chainparams* chain, const dogecoin_tx*
     ctx.inved_to_peers = 0;
     ctx.connected_to_peers = 0;
     ctx.max_peers_to_connect = maxpeers;
+    dogecoin_tx_hash(tx, ctx.txhash);
+    cstring* tx_ser = cstr_new_sz(1024);
+    dogecoin_tx_serialize(tx_ser, tx);
     /* create a node group */
     dogecoin_node_group* group = dogecoin_node_group_new(chain);
+    ctx.tx_msg = dogecoin_p2p_shared_msg_new(group->chainparams->netmagic, DOGECOIN_MSG_TX, tx_ser);
     group->desired_amount_connected_nodes = ctx.max_peers_to_connect;
     group->ctx = &ctx;
 
@@ -1079,11 +2200,9 @@ dogecoin_bool broadcast_tx(const dogecoin_chainparams* chain, const dogecoin_tx*
 
     dogecoin_node_group_add_peers_by_ip_or_seed(group, ips);
 
-    uint256_t txhash;
-    dogecoin_tx_hash(tx, txhash);
-    char hexout[sizeof(txhash) * 2 + 1];
-    utils_bin_to_hex(txhash, sizeof(txhash), hexout);
-    hexout[sizeof(txhash) * 2] = 0;
+    char hexout[sizeof(ctx.txhash) * 2 + 1];
+    utils_bin_to_hex(ctx.txhash, sizeof(ctx.txhash), hexout);
+    hexout[sizeof(ctx.txhash) * 2] = 0;
     utils_reverse_hex(hexout, strlen(hexout));
     printf("Start broadcasting transaction: %s with timeout %d seconds\n", hexout, timeout);
     /* connect to the next node */
@@ -1096,6 +2215,7 @@ dogecoin_bool broadcast_tx(const dogecoin_chainparams* chain, const dogecoin_tx*
 
     /* cleanup (free) nodes structures from the heap */
     dogecoin_node_group_free(group);
+    dogecoin_p2p_shared_msg_release(ctx.tx_msg);
 
     printf("\n\nResult:\n=============\n");
     printf("Max nodes to connect to: %d\n", ctx.max_peers_to_connect);
@@ -68,37 +68,48 @@ void dogecoin_p2p_address_init(dogecoin_p2p_address* addr)
 }
 
 /**
- * Create a new cstring object with the header information for a dogecoin p2p message
+ * Write the header of a dogecoin p2p message, including the payload checksum
  *
+ * @param hdr The 24 byte output buffer.
  * @param netmagic The magic number is a 4-byte value that identifies the network.
  * @param command The command string.
- * @param data The data to be sent.
+ * @param data The payload the header describes.
  * @param data_len The length of the data payload.
- *
- * @return A cstring object.
  */
-cstring* dogecoin_p2p_message_new(const unsigned char netmagic[4], const char* command, const void* data, uint32_t data_len)
+void dogecoin_p2p_message_header(unsigned char* hdr, const unsigned char netmagic[4], const char* command, const void* data, uint32_t data_len)
 {
-    cstring* s = cstr_new_sz(DOGECOIN_P2P_HDRSZ + data_len);
-
     /* network identifier (magic number) */
-    cstr_append_buf(s, netmagic, 4);
+    memcpy(hdr, netmagic, 4);
 
-    /* command string */
-    char command_null[12];
-    dogecoin_mem_zero(command_null, 12);
-    memcpy_safe(command_null, command, strlen(command));
-    //memset(command_null+strlen(command), 0, 12-strlen(command));
-    cstr_append_buf(s, command_null, 12);
+    /* command string, zero padded */
+    dogecoin_mem_zero(hdr + 4, 12);
+    memcpy_safe(hdr + 4, command, strlen(command));
 
     /* data length, always 4 bytes */
     uint32_t data_len_le = htole32(data_len);
-    cstr_append_buf(s, &data_len_le, 4);
+    memcpy(hdr + 16, &data_len_le, 4);
 
     /* data checksum (first 4 bytes of the double sha256 hash of the pl) */
     uint256_t msghash;
     dogecoin_hash(data, data_len, msghash);
-    cstr_append_buf(s, &msghash[0], 4);
+    memcpy(hdr + 20, &msghash[0], 4);
+}
+
+/**
+ * Create a new cstring object with the header information for a dogecoin p2p message
+ *
+ * @param netmagic The magic number is a 4-byte value that identifies the network.
+ * @param command The command string.
+ * @param data The data to be sent.
+ * @param data_len The length of the data payload.
+ *
+ * @return A cstring object.
+ */
+cstring* dogecoin_p2p_message_new(const unsigned char netmagic[4], const char* command, const void* data, uint32_t data_len)
+{
+    cstring* s = cstr_new_sz(DOGECOIN_P2P_HDRSZ + data_len);
+    cstr_resize(s, DOGECOIN_P2P_HDRSZ);
+    dogecoin_p2p_message_header((unsigned char*)s->str, netmagic, command, data, data_len);
 
     /* data payload */
     if (data_len > 0)
@@ -128,8 +139,11 @@ dogecoin_bool dogecoin_p2p_deser_addr(unsigned int protocol_version, dogecoin_p2
         return false;
     if (!deser_bytes(&addr->ip, buf, 16))
         return false;
-    if (!deser_u16(&addr->port, buf))
+    /* the port is in network byte order */
+    unsigned char port[2];
+    if (!deser_bytes(port, buf, 2))
         return false;
+    addr->port = (uint16_t)((port[0] << 8) | port[1]);
     return true;
 }
 
@@ -146,7 +160,8 @@ void dogecoin_p2p_ser_addr(unsigned int protover, const dogecoin_p2p_address* ad
         ser_u32(s, addr->time);
     ser_u64(s, addr->services);
     ser_bytes(s, addr->ip, 16);
-    ser_u16(s, addr->port);
+    unsigned char port[2] = {(unsigned char)(addr->port >> 8), (unsigned char)(addr->port & 0xff)};
+    ser_bytes(s, port, 2);
 }
 
 
@@ -187,10 +202,12 @@ void dogecoin_p2paddr_to_addr(dogecoin_p2p_address* p2p_addr, struct sockaddr* a
     if (!is_ipv4_mapped(p2p_addr->ip)) {
         /* ipv6 */
         struct sockaddr_in6* saddr = (struct sockaddr_in6*)addr_out;
+        saddr->sin6_family = AF_INET6;
         memcpy_safe(&saddr->sin6_addr, p2p_addr->ip, 16);
         saddr->sin6_port = htons(p2p_addr->port);
     } else {
         struct sockaddr_in* saddr = (struct sockaddr_in*)addr_out;
+        saddr->sin_family = AF_INET;
         memcpy_safe(&saddr->sin_addr, &p2p_addr->ip[12], 4);
         saddr->sin_port = htons(p2p_addr->port);
     }
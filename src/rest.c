@@ -36,16 +36,14 @@
 #define TIMESTAMP_MAX_LEN 32
 
 /**
- * This function is called when an http request is received
- * It handles the request and sends a response
+ * This function handles an http request and sends a response
  *
  * @param req the request
- * @param arg the client
+ * @param client the client
  *
  * @return Nothing.
  */
-void dogecoin_http_request_cb(struct evhttp_request *req, void *arg) {
-    dogecoin_spv_client* client = (dogecoin_spv_client*)arg;
+static void dogecoin_http_handle_request(struct evhttp_request *req, dogecoin_spv_client* client) {
     dogecoin_wallet* wallet = (dogecoin_wallet*)client->sync_transaction_ctx;
     if (!wallet) {
         evhttp_send_error(req, HTTP_INTERNAL, "Internal Server Error");
@@ -79,6 +77,9 @@ void dogecoin_http_request_cb(struct evhttp_request *req, void *arg) {
         char wallet_total[21];
         dogecoin_mem_zero(wallet_total, 21);
         uint64_t wallet_total_u64 = 0;
+        char address[P2PKHLEN];
+        char script_pubkey[SCRIPT_PUBKEY_STRINGLEN];
+        char amount[KOINU_STRINGLEN];
 
         if (HASH_COUNT(wallet->utxos) > 0) {
             dogecoin_utxo* utxo;
@@ -88,14 +89,17 @@ void dogecoin_http_request_cb(struct evhttp_request *req, void *arg) {
                     // For spent UTXOs
                     evbuffer_add_printf(evb, "%s\n", "----------------------");
                     evbuffer_add_printf(evb, "txid:           %s\n", utils_uint8_to_hex(utxo->txid, sizeof(utxo->txid)));
-                    evbuffer_add_printf(evb, "vout:           %d\n", utxo->vout);
-                    evbuffer_add_printf(evb, "address:        %s\n", utxo->address);
-                    evbuffer_add_printf(evb, "script_pubkey:  %s\n", utxo->script_pubkey);
-                    evbuffer_add_printf(evb, "amount:         %s\n", utxo->amount);
+                    dogecoin_utxo_get_address(utxo, wallet->chain, address, sizeof(address));
+                    dogecoin_utxo_get_script_pubkey_hex(utxo, script_pubkey, sizeof(script_pubkey));
+                    dogecoin_utxo_get_amount_str(utxo, amount);
+                    evbuffer_add_printf(evb, "vout:           %u\n", utxo->vout);
+                    evbuffer_add_printf(evb, "address:        %s\n", address);
+                    evbuffer_add_printf(evb, "script_pubkey:  %s\n", script_pubkey);
+                    evbuffer_add_printf(evb, "amount:         %s\n", amount);
                     evbuffer_add_printf(evb, "confirmations:  %d\n", utxo->confirmations);
                     evbuffer_add_printf(evb, "spendable:      %d\n", utxo->spendable);
                     evbuffer_add_printf(evb, "solvable:       %d\n", utxo->solvable);
-                    wallet_total_u64 += coins_to_koinu_str(utxo->amount);
+                    wallet_total_u64 += utxo->koinu;
                 }
             }
         }
@@ -107,6 +111,9 @@ void dogecoin_http_request_cb(struct evhttp_request *req, void *arg) {
         char wallet_total[21];
         dogecoin_mem_zero(wallet_total, 21);
         uint64_t wallet_total_u64_unspent = 0;
+        char address[P2PKHLEN];
+        char script_pubkey[SCRIPT_PUBKEY_STRINGLEN];
+        char amount[KOINU_STRINGLEN];
 
         dogecoin_utxo* utxo;
         dogecoin_utxo* tmp;
@@ -117,14 +124,17 @@ void dogecoin_http_request_cb(struct evhttp_request *req, void *arg) {
                 evbuffer_add_printf(evb, "----------------------\n");
                 evbuffer_add_printf(evb, "Unspent UTXO:\n");
                 evbuffer_add_printf(evb, "txid:           %s\n", utils_uint8_to_hex(utxo->txid, sizeof(utxo->txid)));
-                evbuffer_add_printf(evb, "vout:           %d\n", utxo->vout);
-                evbuffer_add_printf(evb, "address:        %s\n", utxo->address);
-                evbuffer_add_printf(evb, "script_pubkey:  %s\n", utxo->script_pubkey);
-                evbuffer_add_printf(evb, "amount:         %s\n", utxo->amount);
+                dogecoin_utxo_get_address(utxo, wallet->chain, address, sizeof(address));
+                dogecoin_utxo_get_script_pubkey_hex(utxo, script_pubkey, sizeof(script_pubkey));
+                dogecoin_utxo_get_amount_str(utxo, amount);
+                evbuffer_add_printf(evb, "vout:           %u\n", utxo->vout);
+                evbuffer_add_printf(evb, "address:        %s\n", address);
+                evbuffer_add_printf(evb, "script_pubkey:  %s\n", script_pubkey);
+                evbuffer_add_printf(evb, "amount:         %s\n", amount);
                 evbuffer_add_printf(evb, "confirmations:  %d\n", utxo->confirmations);
                 evbuffer_add_printf(evb, "spendable:      %d\n", utxo->spendable);
                 evbuffer_add_printf(evb, "solvable:       %d\n", utxo->solvable);
-                wallet_total_u64_unspent += coins_to_koinu_str(utxo->amount);
+                wallet_total_u64_unspent += utxo->koinu;
             }
         }
 
@@ -239,3 +249,41 @@ void dogecoin_http_request_cb(struct evhttp_request *req, void *arg) {
     evhttp_send_reply(req, HTTP_OK, "OK", evb);
     evbuffer_free(evb);
 }
+
+typedef struct dogecoin_http_deferred_request_ {
+    struct evhttp_request *req;
+    dogecoin_spv_client* client;
+} dogecoin_http_deferred_request;
+
+/**
+ * Handles a request once the wallet is locked against the validation
+ * worker
+ *
+ * @param ctx the dogecoin_http_deferred_request, freed
+ * @param run false if the server was shut down meanwhile
+ */
+static void dogecoin_http_handle_deferred_request(void *ctx, dogecoin_bool run) {
+    dogecoin_http_deferred_request* request = (dogecoin_http_deferred_request*)ctx;
+    if (run) {
+        dogecoin_http_handle_request(request->req, request->client);
+    }
+    dogecoin_free(request);
+}
+
+/**
+ * This function is called when an http request is received
+ * It handles the request and sends a response, a busy validation
+ * worker delays the request until it finished its job
+ *
+ * @param req the request
+ * @param arg the client
+ *
+ * @return Nothing.
+ */
+void dogecoin_http_request_cb(struct evhttp_request *req, void *arg) {
+    dogecoin_spv_client* client = (dogecoin_spv_client*)arg;
+    dogecoin_http_deferred_request* request = dogecoin_calloc(1, sizeof(*request));
+    request->req = req;
+    request->client = client;
+    dogecoin_node_group_call_locked(client->nodegroup, dogecoin_http_handle_deferred_request, request);
+}
@@ -32,6 +32,7 @@
 #include <string.h>
 
 #include <emmintrin.h>
+#include <immintrin.h>
 
 #include <dogecoin/scrypt.h>
 #include <dogecoin/sha2.h>
@@ -137,3 +138,157 @@ void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchp
 	pbkdf2_hmac_sha256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 	swap_bytes((uint8_t*)output, 32);
 }
+
+/*
+ * Multi lane kernels: every vector holds the same Salsa20/8 word of 4 (SSE2)
+ * or 8 (AVX2) independent hashes, so the rounds need no shuffles at all.
+ * PBKDF2-HMAC-SHA256 is computed per lane, it is a small fraction of the
+ * cost compared to the 2048 Salsa20/8 core invocations.
+ */
+#define SALSA8_DOUBLEROUND(STEP) \
+	/* Operate on columns. */ \
+	STEP( 4,  0, 12,  7); STEP( 9,  5,  1,  7); STEP(14, 10,  6,  7); STEP( 3, 15, 11,  7); \
+	STEP( 8,  4,  0,  9); STEP(13,  9,  5,  9); STEP( 2, 14, 10,  9); STEP( 7,  3, 15,  9); \
+	STEP(12,  8,  4, 13); STEP( 1, 13,  9, 13); STEP( 6,  2, 14, 13); STEP(11,  7,  3, 13); \
+	STEP( 0, 12,  8, 18); STEP( 5,  1, 13, 18); STEP(10,  6,  2, 18); STEP(15, 11,  7, 18); \
+	/* Operate on rows. */ \
+	STEP( 1,  0,  3,  7); STEP( 6,  5,  4,  7); STEP(11, 10,  9,  7); STEP(12, 15, 14,  7); \
+	STEP( 2,  1,  0,  9); STEP( 7,  6,  5,  9); STEP( 8, 11, 10,  9); STEP(13, 12, 15,  9); \
+	STEP( 3,  2,  1, 13); STEP( 4,  7,  6, 13); STEP( 9,  8, 11, 13); STEP(14, 13, 12, 13); \
+	STEP( 0,  3,  2, 18); STEP( 5,  4,  7, 18); STEP(10,  9,  8, 18); STEP(15, 14, 13, 18);
+
+#define SALSA8_STEP_4WAY(a, b, c, n) do { \
+	__m128i T = _mm_add_epi32(x[b], x[c]); \
+	x[a] = _mm_xor_si128(x[a], _mm_slli_epi32(T, n)); \
+	x[a] = _mm_xor_si128(x[a], _mm_srli_epi32(T, 32 - n)); \
+} while (0)
+
+static inline void xor_salsa8_4way(__m128i B[16], const __m128i Bx[16])
+{
+	__m128i x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = _mm_xor_si128(B[i], Bx[i]);
+	for (i = 0; i < 8; i += 2) {
+		SALSA8_DOUBLEROUND(SALSA8_STEP_4WAY)
+	}
+	for (i = 0; i < 16; i++)
+		B[i] = _mm_add_epi32(B[i], x[i]);
+}
+
+void scrypt_1024_1_1_256_sp_sse2_4way(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+	union {
+		__m128i i128[32];
+		uint32_t u32[32][4];
+	} X;
+	__m128i *V;
+	uint32_t *V32;
+	uint32_t i, j, k, l;
+
+	V = (__m128i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+	V32 = (uint32_t *)V;
+
+	for (l = 0; l < 4; l++) {
+		pbkdf2_hmac_sha256((const uint8_t *)input + 80 * l, 80, (const uint8_t *)input + 80 * l, 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k][l] = le32dec(&B[4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = X.i128[k];
+		xor_salsa8_4way(&X.i128[0], &X.i128[16]);
+		xor_salsa8_4way(&X.i128[16], &X.i128[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		for (l = 0; l < 4; l++) {
+			j = 32 * (X.u32[16][l] & 1023);
+			for (k = 0; k < 32; k++)
+				X.u32[k][l] ^= V32[(j + k) * 4 + l];
+		}
+		xor_salsa8_4way(&X.i128[0], &X.i128[16]);
+		xor_salsa8_4way(&X.i128[16], &X.i128[0]);
+	}
+
+	for (l = 0; l < 4; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X.u32[k][l]);
+		pbkdf2_hmac_sha256((const uint8_t *)input + 80 * l, 80, B, 128, 1, (uint8_t *)output + 32 * l, 32);
+		swap_bytes((uint8_t*)output + 32 * l, 32);
+	}
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SCRYPT_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define SCRYPT_AVX2_TARGET
+#endif
+
+#define SALSA8_STEP_8WAY(a, b, c, n) do { \
+	__m256i T = _mm256_add_epi32(x[b], x[c]); \
+	x[a] = _mm256_xor_si256(x[a], _mm256_slli_epi32(T, n)); \
+	x[a] = _mm256_xor_si256(x[a], _mm256_srli_epi32(T, 32 - n)); \
+} while (0)
+
+static inline SCRYPT_AVX2_TARGET void xor_salsa8_8way(__m256i B[16], const __m256i Bx[16])
+{
+	__m256i x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = _mm256_xor_si256(B[i], Bx[i]);
+	for (i = 0; i < 8; i += 2) {
+		SALSA8_DOUBLEROUND(SALSA8_STEP_8WAY)
+	}
+	for (i = 0; i < 16; i++)
+		B[i] = _mm256_add_epi32(B[i], x[i]);
+}
+
+SCRYPT_AVX2_TARGET void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+	union {
+		__m256i i256[32];
+		uint32_t u32[32][8];
+	} X;
+	__m256i *V;
+	__m256i lane_offsets, idx;
+	uint32_t i, k, l;
+
+	V = (__m256i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (l = 0; l < 8; l++) {
+		pbkdf2_hmac_sha256((const uint8_t *)input + 80 * l, 80, (const uint8_t *)input + 80 * l, 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k][l] = le32dec(&B[4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = X.i256[k];
+		xor_salsa8_8way(&X.i256[0], &X.i256[16]);
+		xor_salsa8_8way(&X.i256[16], &X.i256[0]);
+	}
+	/* word k of lane l in row j lives at uint32 index j * 256 + k * 8 + l */
+	lane_offsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	for (i = 0; i < 1024; i++) {
+		idx = _mm256_and_si256(X.i256[16], _mm256_set1_epi32(1023));
+		idx = _mm256_add_epi32(_mm256_slli_epi32(idx, 8), lane_offsets);
+		for (k = 0; k < 32; k++) {
+			X.i256[k] = _mm256_xor_si256(X.i256[k], _mm256_i32gather_epi32((const int *)V, idx, 4));
+			idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8));
+		}
+		xor_salsa8_8way(&X.i256[0], &X.i256[16]);
+		xor_salsa8_8way(&X.i256[16], &X.i256[0]);
+	}
+
+	for (l = 0; l < 8; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X.u32[k][l]);
+		pbkdf2_hmac_sha256((const uint8_t *)input + 80 * l, 80, B, 128, 1, (uint8_t *)output + 32 * l, 32);
+		swap_bytes((uint8_t*)output + 32 * l, 32);
+	}
+}
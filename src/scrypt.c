@@ -36,10 +36,11 @@
 #include <stdint.h>
 #include <string.h>
 
-#if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
+#if defined(USE_SSE2)
 #ifdef _MSC_VER
 // MSVC 64bit is unable to use inline asm
 #include <intrin.h>
+#include <immintrin.h>
 #else
 // GCC Linux or i686-w64-mingw32
 #include <cpuid.h>
@@ -212,6 +213,94 @@ void scrypt_detect_sse2()
 }
 #endif
 
+#if defined(USE_SSE2)
+int scrypt_cpu_has_avx2()
+{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    unsigned long long xcr0 = 0;
+#if defined(_MSC_VER)
+    int x86cpuid[4];
+    __cpuid(x86cpuid, 0);
+    if (x86cpuid[0] < 7) return 0;
+    __cpuid(x86cpuid, 1);
+    ecx = (unsigned int)x86cpuid[2];
+    // AVX and OSXSAVE, the OS has to save the ymm registers
+    if ((ecx & (1 << 27)) == 0 || (ecx & (1 << 28)) == 0) return 0;
+    xcr0 = _xgetbv(0);
+    __cpuidex(x86cpuid, 7, 0);
+    ebx = (unsigned int)x86cpuid[1];
+#else
+    if (__get_cpuid_max(0, NULL) < 7) return 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    // AVX and OSXSAVE, the OS has to save the ymm registers
+    if ((ecx & (1 << 27)) == 0 || (ecx & (1 << 28)) == 0) return 0;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    xcr0 = ((unsigned long long)edx << 32) | eax;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+#endif
+    return (xcr0 & 6) == 6 && (ebx & (1 << 5)) != 0;
+}
+#endif
+
+/**
+ * Returns the widest multi lane kernel the CPU supports for
+ * scrypt_1024_1_1_256_batch (8 lanes with AVX2, 4 lanes with SSE2,
+ * otherwise the single lane kernel). Only queries the CPU, so it can
+ * be called from any thread.
+ *
+ * @return The amount of lanes.
+ */
+unsigned int scrypt_detect_lanes()
+{
+#if defined(USE_SSE2)
+    if (scrypt_cpu_has_avx2()) {
+        return 8;
+    }
+#if !defined(USE_SSE2_ALWAYS)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+#if defined(_MSC_VER)
+    int x86cpuid[4];
+    __cpuid(x86cpuid, 1);
+    edx = (unsigned int)x86cpuid[3];
+#else
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+#endif
+    if ((edx & (1 << 26)) == 0) {
+        return 1;
+    }
+#endif
+    return 4;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Hashes count consecutive 80 byte inputs
+ *
+ * @param input The inputs.
+ * @param output Receives count 32 byte hashes.
+ * @param count The amount of inputs.
+ * @param lanes The kernel width, as returned by scrypt_detect_lanes.
+ * @param scratchpad SCRYPT_LANES_SCRATCHPAD_SIZE(lanes) bytes, reused between calls.
+ */
+void scrypt_1024_1_1_256_batch(const char *input, char *output, size_t count, unsigned int lanes, char *scratchpad)
+{
+    size_t i = 0;
+#if defined(USE_SSE2)
+    for (; lanes > 1 && i + lanes <= count; i += lanes) {
+        if (lanes == 8)
+            scrypt_1024_1_1_256_sp_avx2_8way(input + i * 80, output + i * 32, scratchpad);
+        else
+            scrypt_1024_1_1_256_sp_sse2_4way(input + i * 80, output + i * 32, scratchpad);
+    }
+#endif
+    // remaining inputs that don't fill all lanes
+    for (; i < count; i++) {
+        scrypt_1024_1_1_256_sp(input + i * 80, output + i * 32, scratchpad);
+    }
+}
+
 void scrypt_1024_1_1_256(const char *input, char *output)
 {
     char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
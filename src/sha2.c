@@ -1888,11 +1888,12 @@ void hmac_sha1_prepare(const uint8_t *key, const uint32_t keylen, uint32_t *opad
 
 void hmac_sha256_prepare(const uint8_t *key, const uint32_t keylen,
                          uint32_t *opad_digest, uint32_t *ipad_digest) {
-  static CONFIDENTIAL uint32_t key_pad[SHA256_BLOCK_LENGTH / sizeof(uint32_t)];
+  /* on the stack, pbkdf2 (scrypt) runs on several threads */
+  uint32_t key_pad[SHA256_BLOCK_LENGTH / sizeof(uint32_t)];
+  sha256_context context;
 
   dogecoin_mem_zero(key_pad, sizeof(key_pad));
   if (keylen > SHA256_BLOCK_LENGTH) {
-    static CONFIDENTIAL sha256_context context;
     sha256_init(&context);
     sha256_write(&context, key, keylen);
     sha256_finalize(&context, (uint8_t *)key_pad);
@@ -1900,25 +1901,24 @@ void hmac_sha256_prepare(const uint8_t *key, const uint32_t keylen,
     memcpy_safe(key_pad, key, keylen);
   }
 
-  /* compute o_key_pad and its digest */
+  /* compute o_key_pad and its digest (the pad bytes are equal, no byte swap needed) */
   int i = 0;
   for (; i < SHA256_BLOCK_LENGTH / (int)sizeof(uint32_t); i++) {
-    uint32_t data = 0;
-#if BYTE_ORDER == LITTLE_ENDIAN
-    REVERSE32(key_pad[i], data);
-#else
-    data = key_pad[i];
-#endif
-    key_pad[i] = data ^ 0x5c5c5c5c;
+    key_pad[i] ^= 0x5c5c5c5c;
   }
-  sha256_transform((sha256_context*)key_pad, opad_digest);
+  sha256_init(&context);
+  sha256_transform(&context, key_pad);
+  memcpy_safe(opad_digest, context.state, SHA256_DIGEST_LENGTH);
 
   /* convert o_key_pad to i_key_pad and compute its digest */
   for (i = 0; i < SHA256_BLOCK_LENGTH / (int)sizeof(uint32_t); i++) {
     key_pad[i] = key_pad[i] ^ 0x5c5c5c5c ^ 0x36363636;
   }
-  sha256_transform((sha256_context*)key_pad, ipad_digest);
+  sha256_init(&context);
+  sha256_transform(&context, key_pad);
+  memcpy_safe(ipad_digest, context.state, SHA256_DIGEST_LENGTH);
   dogecoin_mem_zero(key_pad, sizeof(key_pad));
+  dogecoin_mem_zero(&context, sizeof(context));
 }
 
 void hmac_sha256_init(hmac_sha256_context *hctx, const uint8_t *key, const uint32_t keylen)
@@ -2054,12 +2054,9 @@ void pbkdf2_hmac_sha256_init(pbkdf2_hmac_sha256_context *pctx, const uint8_t *pa
   REVERSE32(blocknr, blocknr);
 #endif
 
-    hmac_sha256_prepare(pass, passlen, pctx->odig, pctx->idig);
     dogecoin_mem_zero(pctx->g, sizeof(pctx->g));
     pctx->g[8] = 0x80000000;
     pctx->g[15] = (SHA256_BLOCK_LENGTH + SHA256_DIGEST_LENGTH) * 8;
-    memcpy(hctx.ctx.state, pctx->idig, sizeof(pctx->idig));
-    hctx.ctx.bitcount = SHA256_BLOCK_LENGTH * 8;
 	hmac_sha256_init(&hctx, pass, passlen);
 	hmac_sha256_write(&hctx, salt, saltlen);
 	hmac_sha256_write(&hctx, (uint8_t *)&blocknr, sizeof(blocknr));
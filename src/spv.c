@@ -29,7 +29,6 @@
 #ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
-#include <conio.h>
 #else
 #include <getopt.h>
 #include <arpa/inet.h>
@@ -39,14 +38,16 @@
 #endif
 
 #include <assert.h>
-#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <time.h>
 
+#include <dogecoin/addrman.h>
 #include <dogecoin/block.h>
 #include <dogecoin/blockchain.h>
+#include <dogecoin/blocksync.h>
+#include <dogecoin/bloom.h>
 #include <dogecoin/headersdb.h>
 #include <dogecoin/headersdb_file.h>
 #include <dogecoin/net.h>
@@ -61,12 +62,26 @@ static const unsigned int MIN_TIME_DELTA_FOR_STATE_CHECK = 5;
 static const unsigned int BLOCK_GAP_TO_DEDUCT_TO_START_SCAN_FROM = 5;
 static const unsigned int BLOCKS_DELTA_IN_S = 60;
 static const unsigned int COMPLETED_WHEN_NUM_NODES_AT_SAME_HEIGHT = 2;
+static const unsigned int BLOCKS_PROCESSED_SAVE_INTERVAL = 60;
 
 static dogecoin_bool dogecoin_net_spv_node_timer_callback(dogecoin_node *node, uint64_t *now);
 void dogecoin_net_spv_post_cmd(dogecoin_node *node, dogecoin_p2p_msg_hdr *hdr, struct const_buffer *buf);
 void dogecoin_net_spv_node_handshake_done(dogecoin_node *node);
+static dogecoin_bool dogecoin_net_spv_node_send_filterload(dogecoin_node *node);
+static dogecoin_bool dogecoin_net_spv_parallel_sync(dogecoin_spv_client *client);
+static void dogecoin_net_spv_node_send_locator(dogecoin_node *node, vector_t *blocklocators, dogecoin_bool blocks);
+static void dogecoin_spv_client_filtered_block_reset(dogecoin_spv_client *client, int nodeid);
+static dogecoin_bool dogecoin_spv_client_save_blocks_processed(dogecoin_spv_client *client);
 
 void dogecoin_node_connection_state_changed_cb(dogecoin_node *node) {
+    dogecoin_spv_client *client = (dogecoin_spv_client *)node->nodegroup->ctx;
+    if ((node->state & NODE_CONNECTED) != NODE_CONNECTED || (node->state & NODE_MISSBEHAVED) == NODE_MISSBEHAVED) {
+        if (client->block_scheduler) {
+            // hand the blocks in flight to the remaining peers
+            dogecoin_block_scheduler_release_node(client->block_scheduler, node->nodeid);
+        }
+        dogecoin_spv_client_filtered_block_reset(client, node->nodeid);
+    }
     if (node->nodegroup->should_connect_to_more_nodes_cb) {
         if (node->nodegroup->should_connect_to_more_nodes_cb(node)) {
             dogecoin_spv_client_discover_peers((dogecoin_spv_client*)node->nodegroup->ctx, NULL);
@@ -108,6 +123,91 @@ void dogecoin_net_set_spv(dogecoin_node_group *nodegroup)
     nodegroup->periodic_timer_cb = dogecoin_net_spv_node_timer_callback;
 }
 
+/* a merkleblock of a peer whose matched transactions are still expected */
+typedef struct dogecoin_spv_filtered_block_ {
+    int nodeid;
+    dogecoin_blockindex *pindex;
+    vector_t *txids;
+    unsigned int txs_received;
+} dogecoin_spv_filtered_block;
+
+static void dogecoin_spv_filtered_block_free(void *obj)
+{
+    dogecoin_spv_filtered_block *filtered = (dogecoin_spv_filtered_block *)obj;
+    if (!filtered) return;
+    vector_free(filtered->txids, true);
+    dogecoin_free(filtered);
+}
+
+/**
+ * Finds the merkleblock of a node whose matched transactions are
+ * still expected.
+ *
+ * @param client The spv client.
+ * @param nodeid The id of the node that served the merkleblock.
+ *
+ * @return The filtered block or NULL if none is pending.
+ */
+static dogecoin_spv_filtered_block *dogecoin_spv_client_filtered_block(dogecoin_spv_client *client, int nodeid)
+{
+    size_t i;
+    for (i = 0; i < client->filtered_blocks->len; i++) {
+        dogecoin_spv_filtered_block *filtered = vector_idx(client->filtered_blocks, i);
+        if (filtered->nodeid == nodeid) return filtered;
+    }
+    return NULL;
+}
+
+/**
+ * Drops the matched transactions still expected for the last
+ * merkleblock of a node.
+ *
+ * @param client The spv client.
+ * @param nodeid The id of the node that served the merkleblock.
+ */
+static void dogecoin_spv_client_filtered_block_reset(dogecoin_spv_client *client, int nodeid)
+{
+    size_t i;
+    for (i = 0; i < client->filtered_blocks->len; i++) {
+        dogecoin_spv_filtered_block *filtered = vector_idx(client->filtered_blocks, i);
+        if (filtered->nodeid != nodeid) continue;
+        if (filtered->txids->len > 0) {
+            client->nodegroup->log_write_cb("%d matched transactions of the last merkleblock of node %d were not received\n", (int)filtered->txids->len, nodeid);
+        }
+        vector_remove_idx(client->filtered_blocks, i);
+        return;
+    }
+}
+
+/**
+ * Forwards blocks disconnected by the headers database to the
+ * block_disconnected callback of the client.
+ *
+ * @param ctx The dogecoin_spv_client.
+ * @param pindex The block leaving the main chain.
+ */
+static void dogecoin_spv_client_block_disconnected(void *ctx, const dogecoin_blockindex *pindex)
+{
+    dogecoin_spv_client *client = (dogecoin_spv_client *)ctx;
+    size_t i = client->filtered_blocks->len;
+    while (i-- > 0) {
+        dogecoin_spv_filtered_block *filtered = vector_idx(client->filtered_blocks, i);
+        if (filtered->pindex == pindex) {
+            dogecoin_spv_client_filtered_block_reset(client, filtered->nodeid);
+        }
+    }
+    if (client->block_scheduler) {
+        dogecoin_block_scheduler_rewind(client->block_scheduler, pindex->height);
+    }
+    if (pindex->height > 0 && client->blocks_processed_height >= pindex->height) {
+        client->blocks_processed_height = pindex->height - 1;
+        client->blocks_processed_dirty = true;
+    }
+    if (client->block_disconnected) {
+        client->block_disconnected(client->sync_transaction_ctx, pindex);
+    }
+}
+
 /**
  * The function creates a new dogecoin_spv_client object and initializes it
  *
@@ -115,7 +215,8 @@ void dogecoin_net_set_spv(dogecoin_node_group *nodegroup)
  * @param debug If true, the node will print out debug messages to stdout.
  * @param headers_memonly If true, the headers database will not be loaded from disk.
  * @param use_checkpoints If true, the client will use checkpoints.
- * @param full_sync If true, the client will do a full sync.
+ * @param full_sync If true, the client will do a full sync. Setting SPV_PARALLEL_BLOCK_SYNC_FLAG
+ * afterwards downloads the blocks from all peers once the headers are synced.
  * @param maxnodes The maximum amount of nodes that the client will connect to.
  * @param http_server The IP and port for the HTTP server; if NULL, the HTTP server will not be initialized.
  *
@@ -151,6 +252,9 @@ dogecoin_spv_client* dogecoin_spv_client_new(const dogecoin_chainparams *params,
     }
     client->headers_db = &dogecoin_headers_db_interface_file;
     client->headers_db_ctx = client->headers_db->init(params, headers_memonly);
+    if (client->headers_db->set_disconnect_cb) {
+        client->headers_db->set_disconnect_cb(client->headers_db_ctx, dogecoin_spv_client_block_disconnected, client);
+    }
 
     // set callbacks
     client->header_connected = NULL;
@@ -158,6 +262,20 @@ dogecoin_spv_client* dogecoin_spv_client_new(const dogecoin_chainparams *params,
     client->sync_completed = NULL;
     client->header_message_processed = NULL;
     client->sync_transaction = NULL;
+    client->sync_transaction_view = NULL;
+    client->block_disconnected = NULL;
+    client->filtered_block_connected = NULL;
+    client->bloom_filter = NULL;
+    client->filtered_blocks = vector_new(1, dogecoin_spv_filtered_block_free);
+    client->block_scheduler = NULL;
+    client->blocks_processed_height = 0;
+    client->blocks_processed_dirty = false;
+    client->blocks_processed_last_save = 0;
+    client->blocks_processed_path = NULL;
+
+    // peers are ranked in memory until dogecoin_spv_client_load picks the peers file
+    client->addrman = dogecoin_addrman_new(params);
+    client->nodegroup->addrman = client->addrman;
 
     if (http_server) {
         // split ip and port
@@ -182,11 +300,8 @@ dogecoin_spv_client* dogecoin_spv_client_new(const dogecoin_chainparams *params,
  */
 void dogecoin_spv_client_discover_peers(dogecoin_spv_client* client, const char *ips)
 {
-#ifndef _WIN32
-    // set stdin to non-blocking for quit command
-    int stdin_flags = fcntl(STDIN_FILENO, F_GETFL);
-    fcntl(STDIN_FILENO, F_SETFL, stdin_flags | O_NONBLOCK);
-#endif
+    // 'q' on stdin quits, watched by the event loop
+    dogecoin_node_group_quit_on_stdin(client->nodegroup);
 
     dogecoin_node_group_add_peers_by_ip_or_seed(client->nodegroup, ips);
 }
@@ -230,9 +345,94 @@ void dogecoin_spv_client_free(dogecoin_spv_client *client)
         client->nodegroup = NULL;
     }
 
+    if (client->addrman) {
+        dogecoin_addrman_save(client->addrman);
+        dogecoin_addrman_free(client->addrman);
+        client->addrman = NULL;
+    }
+
+    if (client->blocks_processed_dirty) {
+        dogecoin_spv_client_save_blocks_processed(client);
+    }
+    dogecoin_free(client->blocks_processed_path);
+
+    if (client->filtered_blocks) {
+        vector_free(client->filtered_blocks, true);
+        client->filtered_blocks = NULL;
+    }
+    dogecoin_bloom_filter_free(client->bloom_filter);
+    dogecoin_block_scheduler_free(client->block_scheduler);
+
     dogecoin_free(client);
 }
 
+/**
+ * Writes the height of the last processed block to the progress file
+ * next to the headers database.
+ *
+ * @param client The spv client.
+ *
+ * @return true if the file was written or there is none to write.
+ */
+static dogecoin_bool dogecoin_spv_client_save_blocks_processed(dogecoin_spv_client *client)
+{
+    if (!client->blocks_processed_path) return true;
+    cstring *s = cstr_new_sz(8);
+    ser_bytes(s, client->chainparams->netmagic, 4);
+    ser_u32(s, client->blocks_processed_height);
+
+    cstring *tmp_path = cstr_new(client->blocks_processed_path);
+    cstr_append_buf(tmp_path, ".tmp", 4);
+    dogecoin_bool ret = false;
+    FILE *file = fopen(tmp_path->str, "wb");
+    if (file) {
+        ret = fwrite(s->str, s->len, 1, file) == 1;
+        ret = (fclose(file) == 0) && ret;
+#ifdef _WIN32
+        // rename does not replace existing files on windows
+        if (ret) remove(client->blocks_processed_path);
+#endif
+        ret = ret && rename(tmp_path->str, client->blocks_processed_path) == 0;
+        if (!ret) remove(tmp_path->str);
+    }
+    cstr_free(tmp_path, true);
+    cstr_free(s, true);
+    if (ret) client->blocks_processed_dirty = false;
+    return ret;
+}
+
+/**
+ * Reads the height of the last processed block. Headers databases
+ * from before the progress file count as processed up to their tip.
+ *
+ * @param client The spv client, its headers database is loaded.
+ * @param file_path The path of the progress file.
+ */
+static void dogecoin_spv_client_load_blocks_processed(dogecoin_spv_client *client, const char *file_path)
+{
+    dogecoin_free(client->blocks_processed_path);
+    client->blocks_processed_path = dogecoin_calloc(1, strlen(file_path) + 1);
+    memcpy(client->blocks_processed_path, file_path, strlen(file_path));
+
+    uint32_t tip_height = client->headers_db->getchaintip(client->headers_db_ctx)->height;
+    client->blocks_processed_height = tip_height;
+    client->blocks_processed_last_save = time(NULL);
+    FILE *file = fopen(file_path, "rb");
+    if (!file) {
+        // start the file right away, a crash must not skip the blocks above the tip
+        dogecoin_spv_client_save_blocks_processed(client);
+        return;
+    }
+    unsigned char data[8];
+    if (fread(data, sizeof(data), 1, file) == 1 && memcmp(data, client->chainparams->netmagic, 4) == 0) {
+        struct const_buffer buf = {data + 4, 4};
+        uint32_t height = 0;
+        deser_u32(&height, &buf);
+        if (height < tip_height) client->blocks_processed_height = height;
+    }
+    fclose(file);
+}
+
 /**
  * Loads the headers database from a file
  *
@@ -250,8 +450,41 @@ dogecoin_bool dogecoin_spv_client_load(dogecoin_spv_client *client, const char *
     if (!client->headers_db)
         return false;
 
-    return client->headers_db->load(client->headers_db_ctx, file_path, prompt);
+    if (!client->headers_db->load(client->headers_db_ctx, file_path, prompt))
+        return false;
 
+    // the peers file lives next to a headers file: main_headers.db -> main_headers_peers.db
+    cstring *headers_path = cstr_new_sz(1024);
+    if (file_path) {
+        cstr_append_buf(headers_path, file_path, strlen(file_path));
+    } else {
+        dogecoin_get_default_datadir(headers_path);
+        cstr_append_buf(headers_path, "/headers.db", strlen("/headers.db"));
+    }
+    cstr_append_c(headers_path, 0);
+    struct stat buffer;
+    if (client->addrman && stat(headers_path->str, &buffer) == 0) {
+        cstring *peers_path = cstr_new_sz(headers_path->len + 16);
+        size_t len = strlen(headers_path->str);
+        if (len > 3 && strcmp(headers_path->str + len - 3, ".db") == 0) {
+            len -= 3;
+        }
+        cstr_append_buf(peers_path, headers_path->str, len);
+        cstr_append_buf(peers_path, "_peers.db", strlen("_peers.db"));
+        if (!dogecoin_addrman_load(client->addrman, peers_path->str)) {
+            client->nodegroup->log_write_cb("Could not read all peers of %s\n", peers_path->str);
+        }
+        client->addrman->last_save = time(NULL);
+        client->nodegroup->log_write_cb("Loaded %d known peers\n", (int)client->addrman->entries->len);
+
+        // main_headers.db -> main_headers_blocks.db
+        cstr_resize(peers_path, len);
+        cstr_append_buf(peers_path, "_blocks.db", strlen("_blocks.db"));
+        dogecoin_spv_client_load_blocks_processed(client, peers_path->str);
+        cstr_free(peers_path, true);
+    }
+    cstr_free(headers_path, true);
+    return true;
 }
 
 /**
@@ -329,6 +562,18 @@ static dogecoin_bool dogecoin_net_spv_node_timer_callback(dogecoin_node *node, u
         dogecoin_net_spv_periodic_statecheck(node, now);
     }
 
+    if (client->addrman && client->addrman->dirty && client->addrman->last_save + DOGECOIN_ADDRMAN_SAVE_INTERVAL < *now)
+    {
+        client->addrman->last_save = *now;
+        dogecoin_addrman_save(client->addrman);
+    }
+
+    if (client->blocks_processed_dirty && client->blocks_processed_last_save + BLOCKS_PROCESSED_SAVE_INTERVAL < *now)
+    {
+        client->blocks_processed_last_save = *now;
+        dogecoin_spv_client_save_blocks_processed(client);
+    }
+
     return true;
 }
 
@@ -356,6 +601,11 @@ void dogecoin_net_spv_fill_block_locator(dogecoin_spv_client *client, vector_t *
                     vector_add(blocklocators, (void *)hash);
                     if (!client->headers_db->has_checkpoint_start(client->headers_db_ctx)) {
                         client->headers_db->set_checkpoint_start(client->headers_db_ctx, *hash, checkpoint[i].height, (uint8_t*)client->chainparams->minimumchainwork);
+                        // blocks below the checkpoint are not of interest and have no headers
+                        if (client->blocks_processed_height < checkpoint[i].height) {
+                            client->blocks_processed_height = checkpoint[i].height;
+                            client->blocks_processed_dirty = true;
+                        }
                     }
                 }
             }
@@ -383,14 +633,42 @@ void dogecoin_net_spv_node_request_headers_or_blocks(dogecoin_node *node, dogeco
     vector_t *blocklocators = vector_new(1, free);
 
     dogecoin_net_spv_fill_block_locator((dogecoin_spv_client *)node->nodegroup->ctx, blocklocators);
+    dogecoin_net_spv_node_send_locator(node, blocklocators, blocks);
+    vector_free(blocklocators, true);
+}
 
+/**
+ * Requests the headers following the given hash, used to ask for the
+ * next batch before the current one is connected.
+ *
+ * @param node The node to request the headers from.
+ * @param hash The hash of the last header received from the node.
+ */
+static void dogecoin_net_spv_node_request_headers_after(dogecoin_node *node, const uint256_t hash)
+{
+    vector_t *blocklocators = vector_new(1, free);
+    uint256_t *locator = dogecoin_calloc(1, sizeof(uint256_t));
+    memcpy_safe(locator, hash, sizeof(uint256_t));
+    vector_add(blocklocators, locator);
+    dogecoin_net_spv_node_send_locator(node, blocklocators, false);
+    vector_free(blocklocators, true);
+}
+
+/**
+ * Sends a getheaders or getblocks message with the given block locator
+ *
+ * @param node The node to send the request to.
+ * @param blocklocators The block locator hashes.
+ * @param blocks boolean, true if we want to request blocks, false if we want to request headers
+ */
+static void dogecoin_net_spv_node_send_locator(dogecoin_node *node, vector_t *blocklocators, dogecoin_bool blocks)
+{
     cstring *getheader_msg = cstr_new_sz(256);
     dogecoin_p2p_msg_getheaders(blocklocators, NULL, getheader_msg);
 
-    cstring *p2p_msg = dogecoin_p2p_message_new(node->nodegroup->chainparams->netmagic, (blocks ? DOGECOIN_MSG_GETBLOCKS : DOGECOIN_MSG_GETHEADERS), getheader_msg->str, getheader_msg->len);
+    dogecoin_node_send_message(node, (blocks ? DOGECOIN_MSG_GETBLOCKS : DOGECOIN_MSG_GETHEADERS), getheader_msg->str, getheader_msg->len);
     cstr_free(getheader_msg, true);
 
-    dogecoin_node_send(node, p2p_msg);
     node->state |= ( blocks ? NODE_BLOCKSYNC : NODE_HEADERSYNC);
 
     if (blocks) {
@@ -398,9 +676,6 @@ void dogecoin_net_spv_node_request_headers_or_blocks(dogecoin_node *node, dogeco
     } else {
         ((dogecoin_spv_client*)node->nodegroup->ctx)->last_headersrequest_time = time(NULL);
     }
-
-    vector_free(blocklocators, true);
-    cstr_free(p2p_msg, true);
 }
 
 /**
@@ -413,6 +688,10 @@ void dogecoin_net_spv_node_request_headers_or_blocks(dogecoin_node *node, dogeco
  */
 dogecoin_bool dogecoin_net_spv_request_headers(dogecoin_spv_client *client)
 {
+    if ((client->stateflags & SPV_PARALLEL_BLOCK_SYNC_FLAG) == SPV_PARALLEL_BLOCK_SYNC_FLAG) {
+        return dogecoin_net_spv_parallel_sync(client);
+    }
+
     size_t i;
     dogecoin_bool new_headers_available = false;
     for(i = 0; i < client->nodegroup->nodes->len; ++i)
@@ -490,6 +769,105 @@ dogecoin_bool dogecoin_net_spv_request_headers(dogecoin_spv_client *client)
     return new_headers_available;
 }
 
+/**
+ * Requests the next ranges of the parallel block download from all
+ * peers with a free download window.
+ *
+ * @param client the spv client
+ *
+ * @return The amount of requested blocks.
+ */
+static uint32_t dogecoin_net_spv_schedule_blocks(dogecoin_spv_client *client)
+{
+    uint64_t now = time(NULL);
+    uint32_t requested = 0;
+    size_t i;
+    // the best ranked peers get the lowest, most urgent heights
+    dogecoin_node **nodes = dogecoin_calloc(client->nodegroup->nodes->len + 1, sizeof(dogecoin_node*));
+    dogecoin_node_group_rank_nodes(client->nodegroup, nodes);
+    for (i = 0; i < client->nodegroup->nodes->len; i++)
+    {
+        dogecoin_node *node = nodes[i];
+        if ((node->state & NODE_CONNECTED) != NODE_CONNECTED || (node->state & NODE_MISSBEHAVED) == NODE_MISSBEHAVED || !node->version_handshake) continue;
+
+        cstring *inv = cstr_new_sz(client->block_scheduler->window * 36);
+        uint32_t count = dogecoin_block_scheduler_assign(client->block_scheduler, node->nodeid, node->bestknownheight, now, inv);
+        if (count > 0) {
+            cstring *getdata = cstr_new_sz(inv->len + 9);
+            ser_varlen(getdata, count);
+            cstr_append_buf(getdata, inv->str, inv->len);
+            dogecoin_node_send_message(node, DOGECOIN_MSG_GETDATA, getdata->str, getdata->len);
+            cstr_free(getdata, true);
+            requested += count;
+        }
+        cstr_free(inv, true);
+    }
+    dogecoin_free(nodes);
+    if (requested > 0) {
+        client->nodegroup->log_write_cb("Requested %d blocks, next block to connect at height %d\n", requested, client->block_scheduler->next_height);
+    }
+    return requested;
+}
+
+/**
+ * Drives the full sync catch up: headers are synced from the peer with
+ * the longest chain while the blocks of all known headers get downloaded
+ * from every connected peer. Once both reached the tip the client falls
+ * back to the regular block sync.
+ *
+ * @param client the spv client
+ *
+ * @return true if the catch up is still in progress.
+ */
+static dogecoin_bool dogecoin_net_spv_parallel_sync(dogecoin_spv_client *client)
+{
+    dogecoin_node *headers_node = NULL;
+    dogecoin_node *node_with_longest_chain = NULL;
+    unsigned int longest_chain_height = 0;
+    size_t i;
+    for (i = 0; i < client->nodegroup->nodes->len; i++)
+    {
+        dogecoin_node *check_node = vector_idx(client->nodegroup->nodes, i);
+        if (((check_node->state & NODE_CONNECTED) != NODE_CONNECTED) || !check_node->version_handshake) continue;
+        if ((check_node->state & NODE_HEADERSYNC) == NODE_HEADERSYNC) {
+            headers_node = check_node;
+        }
+        if (check_node->bestknownheight > longest_chain_height) {
+            longest_chain_height = check_node->bestknownheight;
+            node_with_longest_chain = check_node;
+        }
+    }
+    if (!node_with_longest_chain) return false;
+
+    dogecoin_blockindex *chaintip = client->headers_db->getchaintip(client->headers_db_ctx);
+    if (!headers_node && longest_chain_height > chaintip->height) {
+        dogecoin_net_spv_node_request_headers_or_blocks(node_with_longest_chain, false);
+        headers_node = node_with_longest_chain;
+    }
+
+    if (client->block_scheduler) {
+        uint32_t stalled = dogecoin_block_scheduler_check_stalls(client->block_scheduler, time(NULL));
+        if (stalled > 0) {
+            client->nodegroup->log_write_cb("Reassigning %d stalled blocks\n", stalled);
+        }
+        dogecoin_net_spv_schedule_blocks(client);
+    }
+
+    if (headers_node || (client->block_scheduler && !dogecoin_block_scheduler_done(client->block_scheduler))) {
+        return true;
+    }
+
+    client->nodegroup->log_write_cb("Parallel block download completed at height %d\n", chaintip->height);
+    dogecoin_block_scheduler_free(client->block_scheduler);
+    client->block_scheduler = NULL;
+    client->stateflags &= ~SPV_PARALLEL_BLOCK_SYNC_FLAG;
+    if (!client->called_sync_completed && client->sync_completed) {
+        client->sync_completed(client);
+        client->called_sync_completed = true;
+    }
+    return false;
+}
+
 /**
  * When the handshake is done, we request the headers
  *
@@ -497,9 +875,292 @@ dogecoin_bool dogecoin_net_spv_request_headers(dogecoin_spv_client *client)
  */
 void dogecoin_net_spv_node_handshake_done(dogecoin_node *node)
 {
+    if (node->version >= DOGECOIN_SENDHEADERS_VERSION) {
+        // new blocks get announced with their headers instead of an inv
+        dogecoin_node_send_message(node, DOGECOIN_MSG_SENDHEADERS, NULL, 0);
+    }
+    dogecoin_net_spv_node_send_filterload(node);
     dogecoin_net_spv_request_headers((dogecoin_spv_client*)node->nodegroup->ctx);
 }
 
+/**
+ * Sends the bloom filter of the client to a node, nodes without
+ * NODE_BLOOM keep serving full blocks.
+ *
+ * @param node The node to load the filter into.
+ *
+ * @return true if the filter was sent.
+ */
+static dogecoin_bool dogecoin_net_spv_node_send_filterload(dogecoin_node *node)
+{
+    dogecoin_spv_client *client = (dogecoin_spv_client *)node->nodegroup->ctx;
+    if (!client->bloom_filter || !(node->services & DOGECOIN_NODE_BLOOM)) return false;
+    cstring *payload = cstr_new_sz(client->bloom_filter->size + 16);
+    dogecoin_bloom_filter_serialize(payload, client->bloom_filter);
+    dogecoin_node_send_message(node, DOGECOIN_MSG_FILTERLOAD, payload->str, payload->len);
+    cstr_free(payload, true);
+    return true;
+}
+
+/**
+ * Replaces the bloom filter of the client and loads it into all
+ * connected nodes. Without a filter blocks are downloaded in full.
+ *
+ * @param client The spv client.
+ * @param filter The new filter (owned by the client) or NULL.
+ */
+void dogecoin_spv_client_set_bloom_filter(dogecoin_spv_client *client, dogecoin_bloom_filter *filter)
+{
+    dogecoin_bloom_filter_free(client->bloom_filter);
+    client->bloom_filter = filter;
+    if (filter) {
+        // merkleblocks are followed by their matched transactions, keep them on a single peer
+        dogecoin_block_scheduler_free(client->block_scheduler);
+        client->block_scheduler = NULL;
+        client->stateflags &= ~SPV_PARALLEL_BLOCK_SYNC_FLAG;
+    }
+    size_t i;
+    for (i = 0; i < client->nodegroup->nodes->len; i++) {
+        dogecoin_node *node = vector_idx(client->nodegroup->nodes, i);
+        if ((node->state & NODE_CONNECTED) == NODE_CONNECTED && node->version_handshake) {
+            if (filter) {
+                dogecoin_net_spv_node_send_filterload(node);
+            } else if (node->services & DOGECOIN_NODE_BLOOM) {
+                dogecoin_node_send_message(node, DOGECOIN_MSG_FILTERCLEAR, NULL, 0);
+            }
+        }
+    }
+}
+
+/**
+ * Looks up a block whose header was connected before the block itself
+ * arrived, e.g. after a headers announcement.
+ *
+ * @param client The spv client.
+ * @param pindex The index returned by connect_hdr for the block.
+ *
+ * @return The main chain index of the block or NULL.
+ */
+static dogecoin_blockindex *dogecoin_net_spv_known_block(dogecoin_spv_client *client, dogecoin_blockindex *pindex)
+{
+    if (!pindex || !client->headers_db->find || dogecoin_hash_is_empty(pindex->hash)) return NULL;
+    dogecoin_blockindex *known = client->headers_db->find(client->headers_db_ctx, pindex->hash);
+    if (!known) return NULL;
+
+    // blocks of side chains must not reach the wallet
+    dogecoin_blockindex main_chain;
+    if (client->headers_db->get_header_at_height &&
+        (!client->headers_db->get_header_at_height(client->headers_db_ctx, known->height, &main_chain) ||
+         memcmp(main_chain.hash, known->hash, sizeof(uint256_t)) != 0)) {
+        return NULL;
+    }
+    return known;
+}
+
+/**
+ * Parses the transactions of a block and hands them to the sync
+ * callbacks.
+ *
+ * @param client The spv client.
+ * @param node The node that served the block.
+ * @param pindex The block the transactions belong to.
+ * @param buf The block data after the header.
+ * @param block_size The size of the block message.
+ *
+ * @return true if all transactions could be parsed.
+ */
+static dogecoin_bool dogecoin_net_spv_process_block_txs(dogecoin_spv_client *client, dogecoin_node *node, dogecoin_blockindex *pindex, struct const_buffer *buf, uint32_t block_size)
+{
+    time_t lasttime = pindex->header.timestamp;
+    char s[1000];
+    time_t t = lasttime;
+    struct tm *p = localtime(&t);
+    strftime(s, sizeof s, "%F %T", p);
+    char *ctime_no_newline;
+    ctime_no_newline = strtok(s, "\n");
+    printf("%s|%d|%s|%d\n", hash_to_string(pindex->hash), pindex->height, ctime_no_newline, block_size);
+    uint64_t start = time(NULL);
+
+    uint32_t amount_of_txs;
+    if (!deser_varlen(&amount_of_txs, buf)) {
+        client->nodegroup->log_write_cb("Error deserializing amount of transactions from node %d\n", node->nodeid);
+        return false;
+    }
+
+    client->nodegroup->log_write_cb("Start parsing %d transactions...\n", (int)amount_of_txs);
+
+    // update the last block info for the client
+    client->last_block_tx_count = amount_of_txs;
+    client->last_block_size = block_size;
+
+    uint64_t total_tx_size = 0;
+
+    // parse into a reusable view, a full tx is only materialized for the legacy callback
+    dogecoin_tx_view txview;
+    dogecoin_tx_view_init(&txview);
+    size_t consumedlength = 0;
+    unsigned int i;
+    for (i = 0; i < amount_of_txs; i++)
+    {
+        if (!dogecoin_tx_view_parse(&txview, buf->p, buf->len, &consumedlength)) {
+            client->nodegroup->log_write_cb("Error deserializing transaction\n");
+            dogecoin_tx_view_free(&txview);
+            return false;
+        }
+        if (client->sync_transaction_view) { client->sync_transaction_view(client->sync_transaction_ctx, &txview, i, pindex); }
+        if (client->sync_transaction) {
+            dogecoin_tx* tx = dogecoin_tx_new();
+            if (dogecoin_tx_view_to_tx(&txview, tx)) {
+                client->sync_transaction(client->sync_transaction_ctx, tx, i, pindex);
+            }
+            dogecoin_tx_free(tx);
+        }
+        deser_skip(buf, consumedlength);
+        total_tx_size += consumedlength;
+    }
+    dogecoin_tx_view_free(&txview);
+    client->last_block_total_tx_size = total_tx_size;
+    client->blocks_processed_height = pindex->height;
+    client->blocks_processed_dirty = true;
+    client->nodegroup->log_write_cb("done (took %lld secs)\n", (unsigned long long)(time(NULL) - start));
+    return true;
+}
+
+/**
+ * Looks up a node of the client's nodegroup by its id.
+ *
+ * @param client The spv client.
+ * @param nodeid The id of the node.
+ *
+ * @return The node or NULL if it is not part of the nodegroup.
+ */
+static dogecoin_node *dogecoin_net_spv_find_node(dogecoin_spv_client *client, int nodeid)
+{
+    size_t i;
+    for (i = 0; i < client->nodegroup->nodes->len; i++) {
+        dogecoin_node *check_node = vector_idx(client->nodegroup->nodes, i);
+        if (check_node->nodeid == nodeid) return check_node;
+    }
+    return NULL;
+}
+
+/**
+ * Stores a block of the parallel download in the reorder buffer and
+ * processes all blocks that are now next in height order. The headers
+ * of these blocks are already connected.
+ *
+ * @param node The node that served the block.
+ * @param buf The block message.
+ */
+static void dogecoin_net_spv_scheduled_block(dogecoin_node *node, struct const_buffer *buf)
+{
+    dogecoin_spv_client *client = (dogecoin_spv_client *)node->nodegroup->ctx;
+    if (!client->block_scheduler) return;
+
+    // only the header is parsed now, the transactions wait in the reorder buffer
+    dogecoin_block_header header;
+    uint256_t hash;
+    uint256_t chainwork;
+    dogecoin_mem_zero(chainwork, sizeof(chainwork));
+    if (!dogecoin_block_header_deserialize(&header, buf, client->chainparams, &chainwork)) {
+        client->nodegroup->log_write_cb("Error deserializing block header from node %d\n", node->nodeid);
+        return;
+    }
+    dogecoin_block_header_hash(&header, hash);
+
+    // a body that does not belong to the header is dropped before it takes a slot
+    uint256_t merkle_root;
+    if (!dogecoin_block_txs_merkle_root(buf, merkle_root) || memcmp(merkle_root, header.merkle_root, sizeof(uint256_t)) != 0) {
+        client->nodegroup->log_write_cb("Got block %s with invalid transactions from node %d\n", hash_to_string(hash), node->nodeid);
+        node->state |= NODE_MISSBEHAVED;
+        node->nodegroup->node_connection_state_changed_cb(node);
+        return;
+    }
+    if (!dogecoin_block_scheduler_block_received(client->block_scheduler, node->nodeid, hash, buf->p, buf->len)) {
+        client->nodegroup->log_write_cb("Got unrequested block %s from node %d\n", hash_to_string(hash), node->nodeid);
+        return;
+    }
+
+    dogecoin_blockindex index;
+    cstring *block;
+    int source_nodeid;
+    while ((block = dogecoin_block_scheduler_next(client->block_scheduler, &index, &source_nodeid)) != NULL) {
+        // the block waited in the reorder buffer, it may come from another peer than this message
+        dogecoin_node *source = dogecoin_net_spv_find_node(client, source_nodeid);
+        struct const_buffer txs = { block->str, block->len };
+        dogecoin_bool processed = dogecoin_net_spv_process_block_txs(client, source ? source : node, &index, &txs, (uint32_t)block->len);
+        cstr_free(block, true);
+        if (!processed) {
+            client->nodegroup->log_write_cb("Processing block at height %d from node %d failed\n", index.height, source_nodeid);
+            if (source) {
+                source->state |= NODE_MISSBEHAVED;
+                source->nodegroup->node_connection_state_changed_cb(source);
+            }
+            // download the block again, possibly from another peer
+            dogecoin_block_scheduler_rewind(client->block_scheduler, index.height);
+            dogecoin_block_scheduler_set_target(client->block_scheduler, client->headers_db->getchaintip(client->headers_db_ctx)->height);
+            break;
+        }
+    }
+
+    dogecoin_net_spv_parallel_sync(client);
+}
+
+/**
+ * Continues the block download once the last requested block of
+ * an inv was processed, or signals that the sync completed.
+ *
+ * @param node The node that served the block.
+ * @param pindex The processed block.
+ */
+static void dogecoin_net_spv_block_processed(dogecoin_node *node, dogecoin_blockindex *pindex)
+{
+    dogecoin_spv_client *client = (dogecoin_spv_client *)node->nodegroup->ctx;
+    if (dogecoin_hash_equal((uint8_t *)node->last_requested_inv, (uint8_t *)pindex->hash)) {
+        // instead of querying whether the last connected header timestamp is greater than the oldest item of interest
+        // we check if the height is greater than or equal to the node's bestknown height minus 5 minutes
+        if (client->headers_db->getchaintip(client->headers_db_ctx)->height >= node->bestknownheight - 5) {
+            // last requested block reached, consider stop syncing
+            if (!client->called_sync_completed && client->sync_completed) { client->sync_completed(client); client->called_sync_completed = true; }
+        } else if (client->headers_db->getchaintip(client->headers_db_ctx)->height < node->bestknownheight - 1440) {
+            node->time_last_request = time(NULL);
+            dogecoin_net_spv_node_request_headers_or_blocks(node, true);
+        }
+    }
+}
+
+/**
+ * Requests a merkleblock from another peer after the peer that
+ * served it sent an invalid partial merkle tree.
+ *
+ * @param client The spv client.
+ * @param failed_node The node that served the invalid merkleblock.
+ * @param pindex The block to request again.
+ *
+ * @return true if another peer was asked.
+ */
+static dogecoin_bool dogecoin_net_spv_request_filtered_block(dogecoin_spv_client *client, dogecoin_node *failed_node, dogecoin_blockindex *pindex)
+{
+    size_t i;
+    for (i = 0; i < client->nodegroup->nodes->len; i++)
+    {
+        dogecoin_node *check_node = vector_idx(client->nodegroup->nodes, i);
+        if (check_node == failed_node || (check_node->state & NODE_CONNECTED) != NODE_CONNECTED ||
+            (check_node->state & NODE_MISSBEHAVED) == NODE_MISSBEHAVED || !check_node->version_handshake ||
+            !(check_node->services & DOGECOIN_NODE_BLOOM) || check_node->bestknownheight < pindex->height) continue;
+
+        cstring *getdata = cstr_new_sz(37);
+        ser_varlen(getdata, 1);
+        ser_u32(getdata, DOGECOIN_INV_TYPE_FILTERED_BLOCK);
+        ser_u256(getdata, pindex->hash);
+        dogecoin_node_send_message(check_node, DOGECOIN_MSG_GETDATA, getdata->str, getdata->len);
+        cstr_free(getdata, true);
+        client->nodegroup->log_write_cb("Requesting merkleblock at height %d from node %d\n", pindex->height, check_node->nodeid);
+        return true;
+    }
+    return false;
+}
+
 /**
  * The function is called when a new message is received from a peer
  *
@@ -538,78 +1199,64 @@ void dogecoin_net_spv_post_cmd(dogecoin_node *node, dogecoin_p2p_msg_hdr *hdr, s
         if (contains_block) {
             node->time_last_request = time(NULL);
             client->nodegroup->log_write_cb("Requesting %d blocks\n", varlen);
-            cstring *p2p_msg = dogecoin_p2p_message_new(node->nodegroup->chainparams->netmagic, DOGECOIN_MSG_GETDATA, original_inv.p, original_inv.len);
-            dogecoin_node_send(node, p2p_msg);
-            cstr_free(p2p_msg, true);
+            cstring *getdata = cstr_new_buf(original_inv.p, original_inv.len);
+            if (client->bloom_filter && (node->services & DOGECOIN_NODE_BLOOM)) {
+                // ask for merkleblocks instead, the inv entries follow the item count
+                struct const_buffer items = { getdata->str, getdata->len };
+                deser_varlen(&varlen, &items);
+                uint8_t *type = (uint8_t *)items.p;
+                for (i = 0; i < varlen; i++, type += 36) {
+                    if (type[0] == DOGECOIN_INV_TYPE_BLOCK && type[1] == 0 && type[2] == 0 && type[3] == 0) {
+                        type[0] = DOGECOIN_INV_TYPE_FILTERED_BLOCK;
+                    }
+                }
+            }
+            dogecoin_node_send_message(node, DOGECOIN_MSG_GETDATA, getdata->str, getdata->len);
+            cstr_free(getdata, true);
         }
     }
 
-    if (strcmp(hdr->command, DOGECOIN_MSG_BLOCK) == 0)
+    if (strcmp(hdr->command, DOGECOIN_MSG_BLOCK) == 0 && (client->stateflags & SPV_PARALLEL_BLOCK_SYNC_FLAG) == SPV_PARALLEL_BLOCK_SYNC_FLAG)
+    {
+        dogecoin_net_spv_scheduled_block(node, buf);
+    }
+    else if (strcmp(hdr->command, DOGECOIN_MSG_BLOCK) == 0)
     {
         dogecoin_bool connected;
         dogecoin_blockindex *pindex = client->headers_db->connect_hdr(client->headers_db_ctx, buf, false, &connected);
+        dogecoin_blockindex *known = connected ? NULL : dogecoin_net_spv_known_block(client, pindex);
+        if (known) {
+            // the header arrived with an announcement
+            dogecoin_free(pindex);
+            pindex = known;
+            connected = true;
+        }
 
         node->time_last_request = time(NULL);
 
         if (connected) {
-            if (client->header_connected) { client->header_connected(client); }
+            if (!known && client->header_connected) { client->header_connected(client); }
 
             // for now, turn of stall checks if we are near the tip
             if (pindex->header.timestamp > node->time_last_request - 30*60) {
                 node->time_last_request = 0;
             }
 
-            time_t lasttime = pindex->header.timestamp;
-            char s[1000];
-            time_t t = lasttime;
-            struct tm *p = localtime(&t);
-            strftime(s, sizeof s, "%F %T", p);
-            char *ctime_no_newline;
-            ctime_no_newline = strtok(s, "\n");
-            printf("%s|%d|%s|%d\n", hash_to_string(pindex->hash), pindex->height, ctime_no_newline, hdr->data_len);
-            uint64_t start = time(NULL);
-
-            uint32_t amount_of_txs;
-            if (!deser_varlen(&amount_of_txs, buf)) {
-                if (!client->headers_db->disconnect_tip(client->headers_db_ctx)) {
+            // a body that does not belong to the header must not reach the callbacks
+            uint256_t merkle_root;
+            dogecoin_bool valid_txs = dogecoin_block_txs_merkle_root(buf, merkle_root) && memcmp(merkle_root, pindex->header.merkle_root, sizeof(uint256_t)) == 0;
+            if (!valid_txs) {
+                client->nodegroup->log_write_cb("Got block %s with invalid transactions from node %d\n", hash_to_string(pindex->hash), node->nodeid);
+            }
+            if (!valid_txs || !dogecoin_net_spv_process_block_txs(client, node, pindex, buf, hdr->data_len)) {
+                if (!known && !client->headers_db->disconnect_tip(client->headers_db_ctx)) {
                     dogecoin_free(pindex);
                 }
-                client->nodegroup->log_write_cb("Error deserializing amount of transactions from node %d\n", node->nodeid);
                 node->state &= ~NODE_BLOCKSYNC;
+                if (!valid_txs) node->state |= NODE_MISSBEHAVED;
                 node->nodegroup->node_connection_state_changed_cb(node);
                 return;
             }
-
-            client->nodegroup->log_write_cb("Start parsing %d transactions...\n", (int)amount_of_txs);
-
-            // update the last block info for the client
-            client->last_block_tx_count = amount_of_txs;
-            client->last_block_size = hdr->data_len;
-
-            uint64_t total_tx_size = 0;
-
-            size_t consumedlength = 0;
-            unsigned int i;
-            for (i = 0; i < amount_of_txs; i++)
-            {
-                dogecoin_tx* tx = dogecoin_tx_new();
-                if (!dogecoin_tx_deserialize(buf->p, buf->len, tx, &consumedlength)) {
-                    client->nodegroup->log_write_cb("Error deserializing transaction\n");
-                    if (!client->headers_db->disconnect_tip(client->headers_db_ctx)) {
-                        dogecoin_free(pindex);
-                    }
-                    dogecoin_tx_free(tx);
-                    node->state &= ~NODE_BLOCKSYNC;
-                    node->nodegroup->node_connection_state_changed_cb(node);
-                    return;
-                }
-                deser_skip(buf, consumedlength);
-                if (client->sync_transaction) { client->sync_transaction(client->sync_transaction_ctx, tx, i, pindex); }
-                total_tx_size += consumedlength;
-                dogecoin_tx_free(tx);
-            }
-            client->last_block_total_tx_size = total_tx_size;
-            client->nodegroup->log_write_cb("done (took %lld secs)\n", (unsigned long long)(time(NULL) - start));
         }
         else
         {
@@ -621,17 +1268,106 @@ void dogecoin_net_spv_post_cmd(dogecoin_node *node, dogecoin_p2p_msg_hdr *hdr, s
             return;
         }
 
-        if (dogecoin_hash_equal((uint8_t *)node->last_requested_inv, (uint8_t *)pindex->hash)) {
-            // instead of querying whether the last connected header timestamp is greater than the oldest item of interest
-            // we check if the height is greater than or equal to the node's bestknown height minus 5 minutes
-            if (client->headers_db->getchaintip(client->headers_db_ctx)->height >= node->bestknownheight - 5) {
-                // last requested block reached, consider stop syncing
-                if (!client->called_sync_completed && client->sync_completed) { client->sync_completed(client); client->called_sync_completed = true; }
-            } else if (client->headers_db->getchaintip(client->headers_db_ctx)->height < node->bestknownheight - 1440) {
-                node->time_last_request = time(NULL);
-                dogecoin_net_spv_node_request_headers_or_blocks(node, true);
+        dogecoin_net_spv_block_processed(node, pindex);
+    }
+
+    if (strcmp(hdr->command, DOGECOIN_MSG_MERKLEBLOCK) == 0)
+    {
+        dogecoin_bool connected;
+        dogecoin_blockindex *pindex = client->headers_db->connect_hdr(client->headers_db_ctx, buf, false, &connected);
+        dogecoin_blockindex *known = connected ? NULL : dogecoin_net_spv_known_block(client, pindex);
+        if (known) {
+            // the header arrived with an announcement
+            dogecoin_free(pindex);
+            pindex = known;
+            connected = true;
+        }
+
+        node->time_last_request = time(NULL);
+
+        if (!connected) {
+            client->nodegroup->log_write_cb("Got invalid merkleblock (not in sequence) from node %d\n", node->nodeid);
+            node->state &= ~NODE_BLOCKSYNC;
+            node->state |= NODE_MISSBEHAVED;
+            node->nodegroup->node_connection_state_changed_cb(node);
+            dogecoin_free(pindex);
+            return;
+        }
+        if (!known && client->header_connected) { client->header_connected(client); }
+
+        // for now, turn of stall checks if we are near the tip
+        if (pindex->header.timestamp > node->time_last_request - 30*60) {
+            node->time_last_request = 0;
+        }
+
+        // matched transactions of the previous merkleblock of this node that did not arrive are lost
+        dogecoin_spv_client_filtered_block_reset(client, node->nodeid);
+
+        // the partial merkle tree has to lead to the merkle root of the connected header
+        uint256_t merkle_root;
+        vector_t *matches = vector_new(1, dogecoin_free);
+        if (!dogecoin_merkleblock_extract_matches(buf, merkle_root, matches) ||
+            memcmp(merkle_root, pindex->header.merkle_root, sizeof(uint256_t)) != 0) {
+            client->nodegroup->log_write_cb("Got merkleblock with an invalid partial merkle tree from node %d\n", node->nodeid);
+            vector_free(matches, true);
+            // the header itself is valid, only the peer lied about the transactions
+            node->state &= ~NODE_BLOCKSYNC;
+            node->state |= NODE_MISSBEHAVED;
+            node->nodegroup->node_connection_state_changed_cb(node);
+            dogecoin_net_spv_request_filtered_block(client, node, pindex);
+            return;
+        }
+
+        client->last_block_tx_count = matches->len;
+        client->last_block_size = hdr->data_len;
+        client->last_block_total_tx_size = 0;
+        client->nodegroup->log_write_cb("merkleblock at height %d, %d matched transactions\n", pindex->height, (int)matches->len);
+        if (client->filtered_block_connected) { client->filtered_block_connected(client->sync_transaction_ctx, pindex); }
+
+        if (matches->len > 0) {
+            // the peer sends the matched transactions right after the merkleblock
+            dogecoin_spv_filtered_block *filtered = dogecoin_calloc(1, sizeof(dogecoin_spv_filtered_block));
+            filtered->nodeid = node->nodeid;
+            filtered->pindex = pindex;
+            filtered->txids = matches;
+            vector_add(client->filtered_blocks, filtered);
+        } else {
+            vector_free(matches, true);
+        }
+        dogecoin_net_spv_block_processed(node, pindex);
+    }
+
+    dogecoin_spv_filtered_block *filtered = strcmp(hdr->command, DOGECOIN_MSG_TX) == 0 ? dogecoin_spv_client_filtered_block(client, node->nodeid) : NULL;
+    if (filtered)
+    {
+        dogecoin_tx_view txview;
+        dogecoin_tx_view_init(&txview);
+        if (dogecoin_tx_view_parse(&txview, buf->p, buf->len, NULL)) {
+            uint256_t txid;
+            dogecoin_tx_view_hash(&txview, txid);
+            unsigned int i;
+            for (i = 0; i < filtered->txids->len; i++) {
+                if (memcmp(vector_idx(filtered->txids, i), txid, sizeof(uint256_t)) != 0) continue;
+                // unsolicited mempool relays do not match and get ignored
+                dogecoin_blockindex *pindex = filtered->pindex;
+                unsigned int pos = filtered->txs_received++;
+                client->last_block_total_tx_size += txview.len;
+                if (client->sync_transaction_view) { client->sync_transaction_view(client->sync_transaction_ctx, &txview, pos, pindex); }
+                if (client->sync_transaction) {
+                    dogecoin_tx* tx = dogecoin_tx_new();
+                    if (dogecoin_tx_view_to_tx(&txview, tx)) {
+                        client->sync_transaction(client->sync_transaction_ctx, tx, pos, pindex);
+                    }
+                    dogecoin_tx_free(tx);
+                }
+                vector_remove_idx(filtered->txids, i);
+                break;
+            }
+            if (filtered->txids->len == 0) {
+                dogecoin_spv_client_filtered_block_reset(client, node->nodeid);
             }
         }
+        dogecoin_tx_view_free(&txview);
     }
 
     if (strcmp(hdr->command, DOGECOIN_MSG_HEADERS) == 0)
@@ -644,6 +1380,38 @@ void dogecoin_net_spv_post_cmd(dogecoin_node *node, dogecoin_p2p_msg_hdr *hdr, s
         // flag off the request stall check
         client->last_headersrequest_time = 0;
 
+        // headers nobody asked for announce new blocks (sendheaders), which have to be fetched once connected
+        dogecoin_bool parallel_sync = (client->stateflags & SPV_PARALLEL_BLOCK_SYNC_FLAG) == SPV_PARALLEL_BLOCK_SYNC_FLAG;
+        dogecoin_bool announcement = !parallel_sync && (node->state & NODE_HEADERSYNC) != NODE_HEADERSYNC && (client->stateflags & SPV_FULLBLOCK_SYNC_FLAG) == SPV_FULLBLOCK_SYNC_FLAG;
+        cstring *announced_inv = announcement ? cstr_new_sz(amount_of_headers * 36) : NULL;
+        uint32_t announced_blocks = 0;
+        uint32_t announced_type = (client->bloom_filter && (node->services & DOGECOIN_NODE_BLOOM)) ? DOGECOIN_INV_TYPE_FILTERED_BLOCK : DOGECOIN_INV_TYPE_BLOCK;
+
+        // ask for the next batch before validating this one, the peer sends it while we connect
+        dogecoin_bool pipelined = false;
+        if (amount_of_headers == MAX_HEADERS_RESULTS && (node->state & NODE_BLOCKSYNC) != NODE_BLOCKSYNC &&
+            (parallel_sync || (int64_t)client->headers_db->getchaintip(client->headers_db_ctx)->height + amount_of_headers < (int64_t)node->bestknownheight - 5)) {
+            uint256_t last_hash;
+            if (dogecoin_headers_message_last_hash(buf, amount_of_headers, last_hash)) {
+                dogecoin_net_spv_node_request_headers_after(node, last_hash);
+                pipelined = true;
+            }
+        }
+
+        // the parallel block download resumes above the last block that reached the callbacks
+        if (parallel_sync && !client->block_scheduler && client->headers_db->get_header_at_height) {
+            uint32_t start_height = client->headers_db->getchaintip(client->headers_db_ctx)->height;
+            if (client->blocks_processed_height < start_height) start_height = client->blocks_processed_height;
+            client->block_scheduler = dogecoin_block_scheduler_new(start_height + 1,
+                DOGECOIN_BLOCKSYNC_WINDOW, DOGECOIN_BLOCKSYNC_CAPACITY, DOGECOIN_BLOCKSYNC_STALL_TIMEOUT,
+                client->headers_db->get_header_at_height, client->headers_db_ctx);
+        }
+
+        // write all headers of this message with a single group commit
+        if (client->headers_db->begin_batch) { client->headers_db->begin_batch(client->headers_db_ctx); }
+        // scrypt hash and check the proof of work of the whole message on all cores, connecting only links the headers
+        if (client->headers_db->verify_pow_batch) { client->headers_db->verify_pow_batch(client->headers_db_ctx, buf, amount_of_headers); }
+
         unsigned int connected_headers = 0;
         unsigned int i;
         for (i = 0; i < amount_of_headers; i++)
@@ -658,6 +1426,12 @@ void dogecoin_net_spv_post_cmd(dogecoin_node *node, dogecoin_p2p_msg_hdr *hdr, s
                 client->nodegroup->log_write_cb("Header deserialization (tx count skip) failed (node %d)\n", node->nodeid);
             }
 
+            if (!connected && dogecoin_net_spv_known_block(client, pindex))
+            {
+                // already connected, e.g. announced by another peer
+                dogecoin_free(pindex);
+                continue;
+            }
             if (!connected)
             {
                 client->nodegroup->log_write_cb("Got invalid headers (not in sequence) from node %d\n", node->nodeid);
@@ -668,7 +1442,13 @@ void dogecoin_net_spv_post_cmd(dogecoin_node *node, dogecoin_p2p_msg_hdr *hdr, s
             } else {
                 if (client->header_connected) { client->header_connected(client); }
                 connected_headers++;
-                if (pindex->height >= node->bestknownheight - 5) {
+                if (announced_inv) {
+                    ser_u32(announced_inv, announced_type);
+                    ser_u256(announced_inv, pindex->hash);
+                    memcpy_safe(node->last_requested_inv, pindex->hash, sizeof(uint256_t));
+                    announced_blocks++;
+                }
+                if (!parallel_sync && pindex->height >= node->bestknownheight - 5) {
                     client->stateflags &= ~SPV_HEADER_SYNC_FLAG;
                     client->stateflags |= SPV_FULLBLOCK_SYNC_FLAG;
                     node->state &= ~NODE_HEADERSYNC;
@@ -679,40 +1459,52 @@ void dogecoin_net_spv_post_cmd(dogecoin_node *node, dogecoin_p2p_msg_hdr *hdr, s
                 }
             }
         }
+        if (client->headers_db->commit_batch && !client->headers_db->commit_batch(client->headers_db_ctx)) {
+            client->nodegroup->log_write_cb("Error writing headers to database\n");
+        }
         dogecoin_blockindex *chaintip = client->headers_db->getchaintip(client->headers_db_ctx);
 
         client->nodegroup->log_write_cb("Connected %d headers\n", connected_headers);
         client->nodegroup->log_write_cb("Chaintip at height %d\n", chaintip->height);
 
+        if (announced_inv) {
+            if (announced_blocks > 0) {
+                client->nodegroup->log_write_cb("Requesting %d announced blocks from node %d\n", announced_blocks, node->nodeid);
+                cstring *getdata = cstr_new_sz(announced_inv->len + 9);
+                ser_varlen(getdata, announced_blocks);
+                cstr_append_buf(getdata, announced_inv->str, announced_inv->len);
+                dogecoin_node_send_message(node, DOGECOIN_MSG_GETDATA, getdata->str, getdata->len);
+                cstr_free(getdata, true);
+                node->time_last_request = time(NULL);
+            }
+            cstr_free(announced_inv, true);
+        }
+
+        if (parallel_sync) {
+            if (client->block_scheduler) {
+                dogecoin_block_scheduler_set_target(client->block_scheduler, chaintip->height);
+            }
+            if (amount_of_headers < MAX_HEADERS_RESULTS) {
+                // a short response means the peer has no further headers
+                node->state &= ~NODE_HEADERSYNC;
+                if (connected_headers == amount_of_headers && node->bestknownheight > chaintip->height) {
+                    node->bestknownheight = chaintip->height;
+                }
+            }
+        }
+
         if (client->header_message_processed && client->header_message_processed(client, node, chaintip) == false)
             return;
 
-        if (amount_of_headers == MAX_HEADERS_RESULTS && ((node->state & NODE_BLOCKSYNC) != NODE_BLOCKSYNC))
+        if (!pipelined && amount_of_headers == MAX_HEADERS_RESULTS && ((node->state & NODE_BLOCKSYNC) != NODE_BLOCKSYNC))
         {
             time_t lasttime = chaintip->header.timestamp;
             client->nodegroup->log_write_cb("chain size: %d, last time %s", chaintip->height, ctime(&lasttime));
             dogecoin_net_spv_node_request_headers_or_blocks(node, false);
         }
-    }
-
-    // Check for a 'Q' or 'q' on stdin, to quit.
-#ifdef _WIN32
-    if (_kbhit()) {
-        char c = fgetc(stdin);
-        if (c == 'Q' || c == 'q') {
-            printf("Disconnecting...\n");
-            dogecoin_node_group_shutdown(client->nodegroup);
+        if (parallel_sync) {
+            // blocks of the new headers are requested while the next headers arrive
+            dogecoin_net_spv_parallel_sync(client);
         }
     }
-#else
-    char c = fgetc(stdin);
-    if (c == 'Q' || c == 'q') {
-        // Reset standard input back to blocking mode
-        int stdin_flags = fcntl(STDIN_FILENO, F_GETFL);
-        fcntl(STDIN_FILENO, F_SETFL, stdin_flags & ~O_NONBLOCK);
-
-        printf("Disconnecting...\n");
-        dogecoin_node_group_shutdown(client->nodegroup);
-    }
-#endif
 }
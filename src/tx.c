@@ -545,6 +545,353 @@ int dogecoin_tx_deserialize(const unsigned char* tx_serialized, size_t inlen, do
 }
 
 
+/**
+ * @brief This function initializes an empty transaction view.
+ *
+ * @param view The pointer to the view to initialize.
+ *
+ * @return Nothing.
+ */
+void dogecoin_tx_view_init(dogecoin_tx_view* view)
+{
+    memset(view, 0, sizeof(*view));
+}
+
+
+/**
+ * @brief This function frees the offset tables of a transaction
+ * view. The viewed buffer is not owned and left untouched.
+ *
+ * @param view The pointer to the view to free.
+ *
+ * @return Nothing.
+ */
+void dogecoin_tx_view_free(dogecoin_tx_view* view)
+{
+    if (view->vin) {
+        dogecoin_free(view->vin);
+    }
+    if (view->vout) {
+        dogecoin_free(view->vout);
+    }
+    dogecoin_tx_view_init(view);
+}
+
+
+/**
+ * @brief This function reads a var-length prefixed string from
+ * a buffer and returns its offset instead of copying it.
+ *
+ * @param buf The buffer to read from.
+ * @param start The start of the serialized transaction.
+ * @param offset The pointer to the resulting offset.
+ * @param len The pointer to the resulting length.
+ *
+ * @return 1 if the string fits into the buffer, 0 otherwise.
+ */
+static dogecoin_bool dogecoin_tx_view_skip_varstr(struct const_buffer* buf, const unsigned char* start, size_t* offset, size_t* len)
+{
+    uint32_t slen;
+    if (!deser_varlen(&slen, buf)) {
+        return false;
+    }
+    *offset = (size_t)((const unsigned char*)buf->p - start);
+    *len = slen;
+    return deser_skip(buf, slen);
+}
+
+
+/**
+ * @brief This function makes sure the view can hold the
+ * given amount of inputs and outputs.
+ *
+ * @param view The pointer to the view.
+ * @param vin_count The required amount of inputs.
+ * @param vout_count The required amount of outputs.
+ *
+ * @return Nothing.
+ */
+static void dogecoin_tx_view_reserve(dogecoin_tx_view* view, size_t vin_count, size_t vout_count)
+{
+    if (vin_count > view->vin_alloc) {
+        view->vin = dogecoin_realloc(view->vin, vin_count * sizeof(dogecoin_tx_view_in));
+        view->vin_alloc = vin_count;
+    }
+    if (vout_count > view->vout_alloc) {
+        view->vout = dogecoin_realloc(view->vout, vout_count * sizeof(dogecoin_tx_view_out));
+        view->vout_alloc = vout_count;
+    }
+}
+
+
+/**
+ * @brief This function parses a serialized transaction into a
+ * read-only view without copying scripts. The view keeps a
+ * pointer to the buffer, so the buffer must outlive the view.
+ * A view can be parsed into repeatedly, its offset tables only
+ * grow when a transaction has more inputs or outputs than seen
+ * before.
+ *
+ * @param view The pointer to an initialized view.
+ * @param tx_serialized The buffer containing the transaction.
+ * @param inlen The length of the buffer.
+ * @param consumed_length The pointer to the amount of bytes the transaction occupies.
+ *
+ * @return 1 if parsed successfully, 0 otherwise.
+ */
+dogecoin_bool dogecoin_tx_view_parse(dogecoin_tx_view* view, const unsigned char* tx_serialized, size_t inlen, size_t* consumed_length)
+{
+    struct const_buffer buf = {tx_serialized, inlen};
+    if (consumed_length) {
+        *consumed_length = 0;
+    }
+    view->data = tx_serialized;
+    view->len = 0;
+    view->vin_count = 0;
+    view->vout_count = 0;
+
+    if (!deser_s32(&view->version, &buf)) {
+        return false;
+    }
+
+    view->body_offset = (size_t)((const unsigned char*)buf.p - tx_serialized);
+    uint32_t vlen;
+    if (!deser_varlen(&vlen, &buf)) {
+        return false;
+    }
+
+    uint8_t flags = 0;
+    if (vlen == 0) {
+        /* We read a dummy or an empty vin. */
+        deser_bytes(&flags, &buf, 1);
+        if (flags != 0) {
+            // contains witness, the txid commits to the data after marker and flag
+            view->body_offset = (size_t)((const unsigned char*)buf.p - tx_serialized);
+            if (!deser_varlen(&vlen, &buf)) {
+                return false;
+            }
+        }
+    }
+
+    /* every input occupies at least 41 bytes, reject bogus counts before allocating */
+    if ((size_t)vlen > buf.len / 41) {
+        return false;
+    }
+    dogecoin_tx_view_reserve(view, vlen, 0);
+    size_t i;
+    for (i = 0; i < vlen; i++) {
+        dogecoin_tx_view_in* in = &view->vin[i];
+        in->prevout_offset = (size_t)((const unsigned char*)buf.p - tx_serialized);
+        if (!deser_skip(&buf, 36)) {
+            return false;
+        }
+        if (!dogecoin_tx_view_skip_varstr(&buf, tx_serialized, &in->script_offset, &in->script_len)) {
+            return false;
+        }
+        if (!deser_skip(&buf, 4)) {
+            return false;
+        }
+    }
+    view->vin_count = vlen;
+
+    if (!deser_varlen(&vlen, &buf)) {
+        return false;
+    }
+    /* every output occupies at least 9 bytes */
+    if ((size_t)vlen > buf.len / 9) {
+        return false;
+    }
+    dogecoin_tx_view_reserve(view, 0, vlen);
+    for (i = 0; i < vlen; i++) {
+        dogecoin_tx_view_out* out = &view->vout[i];
+        out->value_offset = (size_t)((const unsigned char*)buf.p - tx_serialized);
+        if (!deser_skip(&buf, 8)) {
+            return false;
+        }
+        if (!dogecoin_tx_view_skip_varstr(&buf, tx_serialized, &out->script_offset, &out->script_len)) {
+            return false;
+        }
+    }
+    view->vout_count = vlen;
+    view->body_end = (size_t)((const unsigned char*)buf.p - tx_serialized);
+
+    if ((flags & 1)) {
+        /* The witness flag is present, skip the witness stacks. */
+        flags ^= 1;
+        for (i = 0; i < view->vin_count; i++) {
+            if (!deser_varlen(&vlen, &buf))
+                return false;
+            size_t j, offset, len;
+            for (j = 0; j < vlen; j++) {
+                if (!dogecoin_tx_view_skip_varstr(&buf, tx_serialized, &offset, &len)) {
+                    return false;
+                }
+            }
+        }
+    }
+    if (flags) {
+        /* Unknown flag in the serialization */
+        return false;
+    }
+
+    if (!deser_u32(&view->locktime, &buf)) {
+        return false;
+    }
+
+    view->len = inlen - buf.len;
+    if (consumed_length) {
+        *consumed_length = view->len;
+    }
+    return true;
+}
+
+
+/**
+ * @brief This function reads the outpoint spent by an input
+ * of a transaction view.
+ *
+ * @param view The pointer to the parsed view.
+ * @param in_num The index of the input.
+ * @param prevout The pointer to the outpoint to fill.
+ *
+ * @return 1 if the input exists, 0 otherwise.
+ */
+dogecoin_bool dogecoin_tx_view_get_prevout(const dogecoin_tx_view* view, size_t in_num, dogecoin_tx_outpoint* prevout)
+{
+    if (in_num >= view->vin_count) {
+        return false;
+    }
+    struct const_buffer buf = {view->data + view->vin[in_num].prevout_offset, 36};
+    deser_u256(prevout->hash, &buf);
+    return deser_u32(&prevout->n, &buf);
+}
+
+
+/**
+ * @brief This function returns a pointer to the script_sig of
+ * an input of a transaction view.
+ *
+ * @param view The pointer to the parsed view.
+ * @param in_num The index of the input.
+ * @param script The pointer set to the script inside the viewed buffer.
+ * @param script_len The pointer to the length of the script.
+ *
+ * @return 1 if the input exists, 0 otherwise.
+ */
+dogecoin_bool dogecoin_tx_view_get_script_sig(const dogecoin_tx_view* view, size_t in_num, const uint8_t** script, size_t* script_len)
+{
+    if (in_num >= view->vin_count) {
+        return false;
+    }
+    *script = view->data + view->vin[in_num].script_offset;
+    *script_len = view->vin[in_num].script_len;
+    return true;
+}
+
+
+/**
+ * @brief This function reads the sequence number of an input
+ * of a transaction view.
+ *
+ * @param view The pointer to the parsed view.
+ * @param in_num The index of the input.
+ * @param sequence The pointer to the sequence to fill.
+ *
+ * @return 1 if the input exists, 0 otherwise.
+ */
+dogecoin_bool dogecoin_tx_view_get_sequence(const dogecoin_tx_view* view, size_t in_num, uint32_t* sequence)
+{
+    if (in_num >= view->vin_count) {
+        return false;
+    }
+    const dogecoin_tx_view_in* in = &view->vin[in_num];
+    struct const_buffer buf = {view->data + in->script_offset + in->script_len, 4};
+    return deser_u32(sequence, &buf);
+}
+
+
+/**
+ * @brief This function reads the value in koinu of an output
+ * of a transaction view.
+ *
+ * @param view The pointer to the parsed view.
+ * @param out_num The index of the output.
+ * @param value The pointer to the value to fill.
+ *
+ * @return 1 if the output exists, 0 otherwise.
+ */
+dogecoin_bool dogecoin_tx_view_get_value(const dogecoin_tx_view* view, size_t out_num, int64_t* value)
+{
+    if (out_num >= view->vout_count) {
+        return false;
+    }
+    struct const_buffer buf = {view->data + view->vout[out_num].value_offset, 8};
+    return deser_s64(value, &buf);
+}
+
+
+/**
+ * @brief This function returns a pointer to the script_pubkey
+ * of an output of a transaction view.
+ *
+ * @param view The pointer to the parsed view.
+ * @param out_num The index of the output.
+ * @param script The pointer set to the script inside the viewed buffer.
+ * @param script_len The pointer to the length of the script.
+ *
+ * @return 1 if the output exists, 0 otherwise.
+ */
+dogecoin_bool dogecoin_tx_view_get_script_pubkey(const dogecoin_tx_view* view, size_t out_num, const uint8_t** script, size_t* script_len)
+{
+    if (out_num >= view->vout_count) {
+        return false;
+    }
+    *script = view->data + view->vout[out_num].script_offset;
+    *script_len = view->vout[out_num].script_len;
+    return true;
+}
+
+
+/**
+ * @brief This function computes the txid of a transaction view
+ * directly from the viewed bytes (witness data excluded).
+ *
+ * @param view The pointer to the parsed view.
+ * @param hashout The resulting hash.
+ *
+ * @return Nothing.
+ */
+void dogecoin_tx_view_hash(const dogecoin_tx_view* view, uint256_t hashout)
+{
+    if (view->body_offset == 4 && view->body_end + 4 == view->len) {
+        sha256_raw(view->data, view->len, hashout);
+    } else {
+        sha256_context ctx;
+        sha256_init(&ctx);
+        sha256_write(&ctx, view->data, 4);
+        sha256_write(&ctx, view->data + view->body_offset, view->body_end - view->body_offset);
+        sha256_write(&ctx, view->data + view->len - 4, 4);
+        sha256_finalize(&ctx, hashout);
+    }
+    sha256_raw(hashout, DOGECOIN_HASH_LENGTH, hashout);
+}
+
+
+/**
+ * @brief This function materializes a transaction view into
+ * a full transaction object.
+ *
+ * @param view The pointer to the parsed view.
+ * @param tx The pointer to an empty transaction to deserialize into.
+ *
+ * @return 1 if deserialized successfully, 0 otherwise.
+ */
+dogecoin_bool dogecoin_tx_view_to_tx(const dogecoin_tx_view* view, dogecoin_tx* tx)
+{
+    return dogecoin_tx_deserialize(view->data, view->len, tx, NULL);
+}
+
+
 /**
  * @brief This function serializes a transaction input.
  *
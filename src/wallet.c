@@ -53,10 +53,20 @@ uint8_t WALLET_DB_REC_TYPE_MASTERPUBKEY = 0;
 uint8_t WALLET_DB_REC_TYPE_PUBKEYCACHE = 1;
 uint8_t WALLET_DB_REC_TYPE_ADDR = 1;
 uint8_t WALLET_DB_REC_TYPE_TX = 2;
+uint8_t WALLET_DB_REC_TYPE_SNAPSHOT = 3;
+uint8_t WALLET_DB_REC_TYPE_UTXO = 4;
+uint8_t WALLET_DB_REC_TYPE_UNDO = 5;
+
+/* blocks below the tip minus this depth are not expected to be disconnected, their undo data gets released */
+#define WALLET_BLOCK_UNDO_DEPTH 1440
 
 static const unsigned char file_hdr_magic[4] = {0xA8, 0xF0, 0x11, 0xC5}; /* header magic */
 static const unsigned char file_rec_magic[4] = {0xC8, 0xF2, 0x69, 0x1E}; /* record magic */
-static const uint32_t current_version = 1;
+static const uint32_t current_version = 2; /* highest version read, 2: snapshot records */
+static const uint32_t snapshotless_version = 1; /* files without snapshot records stay readable by version 1 code */
+
+static void dogecoin_wallet_prefilter_free(dogecoin_wallet_prefilter* filter);
+dogecoin_bool wallet_write_record(dogecoin_wallet *wallet, const cstring* record, uint8_t record_type);
 
 /**
  * Prints an error message to the screen
@@ -186,16 +196,19 @@ dogecoin_wtx* dogecoin_wallet_wtx_new()
 
 dogecoin_wtx* dogecoin_wallet_wtx_copy(dogecoin_wtx* wtx)
 {
+    dogecoin_tx* tx = dogecoin_wallet_wtx_get_tx(wtx);
+    if (!tx) return NULL;
     dogecoin_wtx* wtx_copy;
     wtx_copy = dogecoin_wallet_wtx_new();
-    dogecoin_tx_copy(wtx_copy->tx, wtx->tx);
+    dogecoin_tx_copy(wtx_copy->tx, tx);
 
     return wtx_copy;
 }
 
 void dogecoin_wallet_wtx_free(dogecoin_wtx* wtx)
 {
-    dogecoin_tx_free(wtx->tx);
+    if (wtx->tx) dogecoin_tx_free(wtx->tx);
+    if (wtx->tx_raw) cstr_free(wtx->tx_raw, true);
     dogecoin_free(wtx);
 }
 
@@ -203,7 +216,11 @@ void dogecoin_wallet_wtx_serialize(cstring* s, const dogecoin_wtx* wtx)
 {
     ser_u32(s, wtx->height);
     ser_u256(s, wtx->tx_hash_cache);
-    dogecoin_tx_serialize(s, wtx->tx);
+    if (wtx->tx) {
+        dogecoin_tx_serialize(s, wtx->tx);
+    } else if (wtx->tx_raw) {
+        ser_bytes(s, wtx->tx_raw->str, wtx->tx_raw->len);
+    }
 }
 
 dogecoin_bool dogecoin_wallet_wtx_deserialize(dogecoin_wtx* wtx, struct const_buffer* buf)
@@ -213,8 +230,76 @@ dogecoin_bool dogecoin_wallet_wtx_deserialize(dogecoin_wtx* wtx, struct const_bu
     return dogecoin_tx_deserialize(buf->p, buf->len, wtx->tx, NULL);
 }
 
+/**
+ * @brief This function reads the wtx header of a record and keeps
+ * the transaction serialized; the body gets deserialized on first
+ * use by dogecoin_wallet_wtx_get_tx().
+ *
+ * @param wtx The wtx to fill (its tx gets released).
+ * @param buf The record payload.
+ *
+ * @return 1 if the header was read, 0 otherwise.
+ */
+static dogecoin_bool dogecoin_wallet_wtx_deserialize_lazy(dogecoin_wtx* wtx, struct const_buffer* buf)
+{
+    if (!deser_u32(&wtx->height, buf) || !deser_u256(wtx->tx_hash_cache, buf) || !buf->len) return false;
+    if (wtx->tx) {
+        dogecoin_tx_free(wtx->tx);
+        wtx->tx = NULL;
+    }
+    if (wtx->tx_raw) cstr_free(wtx->tx_raw, true);
+    wtx->tx_raw = cstr_new_buf(buf->p, buf->len);
+    return true;
+}
+
+dogecoin_tx* dogecoin_wallet_wtx_get_tx(dogecoin_wtx* wtx)
+{
+    if (!wtx->tx) {
+        dogecoin_tx* tx = dogecoin_tx_new();
+        if (wtx->tx_raw && !dogecoin_tx_deserialize((const unsigned char*)wtx->tx_raw->str, wtx->tx_raw->len, tx, NULL)) {
+            // keep the raw body, compaction writes it back as it was read
+            fprintf(stderr, "Wallet file: could not deserialize transaction\n");
+            dogecoin_tx_free(tx);
+            return NULL;
+        }
+        wtx->tx = tx;
+        if (wtx->tx_raw) {
+            cstr_free(wtx->tx_raw, true);
+            wtx->tx_raw = NULL;
+        }
+    }
+    return wtx->tx;
+}
+
+/**
+ * @brief This function checks whether a wtx is a coinbase
+ * without deserializing a lazily loaded transaction.
+ *
+ * @param wtx The wtx to check.
+ *
+ * @return 1 if the transaction is a coinbase, 0 otherwise.
+ */
+static dogecoin_bool dogecoin_wallet_wtx_is_coinbase(dogecoin_wtx* wtx)
+{
+    if (wtx->tx || !wtx->tx_raw) {
+        dogecoin_tx* tx = dogecoin_wallet_wtx_get_tx(wtx);
+        return tx && dogecoin_tx_is_coinbase(tx);
+    }
+    dogecoin_bool coinbase = false;
+    dogecoin_tx_view view;
+    dogecoin_tx_view_init(&view);
+    dogecoin_tx_outpoint prevout;
+    if (dogecoin_tx_view_parse(&view, (const unsigned char*)wtx->tx_raw->str, wtx->tx_raw->len, NULL) &&
+        view.vin_count == 1 && dogecoin_tx_view_get_prevout(&view, 0, &prevout)) {
+        coinbase = dogecoin_hash_is_empty(prevout.hash) && prevout.n == UINT32_MAX;
+    }
+    dogecoin_tx_view_free(&view);
+    return coinbase;
+}
+
 void dogecoin_wallet_wtx_cachehash(dogecoin_wtx* wtx) {
-    dogecoin_tx_hash(wtx->tx, wtx->tx_hash_cache);
+    dogecoin_tx* tx = dogecoin_wallet_wtx_get_tx(wtx);
+    if (tx) dogecoin_tx_hash(tx, wtx->tx_hash_cache);
 }
 
 /*
@@ -226,63 +311,403 @@ dogecoin_utxo* dogecoin_wallet_utxo_new() {
     dogecoin_utxo* utxo = dogecoin_calloc(1, sizeof(dogecoin_utxo));
     dogecoin_hash_clear(utxo->txid);
     utxo->vout = 0;
-    dogecoin_mem_zero(&utxo->address, sizeof(utxo->address));
-    dogecoin_mem_zero(&utxo->script_pubkey, sizeof(utxo->script_pubkey));
-    dogecoin_mem_zero(&utxo->amount, sizeof(utxo->amount));
+    utxo->koinu = 0;
+    utxo->script_type = DOGECOIN_TX_NONSTANDARD;
+    dogecoin_mem_zero(utxo->hash160, sizeof(utxo->hash160));
     utxo->confirmations = 0;
     utxo->spendable = true;
     utxo->solvable = true;
     return utxo;
 }
 
-dogecoin_utxo* new_dogecoin_utxo() {
+#define is_spent(x) (((dogecoin_utxo*)x)->spendable == false)
+
+/* running balances of the unspent entries of a utxos table, keyed by script type + hash160 */
+#define UTXO_ADDRESS_KEYLEN (1 + sizeof(uint160_t))
+typedef char dogecoin_utxo_address_key_check[(offsetof(dogecoin_utxo, hash160) == offsetof(dogecoin_utxo, script_type) + 1) ? 1 : -1];
+
+typedef struct dogecoin_address_balance_ {
+    uint8_t script_type;
+    uint160_t hash160;
+    dogecoin_balance balance;
+    vector_t* unspent; // unspent utxos of the address in table order, not owned
+    UT_hash_handle hh;
+} dogecoin_address_balance;
+
+/* a utxos table with its secondary indexes, every wallet owns one */
+typedef struct dogecoin_utxo_table_ {
+    dogecoin_utxo** utxos; /* the table, keyed by index */
+    dogecoin_utxo* by_outpoint; /* secondary index, the key spans txid and vout */
+    dogecoin_address_balance* address_balances;
+    dogecoin_balance balance;
+    int tip_height;
+    /* last index handed out, indexes are never reused once a utxo left the table */
+    int last_index;
+    /* the per address unspent lists are rebuilt lazily once the table changed */
+    uint64_t generation;
+    uint64_t address_unspent_generation;
+} dogecoin_utxo_table;
+
+/* table behind the wallet-less utxo functions (add_dogecoin_utxo & co.) */
+static dogecoin_utxo_table standalone_utxos = {&utxos, NULL, NULL, {0, 0, 0}, 0, 0, 1, 0};
+
+static dogecoin_utxo_table* utxo_table_new(dogecoin_utxo** head) {
+    dogecoin_utxo_table* table = dogecoin_calloc(1, sizeof(*table));
+    table->utxos = head;
+    table->generation = 1;
+    return table;
+}
+
+static dogecoin_utxo* utxo_table_new_utxo(dogecoin_utxo_table* table) {
     dogecoin_utxo* utxo = dogecoin_wallet_utxo_new();
-    utxo->index = HASH_COUNT(utxos) + 1;
+    utxo->index = ++table->last_index;
     return utxo;
 }
 
-#define is_spent(x) (((dogecoin_utxo*)x)->spendable == false)
+dogecoin_utxo* new_dogecoin_utxo() {
+    return utxo_table_new_utxo(&standalone_utxos);
+}
 
-int start_dogecoin_utxo() {
-    dogecoin_utxo* m = new_dogecoin_utxo();
-    add_dogecoin_utxo(m);
-    return m->index;
+#define UTXO_OUTPOINT_KEYLEN (sizeof(uint256_t) + sizeof(uint32_t))
+typedef char dogecoin_utxo_outpoint_key_check[(offsetof(dogecoin_utxo, vout) == offsetof(dogecoin_utxo, txid) + sizeof(uint256_t)) ? 1 : -1];
+
+static void utxo_outpoint_index_remove(dogecoin_utxo_table* table, dogecoin_utxo* utxo) {
+    dogecoin_utxo* indexed;
+    HASH_FIND(hh_outpoint, table->by_outpoint, utxo->txid, UTXO_OUTPOINT_KEYLEN, indexed);
+    if (indexed == utxo) {
+        HASH_DELETE(hh_outpoint, table->by_outpoint, utxo);
+    }
 }
 
-void add_dogecoin_utxo(dogecoin_utxo* utxo_external) {
+enum utxo_balance_state {
+    UTXO_BALANCE_UNCONFIRMED,
+    UTXO_BALANCE_IMMATURE,
+    UTXO_BALANCE_CONFIRMED,
+};
+
+static enum utxo_balance_state utxo_balance_state_at(const dogecoin_utxo* utxo, int tip_height) {
+    if (utxo->height <= 0) return UTXO_BALANCE_UNCONFIRMED;
+    if (utxo->coinbase && tip_height - utxo->height + 1 < COINBASE_MATURITY) return UTXO_BALANCE_IMMATURE;
+    return UTXO_BALANCE_CONFIRMED;
+}
+
+static void balance_add(dogecoin_balance* balance, enum utxo_balance_state state, int64_t amount) {
+    if (state == UTXO_BALANCE_CONFIRMED) {
+        balance->confirmed += amount;
+    } else if (state == UTXO_BALANCE_IMMATURE) {
+        balance->immature += amount;
+    }
+    balance->total += amount;
+}
+
+/**
+ * @brief This function converts a base58 address into the
+ * script type + hash160 key of the address balances.
+ *
+ * @param address The P2PKH or P2SH address.
+ * @param key The key to fill.
+ *
+ * @return 1 if the address could be decoded, 0 otherwise.
+ */
+static dogecoin_bool utxo_address_key(const char* address, uint8_t key[UTXO_ADDRESS_KEYLEN]) {
+    uint8_t buf[64];
+    if (!address || !address[0]) return false;
+    const dogecoin_chainparams* chain = chain_from_b58_prefix(address);
+    // the decoded length includes the 4 byte checksum
+    if (!chain || dogecoin_base58_decode_check(address, buf, sizeof(buf)) != (int)UTXO_ADDRESS_KEYLEN + 4) return false;
+    if (buf[0] == chain->b58prefix_pubkey_address) {
+        key[0] = DOGECOIN_TX_PUBKEYHASH;
+    } else if (buf[0] == chain->b58prefix_script_address) {
+        key[0] = DOGECOIN_TX_SCRIPTHASH;
+    } else {
+        return false;
+    }
+    memcpy(key + 1, buf + 1, sizeof(uint160_t));
+    return true;
+}
+
+static void utxo_balance_move(dogecoin_utxo_table* table, const dogecoin_utxo* utxo, enum utxo_balance_state state, int64_t amount) {
+    balance_add(&table->balance, state, amount);
+    if (utxo->script_type == DOGECOIN_TX_NONSTANDARD) return;
+    dogecoin_address_balance* entry;
+    HASH_FIND(hh, table->address_balances, &utxo->script_type, UTXO_ADDRESS_KEYLEN, entry);
+    if (!entry) {
+        entry = dogecoin_calloc(1, sizeof(*entry));
+        entry->script_type = utxo->script_type;
+        memcpy(entry->hash160, utxo->hash160, sizeof(uint160_t));
+        entry->unspent = vector_new(1, NULL);
+        HASH_ADD(hh, table->address_balances, script_type, UTXO_ADDRESS_KEYLEN, entry);
+    }
+    balance_add(&entry->balance, state, amount);
+}
+
+/**
+ * @brief This function rebuilds the per address lists of
+ * unspent utxos with a single pass over the utxos table if
+ * the table changed since the last rebuild.
+ *
+ * @param table The utxos table.
+ *
+ * @return Nothing.
+ */
+static void address_unspent_update(dogecoin_utxo_table* table) {
+    if (table->address_unspent_generation == table->generation) return;
+    dogecoin_address_balance* entry;
+    dogecoin_address_balance* entry_tmp;
+    HASH_ITER(hh, table->address_balances, entry, entry_tmp) {
+        vector_resize(entry->unspent, 0);
+    }
+    dogecoin_utxo* utxo;
+    dogecoin_utxo* tmp;
+    HASH_ITER(hh, *table->utxos, utxo, tmp) {
+        if (is_spent(utxo) || utxo->script_type == DOGECOIN_TX_NONSTANDARD) continue;
+        HASH_FIND(hh, table->address_balances, &utxo->script_type, UTXO_ADDRESS_KEYLEN, entry);
+        if (entry) vector_add(entry->unspent, utxo);
+    }
+    table->address_unspent_generation = table->generation;
+}
+
+/**
+ * @brief This function returns the unspent utxos of an address.
+ *
+ * @param table The utxos table.
+ * @param address The address to look up.
+ *
+ * @return The list of unspent utxos (not owned by the caller) or NULL if the address holds none.
+ */
+static vector_t* address_unspent_get(dogecoin_utxo_table* table, const char* address) {
+    dogecoin_address_balance* entry = NULL;
+    uint8_t key[UTXO_ADDRESS_KEYLEN];
+    if (!utxo_address_key(address, key)) return NULL;
+    address_unspent_update(table);
+    HASH_FIND(hh, table->address_balances, key, UTXO_ADDRESS_KEYLEN, entry);
+    if (!entry || entry->unspent->len == 0) return NULL;
+    return entry->unspent;
+}
+
+/**
+ * @brief This function adds (sign 1) or removes (sign -1) an
+ * unspent utxo from the running balances.
+ *
+ * @param table The utxos table the utxo belongs to.
+ * @param utxo The utxo to account for.
+ * @param sign The direction of the update.
+ *
+ * @return Nothing.
+ */
+static void utxo_balance_apply(dogecoin_utxo_table* table, const dogecoin_utxo* utxo, int64_t sign) {
+    if (is_spent(utxo)) return;
+    utxo_balance_move(table, utxo, utxo_balance_state_at(utxo, table->tip_height), sign * utxo->koinu);
+}
+
+/**
+ * @brief This function marks a utxo as spent or unspent (e.g.
+ * when the spending block gets disconnected) and keeps the
+ * running balances in sync.
+ *
+ * @param table The utxos table the utxo belongs to.
+ * @param utxo The utxo to update.
+ * @param spent Whether the utxo got spent.
+ *
+ * @return Nothing.
+ */
+static void utxo_set_spent(dogecoin_utxo_table* table, dogecoin_utxo* utxo, dogecoin_bool spent) {
+    if (spent == (dogecoin_bool)is_spent(utxo)) return;
+    table->generation++;
+    if (spent) {
+        utxo_balance_apply(table, utxo, -1);
+        utxo->spendable = 0;
+        utxo->solvable = 0;
+    } else {
+        utxo->spendable = 1;
+        utxo->solvable = 1;
+        utxo_balance_apply(table, utxo, 1);
+    }
+}
+
+void dogecoin_wallet_utxos_get_balance(dogecoin_wallet* wallet, dogecoin_balance* balance) {
+    *balance = wallet->utxo_table->balance;
+}
+
+dogecoin_bool dogecoin_wallet_utxos_get_address_balance(dogecoin_wallet* wallet, const char* address, dogecoin_balance* balance) {
+    dogecoin_address_balance* entry = NULL;
+    uint8_t key[UTXO_ADDRESS_KEYLEN];
+    dogecoin_mem_zero(balance, sizeof(*balance));
+    if (!utxo_address_key(address, key)) return false;
+    HASH_FIND(hh, wallet->utxo_table->address_balances, key, UTXO_ADDRESS_KEYLEN, entry);
+    if (!entry) return false;
+    *balance = entry->balance;
+    return true;
+}
+
+static void utxo_table_add(dogecoin_utxo_table* table, dogecoin_utxo* utxo_external) {
     dogecoin_utxo* utxo_internal;
-    HASH_FIND_INT(utxos, &utxo_external->index, utxo_internal);
+    HASH_FIND_INT(*table->utxos, &utxo_external->index, utxo_internal);
     if (utxo_internal == NULL) {
-        HASH_ADD_INT(utxos, index, utxo_external);
+        HASH_ADD_INT(*table->utxos, index, utxo_external);
+    } else if (utxo_internal != utxo_external) {
+        HASH_REPLACE_INT(*table->utxos, index, utxo_external, utxo_internal);
+        utxo_outpoint_index_remove(table, utxo_internal);
+        utxo_balance_apply(table, utxo_internal, -1);
     } else {
-        HASH_REPLACE_INT(utxos, index, utxo_external, utxo_internal);
+        return;
     }
+    if (utxo_external->index > table->last_index) table->last_index = utxo_external->index;
+    utxo_balance_apply(table, utxo_external, 1);
+    table->generation++;
+    // the newest utxo of an outpoint wins the index slot
+    dogecoin_utxo* utxo_same_outpoint;
+    HASH_FIND(hh_outpoint, table->by_outpoint, utxo_external->txid, UTXO_OUTPOINT_KEYLEN, utxo_same_outpoint);
+    if (utxo_same_outpoint) {
+        HASH_DELETE(hh_outpoint, table->by_outpoint, utxo_same_outpoint);
+    }
+    HASH_ADD(hh_outpoint, table->by_outpoint, txid, UTXO_OUTPOINT_KEYLEN, utxo_external);
     dogecoin_free(utxo_internal);
 }
 
+void add_dogecoin_utxo(dogecoin_utxo* utxo_external) {
+    utxo_table_add(&standalone_utxos, utxo_external);
+}
+
+int start_dogecoin_utxo() {
+    dogecoin_utxo* m = new_dogecoin_utxo();
+    add_dogecoin_utxo(m);
+    return m->index;
+}
+
+static dogecoin_utxo* utxo_table_find(const dogecoin_utxo_table* table, int index) {
+    dogecoin_utxo* utxo;
+    HASH_FIND_INT(*table->utxos, &index, utxo);
+    return utxo;
+}
+
 dogecoin_utxo* find_dogecoin_utxo(int index) {
+    return utxo_table_find(&standalone_utxos, index);
+}
+
+static dogecoin_utxo* utxo_table_find_outpoint(const dogecoin_utxo_table* table, const uint256_t txid, uint32_t vout) {
+    uint8_t key[UTXO_OUTPOINT_KEYLEN];
+    memcpy(key, txid, sizeof(uint256_t));
+    memcpy(key + sizeof(uint256_t), &vout, sizeof(uint32_t));
     dogecoin_utxo* utxo;
-    HASH_FIND_INT(utxos, &index, utxo);
+    HASH_FIND(hh_outpoint, table->by_outpoint, key, UTXO_OUTPOINT_KEYLEN, utxo);
     return utxo;
 }
 
-void remove_dogecoin_utxo(dogecoin_utxo* utxo) {
-    HASH_DEL(utxos, utxo);
+/**
+ * @brief This function looks up a utxo of a wallet by its outpoint.
+ *
+ * @param wallet The wallet owning the utxo.
+ * @param txid The txid in display (reversed) byte order, as stored in dogecoin_utxo.
+ * @param vout The output index.
+ *
+ * @return The utxo if found, NULL otherwise.
+ */
+dogecoin_utxo* find_dogecoin_utxo_by_outpoint(dogecoin_wallet* wallet, const uint256_t txid, uint32_t vout) {
+    return utxo_table_find_outpoint(wallet->utxo_table, txid, vout);
+}
+
+static void utxo_table_remove(dogecoin_utxo_table* table, dogecoin_utxo* utxo) {
+    utxo_outpoint_index_remove(table, utxo);
+    utxo_balance_apply(table, utxo, -1);
+    HASH_DEL(*table->utxos, utxo);
     dogecoin_free(utxo);
+    table->generation++;
 }
 
-void remove_all_utxos() {
+void remove_dogecoin_utxo(dogecoin_utxo* utxo) {
+    utxo_table_remove(&standalone_utxos, utxo);
+}
+
+static void utxo_table_clear(dogecoin_utxo_table* table) {
     dogecoin_utxo* utxo;
     dogecoin_utxo* tmp;
-    HASH_ITER(hh, utxos, utxo, tmp) {
-        remove_dogecoin_utxo(utxo);
+    HASH_CLEAR(hh_outpoint, table->by_outpoint);
+    HASH_ITER(hh, *table->utxos, utxo, tmp) {
+        HASH_DEL(*table->utxos, utxo);
+        dogecoin_free(utxo);
     }
+    dogecoin_address_balance* entry;
+    dogecoin_address_balance* entry_tmp;
+    HASH_ITER(hh, table->address_balances, entry, entry_tmp) {
+        HASH_DEL(table->address_balances, entry);
+        vector_free(entry->unspent, true);
+        dogecoin_free(entry);
+    }
+    dogecoin_mem_zero(&table->balance, sizeof(table->balance));
+    table->tip_height = 0;
+    table->generation++;
+}
+
+void remove_all_utxos() {
+    utxo_table_clear(&standalone_utxos);
 }
 
 void dogecoin_wallet_utxo_free(dogecoin_utxo* utxo) {
     dogecoin_free(utxo);
 }
 
+/**
+ * @brief This function produces the base58 address of a utxo.
+ *
+ * @param utxo The utxo.
+ * @param chain The chain the address is encoded for.
+ * @param address_out The buffer the address gets written to.
+ * @param len The size of the buffer (P2PKHLEN at least).
+ *
+ * @return 1 if the address was written, 0 for non-standard scripts.
+ */
+dogecoin_bool dogecoin_utxo_get_address(const dogecoin_utxo* utxo, const dogecoin_chainparams* chain, char* address_out, size_t len) {
+    if (!utxo || !chain || !address_out || !len) return false;
+    address_out[0] = '\0';
+    if (utxo->script_type == DOGECOIN_TX_PUBKEYHASH) {
+        return dogecoin_p2pkh_addr_from_hash160(utxo->hash160, chain, address_out, len);
+    } else if (utxo->script_type == DOGECOIN_TX_SCRIPTHASH) {
+        return dogecoin_p2sh_addr_from_hash160(utxo->hash160, chain, address_out, len);
+    }
+    return false;
+}
+
+/**
+ * @brief This function produces the hex encoded script_pubkey of
+ * a utxo.
+ *
+ * @param utxo The utxo.
+ * @param hex_out The buffer the hex string gets written to.
+ * @param len The size of the buffer (SCRIPT_PUBKEY_STRINGLEN at least).
+ *
+ * @return 1 if the script was written, 0 otherwise.
+ */
+dogecoin_bool dogecoin_utxo_get_script_pubkey_hex(const dogecoin_utxo* utxo, char* hex_out, size_t len) {
+    if (!utxo || !hex_out || !len) return false;
+    hex_out[0] = '\0';
+    cstring* script = cstr_new_sz(32);
+    if (utxo->script_type == DOGECOIN_TX_PUBKEYHASH) {
+        dogecoin_script_build_p2pkh(script, utxo->hash160);
+    } else if (utxo->script_type == DOGECOIN_TX_SCRIPTHASH) {
+        dogecoin_script_build_p2sh(script, utxo->hash160);
+    }
+    dogecoin_bool res = script->len > 0 && script->len * 2 < len;
+    if (res) {
+        utils_bin_to_hex((unsigned char*)script->str, script->len, hex_out);
+    }
+    cstr_free(script, true);
+    return res;
+}
+
+/**
+ * @brief This function produces the amount of a utxo in coins.
+ *
+ * @param utxo The utxo.
+ * @param amount_out The buffer the amount gets written to.
+ *
+ * @return Nothing.
+ */
+void dogecoin_utxo_get_amount_str(const dogecoin_utxo* utxo, char amount_out[KOINU_STRINGLEN]) {
+    dogecoin_mem_zero(amount_out, KOINU_STRINGLEN);
+    koinu_to_coins_str(utxo ? (uint64_t)utxo->koinu : 0, amount_out);
+}
+
 /*
  ==========================================================
  WALLET ADDRESS (WALLET_ADDR) FUNCTIONS
@@ -367,20 +792,36 @@ void set_wallet_filename(dogecoin_wallet* wallet, const dogecoin_chainparams *pa
     memcpy_safe((char*)wallet->filename + path_size + delim_size + chain_size, file_suffix, file_size);
 }
 
-dogecoin_wallet* dogecoin_wallet_new(const dogecoin_chainparams *params)
+static void dogecoin_wallet_init_members(dogecoin_wallet* wallet, const dogecoin_chainparams *params)
 {
-    dogecoin_wallet* wallet = dogecoin_calloc(1, sizeof(*wallet));
     wallet->masterkey = NULL;
     wallet->chain = params;
-    set_wallet_filename(wallet, params);
     wallet->hdkeys_rbtree = 0;
     wallet->utxos = 0;
+    wallet->utxo_table = utxo_table_new(&wallet->utxos);
     wallet->unspent_rbtree = 0;
     wallet->spends_rbtree = 0;
     wallet->vec_wtxes = vector_new(10, (void (*)(void *)) dogecoin_wallet_wtx_free);
     wallet->wtxes_rbtree = 0;
     wallet->waddr_vector = vector_new(10, (void (*)(void *)) dogecoin_wallet_addr_free);
     wallet->waddr_rbtree = 0;
+    wallet->hash160_set = NULL;
+    wallet->hash160_set_len = 0;
+    wallet->hash160_set_generation = 0;
+    wallet->balance_credit = 0;
+    wallet->balance_waddr_generation = 0;
+    wallet->vec_coinbase_wtxes = vector_new(1, NULL);
+    wallet->prefilter = NULL;
+    wallet->waddr_generation = 1;
+    wallet->wtx_generation = 1;
+    wallet->block_undo = NULL;
+}
+
+dogecoin_wallet* dogecoin_wallet_new(const dogecoin_chainparams *params)
+{
+    dogecoin_wallet* wallet = dogecoin_calloc(1, sizeof(*wallet));
+    set_wallet_filename(wallet, params);
+    dogecoin_wallet_init_members(wallet, params);
     return wallet;
 }
 
@@ -567,42 +1008,51 @@ void print_utxos(dogecoin_wallet* wallet) {
         }
     vector_free(addrs, true);
 
-    if (HASH_COUNT(utxos) > 0) {
+    if (HASH_COUNT(wallet->utxos) > 0) {
         char wallet_total[21];
         dogecoin_mem_zero(wallet_total, 21);
         uint64_t wallet_total_u64 = 0;
+        char address[P2PKHLEN];
+        char script_pubkey[SCRIPT_PUBKEY_STRINGLEN];
+        char amount[KOINU_STRINGLEN];
         dogecoin_utxo* utxo;
         dogecoin_utxo* tmp;
-        HASH_ITER(hh, utxos, utxo, tmp) {
+        HASH_ITER(hh, wallet->utxos, utxo, tmp) {
             if (is_spent(utxo)) {
                 printf("%s\n", "----------------------");
                 printf("txid:           %s\n", utils_uint8_to_hex(utxo->txid, sizeof utxo->txid));
-                printf("vout:           %d\n", utxo->vout);
-                printf("address:        %s\n", utxo->address);
-                printf("script_pubkey:  %s\n", utxo->script_pubkey);
-                printf("amount:         %s\n", utxo->amount);
+                dogecoin_utxo_get_address(utxo, wallet->chain, address, sizeof(address));
+                dogecoin_utxo_get_script_pubkey_hex(utxo, script_pubkey, sizeof(script_pubkey));
+                dogecoin_utxo_get_amount_str(utxo, amount);
+                printf("vout:           %u\n", utxo->vout);
+                printf("address:        %s\n", address);
+                printf("script_pubkey:  %s\n", script_pubkey);
+                printf("amount:         %s\n", amount);
                 debug_print("confirmations:  %d\n", utxo->confirmations);
                 printf("spendable:      %d\n", utxo->spendable);
                 printf("solvable:       %d\n", utxo->solvable);
-                wallet_total_u64 += coins_to_koinu_str(utxo->amount);
+                wallet_total_u64 += utxo->koinu;
             }
         }
         koinu_to_coins_str(wallet_total_u64, wallet_total);
         printf("Spent Balance: %s\n", wallet_total);
         dogecoin_mem_zero(wallet_total, 21);
         wallet_total_u64 = 0;
-        HASH_ITER(hh, utxos, utxo, tmp) {
+        HASH_ITER(hh, wallet->utxos, utxo, tmp) {
             if (!is_spent(utxo)) {
                 printf("%s\n", "----------------------");
                 printf("txid:           %s\n", utils_uint8_to_hex(utxo->txid, sizeof utxo->txid));
-                printf("vout:           %d\n", utxo->vout);
-                printf("address:        %s\n", utxo->address);
-                printf("script_pubkey:  %s\n", utxo->script_pubkey);
-                printf("amount:         %s\n", utxo->amount);
+                dogecoin_utxo_get_address(utxo, wallet->chain, address, sizeof(address));
+                dogecoin_utxo_get_script_pubkey_hex(utxo, script_pubkey, sizeof(script_pubkey));
+                dogecoin_utxo_get_amount_str(utxo, amount);
+                printf("vout:           %u\n", utxo->vout);
+                printf("address:        %s\n", address);
+                printf("script_pubkey:  %s\n", script_pubkey);
+                printf("amount:         %s\n", amount);
                 debug_print("confirmations:  %d\n", utxo->confirmations);
                 printf("spendable:      %d\n", utxo->spendable);
                 printf("solvable:       %d\n", utxo->solvable);
-                wallet_total_u64 += coins_to_koinu_str(utxo->amount);
+                wallet_total_u64 += utxo->koinu;
             }
         }
         koinu_to_coins_str(wallet_total_u64, wallet_total);
@@ -610,11 +1060,8 @@ void print_utxos(dogecoin_wallet* wallet) {
     }
 }
 
-void dogecoin_wallet_free(dogecoin_wallet* wallet)
+static void dogecoin_wallet_release_members(dogecoin_wallet* wallet)
 {
-    if (!wallet)
-        return;
-
     if (wallet->dbfile) {
         fclose(wallet->dbfile);
         wallet->dbfile = NULL;
@@ -635,161 +1082,336 @@ void dogecoin_wallet_free(dogecoin_wallet* wallet)
         wallet->vec_wtxes = NULL;
     }
 
+    if (wallet->vec_coinbase_wtxes) {
+        vector_free(wallet->vec_coinbase_wtxes, true); // elements are owned by vec_wtxes
+        wallet->vec_coinbase_wtxes = NULL;
+    }
+
+    if (wallet->hash160_set) {
+        dogecoin_free(wallet->hash160_set);
+        wallet->hash160_set = NULL;
+    }
+
+    if (wallet->prefilter) {
+        dogecoin_wallet_prefilter_free(wallet->prefilter);
+        wallet->prefilter = NULL;
+    }
+
+    dogecoin_wallet_block_undo* undo;
+    dogecoin_wallet_block_undo* undo_tmp;
+    HASH_ITER(hh, wallet->block_undo, undo, undo_tmp) {
+        HASH_DEL(wallet->block_undo, undo);
+        vector_free(undo->records, true);
+        dogecoin_free(undo);
+    }
+
     wallet->chain = NULL;
 
     // Destroy binary trees
     dogecoin_btree_tdestroy(wallet->hdkeys_rbtree, NULL);
     dogecoin_btree_tdestroy(wallet->unspent_rbtree, NULL);
     dogecoin_btree_tdestroy(wallet->spends_rbtree, NULL);
-    dogecoin_btree_tdestroy(wallet->wtxes_rbtree, (void (*)(void *)) dogecoin_wallet_wtx_free);
+    dogecoin_btree_tdestroy(wallet->wtxes_rbtree, NULL); // wtxes are owned by vec_wtxes
     dogecoin_btree_tdestroy(wallet->waddr_rbtree, NULL);
 
-    remove_all_utxos();
+    wallet->hdkeys_rbtree = 0;
+    wallet->unspent_rbtree = 0;
+    wallet->spends_rbtree = 0;
+    wallet->wtxes_rbtree = 0;
+    wallet->waddr_rbtree = 0;
+
+    if (wallet->utxo_table) {
+        utxo_table_clear(wallet->utxo_table);
+        dogecoin_free(wallet->utxo_table);
+        wallet->utxo_table = NULL;
+    }
+}
+
+void dogecoin_wallet_free(dogecoin_wallet* wallet)
+{
+    if (!wallet)
+        return;
+
+    dogecoin_wallet_release_members(wallet);
     dogecoin_free(wallet);
 }
 
-void dogecoin_wallet_scrape_utxos(dogecoin_wallet* wallet, dogecoin_wtx* wtx) {
-    // needed in case someone spends excess utxo's:
+/**
+ * @brief This function locates the 20 byte hash of a standard
+ * P2PKH or P2SH script without classifying it.
+ *
+ * @param script The raw script.
+ * @param len The length of the script.
+ * @param p2pkh_only Only accept P2PKH scripts if set.
+ *
+ * @return A pointer to the hash inside the script, NULL if the script is not a match.
+ */
+static const uint8_t* dogecoin_wallet_script_hash160(const uint8_t* script, size_t len, dogecoin_bool p2pkh_only)
+{
+    if (len == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+        script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+        return script + 3;
+    }
+    if (!p2pkh_only && len == 23 && script[0] == OP_HASH160 && script[1] == 20 && script[22] == OP_EQUAL) {
+        return script + 2;
+    }
+    return NULL;
+}
+
+/**
+ * @brief This function reverses a hash into display byte
+ * order, the order txids are stored in dogecoin_utxo.
+ *
+ * @param hash The hash in internal byte order.
+ * @param out The reversed hash.
+ *
+ * @return Nothing.
+ */
+static void dogecoin_wallet_hash_to_display(const uint256_t hash, uint256_t out) {
+    size_t i;
+    for (i = 0; i < sizeof(uint256_t); i++) {
+        out[i] = hash[sizeof(uint256_t) - 1 - i];
+    }
+}
+
+/* utxo changes of one wtx, persisted next to its tx record */
+typedef struct dogecoin_wallet_utxo_delta_ {
+    cstring* spent; /* txid (display order) + vout per spent utxo */
+    uint32_t spent_count;
+    cstring* created; /* vout, koinu, script type, hash160, height, flags per created utxo */
+    uint32_t created_count;
+} dogecoin_wallet_utxo_delta;
+
+#define WALLET_UTXO_DELTA_COINBASE 0x01
+
+static void dogecoin_wallet_utxo_delta_add_created(dogecoin_wallet_utxo_delta* delta, const dogecoin_utxo* utxo) {
+    uint8_t flags = utxo->coinbase ? WALLET_UTXO_DELTA_COINBASE : 0;
+    ser_u32(delta->created, utxo->vout);
+    ser_u64(delta->created, (uint64_t)utxo->koinu);
+    ser_bytes(delta->created, &utxo->script_type, sizeof(uint8_t));
+    ser_bytes(delta->created, utxo->hash160, sizeof(uint160_t));
+    ser_u32(delta->created, (uint32_t)utxo->height);
+    ser_bytes(delta->created, &flags, sizeof(uint8_t));
+    delta->created_count++;
+}
+
+/**
+ * @brief This function scrapes the utxo changes of a wtx into the
+ * utxo table and, if delta is set, records them so they can be
+ * persisted and replayed without deserializing the transaction.
+ *
+ * @param wallet The wallet the wtx belongs to.
+ * @param wtx The wtx to scrape.
+ * @param delta The change set to fill or NULL.
+ *
+ * @return 1 if the wtx was scraped, 0 if its transaction is corrupt.
+ */
+static dogecoin_bool dogecoin_wallet_scrape_utxos_delta(dogecoin_wallet* wallet, dogecoin_wtx* wtx, dogecoin_wallet_utxo_delta* delta) {
+    dogecoin_tx* tx = dogecoin_wallet_wtx_get_tx(wtx);
+    if (!tx) return false;
     size_t k = 0;
-    // iterate through vin's:
-    for (; k < wtx->tx->vin->len; k++) {
-        dogecoin_utxo* utxo;
-        dogecoin_utxo* tmp;
-        HASH_ITER(hh, utxos, utxo, tmp) {
-            // assign from vin's to dogecoin_tx_in:
-            dogecoin_tx_in* tx_in = vector_idx(wtx->tx->vin, k);
-            // uint8_t to char*:
-            char* prevout_hash = utils_uint8_to_hex(tx_in->prevout.hash, 32);
-            // reverse the characters:
-            utils_reverse_hex(prevout_hash, 64);
-            // copy back to uint8_t:
-            uint8_t prevout_hash_bytes[32] = {0};
-            memcpy(&prevout_hash_bytes, utils_hex_to_uint8(prevout_hash), 32);
-            // compare wtx->tx->vin->prevout.hash and prevout.n with utxo->txid and utxo->vout:
-            if (memcmp(&prevout_hash_bytes, utxo->txid, 32)==0 && (int)tx_in->prevout.n == utxo->vout) {
-                size_t n = 0;
-                dogecoin_utxo* spent_utxo;
-                dogecoin_utxo* spent_tmp;
-                HASH_ITER(hh, utxos, spent_utxo, spent_tmp) {
-                    if (is_spent(spent_utxo) && memcmp((const uint8_t*)spent_utxo->txid, (const uint8_t*)utxo->txid, 32) == 0 && spent_utxo->vout == utxo->vout) {
-                        n++;
-                    }
-                }
-                if (n == 0) {
-                    // prevent spending/solving:
-                    utxo->spendable = 0;
-                    utxo->solvable = 0;
-                }
+    // mark spent utxos by looking up each prevout:
+    for (; k < tx->vin->len; k++) {
+        dogecoin_tx_in* tx_in = vector_idx(tx->vin, k);
+        uint256_t prevout_hash;
+        dogecoin_wallet_hash_to_display(tx_in->prevout.hash, prevout_hash);
+        dogecoin_utxo* utxo = find_dogecoin_utxo_by_outpoint(wallet, prevout_hash, tx_in->prevout.n);
+        if (utxo) {
+            // prevent spending/solving:
+            utxo_set_spent(wallet->utxo_table, utxo, true);
+            if (delta) {
+                ser_u256(delta->spent, utxo->txid);
+                ser_u32(delta->spent, utxo->vout);
+                delta->spent_count++;
             }
         }
     }
 
+    dogecoin_bool have_txid = false;
+    dogecoin_bool coinbase = dogecoin_tx_is_coinbase(tx);
+    uint256_t utxo_txid;
     size_t j = 0;
     // iterate through vout's:
-    for (; j < wtx->tx->vout->len; j++) {
-        dogecoin_tx_out* tx_out = vector_idx(wtx->tx->vout, j);
-        // populate address vector_t if script_pubkey exists:
-        if (wallet->waddr_vector->len && tx_out->script_pubkey->len) {
-            char p2pkh_from_script_pubkey[P2PKHLEN];
-            // convert script pubkey hash to p2pkh address:
-            if (!dogecoin_pubkey_hash_to_p2pkh_address(tx_out->script_pubkey->str, tx_out->script_pubkey->len, p2pkh_from_script_pubkey, wallet->chain)) {
-                printf("failed to convert pubkey hash to p2pkh address!\n");
+    for (; j < tx->vout->len; j++) {
+        dogecoin_tx_out* tx_out = vector_idx(tx->vout, j);
+        // match the raw pubkey hash of P2PKH outputs against the wallet:
+        const uint8_t* hash160 = dogecoin_wallet_script_hash160((const uint8_t*)tx_out->script_pubkey->str, tx_out->script_pubkey->len, true);
+        if (hash160 && dogecoin_wallet_have_key(wallet, hash160)) {
+            if (!have_txid) {
+                // make the txid, utxos store it in display byte order:
+                uint256_t hash;
+                dogecoin_tx_hash(tx, hash);
+                dogecoin_wallet_hash_to_display(hash, utxo_txid);
+                have_txid = true;
             }
-            vector_t* addrs = vector_new(1, free);
-            // grab all addresses in vector_t:
-            dogecoin_wallet_get_addresses(wallet, addrs);
-            unsigned int i, g;
-            // loop through addresses:
-            for (i = 0; i < addrs->len; i++) {
-                char* addr = vector_idx(addrs, i);
-                // compare wtx->tx->vout with address from wallet->waddr_vector:
-                if (strncmp(p2pkh_from_script_pubkey, addr, P2PKHLEN - 1)==0) {
-                    uint256_t utxo_txid;
-                    // make the txid:
-                    dogecoin_tx_hash(wtx->tx, (uint8_t*)&utxo_txid);
-                    // convert from uint8_t to char*
-                    char* hexbuf = utils_uint8_to_hex((const uint8_t*)&utxo_txid, DOGECOIN_HASH_LENGTH);
-                    // reverse txid with double length:
-                    utils_reverse_hex(hexbuf, DOGECOIN_HASH_LENGTH*2);
-                    // copy back to utxo->txid as uint256_t (uint8_t* or uint8_t[32]):
-                    memcpy_safe(utxo_txid, utils_hex_to_uint8(hexbuf), 32);
-                    g = 0;
-                    dogecoin_utxo* unspent_utxo;
-                    dogecoin_utxo* unspent_tmp;
-                    HASH_ITER(hh, utxos, unspent_utxo, unspent_tmp) {
-                        if (!is_spent(unspent_utxo) && memcmp(unspent_utxo->txid, &utxo_txid, 32)==0 && (size_t)unspent_utxo->vout == j) {
-                            g++;
-                        }
-                    }
-                    dogecoin_utxo* spent_utxo;
-                    dogecoin_utxo* spent_tmp;
-                    HASH_ITER(hh, utxos, spent_utxo, spent_tmp) {
-                        if (is_spent(spent_utxo) && memcmp(spent_utxo->txid, &utxo_txid, 32)==0 && (size_t)spent_utxo->vout == j) {
-                            g++;
-                        }
-                    }
-                    if (g == 0) {
-                        // match so we populate utxo struct:
-                        dogecoin_utxo* utxo = new_dogecoin_utxo();
-                        memcpy_safe(utxo->txid, &utxo_txid, DOGECOIN_HASH_LENGTH);
-                        // copy matching script_pubkey:
-                        memcpy_safe(utxo->script_pubkey, utils_uint8_to_hex((const uint8_t*)tx_out->script_pubkey->str, tx_out->script_pubkey->len), SCRIPT_PUBKEY_STRINGLEN);
-                        // set tx->tx_in->prevout.n (utxo->vout):
-                        utxo->vout = j;
-                        // set utxo p2pkh address:
-                        memcpy_safe(utxo->address, p2pkh_from_script_pubkey, P2PKHLEN);
-                        // set amount of utxo:
-                        koinu_to_coins_str(tx_out->value, utxo->amount);
-                        // set the height of the utxo:
-                        utxo->height = wtx->height;
-                        // finally add utxo to rbtree:
-                        dogecoin_btree_tfind(utxo, &wallet->unspent_rbtree, dogecoin_utxo_compare);
-                        add_dogecoin_utxo(utxo);
-                    }
+            if (!find_dogecoin_utxo_by_outpoint(wallet, utxo_txid, (uint32_t)j)) {
+                // match so we populate utxo struct:
+                dogecoin_utxo* utxo = utxo_table_new_utxo(wallet->utxo_table);
+                memcpy_safe(utxo->txid, &utxo_txid, DOGECOIN_HASH_LENGTH);
+                // keep the matching script_pubkey as its template and hash160:
+                utxo->script_type = DOGECOIN_TX_PUBKEYHASH;
+                memcpy(utxo->hash160, hash160, sizeof(uint160_t));
+                // set tx->tx_in->prevout.n (utxo->vout):
+                utxo->vout = (uint32_t)j;
+                // set amount of utxo:
+                utxo->koinu = tx_out->value;
+                // set the height of the utxo:
+                utxo->height = wtx->height;
+                utxo->coinbase = coinbase;
+                // finally add utxo to rbtree:
+                dogecoin_btree_tfind(utxo, &wallet->unspent_rbtree, dogecoin_utxo_compare);
+                utxo_table_add(wallet->utxo_table, utxo);
+                if (delta) {
+                    dogecoin_wallet_utxo_delta_add_created(delta, utxo);
                 }
             }
-            vector_free(addrs, true);
         }
     }
+    return true;
+}
 
-    // update the wallet with the new utxos:
-    wallet->utxos = utxos;
+void dogecoin_wallet_scrape_utxos(dogecoin_wallet* wallet, dogecoin_wtx* wtx) {
+    dogecoin_wallet_scrape_utxos_delta(wallet, wtx, NULL);
+}
+
+/**
+ * @brief This function replays a utxo record written next to a tx
+ * record, so loading a wallet does not need to deserialize and
+ * scrape the transaction again.
+ *
+ * @param wallet The wallet to load into.
+ * @param buf The record payload (past the tx hash).
+ *
+ * @return 1 if the record was applied, 0 if it is corrupt.
+ */
+static dogecoin_bool dogecoin_wallet_utxo_delta_apply(dogecoin_wallet* wallet, const uint256_t tx_hash, struct const_buffer* buf) {
+    uint32_t count = 0;
+    uint32_t i;
+    if (!deser_varlen(&count, buf)) return false;
+    for (i = 0; i < count; i++) {
+        uint256_t txid;
+        uint32_t vout;
+        if (!deser_u256(txid, buf) || !deser_u32(&vout, buf)) return false;
+        dogecoin_utxo* utxo = find_dogecoin_utxo_by_outpoint(wallet, txid, vout);
+        if (utxo) utxo_set_spent(wallet->utxo_table, utxo, true);
+    }
+
+    uint256_t utxo_txid;
+    dogecoin_wallet_hash_to_display(tx_hash, utxo_txid);
+    if (!deser_varlen(&count, buf)) return false;
+    for (i = 0; i < count; i++) {
+        uint32_t vout, height;
+        uint64_t koinu;
+        uint8_t script_type, flags;
+        uint160_t hash160;
+        if (!deser_u32(&vout, buf) || !deser_u64(&koinu, buf) || !deser_bytes(&script_type, buf, sizeof(uint8_t)) ||
+            !deser_bytes(hash160, buf, sizeof(uint160_t)) || !deser_u32(&height, buf) || !deser_bytes(&flags, buf, sizeof(uint8_t))) {
+            return false;
+        }
+        // skip utxos of addresses removed since the record was written
+        if (find_dogecoin_utxo_by_outpoint(wallet, utxo_txid, vout) || !dogecoin_wallet_have_key(wallet, hash160)) continue;
+        dogecoin_utxo* utxo = utxo_table_new_utxo(wallet->utxo_table);
+        memcpy_safe(utxo->txid, utxo_txid, DOGECOIN_HASH_LENGTH);
+        utxo->vout = vout;
+        utxo->koinu = (int64_t)koinu;
+        utxo->script_type = script_type;
+        memcpy(utxo->hash160, hash160, sizeof(uint160_t));
+        utxo->height = (int)height;
+        utxo->coinbase = (flags & WALLET_UTXO_DELTA_COINBASE) != 0;
+        dogecoin_btree_tfind(utxo, &wallet->unspent_rbtree, dogecoin_utxo_compare);
+        utxo_table_add(wallet->utxo_table, utxo);
+    }
+    return true;
 }
 
-void dogecoin_wallet_utxos_update_confirmations(int height) {
+void dogecoin_wallet_utxos_update_confirmations(dogecoin_wallet* wallet, int height) {
+    dogecoin_utxo_table* table = wallet->utxo_table;
     dogecoin_utxo* utxo;
     dogecoin_utxo* tmp;
-    HASH_ITER(hh, utxos, utxo, tmp) {
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
         utxo->confirmations = height - utxo->height + 1;
-    }
-}
-void dogecoin_wallet_add_wtx_intern_move(dogecoin_wallet *wallet, const dogecoin_wtx *wtx) {
-    // check if wtx already exists
-    dogecoin_wtx* checkwtx = dogecoin_btree_tfind(wtx, &wallet->wtxes_rbtree, dogecoin_wtx_compare);
-    if (checkwtx) {
-        // remove existing wtx
-        checkwtx = *(dogecoin_wtx **)checkwtx;
-        unsigned int i;
-        for (i = 0; i < wallet->vec_wtxes->len; i++) {
-            dogecoin_wtx *wtx_vec = vector_idx(wallet->vec_wtxes, i);
-            if (wtx_vec == checkwtx) {
-                vector_remove_idx(wallet->vec_wtxes, i);
+        if (utxo->coinbase && !is_spent(utxo)) {
+            // coinbase outputs move between immature and confirmed with the tip
+            enum utxo_balance_state prev = utxo_balance_state_at(utxo, table->tip_height);
+            enum utxo_balance_state next = utxo_balance_state_at(utxo, height);
+            if (prev != next) {
+                utxo_balance_move(table, utxo, prev, -utxo->koinu);
+                utxo_balance_move(table, utxo, next, utxo->koinu);
             }
         }
-        // we do not really delete transactions
-        checkwtx->ignore = true;
-        dogecoin_btree_tdelete(checkwtx, &wallet->wtxes_rbtree, dogecoin_wtx_compare);
-        dogecoin_wallet_wtx_free(checkwtx);
     }
-    dogecoin_btree_tfind(wtx, &wallet->wtxes_rbtree, dogecoin_wtx_compare);
-    vector_add(wallet->vec_wtxes, (dogecoin_wtx *)wtx);
+    table->tip_height = height;
 }
-
-dogecoin_bool dogecoin_wallet_create(dogecoin_wallet* wallet, const char* file_path, int *error)
-{
-    if (!wallet)
-        return false;
-
+/**
+ * @brief These functions keep the running wallet credit in sync
+ * when wtxes are added or replaced. Coinbase credit depends on
+ * the best height, so coinbase wtxes are only tracked and get
+ * valued on demand.
+ *
+ * @param wallet The wallet the wtx belongs to.
+ * @param wtx The added or removed wtx.
+ *
+ * @return Nothing.
+ */
+static void dogecoin_wallet_balance_add_wtx(dogecoin_wallet *wallet, dogecoin_wtx *wtx) {
+    if (dogecoin_wallet_wtx_is_coinbase(wtx)) {
+        vector_add(wallet->vec_coinbase_wtxes, wtx);
+    } else if (wallet->balance_waddr_generation == wallet->waddr_generation) {
+        wallet->balance_credit += dogecoin_wallet_wtx_get_available_credit(wallet, wtx);
+    }
+}
+
+static void dogecoin_wallet_balance_remove_wtx(dogecoin_wallet *wallet, dogecoin_wtx *wtx) {
+    if (dogecoin_wallet_wtx_is_coinbase(wtx)) {
+        unsigned int i;
+        for (i = 0; i < wallet->vec_coinbase_wtxes->len; i++) {
+            if (vector_idx(wallet->vec_coinbase_wtxes, i) == wtx) {
+                vector_remove_idx(wallet->vec_coinbase_wtxes, i);
+                break;
+            }
+        }
+    } else if (wallet->balance_waddr_generation == wallet->waddr_generation) {
+        wallet->balance_credit -= dogecoin_wallet_wtx_get_available_credit(wallet, wtx);
+    }
+}
+
+/**
+ * @brief This function drops a wtx from the wallet, the vector
+ * owns the wtx and frees it.
+ *
+ * @param wallet The wallet the wtx belongs to.
+ * @param wtx The wtx to remove.
+ *
+ * @return Nothing.
+ */
+static void dogecoin_wallet_remove_wtx(dogecoin_wallet* wallet, dogecoin_wtx* wtx) {
+    dogecoin_wallet_balance_remove_wtx(wallet, wtx);
+    wtx->ignore = true;
+    dogecoin_btree_tdelete(wtx, &wallet->wtxes_rbtree, dogecoin_wtx_compare);
+    vector_remove(wallet->vec_wtxes, wtx);
+    wallet->wtx_generation++;
+}
+
+void dogecoin_wallet_add_wtx_intern_move(dogecoin_wallet *wallet, const dogecoin_wtx *wtx) {
+    // check if wtx already exists
+    dogecoin_wtx* checkwtx = dogecoin_btree_tfind(wtx, &wallet->wtxes_rbtree, dogecoin_wtx_compare);
+    if (checkwtx) {
+        // remove existing wtx, the superseded record stays in the file until compaction
+        dogecoin_wallet_remove_wtx(wallet, *(dogecoin_wtx **)checkwtx);
+    }
+    dogecoin_btree_tsearch(wtx, &wallet->wtxes_rbtree, dogecoin_wtx_compare);
+    vector_add(wallet->vec_wtxes, (dogecoin_wtx *)wtx);
+    wallet->wtx_generation++;
+    dogecoin_wallet_balance_add_wtx(wallet, (dogecoin_wtx *)wtx);
+}
+
+static dogecoin_bool wallet_write_header(dogecoin_wallet* wallet, uint32_t version);
+
+dogecoin_bool dogecoin_wallet_create(dogecoin_wallet* wallet, const char* file_path, int *error)
+{
+    if (!wallet)
+        return false;
+
     struct stat buffer;
     if (stat(file_path, &buffer) != 0) {
         *error = 1;
@@ -802,11 +1424,16 @@ dogecoin_bool dogecoin_wallet_create(dogecoin_wallet* wallet, const char* file_p
         wallet->dbfile = fopen(file_path, "a+b");
     }
 
+    return wallet_write_header(wallet, snapshotless_version);
+}
+
+static dogecoin_bool wallet_write_header(dogecoin_wallet* wallet, uint32_t version)
+{
     // write file-header-magic
     if (fwrite(file_hdr_magic, 4, 1, wallet->dbfile) != 1) return false;
 
     // write version
-    uint32_t v = htole32(current_version);
+    uint32_t v = htole32(version);
     if (fwrite(&v, sizeof(v), 1, wallet->dbfile) != 1) return false;
 
     // write genesis
@@ -854,24 +1481,198 @@ dogecoin_bool dogecoin_wallet_load_address(dogecoin_wallet* wallet) {
         // add the node to the binary tree
         dogecoin_btree_tsearch(waddr, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
         vector_add(wallet->waddr_vector, waddr);
+        wallet->waddr_generation++;
         wallet->next_childindex = waddr->childindex+1;
     }
     return true;
 }
 
-dogecoin_bool dogecoin_wallet_load_transaction(dogecoin_wallet* wallet, uint32_t reclen) {
+static void dogecoin_wallet_undo_record_free(void* record) {
+    cstr_free((cstring*)record, true);
+}
+
+/**
+ * @brief This function keeps a utxo record as undo data of the
+ * block it was connected with. Undo data of blocks deeper than
+ * WALLET_BLOCK_UNDO_DEPTH gets released.
+ *
+ * @param wallet The wallet the record belongs to.
+ * @param blockhash The hash of the block.
+ * @param height The height of the block.
+ * @param record The utxo record payload.
+ * @param len The length of the payload.
+ *
+ * @return Nothing.
+ */
+static void dogecoin_wallet_block_undo_add(dogecoin_wallet* wallet, const uint256_t blockhash, uint32_t height, const unsigned char* record, size_t len) {
+    dogecoin_wallet_block_undo* undo = NULL;
+    HASH_FIND(hh, wallet->block_undo, blockhash, sizeof(uint256_t), undo);
+    if (!undo) {
+        dogecoin_wallet_block_undo* entry;
+        dogecoin_wallet_block_undo* tmp;
+        HASH_ITER(hh, wallet->block_undo, entry, tmp) {
+            if (entry->height + WALLET_BLOCK_UNDO_DEPTH <= height) {
+                HASH_DEL(wallet->block_undo, entry);
+                vector_free(entry->records, true);
+                dogecoin_free(entry);
+            }
+        }
+        undo = dogecoin_calloc(1, sizeof(*undo));
+        memcpy(undo->blockhash, blockhash, sizeof(uint256_t));
+        undo->height = height;
+        undo->records = vector_new(1, dogecoin_wallet_undo_record_free);
+        HASH_ADD(hh, wallet->block_undo, blockhash, sizeof(uint256_t), undo);
+    }
+    vector_add(undo->records, cstr_new_buf(record, len));
+}
+
+/**
+ * @brief This function reverts a utxo record: its spent utxos
+ * become unspent, its created utxos and its wtx get removed.
+ *
+ * @param wallet The wallet to roll back.
+ * @param record The utxo record payload.
+ * @param height The height of the block being disconnected.
+ *
+ * @return 1 if the record was reverted, 0 if it is corrupt.
+ */
+static dogecoin_bool dogecoin_wallet_undo_record(dogecoin_wallet* wallet, const cstring* record, uint32_t height) {
+    struct const_buffer buf = {record->str, record->len};
+    uint256_t tx_hash;
+    uint32_t count = 0;
+    uint32_t i;
+    if (!deser_u256(tx_hash, &buf) || !deser_varlen(&count, &buf)) return false;
+    for (i = 0; i < count; i++) {
+        uint256_t txid;
+        uint32_t vout;
+        if (!deser_u256(txid, &buf) || !deser_u32(&vout, &buf)) return false;
+        dogecoin_utxo* utxo = find_dogecoin_utxo_by_outpoint(wallet, txid, vout);
+        if (utxo) utxo_set_spent(wallet->utxo_table, utxo, false);
+    }
+
+    uint256_t utxo_txid;
+    dogecoin_wallet_hash_to_display(tx_hash, utxo_txid);
+    if (!deser_varlen(&count, &buf)) return false;
+    for (i = 0; i < count; i++) {
+        uint32_t vout;
+        if (!deser_u32(&vout, &buf) || !deser_skip(&buf, sizeof(uint64_t) + 1 + sizeof(uint160_t) + sizeof(uint32_t) + 1)) return false;
+        dogecoin_utxo* utxo = find_dogecoin_utxo_by_outpoint(wallet, utxo_txid, vout);
+        if (utxo) utxo_table_remove(wallet->utxo_table, utxo);
+    }
+
+    // the transaction may get mined again, check_transaction adds it back then
+    dogecoin_wtx* search = dogecoin_wallet_wtx_new();
+    dogecoin_hash_set(search->tx_hash_cache, tx_hash);
+    dogecoin_wtx* wtx = dogecoin_btree_tfind(search, &wallet->wtxes_rbtree, dogecoin_wtx_compare);
+    dogecoin_wallet_wtx_free(search);
+    if (wtx) {
+        wtx = *(dogecoin_wtx **)wtx;
+        if (wtx->height == height) dogecoin_wallet_remove_wtx(wallet, wtx);
+    }
+    return true;
+}
+
+/**
+ * @brief This function rolls the wallet back by the undo data of
+ * a block, newest record first.
+ *
+ * @param wallet The wallet to roll back.
+ * @param blockhash The hash of the disconnected block.
+ *
+ * @return 1 if the block had undo data, 0 otherwise.
+ */
+static dogecoin_bool dogecoin_wallet_undo_block(dogecoin_wallet* wallet, const uint256_t blockhash) {
+    dogecoin_wallet_block_undo* undo = NULL;
+    HASH_FIND(hh, wallet->block_undo, blockhash, sizeof(uint256_t), undo);
+    if (!undo) return false;
+    size_t i = undo->records->len;
+    while (i-- > 0) {
+        if (!dogecoin_wallet_undo_record(wallet, vector_idx(undo->records, i), undo->height)) {
+            fprintf(stderr, "Wallet: corrupt undo data for block at height %u\n", undo->height);
+        }
+    }
+    dogecoin_wallet_utxos_update_confirmations(wallet, (int)undo->height - 1);
+    HASH_DEL(wallet->block_undo, undo);
+    vector_free(undo->records, true);
+    dogecoin_free(undo);
+    return true;
+}
+
+/**
+ * @brief This function loads a tx record with its body kept
+ * serialized. Its utxos get scraped by the next call unless a
+ * utxo record for it follows, which makes scraping unnecessary.
+ *
+ * @param wallet The wallet to load into.
+ * @param reclen The length of the record.
+ * @param pending The wtx still waiting to be scraped, updated in place.
+ *
+ * @return 1 if the record was loaded, 0 otherwise.
+ */
+dogecoin_bool dogecoin_wallet_load_transaction(dogecoin_wallet* wallet, uint32_t reclen, dogecoin_wtx** pending) {
     if (!wallet) return false;
+    if (*pending) {
+        dogecoin_wtx* wtx = *pending;
+        *pending = NULL;
+        if (!dogecoin_wallet_scrape_utxos_delta(wallet, wtx, NULL)) return false;
+    }
     unsigned char* buf = dogecoin_uchar_vla(reclen);
     struct const_buffer cbuf = {buf, reclen};
-    if (fread(buf, reclen, 1, wallet->dbfile) != 1) return false;
+    if (fread(buf, reclen, 1, wallet->dbfile) != 1) {
+        dogecoin_free(buf);
+        return false;
+    }
     dogecoin_wtx *wtx = dogecoin_wallet_wtx_new();
-    if (!dogecoin_wallet_wtx_deserialize(wtx, &cbuf)) return false;
+    dogecoin_bool res = dogecoin_wallet_wtx_deserialize_lazy(wtx, &cbuf);
     dogecoin_free(buf);
-    dogecoin_wallet_scrape_utxos(wallet, wtx);
+    if (!res) {
+        dogecoin_wallet_wtx_free(wtx);
+        return false;
+    }
     dogecoin_wallet_add_wtx_intern_move(wallet, wtx); // hands memory management over to the binary tree
+    *pending = wtx;
     return true;
 }
 
+/**
+ * @brief This function loads a utxo record and applies it instead
+ * of scraping the matching pending wtx.
+ *
+ * @param wallet The wallet to load into.
+ * @param reclen The length of the record.
+ * @param pending The wtx still waiting to be scraped, updated in place.
+ *
+ * @return 1 if the record was loaded, 0 otherwise.
+ */
+static dogecoin_bool dogecoin_wallet_load_utxo_delta(dogecoin_wallet* wallet, uint32_t reclen, dogecoin_wtx** pending) {
+    unsigned char* buf = dogecoin_uchar_vla(reclen);
+    if (fread(buf, reclen, 1, wallet->dbfile) != 1) {
+        dogecoin_free(buf);
+        return false;
+    }
+    struct const_buffer cbuf = {buf, reclen};
+    uint256_t tx_hash;
+    dogecoin_bool res = deser_u256(tx_hash, &cbuf);
+    if (res && *pending && !dogecoin_hash_equal((*pending)->tx_hash_cache, tx_hash)) {
+        res = dogecoin_wallet_scrape_utxos_delta(wallet, *pending, NULL);
+    }
+    *pending = NULL;
+    res = res && dogecoin_wallet_utxo_delta_apply(wallet, tx_hash, &cbuf);
+    if (res && cbuf.len >= sizeof(uint256_t) + sizeof(uint32_t)) {
+        // records written during a block sync end with the block they belong to
+        uint256_t blockhash;
+        uint32_t height;
+        deser_u256(blockhash, &cbuf);
+        deser_u32(&height, &cbuf);
+        dogecoin_wallet_block_undo_add(wallet, blockhash, height, buf, reclen);
+    }
+    dogecoin_free(buf);
+    if (!res) {
+        fprintf(stderr, "Wallet file: error reading utxo record. Wallet file is corrupt\n");
+    }
+    return res;
+}
+
 // dogecoin_bool dogecoin_wallet_replace(dogecoin_wallet* wallet, const char* file_path, cstring* record, uint8_t record_type, int *error)
 // {
 //     if (!wallet) return false;
@@ -911,13 +1712,155 @@ dogecoin_bool dogecoin_wallet_load_transaction(dogecoin_wallet* wallet, uint32_t
 //         } else if (rectype == WALLET_DB_REC_TYPE_ADDR) {
 //             if (!dogecoin_wallet_load_address(wallet)) return false;
 //         } else if (rectype == WALLET_DB_REC_TYPE_TX) {
-//             if (!dogecoin_wallet_load_transaction(wallet, reclen)) return false;
+//             if (!dogecoin_wallet_load_transaction(wallet, reclen, &pending)) return false;
 //         }
 //     }
 //     dogecoin_file_commit(wallet->dbfile);
 //     return true;
 // }
 
+/* utxo flags of snapshot records */
+#define WALLET_SNAPSHOT_UTXO_SPENT 0x01
+#define WALLET_SNAPSHOT_UTXO_COINBASE 0x02
+
+/**
+ * @brief This function serializes the live wallet state into a
+ * snapshot record: best height, next child index, address set,
+ * utxo set (spent and unspent) and the current wtxes.
+ *
+ * @param s The cstring to append the record payload to.
+ * @param wallet The wallet to serialize.
+ *
+ * @return Nothing.
+ */
+static void dogecoin_wallet_snapshot_serialize(cstring* s, const dogecoin_wallet* wallet) {
+    unsigned int i;
+    ser_u32(s, (uint32_t)wallet->utxo_table->tip_height);
+    ser_u32(s, wallet->next_childindex);
+
+    ser_varlen(s, (uint32_t)wallet->waddr_vector->len);
+    for (i = 0; i < wallet->waddr_vector->len; i++) {
+        dogecoin_wallet_addr_serialize(s, wallet->chain, vector_idx(wallet->waddr_vector, i));
+    }
+
+    ser_varlen(s, (uint32_t)HASH_COUNT(wallet->utxos));
+    dogecoin_utxo* utxo;
+    dogecoin_utxo* tmp;
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+        uint8_t flags = (is_spent(utxo) ? WALLET_SNAPSHOT_UTXO_SPENT : 0) | (utxo->coinbase ? WALLET_SNAPSHOT_UTXO_COINBASE : 0);
+        ser_u256(s, utxo->txid);
+        ser_u32(s, utxo->vout);
+        ser_u64(s, (uint64_t)utxo->koinu);
+        ser_bytes(s, &utxo->script_type, sizeof(uint8_t));
+        ser_bytes(s, utxo->hash160, sizeof(uint160_t));
+        ser_u32(s, (uint32_t)utxo->height);
+        ser_bytes(s, &flags, sizeof(uint8_t));
+    }
+
+    ser_varlen(s, (uint32_t)wallet->vec_wtxes->len);
+    cstring* wtx_record = cstr_new_sz(1024);
+    for (i = 0; i < wallet->vec_wtxes->len; i++) {
+        cstr_resize(wtx_record, 0);
+        dogecoin_wallet_wtx_serialize(wtx_record, vector_idx(wallet->vec_wtxes, i));
+        ser_varstr(s, wtx_record);
+    }
+    cstr_free(wtx_record, true);
+}
+
+/**
+ * @brief This function maps a snapshot record straight into the
+ * in-memory indexes. The utxo set is restored as written, the
+ * wtxes do not get scraped again.
+ *
+ * @param wallet The wallet to load into.
+ * @param buf The record payload.
+ *
+ * @return 1 if the snapshot was read completely, 0 otherwise.
+ */
+static dogecoin_bool dogecoin_wallet_snapshot_deserialize(dogecoin_wallet* wallet, struct const_buffer* buf) {
+    uint32_t best_height, next_childindex, count, i;
+    if (!deser_u32(&best_height, buf) || !deser_u32(&next_childindex, buf)) return false;
+
+    if (!deser_varlen(&count, buf)) return false;
+    for (i = 0; i < count; i++) {
+        dogecoin_wallet_addr* waddr = dogecoin_wallet_addr_new();
+        if (!dogecoin_wallet_addr_deserialize(waddr, wallet->chain, buf)) {
+            dogecoin_wallet_addr_free(waddr);
+            return false;
+        }
+        if (waddr->ignore) {
+            dogecoin_wallet_addr_free(waddr);
+            continue;
+        }
+        dogecoin_btree_tsearch(waddr, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
+        vector_add(wallet->waddr_vector, waddr);
+        wallet->waddr_generation++;
+    }
+    wallet->next_childindex = next_childindex;
+
+    if (!deser_varlen(&count, buf)) return false;
+    for (i = 0; i < count; i++) {
+        dogecoin_utxo* utxo = utxo_table_new_utxo(wallet->utxo_table);
+        uint64_t koinu;
+        uint32_t height;
+        uint8_t flags;
+        if (!deser_u256(utxo->txid, buf) || !deser_u32(&utxo->vout, buf) || !deser_u64(&koinu, buf) ||
+            !deser_bytes(&utxo->script_type, buf, sizeof(uint8_t)) || !deser_bytes(utxo->hash160, buf, sizeof(uint160_t)) ||
+            !deser_u32(&height, buf) || !deser_bytes(&flags, buf, sizeof(uint8_t))) {
+            dogecoin_wallet_utxo_free(utxo);
+            return false;
+        }
+        utxo->koinu = (int64_t)koinu;
+        utxo->height = (int)height;
+        utxo->coinbase = (flags & WALLET_SNAPSHOT_UTXO_COINBASE) != 0;
+        utxo->spendable = utxo->solvable = (flags & WALLET_SNAPSHOT_UTXO_SPENT) == 0;
+        utxo_table_add(wallet->utxo_table, utxo);
+    }
+
+    if (!deser_varlen(&count, buf)) return false;
+    for (i = 0; i < count; i++) {
+        cstring* wtx_record = NULL;
+        if (!deser_varstr(&wtx_record, buf)) return false;
+        struct const_buffer wtx_buf = {wtx_record->str, wtx_record->len};
+        dogecoin_wtx* wtx = dogecoin_wallet_wtx_new();
+        dogecoin_bool res = dogecoin_wallet_wtx_deserialize_lazy(wtx, &wtx_buf);
+        cstr_free(wtx_record, true);
+        if (!res) {
+            dogecoin_wallet_wtx_free(wtx);
+            return false;
+        }
+        dogecoin_wallet_add_wtx_intern_move(wallet, wtx);
+    }
+
+    dogecoin_wallet_utxos_update_confirmations(wallet, (int)best_height);
+    return true;
+}
+
+/**
+ * @brief This function loads a snapshot record written by
+ * dogecoin_wallet_compact().
+ *
+ * @param wallet The wallet to load into.
+ * @param reclen The length of the record.
+ *
+ * @return 1 if the snapshot was loaded, 0 if it is corrupt.
+ */
+static dogecoin_bool dogecoin_wallet_load_snapshot(dogecoin_wallet* wallet, uint32_t reclen) {
+    if (!wallet || !reclen) return false;
+    unsigned char* buf = dogecoin_uchar_vla(reclen);
+    if (fread(buf, reclen, 1, wallet->dbfile) != 1) {
+        dogecoin_free(buf);
+        return false;
+    }
+    struct const_buffer cbuf = {buf, reclen};
+    dogecoin_bool res = dogecoin_wallet_snapshot_deserialize(wallet, &cbuf);
+    dogecoin_free(buf);
+    if (!res) {
+        fprintf(stderr, "Wallet file: error reading snapshot record. Wallet file is corrupt\n");
+    }
+    return res;
+}
+
 dogecoin_bool dogecoin_wallet_load(dogecoin_wallet* wallet, const char* file_path, int *error, dogecoin_bool *created, dogecoin_bool prompt)
 {
     (void)(error);
@@ -951,6 +1894,13 @@ dogecoin_bool dogecoin_wallet_load(dogecoin_wallet* wallet, const char* file_pat
     }
 
     wallet->dbfile = fopen(file_path, *created ? "a+b" : "r+b");
+    if (!wallet->dbfile) return false;
+
+    // remember the file a named wallet was loaded from
+    if (file_path != wallet->filename && strlen(file_path) < sizeof(wallet->filename)) {
+        dogecoin_mem_zero((char*)wallet->filename, sizeof(wallet->filename));
+        memcpy_safe((char*)wallet->filename, file_path, strlen(file_path));
+    }
 
     if (*created) {
         if (!dogecoin_wallet_create(wallet, file_path, error)) {
@@ -975,6 +1925,7 @@ dogecoin_bool dogecoin_wallet_load(dogecoin_wallet* wallet, const char* file_pat
         }
 
         // read
+        dogecoin_wtx* pending = NULL;
         while (!feof(wallet->dbfile))
         {
             uint8_t buf[sizeof(file_rec_magic)];
@@ -992,16 +1943,35 @@ dogecoin_bool dogecoin_wallet_load(dogecoin_wallet* wallet, const char* file_pat
             uint8_t rectype;
             if (fread(&rectype, 1, 1, wallet->dbfile) != 1) return false;
 
+            if (rectype == WALLET_DB_REC_TYPE_TX) {
+                if (!dogecoin_wallet_load_transaction(wallet, reclen, &pending)) return false;
+                continue;
+            } else if (rectype == WALLET_DB_REC_TYPE_UTXO) {
+                if (!dogecoin_wallet_load_utxo_delta(wallet, reclen, &pending)) return false;
+                continue;
+            }
+
+            // any other record ends the utxo record window of the last tx
+            if (pending) {
+                dogecoin_wtx* wtx = pending;
+                pending = NULL;
+                if (!dogecoin_wallet_scrape_utxos_delta(wallet, wtx, NULL)) return false;
+            }
             if (rectype == WALLET_DB_REC_TYPE_MASTERPUBKEY) {
                 if (!dogecoin_load_wallet_masterpubkey(wallet)) return false;
             } else if (rectype == WALLET_DB_REC_TYPE_ADDR) {
                 if (!dogecoin_wallet_load_address(wallet)) return false;
-            } else if (rectype == WALLET_DB_REC_TYPE_TX) {
-                if (!dogecoin_wallet_load_transaction(wallet, reclen)) return false;
+            } else if (rectype == WALLET_DB_REC_TYPE_SNAPSHOT) {
+                if (!dogecoin_wallet_load_snapshot(wallet, reclen)) return false;
+            } else if (rectype == WALLET_DB_REC_TYPE_UNDO && reclen == sizeof(uint256_t)) {
+                uint256_t blockhash;
+                if (fread(blockhash, sizeof(uint256_t), 1, wallet->dbfile) != 1) return false;
+                dogecoin_wallet_undo_block(wallet, blockhash);
             } else {
                 fseek(wallet->dbfile, reclen, SEEK_CUR);
             }
         }
+        if (pending && !dogecoin_wallet_scrape_utxos_delta(wallet, pending, NULL)) return false;
     }
 
     return true;
@@ -1034,6 +2004,20 @@ dogecoin_bool wallet_write_record(dogecoin_wallet *wallet, const cstring* record
     return true;
 }
 
+static dogecoin_bool wallet_write_masterpubkey(dogecoin_wallet* wallet)
+{
+    cstring* record = cstr_new_sz(256);
+    char strbuf[HDKEYLEN];
+    dogecoin_hdnode_serialize_public(wallet->masterkey, wallet->chain, strbuf, sizeof(strbuf));
+    ser_str(record, strbuf, sizeof(strbuf));
+    ser_str(record, strbuf, sizeof(strbuf));
+
+    dogecoin_bool res = wallet_write_record(wallet, record, WALLET_DB_REC_TYPE_MASTERPUBKEY);
+
+    cstr_free(record, true);
+    return res;
+}
+
 void dogecoin_wallet_set_master_key_copy(dogecoin_wallet* wallet, const dogecoin_hdnode* master_xpub)
 {
     if (!master_xpub)
@@ -1048,15 +2032,7 @@ void dogecoin_wallet_set_master_key_copy(dogecoin_wallet* wallet, const dogecoin
     }
     wallet->masterkey = dogecoin_hdnode_copy(master_xpub);
 
-    cstring* record = cstr_new_sz(256);
-    char strbuf[HDKEYLEN];
-    dogecoin_hdnode_serialize_public(wallet->masterkey, wallet->chain, strbuf, sizeof(strbuf));
-    ser_str(record, strbuf, sizeof(strbuf));
-    ser_str(record, strbuf, sizeof(strbuf));
-
-    wallet_write_record(wallet, record, WALLET_DB_REC_TYPE_MASTERPUBKEY);
-
-    cstr_free(record, true);
+    wallet_write_masterpubkey(wallet);
 
     dogecoin_file_commit(wallet->dbfile);
 }
@@ -1078,6 +2054,7 @@ dogecoin_wallet_addr* dogecoin_wallet_next_addr(dogecoin_wallet* wallet)
     // tree manages memory
     dogecoin_btree_tsearch(waddr, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
     vector_add(wallet->waddr_vector, waddr);
+    wallet->waddr_generation++;
 
     //serialize and store node
     cstring* record = cstr_new_sz(256);
@@ -1126,6 +2103,7 @@ dogecoin_wallet_addr* dogecoin_wallet_next_bip44_addr(dogecoin_wallet* wallet)
     // tree manages memory
     dogecoin_btree_tsearch(waddr, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
     vector_add(wallet->waddr_vector, waddr);
+    wallet->waddr_generation++;
 
     //serialize and store node
     cstring* record = cstr_new_sz(256);
@@ -1169,6 +2147,7 @@ dogecoin_bool dogecoin_p2pkh_address_to_wallet_pubkeyhash(const char* address_in
         addr->childindex = wallet->next_childindex;
         dogecoin_btree_tsearch(addr, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
         vector_add(wallet->waddr_vector, addr);
+        wallet->waddr_generation++;
         cstring* record = cstr_new_sz(256);
         dogecoin_wallet_addr_serialize(record, wallet->chain, addr);
         if (!wallet_write_record(wallet, record, WALLET_DB_REC_TYPE_ADDR)) fprintf(stderr, "Writing wallet address failed\n");
@@ -1207,6 +2186,7 @@ dogecoin_wallet_addr* dogecoin_p2pkh_address_to_wallet(const char* address_in, d
         addr->childindex = wallet->next_childindex;
         dogecoin_btree_tsearch(addr, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
         vector_add(wallet->waddr_vector, addr);
+        wallet->waddr_generation++;
         cstring* record = cstr_new_sz(256);
         dogecoin_wallet_addr_serialize(record, wallet->chain, addr);
         if (!wallet_write_record(wallet, record, WALLET_DB_REC_TYPE_ADDR)) fprintf(stderr, "Writing wallet address failed\n");
@@ -1260,11 +2240,16 @@ dogecoin_wallet_addr* dogecoin_wallet_find_waddr_byaddr(dogecoin_wallet* wallet,
     return needle;
 }
 
-dogecoin_bool dogecoin_wallet_add_wtx(dogecoin_wallet* wallet, dogecoin_wtx* wtx) {
-
-    if (!wallet || !wtx)
-        return false;
-
+/**
+ * @brief This function appends the record of a wtx to the wallet
+ * file without committing it, callers commit once per batch.
+ *
+ * @param wallet The wallet to write to.
+ * @param wtx The wtx to write.
+ *
+ * @return Nothing.
+ */
+static void dogecoin_wallet_write_wtx(dogecoin_wallet* wallet, dogecoin_wtx* wtx) {
     dogecoin_wallet_wtx_cachehash(wtx);
 
     cstring* record = cstr_new_sz(1024);
@@ -1275,6 +2260,14 @@ dogecoin_bool dogecoin_wallet_add_wtx(dogecoin_wallet* wallet, dogecoin_wtx* wtx
         fprintf(stderr, "Writing wtx record failed\n");
     }
     cstr_free(record, true);
+}
+
+dogecoin_bool dogecoin_wallet_add_wtx(dogecoin_wallet* wallet, dogecoin_wtx* wtx) {
+
+    if (!wallet || !wtx)
+        return false;
+
+    dogecoin_wallet_write_wtx(wallet, wtx);
     dogecoin_file_commit(wallet->dbfile);
 
     return true;
@@ -1288,32 +2281,170 @@ dogecoin_bool dogecoin_wallet_add_wtx_move(dogecoin_wallet* wallet, dogecoin_wtx
     return true;
 }
 
-dogecoin_bool dogecoin_wallet_have_key(dogecoin_wallet* wallet, uint160_t hash160)
-{
-    if (!wallet)
+/**
+ * @brief This function compacts the wallet file while the wallet
+ * stays open. The master key and a snapshot record of the live
+ * state get written to a fresh file which replaces the current
+ * one; later records are appended to it as the new log tail.
+ * Superseded and soft-deleted records are dropped.
+ *
+ * @param wallet The loaded wallet to compact.
+ *
+ * @return 1 if the file was compacted, 0 otherwise.
+ */
+dogecoin_bool dogecoin_wallet_compact(dogecoin_wallet* wallet) {
+    if (!wallet || !wallet->dbfile || !wallet->filename[0]) return false;
+
+    char tmp_path[sizeof(wallet->filename) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.compact", wallet->filename);
+    FILE* log = wallet->dbfile;
+    wallet->dbfile = fopen(tmp_path, "w+b");
+    if (!wallet->dbfile) {
+        wallet->dbfile = log;
+        fprintf(stderr, "Wallet file: could not create %s\n", tmp_path);
         return false;
+    }
 
-    dogecoin_wallet_addr waddr_search;
-    memcpy_safe(&waddr_search.pubkeyhash, hash160, sizeof(uint160_t));
+    cstring* record = cstr_new_sz(1024);
+    dogecoin_wallet_snapshot_serialize(record, wallet);
+    dogecoin_bool res = wallet_write_header(wallet, current_version) &&
+                        (!wallet->masterkey || wallet_write_masterpubkey(wallet)) &&
+                        wallet_write_record(wallet, record, WALLET_DB_REC_TYPE_SNAPSHOT);
+    cstr_free(record, true);
 
-    dogecoin_wallet_addr *needle = dogecoin_btree_tfind(&waddr_search, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare); /* read */
-    if (needle) {
-        needle = *(dogecoin_wallet_addr **)needle;
+    // keep the undo data of recent blocks, replaying it over the snapshot changes nothing else
+    dogecoin_wallet_block_undo* undo;
+    dogecoin_wallet_block_undo* undo_tmp;
+    HASH_ITER(hh, wallet->block_undo, undo, undo_tmp) {
+        size_t i;
+        for (i = 0; res && i < undo->records->len; i++) {
+            res = wallet_write_record(wallet, vector_idx(undo->records, i), WALLET_DB_REC_TYPE_UTXO);
+        }
+    }
+    if (res) {
+        dogecoin_file_commit(wallet->dbfile);
+    }
+    fclose(wallet->dbfile);
+    if (!res) {
+        remove(tmp_path);
+        wallet->dbfile = log;
+        fprintf(stderr, "Wallet file: writing %s failed\n", tmp_path);
+        return false;
     }
 
-    return (needle != NULL);
+    fclose(log);
+#ifdef WIN32
+    // rename does not replace existing files on windows
+    remove(wallet->filename);
+#endif
+    if (rename(tmp_path, wallet->filename) != 0) {
+        fprintf(stderr, "Wallet file: could not replace %s\n", wallet->filename);
+        res = false;
+    }
+    wallet->dbfile = fopen(wallet->filename, "r+b");
+    if (!wallet->dbfile) return false;
+    fseek(wallet->dbfile, 0, SEEK_END);
+    return res;
 }
 
-int64_t dogecoin_wallet_get_balance(dogecoin_wallet* wallet)
+/**
+ * @brief This function removes a watched address together with
+ * its utxos from the in-memory wallet. dogecoin_wallet_compact()
+ * persists the removal.
+ *
+ * @param wallet The loaded wallet.
+ * @param address The P2PKH address to remove.
+ *
+ * @return 1 if the address was watched, 0 otherwise.
+ */
+dogecoin_bool dogecoin_wallet_remove_address(dogecoin_wallet* wallet, const char* address) {
+    dogecoin_wallet_addr* waddr = dogecoin_wallet_find_waddr_byaddr(wallet, address);
+    if (!waddr) return false;
+    uint160_t hash160;
+    memcpy(hash160, waddr->pubkeyhash, sizeof(uint160_t));
+
+    dogecoin_utxo* utxo;
+    dogecoin_utxo* tmp;
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+        if (utxo->script_type == DOGECOIN_TX_PUBKEYHASH && memcmp(utxo->hash160, hash160, sizeof(uint160_t)) == 0) {
+            utxo_table_remove(wallet->utxo_table, utxo);
+        }
+    }
+
+    dogecoin_btree_tdelete(waddr, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
+    size_t i = wallet->waddr_vector->len;
+    while (i-- > 0) {
+        dogecoin_wallet_addr* waddr_vec = vector_idx(wallet->waddr_vector, i);
+        if (memcmp(waddr_vec->pubkeyhash, hash160, sizeof(uint160_t)) == 0) {
+            vector_remove_idx(wallet->waddr_vector, i);
+        }
+    }
+    wallet->waddr_generation++;
+    return true;
+}
+
+static int dogecoin_wallet_hash160_cmp(const void *l, const void *r) {
+    return memcmp(l, r, sizeof(uint160_t));
+}
+
+/**
+ * @brief This function rebuilds the sorted hash160 set of the
+ * wallet if addresses changed since it was last built.
+ *
+ * @param wallet The wallet to update the set for.
+ *
+ * @return Nothing.
+ */
+static void dogecoin_wallet_hash160_set_update(dogecoin_wallet* wallet)
 {
-    int64_t credit = 0;
+    if (wallet->hash160_set_generation == wallet->waddr_generation) {
+        return;
+    }
+    size_t len = wallet->waddr_vector->len;
+    wallet->hash160_set = dogecoin_realloc(wallet->hash160_set, (len ? len : 1) * sizeof(uint160_t));
+    size_t i;
+    for (i = 0; i < len; i++) {
+        dogecoin_wallet_addr* waddr = vector_idx(wallet->waddr_vector, i);
+        memcpy(wallet->hash160_set + i * sizeof(uint160_t), waddr->pubkeyhash, sizeof(uint160_t));
+    }
+    qsort(wallet->hash160_set, len, sizeof(uint160_t), dogecoin_wallet_hash160_cmp);
+    wallet->hash160_set_len = len;
+    wallet->hash160_set_generation = wallet->waddr_generation;
+}
 
+dogecoin_bool dogecoin_wallet_have_key(dogecoin_wallet* wallet, const uint160_t hash160)
+{
+    if (!wallet)
+        return false;
+
+    dogecoin_wallet_hash160_set_update(wallet);
+    if (!wallet->hash160_set_len)
+        return false;
+
+    return bsearch(hash160, wallet->hash160_set, wallet->hash160_set_len, sizeof(uint160_t), dogecoin_wallet_hash160_cmp) != NULL;
+}
+
+int64_t dogecoin_wallet_get_balance(dogecoin_wallet* wallet)
+{
     if (!wallet)
         return false;
 
     unsigned int i;
-    for (i = 0; i < wallet->vec_wtxes->len; i++) {
-        dogecoin_wtx *wtx = vector_idx(wallet->vec_wtxes, i);
+    if (wallet->balance_waddr_generation != wallet->waddr_generation) {
+        // the address set changed, revalue the running credit once
+        wallet->balance_credit = 0;
+        wallet->balance_waddr_generation = wallet->waddr_generation;
+        for (i = 0; i < wallet->vec_wtxes->len; i++) {
+            dogecoin_wtx *wtx = vector_idx(wallet->vec_wtxes, i);
+            if (!dogecoin_wallet_wtx_is_coinbase(wtx)) {
+                wallet->balance_credit += dogecoin_wallet_wtx_get_available_credit(wallet, wtx);
+            }
+        }
+    }
+
+    int64_t credit = wallet->balance_credit;
+    for (i = 0; i < wallet->vec_coinbase_wtxes->len; i++) {
+        dogecoin_wtx *wtx = vector_idx(wallet->vec_coinbase_wtxes, i);
         credit += dogecoin_wallet_wtx_get_available_credit(wallet, wtx);
     }
 
@@ -1323,15 +2454,17 @@ int64_t dogecoin_wallet_get_balance(dogecoin_wallet* wallet)
 int64_t dogecoin_wallet_wtx_get_credit(dogecoin_wallet* wallet, dogecoin_wtx* wtx)
 {
     int64_t credit = 0;
+    dogecoin_tx* tx = dogecoin_wallet_wtx_get_tx(wtx);
+    if (!tx) return credit;
 
-    if (dogecoin_tx_is_coinbase(wtx->tx) &&
+    if (dogecoin_tx_is_coinbase(tx) &&
         (wallet->bestblockheight < COINBASE_MATURITY || wtx->height > wallet->bestblockheight - COINBASE_MATURITY))
         return credit;
 
     unsigned int i = 0;
-    for (i = 0; i < wtx->tx->vout->len; i++) {
+    for (i = 0; i < tx->vout->len; i++) {
         dogecoin_tx_out* tx_out;
-        tx_out = vector_idx(wtx->tx->vout, i);
+        tx_out = vector_idx(tx->vout, i);
         if (dogecoin_wallet_txout_is_mine(wallet, tx_out)) {
             credit += tx_out->value;
         }
@@ -1346,18 +2479,21 @@ int64_t dogecoin_wallet_wtx_get_available_credit(dogecoin_wallet* wallet, dogeco
         return credit;
     }
 
+    dogecoin_tx* tx = dogecoin_wallet_wtx_get_tx(wtx);
+    if (!tx) return credit;
+
     // Must wait until coinbase is safely deep enough in the chain before valuing it
-    if (dogecoin_tx_is_coinbase(wtx->tx) &&
+    if (dogecoin_tx_is_coinbase(tx) &&
         (wallet->bestblockheight < COINBASE_MATURITY || wtx->height > wallet->bestblockheight - COINBASE_MATURITY)) {
         return credit;
     }
 
     unsigned int i;
-    for (i = 0; i < wtx->tx->vout->len; i++)
+    for (i = 0; i < tx->vout->len; i++)
     {
         if (!dogecoin_wallet_is_spent(wallet, wtx->tx_hash_cache, i))
         {
-            dogecoin_tx_out* tx_out = vector_idx(wtx->tx->vout, i);
+            dogecoin_tx_out* tx_out = vector_idx(tx->vout, i);
             if (dogecoin_wallet_txout_is_mine(wallet, tx_out)) {
                 credit += tx_out->value;
             }
@@ -1367,28 +2503,61 @@ int64_t dogecoin_wallet_wtx_get_available_credit(dogecoin_wallet* wallet, dogeco
     return credit;
 }
 
+/**
+ * @brief This function builds a BIP37 filter that lets peers match
+ * payments to the watched keys and spends of the unspent outputs.
+ * Matched outputs get added by the peer so chained spends are found.
+ *
+ * @param wallet The wallet to build the filter for.
+ * @param fp_rate The false positive rate of the filter.
+ * @param tweak The random filter tweak.
+ *
+ * @return The filter or NULL if the wallet watches nothing.
+ */
+dogecoin_bloom_filter* dogecoin_wallet_bloom_filter_new(dogecoin_wallet* wallet, double fp_rate, uint32_t tweak)
+{
+    if (!wallet) return NULL;
+
+    dogecoin_wallet_hash160_set_update(wallet);
+    uint32_t elements = (uint32_t)wallet->hash160_set_len;
+    dogecoin_utxo *utxo, *tmp;
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+        if (!is_spent(utxo)) elements++;
+    }
+    if (!elements) return NULL;
+
+    dogecoin_bloom_filter* filter = dogecoin_bloom_filter_new(elements, fp_rate, tweak, DOGECOIN_BLOOM_UPDATE_ALL);
+    size_t i;
+    for (i = 0; i < wallet->hash160_set_len; i++) {
+        dogecoin_bloom_filter_insert(filter, wallet->hash160_set + i * sizeof(uint160_t), sizeof(uint160_t));
+    }
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+        if (is_spent(utxo)) continue;
+        // utxos keep the txid in display order, outpoints use the internal one
+        uint256_t hash;
+        dogecoin_wallet_hash_to_display(utxo->txid, hash);
+        dogecoin_bloom_filter_insert_outpoint(filter, hash, utxo->vout);
+    }
+    return filter;
+}
+
 dogecoin_bool dogecoin_wallet_txout_is_mine(dogecoin_wallet* wallet, dogecoin_tx_out* tx_out)
 {
     if (!wallet || !tx_out) return false;
 
+    // fast path for the standard templates, no classification needed
+    const uint8_t* hash160 = dogecoin_wallet_script_hash160((const uint8_t*)tx_out->script_pubkey->str, tx_out->script_pubkey->len, false);
+    if (hash160) {
+        return dogecoin_wallet_have_key(wallet, hash160);
+    }
+
     dogecoin_bool ismine = false;
 
     vector_t* vec = vector_new(16, free);
     enum dogecoin_tx_out_type type = dogecoin_script_classify(tx_out->script_pubkey, vec);
 
-    if (type == DOGECOIN_TX_PUBKEY) { //TODO: find a better format for vector_t elements (not a pure pointer)
-        goto check;
-    } else if (type == DOGECOIN_TX_PUBKEYHASH) {
-        goto check;
-    } else if (type == DOGECOIN_TX_SCRIPTHASH) {
-        goto check;
-    } else if (type == DOGECOIN_TX_MULTISIG) {
-        goto check;
-    }
-
-check:
-    if (vec->len >= 1) {
-        if (dogecoin_wallet_have_key(wallet, (uint8_t*)vector_idx(vec, 0))) {
+    if (type == DOGECOIN_TX_PUBKEY || type == DOGECOIN_TX_MULTISIG) { //TODO: find a better format for vector_t elements (not a pure pointer)
+        if (vec->len >= 1 && dogecoin_wallet_have_key(wallet, (uint8_t*)vector_idx(vec, 0))) {
             ismine = true;
         }
     }
@@ -1423,8 +2592,9 @@ int64_t dogecoin_wallet_get_debit_txi(dogecoin_wallet *wallet, const dogecoin_tx
         // remove existing wtx
         prevwtx = *(dogecoin_wtx **)prevwtx;
 
-        if (txin->prevout.n < prevwtx->tx->vout->len) {
-            dogecoin_tx_out *tx_out = vector_idx(prevwtx->tx->vout, txin->prevout.n);
+        dogecoin_tx* prevtx = dogecoin_wallet_wtx_get_tx(prevwtx);
+        if (prevtx && txin->prevout.n < prevtx->vout->len) {
+            dogecoin_tx_out *tx_out = vector_idx(prevtx->vout, txin->prevout.n);
             if (tx_out && dogecoin_wallet_txout_is_mine(wallet, tx_out)) {
                 return tx_out->value;
             }
@@ -1488,11 +2658,13 @@ dogecoin_bool dogecoin_wallet_get_unspents(dogecoin_wallet* wallet, vector_t* un
     unsigned int i, j;
     for (i = 0; i < wallet->vec_wtxes->len; i++) {
         dogecoin_wtx *wtx = vector_idx(wallet->vec_wtxes, i);
-        for (j = 0; j < wtx->tx->vout->len; j++)
+        dogecoin_tx* tx = dogecoin_wallet_wtx_get_tx(wtx);
+        if (!tx) continue;
+        for (j = 0; j < tx->vout->len; j++)
         {
             if (!dogecoin_wallet_is_spent(wallet, wtx->tx_hash_cache, j))
             {
-                dogecoin_tx_out* tx_out = vector_idx(wtx->tx->vout, j);
+                dogecoin_tx_out* tx_out = vector_idx(tx->vout, j);
                 if (dogecoin_wallet_txout_is_mine(wallet, tx_out)) {
                     dogecoin_tx_outpoint *outpoint = dogecoin_calloc(1, sizeof(dogecoin_tx_outpoint));
                     dogecoin_hash_set(outpoint->hash, wtx->tx_hash_cache);
@@ -1507,9 +2679,9 @@ dogecoin_bool dogecoin_wallet_get_unspents(dogecoin_wallet* wallet, vector_t* un
 
 dogecoin_bool dogecoin_wallet_get_unspent(vector_t* unspents)
 {
-    unsigned int i;
-    for (i = 0; i < HASH_COUNT(utxos); i++) {
-        dogecoin_utxo* utxo = find_dogecoin_utxo(i + 1);
+    dogecoin_utxo* utxo;
+    dogecoin_utxo* tmp;
+    HASH_ITER(hh, utxos, utxo, tmp) {
         if (!is_spent(utxo)) vector_add(unspents, utxo);
     }
     return true;
@@ -1526,10 +2698,169 @@ void dogecoin_wallet_check_transaction(void *ctx, dogecoin_tx *tx, unsigned int
         dogecoin_hash_set(wtx->blockhash, blockhash);
         wtx->height = pindex->height;
         dogecoin_tx_copy(wtx->tx, tx);
-        dogecoin_wallet_scrape_utxos(wallet, wtx);
-        dogecoin_wallet_add_wtx_move(wallet, wtx);
+        dogecoin_wallet_utxo_delta delta = {cstr_new_sz(64), 0, cstr_new_sz(64), 0};
+        dogecoin_wallet_scrape_utxos_delta(wallet, wtx, &delta);
+        dogecoin_wallet_write_wtx(wallet, wtx);
+        dogecoin_wallet_add_wtx_intern_move(wallet, wtx);
+
+        // persist the utxo changes so loading does not scrape the tx again,
+        // both records get committed together
+        cstring* record = cstr_new_sz(64 + delta.spent->len + delta.created->len);
+        ser_u256(record, wtx->tx_hash_cache);
+        ser_varlen(record, delta.spent_count);
+        cstr_append_buf(record, delta.spent->str, delta.spent->len);
+        ser_varlen(record, delta.created_count);
+        cstr_append_buf(record, delta.created->str, delta.created->len);
+        ser_u256(record, pindex->hash);
+        ser_u32(record, pindex->height);
+        if (!wallet_write_record(wallet, record, WALLET_DB_REC_TYPE_UTXO)) {
+            fprintf(stderr, "Writing utxo record failed\n");
+        }
+        dogecoin_wallet_block_undo_add(wallet, pindex->hash, pindex->height, (const unsigned char*)record->str, record->len);
+        dogecoin_file_commit(wallet->dbfile);
+        cstr_free(record, true);
+        cstr_free(delta.spent, true);
+        cstr_free(delta.created, true);
     }
-    dogecoin_wallet_utxos_update_confirmations(pindex->height);
+    dogecoin_wallet_utxos_update_confirmations(wallet, pindex->height);
+}
+
+static int dogecoin_wallet_prefilter_cmp160(const void *l, const void *r) {
+    return memcmp(l, r, sizeof(uint160_t));
+}
+
+static int dogecoin_wallet_prefilter_cmp256(const void *l, const void *r) {
+    return memcmp(l, r, sizeof(uint256_t));
+}
+
+static void dogecoin_wallet_prefilter_free(dogecoin_wallet_prefilter* filter) {
+    if (filter->hash160s) dogecoin_free(filter->hash160s);
+    if (filter->txids) dogecoin_free(filter->txids);
+    dogecoin_free(filter);
+}
+
+static void dogecoin_wallet_prefilter_mark(dogecoin_wallet_prefilter* filter, const uint8_t* entry) {
+    uint16_t lo = (uint16_t)(entry[0] | (entry[1] << 8));
+    uint16_t hi = (uint16_t)(entry[2] | (entry[3] << 8));
+    filter->bitmap_lo[lo >> 3] |= (uint8_t)(1 << (lo & 7));
+    filter->bitmap_hi[hi >> 3] |= (uint8_t)(1 << (hi & 7));
+}
+
+/**
+ * @brief This function (re)builds the wallet pre-filter from
+ * the watched addresses and the txids of the wallet transactions
+ * if either changed since the last build.
+ *
+ * @param wallet The wallet to build the filter for.
+ *
+ * @return The up to date filter.
+ */
+static dogecoin_wallet_prefilter* dogecoin_wallet_prefilter_update(dogecoin_wallet* wallet) {
+    dogecoin_wallet_prefilter* filter = wallet->prefilter;
+    if (filter && filter->waddr_generation == wallet->waddr_generation && filter->wtx_generation == wallet->wtx_generation) {
+        return filter;
+    }
+    if (filter) {
+        dogecoin_wallet_prefilter_free(filter);
+    }
+    filter = dogecoin_calloc(1, sizeof(*filter));
+    filter->waddr_generation = wallet->waddr_generation;
+    filter->wtx_generation = wallet->wtx_generation;
+
+    size_t i;
+    dogecoin_wallet_hash160_set_update(wallet);
+    if (wallet->hash160_set_len) {
+        // the wallet hash160 set is already sorted
+        filter->hash160s = dogecoin_malloc(wallet->hash160_set_len * sizeof(uint160_t));
+        memcpy(filter->hash160s, wallet->hash160_set, wallet->hash160_set_len * sizeof(uint160_t));
+        filter->hash160_count = wallet->hash160_set_len;
+        for (i = 0; i < filter->hash160_count; i++) {
+            dogecoin_wallet_prefilter_mark(filter, filter->hash160s + i * sizeof(uint160_t));
+        }
+    }
+    if (wallet->vec_wtxes->len) {
+        // spends reference the txid in internal byte order, as cached in the wtx
+        filter->txids = dogecoin_malloc(wallet->vec_wtxes->len * sizeof(uint256_t));
+        for (i = 0; i < wallet->vec_wtxes->len; i++) {
+            dogecoin_wtx* wtx = vector_idx(wallet->vec_wtxes, i);
+            memcpy(filter->txids + i * sizeof(uint256_t), wtx->tx_hash_cache, sizeof(uint256_t));
+            dogecoin_wallet_prefilter_mark(filter, wtx->tx_hash_cache);
+        }
+        filter->txid_count = wallet->vec_wtxes->len;
+        qsort(filter->txids, filter->txid_count, sizeof(uint256_t), dogecoin_wallet_prefilter_cmp256);
+    }
+    wallet->prefilter = filter;
+    return filter;
+}
+
+dogecoin_bool dogecoin_wallet_prefilter_match(dogecoin_wallet* wallet, const uint8_t* data, size_t len) {
+    if (!wallet || !data || len < sizeof(uint160_t)) return false;
+    const dogecoin_wallet_prefilter* filter = dogecoin_wallet_prefilter_update(wallet);
+    if (!filter->hash160_count && !filter->txid_count) return false;
+
+    size_t i;
+    for (i = 0; i + sizeof(uint160_t) <= len; i++) {
+        const uint8_t* p = data + i;
+        uint16_t lo = (uint16_t)(p[0] | (p[1] << 8));
+        uint16_t hi = (uint16_t)(p[2] | (p[3] << 8));
+        if (!((filter->bitmap_lo[lo >> 3] >> (lo & 7)) & (filter->bitmap_hi[hi >> 3] >> (hi & 7)) & 1)) {
+            continue;
+        }
+        if (filter->hash160_count && bsearch(p, filter->hash160s, filter->hash160_count, sizeof(uint160_t), dogecoin_wallet_prefilter_cmp160)) {
+            return true;
+        }
+        if (filter->txid_count && i + sizeof(uint256_t) <= len && bsearch(p, filter->txids, filter->txid_count, sizeof(uint256_t), dogecoin_wallet_prefilter_cmp256)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void dogecoin_wallet_check_transaction_view(void *ctx, const dogecoin_tx_view *txview, unsigned int pos, dogecoin_blockindex *pindex) {
+    dogecoin_wallet *wallet = (dogecoin_wallet *)ctx;
+    if (dogecoin_wallet_prefilter_match(wallet, txview->data, txview->len)) {
+        dogecoin_tx* tx = dogecoin_tx_new();
+        if (dogecoin_tx_view_to_tx(txview, tx)) {
+            dogecoin_wallet_check_transaction(ctx, tx, pos, pindex);
+        }
+        dogecoin_tx_free(tx);
+    } else if (pos == 0) {
+        // confirmations only depend on the height, once per block is enough
+        dogecoin_wallet_utxos_update_confirmations(wallet, pindex->height);
+    }
+}
+
+void dogecoin_wallet_filtered_block_connected(void *ctx, const dogecoin_blockindex *pindex) {
+    dogecoin_wallet *wallet = (dogecoin_wallet *)ctx;
+    dogecoin_wallet_utxos_update_confirmations(wallet, pindex->height);
+}
+
+/**
+ * @brief This function rolls the wallet back when a block leaves
+ * the main chain. The rollback is logged as an undo record so a
+ * reload ends up in the same state.
+ *
+ * @param ctx The wallet.
+ * @param pindex The disconnected block.
+ *
+ * @return Nothing.
+ */
+void dogecoin_wallet_block_disconnected(void *ctx, const dogecoin_blockindex *pindex) {
+    dogecoin_wallet *wallet = (dogecoin_wallet *)ctx;
+    if (!wallet || !pindex) return;
+    dogecoin_wallet_block_undo* undo = NULL;
+    HASH_FIND(hh, wallet->block_undo, pindex->hash, sizeof(uint256_t), undo);
+    if (!undo) return;
+
+    cstring* record = cstr_new_sz(sizeof(uint256_t));
+    ser_u256(record, pindex->hash);
+    if (!wallet->dbfile || !wallet_write_record(wallet, record, WALLET_DB_REC_TYPE_UNDO)) {
+        fprintf(stderr, "Writing undo record failed\n");
+    } else {
+        dogecoin_file_commit(wallet->dbfile);
+    }
+    cstr_free(record, true);
+    dogecoin_wallet_undo_block(wallet, pindex->hash);
 }
 
 dogecoin_wallet* dogecoin_wallet_read(char* address) {
@@ -1538,6 +2869,104 @@ dogecoin_wallet* dogecoin_wallet_read(char* address) {
     return wallet;
 }
 
+/**
+ * @brief This function opens a long-lived wallet handle for the
+ * chain of the given address. All address queries against the
+ * handle are answered from memory; the file is only read again
+ * on dogecoin_wallet_refresh(). Every wallet owns its utxo
+ * table, other wallets do not affect the handle.
+ *
+ * @param address An address of the chain the wallet belongs to.
+ *
+ * @return The wallet handle or NULL on failure.
+ */
+dogecoin_wallet* dogecoin_wallet_open(const char* address) {
+    if (!address) return NULL;
+    return dogecoin_wallet_read((char*)address);
+}
+
+/**
+ * @brief This function reloads a wallet handle from its file,
+ * picking up records written by other wallet instances (e.g.
+ * after registering or unregistering watch addresses).
+ *
+ * @param wallet The wallet handle to reload.
+ *
+ * @return 1 if the wallet was reloaded successfully, 0 otherwise.
+ */
+dogecoin_bool dogecoin_wallet_refresh(dogecoin_wallet* wallet) {
+    if (!wallet || !wallet->chain) return false;
+    const dogecoin_chainparams* chain = wallet->chain;
+    char filename[sizeof(wallet->filename)];
+    memcpy_safe(filename, wallet->filename, sizeof(filename));
+    dogecoin_wallet_release_members(wallet);
+    dogecoin_wallet_init_members(wallet, chain);
+    int error;
+    dogecoin_bool created;
+    if (!dogecoin_wallet_load(wallet, filename, &error, &created, false)) {
+        fprintf(stderr, "Wallet file: reloading %s failed\n", filename);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief This function closes a wallet handle.
+ *
+ * @param wallet The wallet handle to close.
+ *
+ * @return Nothing.
+ */
+void dogecoin_wallet_close(dogecoin_wallet* wallet) {
+    dogecoin_wallet_free(wallet);
+}
+
+/**
+ * @brief This function returns the unspent balance of an address.
+ *
+ * @param wallet The wallet handle.
+ * @param address The address to look up.
+ *
+ * @return The balance in koinu.
+ */
+uint64_t dogecoin_wallet_address_balance(dogecoin_wallet* wallet, const char* address) {
+    dogecoin_balance balance;
+    if (!wallet) return 0;
+    dogecoin_wallet_utxos_get_address_balance(wallet, address, &balance);
+    return (uint64_t)balance.total;
+}
+
+/**
+ * @brief This function returns the number of unspent utxos of an
+ * address.
+ *
+ * @param wallet The wallet handle.
+ * @param address The address to look up.
+ *
+ * @return The number of unspent utxos.
+ */
+unsigned int dogecoin_wallet_address_utxos_length(dogecoin_wallet* wallet, const char* address) {
+    if (!wallet) return 0;
+    vector_t* unspent = address_unspent_get(wallet->utxo_table, address);
+    return unspent ? (unsigned int)unspent->len : 0;
+}
+
+/**
+ * @brief This function returns an unspent utxo of an address.
+ *
+ * @param wallet The wallet handle.
+ * @param address The address to look up.
+ * @param index The 1-based position among the unspent utxos of the address.
+ *
+ * @return The utxo (owned by the wallet) or NULL if the index is out of range.
+ */
+dogecoin_utxo* dogecoin_wallet_address_utxo(dogecoin_wallet* wallet, const char* address, unsigned int index) {
+    if (!wallet || !index) return NULL;
+    vector_t* unspent = address_unspent_get(wallet->utxo_table, address);
+    if (!unspent || index > unspent->len) return NULL;
+    return vector_idx(unspent, index - 1);
+}
+
 int dogecoin_register_watch_address_with_node(char* address) {
     if (address != NULL) {
         printf("address: %s\n", address);
@@ -1572,233 +3001,114 @@ int dogecoin_unregister_watch_address_with_node(char* address) {
         while((ptr = strtok_r(temp_address_copy, delim, &temp_address_copy)))
         {
             dogecoin_wallet* wallet = dogecoin_wallet_read(ptr);
-            int found = 0, error = 0;
-            dogecoin_bool created;
-            // set up new wallet to store everything except our soon to be unregistered watch address:
-            dogecoin_wallet* wallet_new = dogecoin_wallet_new(wallet->chain);
-            char* file_delim = NULL;
-#ifdef WIN32
-            file_delim = "\\";
-#else
-            file_delim = "/";
-#endif
-            replace_last_after_delim((char*)wallet_new->filename, file_delim, "temp.bin");
-            dogecoin_wallet_load(wallet_new, wallet_new->filename, &error, &created, false);
-            dogecoin_wallet_addr* waddr_check = dogecoin_wallet_addr_new();
-            // convert address to 20 byte script hash:
-            dogecoin_p2pkh_address_to_wallet_pubkeyhash(ptr, waddr_check, wallet);
-            // serialize address prior to search:
-            cstring* record = cstr_new_sz(256);
-            dogecoin_wallet_addr_serialize(record, wallet->chain, waddr_check);
-            dogecoin_free(waddr_check);
-            // rewind db to read again:
-            rewind(wallet->dbfile);
-            // check file-header-magic, version and genesis
-            uint8_t buf[sizeof(file_hdr_magic) + sizeof(current_version) + sizeof(uint256_t)];
-            if (fread(buf, sizeof(buf), 1, wallet->dbfile) != 1 || memcmp(buf, file_hdr_magic, sizeof(file_hdr_magic))) {
-                fprintf(stderr, "Wallet file: error reading database file\n");
-                return false;
-            }
-            if (le32toh(*(buf+sizeof(file_hdr_magic))) > current_version) {
-                fprintf(stderr, "Wallet file: unsupported file version\n");
-                return false;
-            }
-            if (memcmp(buf+sizeof(file_hdr_magic)+sizeof(current_version), wallet->chain->genesisblockhash, sizeof(uint256_t)) != 0) {
-                fprintf(stderr, "Wallet file: different network\n");
-                return false;
-            }
-            // read
-            while (!feof(wallet->dbfile)) {
-                uint8_t buf[sizeof(file_rec_magic)];
-                if (fread(buf, sizeof(buf), 1, wallet->dbfile) != 1 ) {
-                    // no more record, break
-                    break;
-                }
-                if (memcmp(buf, file_rec_magic, sizeof(file_rec_magic))) {
-                    fprintf(stderr, "Wallet file: error reading record file (invalid magic). Wallet file is corrupt\n");
-                    return false;
-                }
-                uint32_t reclen = 0;
-                if (!deser_varlen_from_file(&reclen, wallet->dbfile)) return false;
-
-                uint8_t rectype;
-                if (fread(&rectype, 1, 1, wallet->dbfile) != 1) return false;
-                if (rectype == WALLET_DB_REC_TYPE_MASTERPUBKEY) {
-                    uint32_t len;
-                    char strbuf[196];
-                    char strbuf_check[196];
-                    dogecoin_mem_zero(strbuf, sizeof(strbuf));
-                    dogecoin_mem_zero(strbuf_check, sizeof(strbuf_check));
-                    if (!deser_varlen_from_file(&len, wallet->dbfile)) return false;
-                    if (len > sizeof(strbuf)) { return false; }
-                    if (fread(strbuf, len, 1, wallet->dbfile) != 1) return false;
-                    if (!deser_varlen_from_file(&len, wallet->dbfile)) return false;
-                    if (len > sizeof(strbuf_check)) { return false; }
-                    if (fread(strbuf_check, len, 1, wallet->dbfile) != 1) return false;
-
-                    if (strcmp(strbuf, strbuf_check) != 0) {
-                        fprintf(stderr, "Wallet file: xpub check failed, corrupt wallet detected.\n");
-                        return false;
-                    }
-                    dogecoin_hdnode_deserialize(strbuf, wallet->chain, wallet->masterkey);
-                    if (wallet_new->masterkey==NULL) {
-                        // copy masterkey to new wallet:
-                        dogecoin_wallet_set_master_key_copy(wallet_new, wallet->masterkey);
-                    }
-                } else if (rectype == WALLET_DB_REC_TYPE_ADDR) {
-                    dogecoin_wallet_addr* waddr = dogecoin_wallet_addr_new();
-                    size_t addr_len = 20+1+4+1;
-                    unsigned char* buf = dogecoin_uchar_vla(addr_len);
-                    struct const_buffer cbuf = {buf, addr_len};
-                    if (fread(buf, addr_len, 1, wallet->dbfile) != 1) {
-                        dogecoin_wallet_addr_free(waddr);
-                        return false;
-                    }
-                    char p2pkh_check[P2PKHLEN];
-                    dogecoin_wallet_addr_deserialize(waddr, wallet_new->chain, &cbuf);
-                    dogecoin_p2pkh_addr_from_hash160(waddr->pubkeyhash, wallet->chain, p2pkh_check, P2PKHLEN);
-                    if (memcmp(record->str, buf, record->len)==0) {
-                        found = 1;
-                        dogecoin_wallet_addr_free(waddr);
-                    } else {
-                        const char* addr_match = find_needle(ptr, strlen(ptr), p2pkh_check, P2PKHLEN);
-                        if (!addr_match) {
-                            if (!dogecoin_p2pkh_address_to_wallet_pubkeyhash(p2pkh_check, waddr, wallet_new)) return false;
-                        } else {
-                            dogecoin_wallet_addr_free(waddr);
-                        }
-                    }
-                    free(buf);
-                } else if (rectype == WALLET_DB_REC_TYPE_TX) {
-                    unsigned char* buf = dogecoin_uchar_vla(reclen);
-                    struct const_buffer cbuf = {buf, reclen};
-                    if (fread(buf, reclen, 1, wallet->dbfile) != 1) {
-                        return false;
-                    }
-
-                    dogecoin_wtx *wtx = dogecoin_wallet_wtx_new();
-                    dogecoin_wallet_wtx_deserialize(wtx, &cbuf);
-                    // loop through existing wallet and omit wtx's with matching address:
-                    unsigned int i = 0;
-                    for (; i < wallet->waddr_vector->len; i++) {
-                        char p2pkh_check[P2PKHLEN];
-                        dogecoin_wallet_addr* addr_check = vector_idx(wallet->waddr_vector, i);
-                        dogecoin_p2pkh_addr_from_hash160(addr_check->pubkeyhash, wallet->chain, p2pkh_check, P2PKHLEN);
-                        const char* match = find_needle(address, strlen(address), p2pkh_check, strlen(p2pkh_check));
-                        if (!match) {
-                            dogecoin_free(buf);
-                            goto copy;
-                        }
-                    }
-                    dogecoin_free(buf);
-copy:
-                    dogecoin_wallet_scrape_utxos(wallet_new, wtx);
-                    dogecoin_wallet_add_wtx_move(wallet_new, wtx); // hands memory management over to the binary tree
-                } else {
-                    fseek(wallet->dbfile, reclen, SEEK_CUR);
-                }
-            }
-
-            if (!wallet_new->waddr_vector->len) {
-                dogecoin_wallet_next_addr(wallet_new);
-            }
-
-            cstr_free(record, true);
-            dogecoin_wallet_flush(wallet);
-            dogecoin_wallet_flush(wallet_new);
+            if (!wallet) return false;
+            dogecoin_bool found = dogecoin_wallet_remove_address(wallet, ptr);
             if (found) {
-                /* Attempt to rename file: */
-#ifdef WIN32
-#include <winbase.h>
-                _fcloseall();
-                LPVOID message;
-                int result = DeleteFile(wallet->filename);
-                if (!result) {
-                    error = GetLastError();
-                    FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, NULL, error, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPTSTR)&message, 0, NULL);
-                    printf("ERROR: %s\n", message);
+                if (!wallet->waddr_vector->len) {
+                    dogecoin_wallet_next_addr(wallet);
                 }
-                result = rename( wallet_new->filename, wallet->filename );
-#else
-                int result = rename( wallet_new->filename, wallet->filename );
-#endif
-                if( result != 0 )
-                    printf( "Could not rename '%s' %d\n", wallet_new->filename, result );
-                else
-                    printf( "File '%s' renamed to '%s' for %s\n", wallet_new->filename, wallet->filename, ptr );
-            } else {
-#ifndef WIN32
-                int res = remove(wallet_new->filename);
-                if (!res) {
-                    printf("remove failed!\n");
+                // rewrite the file as a snapshot without the address
+                if (!dogecoin_wallet_compact(wallet)) {
+                    dogecoin_wallet_free(wallet);
                     return false;
                 }
-#endif
+                printf("File '%s' compacted for %s\n", wallet->filename, ptr);
             }
             dogecoin_wallet_free(wallet);
-            dogecoin_wallet_free(wallet_new);
+            if (!found) return false;
         }
     } else return false;
     return true;
 }
 
-int dogecoin_get_utxo_vector(char* address, vector_t* utxo_vec) {
-    if (!address) return false;
-    dogecoin_wallet* wallet = dogecoin_wallet_read(address);
-    if (HASH_COUNT(utxos) > 0) {
-        dogecoin_utxo* utxo;
-        dogecoin_utxo* tmp;
-        HASH_ITER(hh, utxos, utxo, tmp) {
-            if (strncmp(utxo->address, address, strlen(utxo->address))==0 && !is_spent(utxo)) {
-                vector_add(utxo_vec, utxo);
-            }
+/* handle shared by the address based helpers below */
+static dogecoin_wallet* address_wallet = NULL;
+static struct stat address_wallet_stat;
+
+/**
+ * @brief This function returns the cached wallet handle for the
+ * chain of an address. The handle is only reloaded if the wallet
+ * file changed since it was last read (e.g. another wallet
+ * instance registered a watch address).
+ *
+ * @param address An address of the chain the wallet belongs to.
+ *
+ * @return The wallet handle (owned by the cache) or NULL on failure.
+ */
+static dogecoin_wallet* dogecoin_wallet_address_handle(const char* address) {
+    const dogecoin_chainparams* chain = chain_from_b58_prefix(address);
+    if (!chain) return NULL;
+    if (address_wallet && address_wallet->chain != chain) {
+        dogecoin_wallet_close(address_wallet);
+        address_wallet = NULL;
+    }
+    struct stat st;
+    if (address_wallet) {
+        if (stat(address_wallet->filename, &st) == 0 && st.st_size == address_wallet_stat.st_size &&
+            st.st_mtime == address_wallet_stat.st_mtime && st.st_ino == address_wallet_stat.st_ino) {
+            return address_wallet;
+        }
+        if (!dogecoin_wallet_refresh(address_wallet)) {
+            dogecoin_wallet_close(address_wallet);
+            address_wallet = NULL;
+            return NULL;
         }
     } else {
-        dogecoin_wallet_free(wallet);
-        return false;
+        address_wallet = dogecoin_wallet_open(address);
+        if (!address_wallet) return NULL;
     }
-    dogecoin_wallet_free(wallet);
-    return true;
+    if (stat(address_wallet->filename, &address_wallet_stat) != 0) {
+        dogecoin_mem_zero(&address_wallet_stat, sizeof(address_wallet_stat));
+    }
+    return address_wallet;
 }
 
-unsigned int dogecoin_get_utxos_length(char* address) {
+int dogecoin_get_utxo_vector(char* address, vector_t* utxo_vec) {
     if (!address) return false;
-    dogecoin_wallet* wallet = dogecoin_wallet_read(address);
-    unsigned int utxos_total = 0;
-    dogecoin_utxo* utxo;
-    dogecoin_utxo* tmp;
-    HASH_ITER(hh, utxos, utxo, tmp) {
-        if (!is_spent(utxo) && strcmp(utxo->address, address) == 0) utxos_total++;
+    dogecoin_wallet* wallet = dogecoin_wallet_address_handle(address);
+    unsigned int i, len = dogecoin_wallet_address_utxos_length(wallet, address);
+    for (i = 1; i <= len; i++) {
+        vector_add(utxo_vec, dogecoin_wallet_address_utxo(wallet, address, i));
     }
-    dogecoin_wallet_free(wallet);
-    return utxos_total;
+    return len > 0;
+}
+
+unsigned int dogecoin_get_utxos_length(char* address) {
+    if (!address) return false;
+    dogecoin_wallet* wallet = dogecoin_wallet_address_handle(address);
+    return dogecoin_wallet_address_utxos_length(wallet, address);
 }
 
 uint8_t* dogecoin_get_utxos(char* address) {
     if (!address) return false;
-    dogecoin_wallet* wallet = dogecoin_wallet_read(address);
-    char* concat_str = dogecoin_char_vla(HASH_COUNT(utxos) * 55);
-    dogecoin_mem_zero(concat_str, HASH_COUNT(utxos) * 55);
-    if (HASH_COUNT(utxos) > 0) {
-        unsigned int i;
-        for (i = 0; i < HASH_COUNT(utxos); i++) {
-            dogecoin_utxo* utxo = find_dogecoin_utxo(i + 1);
-            if (strncmp(utxo->address, address, strlen(utxo->address))==0 && !is_spent(utxo)) {
-                int utxo_index_length = integer_length(i);
+    dogecoin_wallet* wallet = dogecoin_wallet_address_handle(address);
+    if (!wallet) return false;
+    char* concat_str = dogecoin_char_vla(HASH_COUNT(wallet->utxos) * 55);
+    dogecoin_mem_zero(concat_str, HASH_COUNT(wallet->utxos) * 55);
+    if (HASH_COUNT(wallet->utxos) > 0) {
+        unsigned int i = 0;
+        dogecoin_utxo* utxo;
+        dogecoin_utxo* tmp;
+        HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+            i++;
+            char utxo_address[P2PKHLEN];
+            if (!dogecoin_utxo_get_address(utxo, wallet->chain, utxo_address, sizeof(utxo_address))) continue;
+            if (strncmp(utxo_address, address, strlen(utxo_address))==0 && !is_spent(utxo)) {
+                int utxo_index_length = integer_length(i - 1);
                 char* utxo_index_hex = dogecoin_char_vla(utxo_index_length+1);
-                sprintf(utxo_index_hex, "%d", i);
+                sprintf(utxo_index_hex, "%d", i - 1);
                 // index
                 concat_str = concat(concat_str, utxo_index_hex);
                 char* txid_hex = utils_uint8_to_hex(utxo->txid, 32);
                 int vout_length = integer_length(utxo->vout);
                 char* vout_hex = dogecoin_char_vla(vout_length);
-                sprintf(vout_hex, "%d", utxo->vout);
+                sprintf(vout_hex, "%u", utxo->vout);
                 // txid
                 concat_str = concat(concat_str, txid_hex);
                 // vout index
                 concat_str = concat(concat_str, vout_hex);
                 char amount_hex[21];
-                uint64_t utxo_amount = coins_to_koinu_str(utxo->amount);
+                uint64_t utxo_amount = (uint64_t)utxo->koinu;
                 sprintf(amount_hex, "%" PRIx64, utxo_amount);
                 // amount
                 concat_str = concat(concat_str, amount_hex);
@@ -1807,28 +3117,14 @@ uint8_t* dogecoin_get_utxos(char* address) {
     } else return false;
     uint8_t* utxos = utils_hex_to_uint8(concat_str);
     dogecoin_free(concat_str);
-    dogecoin_wallet_free(wallet);
     return utxos;
 }
 
 char* dogecoin_get_utxo_txid_str(char* address, unsigned int index) {
     if (!address || !index) return false;
-    dogecoin_wallet* wallet = dogecoin_wallet_read(address);
-    char* txid = NULL;
-    unsigned int i = 0;
-    dogecoin_utxo* utxo;
-    dogecoin_utxo* tmp;
-    HASH_ITER(hh, utxos, utxo, tmp) {
-        if (strcmp(address, utxo->address) == 0 && !is_spent(utxo)) {
-            if (i == index - 1) {
-                txid = to_string(utxo->txid);
-                break;
-            }
-            i++;
-        }
-    }
-    dogecoin_wallet_free(wallet);
-    return txid;
+    dogecoin_wallet* wallet = dogecoin_wallet_address_handle(address);
+    dogecoin_utxo* utxo = dogecoin_wallet_address_utxo(wallet, address, index);
+    return utxo ? to_string(utxo->txid) : NULL;
 }
 
 uint8_t* dogecoin_get_utxo_txid(char* address, unsigned int index) {
@@ -1841,59 +3137,27 @@ uint8_t* dogecoin_get_utxo_txid(char* address, unsigned int index) {
 
 int dogecoin_get_utxo_vout(char* address, unsigned int index) {
     if (!address || !index) return false;
-    dogecoin_wallet* wallet = dogecoin_wallet_read(address);
-    int vout = 0;
-    unsigned int i = 0;
-    dogecoin_utxo* utxo;
-    dogecoin_utxo* tmp;
-    HASH_ITER(hh, utxos, utxo, tmp) {
-        if (strcmp(address, utxo->address) == 0 && !is_spent(utxo)) {
-            if (i == index - 1) {
-                vout = utxo->vout;
-                break;
-            }
-            i++;
-        }
-    }
-    dogecoin_wallet_free(wallet);
-    return vout;
+    dogecoin_wallet* wallet = dogecoin_wallet_address_handle(address);
+    dogecoin_utxo* utxo = dogecoin_wallet_address_utxo(wallet, address, index);
+    return utxo ? (int)utxo->vout : 0;
 }
 
 char* dogecoin_get_utxo_amount(char* address, unsigned int index) {
     if (!address || !index) return false;
-    dogecoin_wallet* wallet = dogecoin_wallet_read(address);
-    unsigned int i = 0;
-    dogecoin_utxo* utxo;
-    dogecoin_utxo* tmp;
-    HASH_ITER(hh, utxos, utxo, tmp) {
-        if (strcmp(address, utxo->address) == 0 && !is_spent(utxo)) {
-            if (i == index - 1) {
-                break;
-            }
-            i++;
-        }
+    dogecoin_wallet* wallet = dogecoin_wallet_address_handle(address);
+    dogecoin_utxo* utxo = dogecoin_wallet_address_utxo(wallet, address, index);
+    char* amount = NULL;
+    if (utxo) {
+        amount = (char*)dogecoin_calloc(1, KOINU_STRINGLEN);
+        dogecoin_utxo_get_amount_str(utxo, amount);
     }
-    char* amount = (char*)dogecoin_calloc(1, 21);
-    memcpy_safe(amount, utxo->amount, 21);
-    dogecoin_wallet_free(wallet);
     return amount;
 }
 
 uint64_t dogecoin_get_balance(char* address) {
     if (!address) return false;
-    dogecoin_wallet* wallet = dogecoin_wallet_read(address);
-    uint64_t wallet_total_u64 = 0;
-    if (HASH_COUNT(utxos)) {
-        dogecoin_utxo* utxo;
-        dogecoin_utxo* tmp;
-        HASH_ITER(hh, utxos, utxo, tmp) {
-            if (!is_spent(utxo) && strcmp(address, utxo->address) == 0) {
-                wallet_total_u64 += coins_to_koinu_str(utxo->amount);
-            }
-        }
-    }
-    dogecoin_wallet_free(wallet);
-    return wallet_total_u64;
+    dogecoin_wallet* wallet = dogecoin_wallet_address_handle(address);
+    return dogecoin_wallet_address_balance(wallet, address);
 }
 
 char* dogecoin_get_balance_str(char* address) {
@@ -12,6 +12,7 @@
 
 #include <dogecoin/arith_uint256.h>
 #include <dogecoin/utils.h>
+#include <test/utest.h>
 
 void test_init_and_negate()
 {
@@ -146,11 +147,57 @@ void test_arithmetic_and_comparison_operations()
     }
 }
 
+void test_value_operations()
+{
+    // the value type API must agree with the allocating API
+    dogecoin_bool f_negative, f_overflow;
+    arith_uint256 target = arith_uint256_from_compact(0x1e0ffff0, &f_negative, &f_overflow);
+    arith_uint256* target_ref = set_compact(init_arith_uint256(), 0x1e0ffff0, NULL, NULL);
+    u_assert_int_eq(f_negative, false);
+    u_assert_int_eq(f_overflow, false);
+    u_assert_int_eq(arith_uint256_compare(&target, target_ref), 0);
+
+    // work = ~target / (target + 1) + 1
+    arith_uint256 one;
+    memset(&one, 0, sizeof(one));
+    one.pn[0] = 1;
+    arith_uint256 neg_target = target;
+    arith_negate(&neg_target);
+    arith_uint256 target_plus_one = arith_uint256_add(&target, &one);
+    arith_uint256 work = arith_uint256_div(&neg_target, &target_plus_one);
+    arith_uint256* work_ref = div_arith_uint256(&neg_target, &target_plus_one);
+    u_assert_int_eq(arith_uint256_compare(&work, work_ref), 0);
+    // ~(0x0ffff0 << 216) / ((0x0ffff0 << 216) + 1) = 0x10000f
+    u_assert_uint64_eq(get_low64(&work), 0);
+    u_assert_uint32_eq(work.pn[0], 0x0010000f);
+
+    // round trip through uint256 and comparison
+    uint256_t raw;
+    arith_uint256_to_uint256(&work, raw);
+    arith_uint256 back = arith_uint256_from_uint256(raw);
+    u_assert_int_eq(arith_uint256_compare(&back, &work), 0);
+    arith_uint256 bigger = arith_uint256_add(&work, &one);
+    u_assert_int_eq(arith_uint256_compare(&bigger, &work), 1);
+    u_assert_int_eq(arith_uint256_compare(&work, &bigger), -1);
+    arith_uint256 smaller = arith_uint256_sub(&bigger, &one);
+    u_assert_int_eq(arith_uint256_compare(&smaller, &work), 0);
+
+    // division by zero yields zero
+    arith_uint256 zero;
+    memset(&zero, 0, sizeof(zero));
+    arith_uint256 quotient = arith_uint256_div(&work, &zero);
+    u_assert_true(arith_uint256_is_zero(&quotient));
+
+    dogecoin_free(target_ref);
+    dogecoin_free(work_ref);
+}
+
 int test_arith_uint256() {
     test_init_and_negate();
     test_shift_operations();
     test_set_compact();
     test_arithmetic_and_comparison_operations();
+    test_value_operations();
 
     return 0;
 }
@@ -18,6 +18,7 @@
 #include <dogecoin/key.h>
 #include <dogecoin/mem.h>
 #include <dogecoin/pow.h>
+#include <dogecoin/serialize.h>
 #include <dogecoin/utils.h>
 #include <dogecoin/validation.h>
 
@@ -185,3 +186,70 @@ void test_block_header()
     dogecoin_block_header_hash(&bheaderprev, (uint8_t *)&checkhash);
     u_assert_str_eq(utils_uint8_to_hex(bheader.prev_block, sizeof(bheader.prev_block)), utils_uint8_to_hex(checkhash, sizeof(checkhash)));
 }
+
+static void block_txs_add_tx(cstring* s, uint32_t locktime, uint256_t txid)
+{
+    dogecoin_tx* tx = dogecoin_tx_new();
+    vector_add(tx->vin, dogecoin_tx_in_new());
+    dogecoin_tx_out* out = dogecoin_tx_out_new();
+    out->value = 1;
+    vector_add(tx->vout, out);
+    tx->locktime = locktime;
+    dogecoin_tx_serialize(s, tx);
+    dogecoin_tx_hash(tx, txid);
+    dogecoin_tx_free(tx);
+}
+
+void test_block_txs_merkle_root()
+{
+    uint256_t a, b, c, root, expected;
+    uint8_t pair[64];
+
+    // a single transaction is its own root
+    cstring* s = cstr_new_sz(256);
+    ser_varlen(s, 1);
+    block_txs_add_tx(s, 1, a);
+    struct const_buffer buf = {s->str, s->len};
+    u_assert_int_eq(dogecoin_block_txs_merkle_root(&buf, root), true);
+    u_assert_mem_eq(root, a, 32);
+    u_assert_uint32_eq(buf.len, s->len);
+    cstr_free(s, true);
+
+    // the last hash of an odd level gets paired with itself
+    s = cstr_new_sz(256);
+    ser_varlen(s, 3);
+    block_txs_add_tx(s, 1, a);
+    block_txs_add_tx(s, 2, b);
+    block_txs_add_tx(s, 3, c);
+    memcpy(pair, a, 32);
+    memcpy(pair + 32, b, 32);
+    dogecoin_dblhash(pair, sizeof(pair), a);
+    memcpy(pair, c, 32);
+    memcpy(pair + 32, c, 32);
+    dogecoin_dblhash(pair, sizeof(pair), c);
+    memcpy(pair, a, 32);
+    memcpy(pair + 32, c, 32);
+    dogecoin_dblhash(pair, sizeof(pair), expected);
+    buf.p = s->str;
+    buf.len = s->len;
+    u_assert_int_eq(dogecoin_block_txs_merkle_root(&buf, root), true);
+    u_assert_mem_eq(root, expected, 32);
+
+    // a truncated transaction list fails
+    buf.len = s->len - 1;
+    u_assert_int_eq(dogecoin_block_txs_merkle_root(&buf, root), false);
+    cstr_free(s, true);
+
+    // duplicated transactions give the same root as the odd list and are rejected
+    s = cstr_new_sz(256);
+    ser_varlen(s, 4);
+    block_txs_add_tx(s, 1, a);
+    block_txs_add_tx(s, 2, b);
+    block_txs_add_tx(s, 3, c);
+    block_txs_add_tx(s, 3, c);
+    buf.p = s->str;
+    buf.len = s->len;
+    u_assert_int_eq(dogecoin_block_txs_merkle_root(&buf, root), false);
+    u_assert_mem_eq(root, expected, 32);
+    cstr_free(s, true);
+}
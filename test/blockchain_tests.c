@@ -0,0 +1,63 @@
+/**********************************************************************
+ * Copyright (c) 2025 The Dogecoin Foundation                         *
+ * Distributed under the MIT software license, see the accompanying   *
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.*
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dogecoin/blockchain.h>
+#include <dogecoin/mem.h>
+#include <dogecoin/sha2.h>
+
+#include <test/utest.h>
+
+#define BLOCKINDEX_MAP_TEST_COUNT 5000
+
+void test_blockindex_map()
+{
+    dogecoin_blockindex_map* map = dogecoin_blockindex_map_new(0);
+    dogecoin_blockindex* blocks = dogecoin_calloc(BLOCKINDEX_MAP_TEST_COUNT, sizeof(dogecoin_blockindex));
+    uint32_t i;
+
+    // derive distinct hashes, enough to force the table to grow a few times
+    for (i = 0; i < BLOCKINDEX_MAP_TEST_COUNT; i++) {
+        blocks[i].height = i;
+        sha256_raw((const uint8_t*)&i, sizeof(i), blocks[i].hash);
+        u_assert_true(dogecoin_blockindex_map_insert(map, &blocks[i]));
+    }
+    u_assert_uint32_eq(map->count, BLOCKINDEX_MAP_TEST_COUNT);
+
+    // duplicates are rejected
+    u_assert_true(!dogecoin_blockindex_map_insert(map, &blocks[42]));
+    u_assert_uint32_eq(map->count, BLOCKINDEX_MAP_TEST_COUNT);
+
+    for (i = 0; i < BLOCKINDEX_MAP_TEST_COUNT; i++) {
+        u_assert_true(dogecoin_blockindex_map_find(map, blocks[i].hash) == &blocks[i]);
+    }
+
+    // remove every other entry, the remaining ones must stay reachable
+    for (i = 0; i < BLOCKINDEX_MAP_TEST_COUNT; i += 2) {
+        u_assert_true(dogecoin_blockindex_map_remove(map, blocks[i].hash));
+    }
+    u_assert_true(!dogecoin_blockindex_map_remove(map, blocks[0].hash));
+    u_assert_uint32_eq(map->count, BLOCKINDEX_MAP_TEST_COUNT / 2);
+    for (i = 0; i < BLOCKINDEX_MAP_TEST_COUNT; i++) {
+        dogecoin_blockindex* found = dogecoin_blockindex_map_find(map, blocks[i].hash);
+        if (i % 2 == 0) {
+            u_assert_is_null(found);
+        } else {
+            u_assert_true(found == &blocks[i]);
+        }
+    }
+
+    // a hash never inserted is not found
+    uint256_t unknown;
+    dogecoin_mem_zero(unknown, sizeof(unknown));
+    u_assert_is_null(dogecoin_blockindex_map_find(map, unknown));
+
+    dogecoin_blockindex_map_free(map, NULL);
+    dogecoin_free(blocks);
+}
@@ -0,0 +1,167 @@
+/**********************************************************************
+ * Copyright (c) 2012-2016 The Bitcoin Core developers                *
+ * Copyright (c) 2024 The Dogecoin Foundation                         *
+ * Distributed under the MIT software license, see the accompanying   *
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.*
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dogecoin/bloom.h>
+#include <dogecoin/hash.h>
+#include <dogecoin/mem.h>
+#include <dogecoin/serialize.h>
+#include <dogecoin/utils.h>
+
+#include <test/utest.h>
+
+struct murmur3test {
+    uint32_t expected;
+    uint32_t seed;
+    const char* hexdata;
+};
+
+static const struct murmur3test murmur3_tests[] = {
+    {0x00000000, 0x00000000, ""},
+    {0x6a396f08, 0xFBA4C795, ""},
+    {0x81f16f39, 0xffffffff, ""},
+    {0x514E28B7, 0x00000000, "00"},
+    {0xEA3F0B17, 0xFBA4C795, "00"},
+    {0xFD6CF10D, 0x00000000, "ff"},
+    {0x16C6B7AB, 0x00000000, "0011"},
+    {0x8eb51c3d, 0x00000000, "001122"},
+    {0xb4471bf8, 0x00000000, "00112233"},
+    {0xe2301fa8, 0x00000000, "0011223344"},
+    {0xfc2e4a15, 0x00000000, "001122334455"},
+    {0xb074502c, 0x00000000, "00112233445566"},
+    {0x8034d2a0, 0x00000000, "0011223344556677"},
+    {0xb4698def, 0x00000000, "001122334455667788"},
+};
+
+void test_bloom()
+{
+    uint8_t data[64];
+    size_t outlen = 0;
+    unsigned int i;
+    for (i = 0; i < sizeof(murmur3_tests) / sizeof(murmur3_tests[0]); i++) {
+        outlen = 0;
+        if (strlen(murmur3_tests[i].hexdata)) {
+            utils_hex_to_bin(murmur3_tests[i].hexdata, data, strlen(murmur3_tests[i].hexdata), &outlen);
+        }
+        u_assert_uint32_eq(dogecoin_murmur3(murmur3_tests[i].seed, data, outlen), murmur3_tests[i].expected);
+    }
+
+    // filter vectors of the BIP37 reference implementation
+    const char* elements[] = {"99108ad8ed9bb6274d3980bab5a85c048f0950c8", "b5a2c786d9ef4658287ced5914b37a1b4aa32eee", "b9300670b4c5366e95b2699e8b18bc75e5f729c5"};
+    const char* expected[] = {"03614e9b050000000000000001", "03ce4299050000000100008001"};
+    const uint32_t tweaks[] = {0, 2147483649UL};
+    unsigned int t;
+    for (t = 0; t < 2; t++) {
+        dogecoin_bloom_filter* filter = dogecoin_bloom_filter_new(3, 0.01, tweaks[t], DOGECOIN_BLOOM_UPDATE_ALL);
+        for (i = 0; i < 3; i++) {
+            utils_hex_to_bin(elements[i], data, 40, &outlen);
+            u_assert_int_eq(dogecoin_bloom_filter_contains(filter, data, outlen), false);
+            dogecoin_bloom_filter_insert(filter, data, outlen);
+            u_assert_int_eq(dogecoin_bloom_filter_contains(filter, data, outlen), true);
+        }
+        utils_hex_to_bin("19108ad8ed9bb6274d3980bab5a85c048f0950c8", data, 40, &outlen);
+        u_assert_int_eq(dogecoin_bloom_filter_contains(filter, data, outlen), false);
+
+        cstring* s = cstr_new_sz(64);
+        dogecoin_bloom_filter_serialize(s, filter);
+        char hex[64];
+        utils_bin_to_hex((unsigned char*)s->str, s->len, hex);
+        u_assert_str_eq(hex, expected[t]);
+        cstr_free(s, true);
+        dogecoin_bloom_filter_free(filter);
+    }
+
+    // outpoints are the txid followed by the little endian output index
+    dogecoin_bloom_filter* filter = dogecoin_bloom_filter_new(10, 0.0001, 5, DOGECOIN_BLOOM_UPDATE_ALL);
+    uint256_t hash;
+    dogecoin_mem_zero(hash, sizeof(hash));
+    hash[0] = 0xaa;
+    dogecoin_bloom_filter_insert_outpoint(filter, hash, 1);
+    uint8_t outpoint[36];
+    dogecoin_mem_zero(outpoint, sizeof(outpoint));
+    outpoint[0] = 0xaa;
+    outpoint[32] = 1;
+    u_assert_int_eq(dogecoin_bloom_filter_contains(filter, outpoint, sizeof(outpoint)), true);
+    outpoint[32] = 2;
+    u_assert_int_eq(dogecoin_bloom_filter_contains(filter, outpoint, sizeof(outpoint)), false);
+    dogecoin_bloom_filter_free(filter);
+}
+
+static void merkle_parent(const uint256_t left, const uint256_t right, uint256_t out)
+{
+    uint8_t pair[64];
+    memcpy(pair, left, 32);
+    memcpy(pair + 32, right, 32);
+    dogecoin_dblhash(pair, sizeof(pair), out);
+}
+
+void test_merkleblock()
+{
+    uint256_t a, b, c, ab, cc, root, computed;
+    dogecoin_mem_zero(a, 32);
+    dogecoin_mem_zero(b, 32);
+    dogecoin_mem_zero(c, 32);
+    a[0] = 1;
+    b[0] = 2;
+    c[0] = 3;
+    merkle_parent(a, b, ab);
+    merkle_parent(c, c, cc);
+    merkle_parent(ab, cc, root);
+
+    // three transactions, b matched: root(1) left(1) a(0) b(1) right(0)
+    cstring* s = cstr_new_sz(256);
+    ser_u32(s, 3);
+    ser_varlen(s, 3);
+    ser_u256(s, a);
+    ser_u256(s, b);
+    ser_u256(s, cc);
+    ser_varlen(s, 1);
+    uint8_t flags = 0x0b;
+    ser_bytes(s, &flags, 1);
+
+    vector_t* matches = vector_new(1, dogecoin_free);
+    struct const_buffer buf = {s->str, s->len};
+    u_assert_int_eq(dogecoin_merkleblock_extract_matches(&buf, computed, matches), true);
+    u_assert_mem_eq(computed, root, 32);
+    u_assert_uint32_eq(matches->len, 1);
+    u_assert_mem_eq(vector_idx(matches, 0), b, 32);
+    u_assert_uint32_eq(buf.len, 0);
+
+    // an unused trailing hash makes the tree invalid
+    cstring* bad = cstr_new_sz(256);
+    ser_u32(bad, 3);
+    ser_varlen(bad, 4);
+    ser_u256(bad, a);
+    ser_u256(bad, b);
+    ser_u256(bad, cc);
+    ser_u256(bad, c);
+    ser_varlen(bad, 1);
+    ser_bytes(bad, &flags, 1);
+    struct const_buffer badbuf = {bad->str, bad->len};
+    u_assert_int_eq(dogecoin_merkleblock_extract_matches(&badbuf, computed, matches), false);
+    u_assert_uint32_eq(matches->len, 1);
+    cstr_free(bad, true);
+
+    // a single transaction block is its own root
+    cstr_resize(s, 0);
+    ser_u32(s, 1);
+    ser_varlen(s, 1);
+    ser_u256(s, a);
+    ser_varlen(s, 1);
+    flags = 0x01;
+    ser_bytes(s, &flags, 1);
+    struct const_buffer onebuf = {s->str, s->len};
+    u_assert_int_eq(dogecoin_merkleblock_extract_matches(&onebuf, computed, matches), true);
+    u_assert_mem_eq(computed, a, 32);
+    u_assert_uint32_eq(matches->len, 2);
+
+    vector_free(matches, true);
+    cstr_free(s, true);
+}
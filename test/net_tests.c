@@ -7,7 +7,27 @@
 
 #include <test/utest.h>
 
+#ifdef _MSC_VER
+#include <win/pthread.h>
+#else
+#include <pthread.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/dns.h>
+#include <event2/dns_struct.h>
+
+#include <dogecoin/addrman.h>
 #include <dogecoin/block.h>
+#include <dogecoin/broadcast.h>
+#include <dogecoin/hash.h>
 #include <dogecoin/net.h>
 #include <dogecoin/utils.h>
 #include <dogecoin/serialize.h>
@@ -251,3 +271,663 @@ void test_net_basics_plus_download_block()
 
     dogecoin_node_group_free(group); //will also free the nodes structures from the heap
 }
+
+extern void read_cb(struct bufferevent* bev, void* ctx);
+
+static unsigned int framing_msgs = 0;
+static size_t framing_bytes = 0;
+
+static void framing_postcmd(struct dogecoin_node_ *node, dogecoin_p2p_msg_hdr *hdr, struct const_buffer *buf)
+{
+    (void)(node);
+    if (strcmp(hdr->command, "test") == 0) {
+        framing_msgs++;
+        framing_bytes += buf->len;
+    }
+}
+
+void test_net_read_framing()
+{
+    dogecoin_node_group* group = dogecoin_node_group_new(NULL);
+    group->log_write_cb = net_write_log_null;
+    group->postcmd_cb = framing_postcmd;
+
+    dogecoin_node *node = dogecoin_node_new();
+    dogecoin_node_group_add_node(group, node);
+
+    struct bufferevent* pair[2];
+    u_assert_int_eq(bufferevent_pair_new(group->event_base, BEV_OPT_DEFER_CALLBACKS, pair), 0);
+    node->event_bev = pair[0];
+    node->state = NODE_CONNECTED;
+    bufferevent_setcb(node->event_bev, read_cb, NULL, NULL, node);
+    bufferevent_enable(node->event_bev, EV_READ | EV_WRITE);
+    bufferevent_enable(pair[1], EV_READ | EV_WRITE);
+
+    // three messages (empty, small, larger than a socket read) written in odd sized pieces
+    uint8_t payload[70000];
+    unsigned int i;
+    for (i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)i;
+    }
+    cstring* stream = cstr_new_sz(sizeof(payload) + 200);
+    const size_t sizes[] = {0, 5, sizeof(payload)};
+    for (i = 0; i < 3; i++) {
+        cstring* msg = dogecoin_p2p_message_new(group->chainparams->netmagic, "test", payload, sizes[i]);
+        cstr_append_buf(stream, msg->str, msg->len);
+        cstr_free(msg, true);
+    }
+    size_t pos = 0;
+    while (pos < stream->len) {
+        size_t chunk = stream->len - pos < 1000 ? stream->len - pos : 1000;
+        if (pos < 30) chunk = 7;
+        bufferevent_write(pair[1], stream->str + pos, chunk);
+        event_base_loop(group->event_base, EVLOOP_NONBLOCK);
+        pos += chunk;
+        if (pos < stream->len) {
+            u_assert_int_eq(framing_msgs < 3, true);
+        }
+    }
+    event_base_loop(group->event_base, EVLOOP_NONBLOCK);
+    u_assert_uint32_eq(framing_msgs, 3);
+    u_assert_uint32_eq(framing_bytes, 5 + sizeof(payload));
+    u_assert_uint32_eq(evbuffer_get_length(bufferevent_get_input(node->event_bev)), 0);
+
+    // an oversized header gets the peer disconnected before the payload arrives
+    cstring* big = dogecoin_p2p_message_new(group->chainparams->netmagic, "test", NULL, 0);
+    uint32_t huge = DOGECOIN_MAX_P2P_MSG_SIZE + 1;
+    memcpy(big->str + 16, &huge, 4);
+    bufferevent_write(pair[1], big->str, big->len);
+    event_base_loop(group->event_base, EVLOOP_NONBLOCK);
+    u_assert_int_eq((node->state & NODE_CONNECTED) == NODE_CONNECTED, false);
+    cstr_free(big, true);
+
+    cstr_free(stream, true);
+    bufferevent_free(pair[1]);
+    dogecoin_node_group_free(group);
+}
+
+void test_net_send_framing()
+{
+    dogecoin_node_group* group = dogecoin_node_group_new(NULL);
+    group->log_write_cb = net_write_log_null;
+
+    struct bufferevent* pairs[2][2];
+    dogecoin_node* nodes[2];
+    unsigned int i;
+    for (i = 0; i < 2; i++) {
+        nodes[i] = dogecoin_node_new();
+        dogecoin_node_group_add_node(group, nodes[i]);
+        u_assert_int_eq(bufferevent_pair_new(group->event_base, BEV_OPT_DEFER_CALLBACKS, pairs[i]), 0);
+        nodes[i]->event_bev = pairs[i][0];
+        nodes[i]->state = NODE_CONNECTED;
+        bufferevent_enable(pairs[i][0], EV_READ | EV_WRITE);
+        bufferevent_enable(pairs[i][1], EV_READ | EV_WRITE);
+    }
+
+    uint8_t payload[300];
+    for (i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i * 7);
+    }
+    cstring* expected = dogecoin_p2p_message_new(group->chainparams->netmagic, "tx", payload, sizeof(payload));
+    cstring* expected_empty = dogecoin_p2p_message_new(group->chainparams->netmagic, "verack", NULL, 0);
+
+    // header and payload written straight into the output buffer
+    dogecoin_node_send_message(nodes[0], "tx", payload, sizeof(payload));
+    dogecoin_node_send_message(nodes[0], "verack", NULL, 0);
+    event_base_loop(group->event_base, EVLOOP_NONBLOCK);
+    struct evbuffer* input = bufferevent_get_input(pairs[0][1]);
+    u_assert_uint32_eq(evbuffer_get_length(input), expected->len + expected_empty->len);
+    u_assert_mem_eq(evbuffer_pullup(input, -1), expected->str, expected->len);
+    u_assert_mem_eq(evbuffer_pullup(input, -1) + expected->len, expected_empty->str, expected_empty->len);
+    evbuffer_drain(input, evbuffer_get_length(input));
+
+    // one shared payload referenced by both nodes
+    cstring* ser = cstr_new_buf(payload, sizeof(payload));
+    dogecoin_p2p_shared_msg* msg = dogecoin_p2p_shared_msg_new(group->chainparams->netmagic, "tx", ser);
+    u_assert_mem_eq(msg->hdr, expected->str, DOGECOIN_P2P_HDRSZ);
+    dogecoin_node_send_shared(nodes[0], msg);
+    dogecoin_node_send_shared(nodes[1], msg);
+    u_assert_uint32_eq(msg->refcount, 3);
+    event_base_loop(group->event_base, EVLOOP_NONBLOCK);
+    for (i = 0; i < 2; i++) {
+        input = bufferevent_get_input(pairs[i][1]);
+        u_assert_uint32_eq(evbuffer_get_length(input), expected->len);
+        uint8_t received[DOGECOIN_P2P_HDRSZ + sizeof(payload)];
+        evbuffer_remove(input, received, sizeof(received));
+        u_assert_mem_eq(received, expected->str, expected->len);
+    }
+    // written out everywhere, only the callers reference is left
+    u_assert_uint32_eq(msg->refcount, 1);
+    dogecoin_p2p_shared_msg_release(msg);
+
+    cstr_free(expected, true);
+    cstr_free(expected_empty, true);
+    for (i = 0; i < 2; i++) {
+        bufferevent_free(pairs[i][1]);
+    }
+    dogecoin_node_group_free(group);
+}
+
+static pthread_t worker_test_main_thread;
+static unsigned int worker_test_msgs = 0;
+static unsigned int worker_test_off_main = 0;
+
+static void worker_postcmd(struct dogecoin_node_ *node, dogecoin_p2p_msg_hdr *hdr, struct const_buffer *buf)
+{
+    if (!pthread_equal(pthread_self(), worker_test_main_thread)) {
+        worker_test_off_main++;
+    }
+    if (strcmp(hdr->command, "test") == 0) {
+        worker_test_msgs++;
+        // answered from the worker, goes out through the event loop thread
+        dogecoin_node_send_message(node, "echo", buf->p, buf->len);
+    } else if (strcmp(hdr->command, "bad") == 0) {
+        dogecoin_node_misbehave(node);
+    } else if (strcmp(hdr->command, "quit") == 0) {
+        dogecoin_node_group_shutdown(node->nodegroup);
+    }
+}
+
+static void worker_locked_call(void* ctx, dogecoin_bool run)
+{
+    if (run) (*(unsigned int*)ctx)++;
+}
+
+void test_net_worker()
+{
+    worker_test_main_thread = pthread_self();
+    dogecoin_node_group* group = dogecoin_node_group_new(NULL);
+    group->log_write_cb = net_write_log_null;
+    group->postcmd_cb = worker_postcmd;
+
+    dogecoin_node *node = dogecoin_node_new();
+    dogecoin_node_group_add_node(group, node);
+
+    struct bufferevent* pair[2];
+    u_assert_int_eq(bufferevent_pair_new(group->event_base, BEV_OPT_DEFER_CALLBACKS, pair), 0);
+    node->event_bev = pair[0];
+    node->state = NODE_CONNECTED;
+    node->connected = true;
+    bufferevent_setcb(node->event_bev, read_cb, NULL, NULL, node);
+    bufferevent_enable(node->event_bev, EV_READ | EV_WRITE);
+    bufferevent_enable(pair[1], EV_READ | EV_WRITE);
+    u_assert_int_eq(dogecoin_node_group_start_worker(group), true);
+
+    uint64_t nonce = 0x0102030405060708ULL;
+    const char* commands[] = {"test", "ping", "test", "test"};
+    unsigned int i;
+    for (i = 0; i < 4; i++) {
+        cstring* msg = dogecoin_p2p_message_new(group->chainparams->netmagic, commands[i], &nonce, sizeof(nonce));
+        bufferevent_write(pair[1], msg->str, msg->len);
+        cstr_free(msg, true);
+    }
+    // runs until the worker acknowledged every job
+    event_base_dispatch(group->event_base);
+    u_assert_uint32_eq(worker_test_msgs, 3);
+    u_assert_uint32_eq(worker_test_off_main, 3);
+
+    // three echos from the worker, the pong from the event loop thread
+    struct evbuffer* input = bufferevent_get_input(pair[1]);
+    unsigned int echos = 0, pongs = 0;
+    while (evbuffer_get_length(input) >= DOGECOIN_P2P_HDRSZ) {
+        unsigned char data[DOGECOIN_P2P_HDRSZ + sizeof(nonce)];
+        u_assert_int_eq(evbuffer_remove(input, data, sizeof(data)), sizeof(data));
+        struct const_buffer buf = {data, sizeof(data)};
+        dogecoin_p2p_msg_hdr hdr;
+        dogecoin_p2p_deser_msghdr(&hdr, &buf);
+        u_assert_uint32_eq(hdr.data_len, sizeof(nonce));
+        u_assert_mem_eq(buf.p, &nonce, sizeof(nonce));
+        if (strcmp(hdr.command, "echo") == 0) echos++;
+        if (strcmp(hdr.command, "pong") == 0) pongs++;
+    }
+    u_assert_uint32_eq(echos, 3);
+    u_assert_uint32_eq(pongs, 1);
+    u_assert_int_eq((node->state & NODE_CONNECTED) == NODE_CONNECTED, true);
+
+    // the event loop thread does not wait for a held state lock, the call runs once it is free
+    unsigned int calls = 0;
+    dogecoin_node_group_lock(group);
+    dogecoin_node_group_call_locked(group, worker_locked_call, &calls);
+    u_assert_uint32_eq(calls, 0);
+    dogecoin_node_group_unlock(group);
+    event_base_dispatch(group->event_base);
+    u_assert_uint32_eq(calls, 1);
+
+    // a misbehave from the worker disconnects on the event loop thread
+    cstring* bad = dogecoin_p2p_message_new(group->chainparams->netmagic, "bad", NULL, 0);
+    bufferevent_write(pair[1], bad->str, bad->len);
+    cstr_free(bad, true);
+    event_base_dispatch(group->event_base);
+    u_assert_int_eq((node->state & NODE_CONNECTED) == NODE_CONNECTED, false);
+    u_assert_int_eq((node->state & NODE_MISSBEHAVED) == NODE_MISSBEHAVED, true);
+    bufferevent_free(pair[1]);
+
+    // a shutdown from the worker closes the connections on the event loop thread
+    dogecoin_node *node2 = dogecoin_node_new();
+    dogecoin_node_group_add_node(group, node2);
+    u_assert_int_eq(bufferevent_pair_new(group->event_base, BEV_OPT_DEFER_CALLBACKS, pair), 0);
+    node2->event_bev = pair[0];
+    node2->state = NODE_CONNECTED;
+    node2->connected = true;
+    bufferevent_setcb(node2->event_bev, read_cb, NULL, NULL, node2);
+    bufferevent_enable(node2->event_bev, EV_READ | EV_WRITE);
+    bufferevent_enable(pair[1], EV_READ | EV_WRITE);
+    cstring* quit = dogecoin_p2p_message_new(group->chainparams->netmagic, "quit", NULL, 0);
+    bufferevent_write(pair[1], quit->str, quit->len);
+    cstr_free(quit, true);
+    event_base_dispatch(group->event_base);
+    u_assert_is_null(node2->event_bev);
+    u_assert_int_eq(node2->connected, false);
+    u_assert_int_eq((node2->state & NODE_DISCONNECTED) == NODE_DISCONNECTED, true);
+
+    bufferevent_free(pair[1]);
+    dogecoin_node_group_free(group);
+}
+
+void test_net_quit_on_stdin()
+{
+#ifndef _WIN32
+    int saved_stdin = dup(STDIN_FILENO);
+    int fds[2];
+    u_assert_int_eq(pipe(fds), 0);
+    u_assert_int_eq(dup2(fds[0], STDIN_FILENO), STDIN_FILENO);
+    close(fds[0]);
+
+    dogecoin_node_group* group = dogecoin_node_group_new(NULL);
+    group->log_write_cb = net_write_log_null;
+    dogecoin_node_group_quit_on_stdin(group);
+    u_assert_not_null(group->quit_event);
+    // other input is ignored, the quit command removes the only event and the loop ends
+    u_assert_int_eq(write(fds[1], "x\nq\n", 4), 4);
+    event_base_dispatch(group->event_base);
+    u_assert_is_null(group->quit_event);
+
+    // a closed stdin stops the watch as well
+    dogecoin_node_group_quit_on_stdin(group);
+    u_assert_not_null(group->quit_event);
+    close(fds[1]);
+    event_base_dispatch(group->event_base);
+    u_assert_is_null(group->quit_event);
+    dogecoin_node_group_free(group);
+
+    dup2(saved_stdin, STDIN_FILENO);
+    close(saved_stdin);
+#endif
+}
+
+static dogecoin_p2p_address test_addrman_address(uint8_t last, uint16_t port)
+{
+    dogecoin_p2p_address addr;
+    dogecoin_p2p_address_init(&addr);
+    memset(&addr.ip[10], 0xff, 2);
+    addr.ip[12] = 10;
+    addr.ip[15] = last;
+    addr.port = port;
+    addr.services = DOGECOIN_NODE_NETWORK;
+    addr.time = 1700000000;
+    return addr;
+}
+
+void test_addrman()
+{
+    const uint32_t now = 1700000000;
+    dogecoin_addrman* addrman = dogecoin_addrman_new(&dogecoin_chainparams_main);
+
+    // unusable addresses are rejected, known ones refreshed
+    dogecoin_p2p_address unspecified = test_addrman_address(0, 22556);
+    unspecified.ip[12] = 0;
+    u_assert_is_null(dogecoin_addrman_add(addrman, &unspecified, now));
+    dogecoin_p2p_address a = test_addrman_address(1, 22556);
+    dogecoin_p2p_address b = test_addrman_address(2, 22556);
+    dogecoin_p2p_address c = test_addrman_address(3, 22556);
+    u_assert_not_null(dogecoin_addrman_add(addrman, &a, now));
+    u_assert_not_null(dogecoin_addrman_add(addrman, &b, now));
+    u_assert_not_null(dogecoin_addrman_add(addrman, &c, now));
+    u_assert_not_null(dogecoin_addrman_add(addrman, &a, now));
+    u_assert_uint32_eq(addrman->entries->len, 3);
+
+    // addresses travel with the port in network byte order
+    cstring* s = cstr_new_sz(32);
+    dogecoin_p2p_ser_addr(70015, &a, s);
+    u_assert_int_eq((unsigned char)s->str[s->len - 2], 22556 >> 8);
+    u_assert_int_eq((unsigned char)s->str[s->len - 1], 22556 & 0xff);
+    struct const_buffer buf = {s->str, s->len};
+    dogecoin_p2p_address a_check;
+    u_assert_int_eq(dogecoin_p2p_deser_addr(70015, &a_check, &buf), true);
+    u_assert_int_eq(a_check.port, 22556);
+    cstr_free(s, true);
+
+    // b answers fast and delivers blocks, c fails, a misbehaves
+    struct sockaddr sa, sb, sc;
+    dogecoin_mem_zero(&sa, sizeof(sa));
+    dogecoin_mem_zero(&sb, sizeof(sb));
+    dogecoin_mem_zero(&sc, sizeof(sc));
+    dogecoin_addrman_entry_to_addr(vector_idx(addrman->entries, 0), &sa);
+    dogecoin_addrman_entry_to_addr(vector_idx(addrman->entries, 1), &sb);
+    dogecoin_addrman_entry_to_addr(vector_idx(addrman->entries, 2), &sc);
+    u_assert_int_eq(sb.sa_family, AF_INET);
+    u_assert_int_eq(ntohs(((struct sockaddr_in*)&sb)->sin_port), 22556);
+
+    dogecoin_addrman_attempt(addrman, &sb, now);
+    dogecoin_addrman_connected(addrman, &sb, DOGECOIN_NODE_NETWORK, 120, now);
+    dogecoin_addrman_block_received(addrman, &sb, 1024 * 1024, 1000);
+    dogecoin_addrman_entry* eb = dogecoin_addrman_find(addrman, &sb);
+    u_assert_uint32_eq(eb->failures, 0);
+    u_assert_uint32_eq(eb->successes, 1);
+    u_assert_uint32_eq(eb->latency_ms, 120);
+    u_assert_uint32_eq(eb->throughput, 1024 * 1024);
+    dogecoin_addrman_connected(addrman, &sb, DOGECOIN_NODE_NETWORK, 200, now);
+    u_assert_uint32_eq(eb->latency_ms, 140);
+
+    dogecoin_addrman_attempt(addrman, &sc, now);
+    u_assert_uint32_eq(dogecoin_addrman_find(addrman, &sc)->failures, 1);
+    dogecoin_addrman_misbehaved(addrman, &sa, now);
+    u_assert_int_eq(dogecoin_addrman_score(eb, now) > dogecoin_addrman_score(dogecoin_addrman_find(addrman, &sc), now), true);
+
+    // failed peers wait for their retry, misbehaving ones for the ban to expire
+    vector_t* selected = vector_new(4, NULL);
+    u_assert_uint32_eq(dogecoin_addrman_select(addrman, selected, 10, now, NULL, NULL), 1);
+    u_assert_mem_eq(vector_idx(selected, 0), eb, sizeof(*eb));
+    vector_remove_range(selected, 0, selected->len);
+    u_assert_uint32_eq(dogecoin_addrman_select(addrman, selected, 10, now + DOGECOIN_ADDRMAN_RETRY_DELAY, NULL, NULL), 2);
+    u_assert_mem_eq(vector_idx(selected, 0), eb, sizeof(*eb));
+    u_assert_mem_eq(vector_idx(selected, 1), dogecoin_addrman_find(addrman, &sc), sizeof(*eb));
+    vector_remove_range(selected, 0, selected->len);
+    u_assert_uint32_eq(dogecoin_addrman_select(addrman, selected, 10, now + DOGECOIN_ADDRMAN_BAN_TIME, NULL, NULL), 3);
+    u_assert_mem_eq(vector_idx(selected, 2), dogecoin_addrman_find(addrman, &sa), sizeof(*eb));
+    vector_free(selected, true);
+
+    // the peers file survives a restart, other chains start empty
+    const char* peersfile = "test_peers.db";
+    remove(peersfile);
+    u_assert_int_eq(dogecoin_addrman_load(addrman, peersfile), true);
+    u_assert_int_eq(dogecoin_addrman_save(addrman), true);
+    dogecoin_addrman* loaded = dogecoin_addrman_new(&dogecoin_chainparams_main);
+    u_assert_int_eq(dogecoin_addrman_load(loaded, peersfile), true);
+    u_assert_uint32_eq(loaded->entries->len, 3);
+    size_t i;
+    for (i = 0; i < 3; i++) {
+        u_assert_mem_eq(vector_idx(loaded->entries, i), vector_idx(addrman->entries, i), sizeof(dogecoin_addrman_entry));
+    }
+    dogecoin_addrman_free(loaded);
+    loaded = dogecoin_addrman_new(&dogecoin_chainparams_test);
+    u_assert_int_eq(dogecoin_addrman_load(loaded, peersfile), true);
+    u_assert_uint32_eq(loaded->entries->len, 0);
+    dogecoin_addrman_free(loaded);
+    remove(peersfile);
+
+    // addr messages feed the group's address manager, which then supplies the peers
+    dogecoin_node_group* group = dogecoin_node_group_new(&dogecoin_chainparams_main);
+    group->addrman = addrman;
+    group->desired_amount_connected_nodes = 2;
+    dogecoin_node* node = dogecoin_node_new();
+    dogecoin_node_group_add_node(group, node);
+    node->version = 70015;
+    cstring* addrmsg = cstr_new_sz(256);
+    ser_varlen(addrmsg, 3);
+    dogecoin_p2p_address d = test_addrman_address(4, 22556);
+    dogecoin_p2p_address e = test_addrman_address(5, 22556);
+    dogecoin_p2p_address f = test_addrman_address(6, 22556);
+    f.services = 0;
+    dogecoin_p2p_ser_addr(70015, &d, addrmsg);
+    dogecoin_p2p_ser_addr(70015, &e, addrmsg);
+    dogecoin_p2p_ser_addr(70015, &f, addrmsg);
+    dogecoin_p2p_msg_hdr hdr;
+    dogecoin_mem_zero(&hdr, sizeof(hdr));
+    memcpy(hdr.netmagic, dogecoin_chainparams_main.netmagic, 4);
+    strcpy(hdr.command, DOGECOIN_MSG_ADDR);
+    hdr.data_len = addrmsg->len;
+    struct const_buffer addrbuf = {addrmsg->str, addrmsg->len};
+    u_assert_int_eq(dogecoin_node_parse_message(node, &hdr, &addrbuf), true);
+    u_assert_uint32_eq(addrman->entries->len, 5);
+    cstr_free(addrmsg, true);
+
+    u_assert_int_eq(dogecoin_node_group_add_peers_by_ip_or_seed(group, NULL), true);
+    u_assert_uint32_eq(group->nodes->len, 1 + 5);
+    dogecoin_node* best = vector_idx(group->nodes, 1);
+    u_assert_mem_eq(&best->addr, &sb, sizeof(sb));
+
+    // the tried peer ranks before the new ones
+    dogecoin_node* ranked[6];
+    dogecoin_node_group_rank_nodes(group, ranked);
+    u_assert_int_eq(ranked[0] == best, true);
+
+    dogecoin_node_group_free(group);
+    dogecoin_addrman_free(addrman);
+}
+
+static void test_dns_stub_cb(struct evdns_server_request* req, void* ctx)
+{
+    int* queries = (int*)ctx;
+    int i;
+    for (i = 0; i < req->nquestions; i++) {
+        if (req->questions[i]->type == EVDNS_TYPE_A) {
+            uint32_t addrs[2] = {htonl(0x0a000001), htonl(0x0a000002)};
+            evdns_server_request_add_a_reply(req, req->questions[i]->name, 2, addrs, 60);
+        }
+    }
+    (*queries)++;
+    evdns_server_request_respond(req, 0);
+}
+
+void test_net_dns_seeds()
+{
+    // a seed that only the local stub resolver knows
+    dogecoin_chainparams params = dogecoin_chainparams_main;
+    dogecoin_mem_zero(params.dnsseeds, sizeof(params.dnsseeds));
+    strcpy(params.dnsseeds[0].domain, "seed.stub.test");
+
+    dogecoin_node_group* group = dogecoin_node_group_new(&params);
+    group->desired_amount_connected_nodes = 0;
+
+    evutil_socket_t sock = socket(AF_INET, SOCK_DGRAM, 0);
+    u_assert_int_eq(sock >= 0, true);
+    evutil_make_socket_nonblocking(sock);
+    struct sockaddr_in stub;
+    dogecoin_mem_zero(&stub, sizeof(stub));
+    stub.sin_family = AF_INET;
+    stub.sin_addr.s_addr = htonl(0x7f000001);
+    stub.sin_port = 0;
+    u_assert_int_eq(bind(sock, (struct sockaddr*)&stub, sizeof(stub)), 0);
+    ev_socklen_t stub_len = sizeof(stub);
+    u_assert_int_eq(getsockname(sock, (struct sockaddr*)&stub, &stub_len), 0);
+    int queries = 0;
+    struct evdns_server_port* port = evdns_add_server_port_with_base(group->event_base, sock, 0, test_dns_stub_cb, &queries);
+    u_assert_not_null(port);
+
+    char nameserver[32];
+    sprintf(nameserver, "127.0.0.1:%d", ntohs(stub.sin_port));
+    u_assert_int_eq(dogecoin_node_group_set_nameserver(group, nameserver), true);
+
+    // the lookup runs on the event loop, peers arrive with the answer
+    u_assert_int_eq(dogecoin_node_group_add_peers_by_ip_or_seed(group, NULL), true);
+    u_assert_uint32_eq(group->nodes->len, 0);
+    u_assert_int_eq(group->dns_pending, 1);
+    int rounds = 0;
+    while (group->dns_pending > 0 && rounds++ < 100) {
+        event_base_loop(group->event_base, EVLOOP_ONCE);
+    }
+    u_assert_int_eq(group->dns_pending, 0);
+    u_assert_int_eq(queries, 1);
+    u_assert_uint32_eq(group->nodes->len, 2);
+    dogecoin_node* node = vector_idx(group->nodes, 1);
+    struct sockaddr_in* sin = (struct sockaddr_in*)&node->addr;
+    u_assert_int_eq(ntohl(sin->sin_addr.s_addr), 0x0a000002);
+    u_assert_int_eq(ntohs(sin->sin_port), params.default_port);
+
+    // another round learns nothing new
+    u_assert_int_eq(dogecoin_node_group_add_peers_by_ip_or_seed(group, NULL), true);
+    rounds = 0;
+    while (group->dns_pending > 0 && rounds++ < 100) {
+        event_base_loop(group->event_base, EVLOOP_ONCE);
+    }
+    u_assert_int_eq(queries, 2);
+    u_assert_uint32_eq(group->nodes->len, 2);
+
+    evdns_close_server_port(port); /* closes the socket */
+
+    // lookups still running when the group goes away fail quietly
+    u_assert_int_eq(dogecoin_node_group_add_peers_by_ip_or_seed(group, NULL), true);
+    u_assert_int_eq(group->dns_pending, 1);
+    dogecoin_node_group_free(group);
+}
+
+static unsigned int broadcaster_reports[DOGECOIN_BROADCAST_EXPIRED + 1];
+static dogecoin_broadcast_status broadcaster_last_status;
+
+static void broadcaster_status_cb(void* ctx, const dogecoin_broadcast_status* status)
+{
+    dogecoin_broadcaster* broadcaster = (dogecoin_broadcaster*)ctx;
+    broadcaster_reports[status->state]++;
+    broadcaster_last_status = *status;
+    if (status->state == DOGECOIN_BROADCAST_RELAYED) {
+        // drop everything with the next flush
+        broadcaster->tx_expiry = 0;
+    } else if (status->state == DOGECOIN_BROADCAST_EXPIRED && broadcaster_reports[DOGECOIN_BROADCAST_EXPIRED] == 3) {
+        dogecoin_broadcaster_stop(broadcaster);
+    }
+}
+
+/* the remote peer: requests two of the announced transactions and announces one back */
+static unsigned int broadcaster_peer_invs = 0;
+static unsigned int broadcaster_peer_txs = 0;
+static uint256_t broadcaster_peer_hashes[3];
+
+static void broadcaster_peer_read_cb(struct bufferevent* bev, void* ctx)
+{
+    const dogecoin_chainparams* chainparams = (const dogecoin_chainparams*)ctx;
+    struct evbuffer* input = bufferevent_get_input(bev);
+    while (evbuffer_get_length(input) >= DOGECOIN_P2P_HDRSZ) {
+        struct const_buffer hdr_buf = {evbuffer_pullup(input, DOGECOIN_P2P_HDRSZ), DOGECOIN_P2P_HDRSZ};
+        dogecoin_p2p_msg_hdr hdr;
+        dogecoin_p2p_deser_msghdr(&hdr, &hdr_buf);
+        if (evbuffer_get_length(input) < DOGECOIN_P2P_HDRSZ + hdr.data_len) return;
+        evbuffer_drain(input, DOGECOIN_P2P_HDRSZ);
+        unsigned char* data = dogecoin_malloc(hdr.data_len + 1);
+        evbuffer_remove(input, data, hdr.data_len);
+        struct const_buffer buf = {data, hdr.data_len};
+
+        const char* reply = NULL;
+        uint32_t count = 0;
+        if (strcmp(hdr.command, "inv") == 0) {
+            broadcaster_peer_invs++;
+            u_assert_int_eq(deser_varlen(&count, &buf), true);
+            u_assert_uint32_eq(count, 3);
+            unsigned int i;
+            for (i = 0; i < 3; i++) {
+                dogecoin_p2p_inv_msg inv;
+                u_assert_int_eq(dogecoin_p2p_msg_inv_deser(&inv, &buf), true);
+                u_assert_uint32_eq(inv.type, DOGECOIN_INV_TYPE_TX);
+                memcpy(broadcaster_peer_hashes[i], inv.hash, sizeof(uint256_t));
+            }
+            reply = "getdata";
+            count = 2;
+        } else if (strcmp(hdr.command, "tx") == 0) {
+            uint256_t hash;
+            dogecoin_hash(data, hdr.data_len, hash);
+            u_assert_mem_eq(hash, broadcaster_peer_hashes[broadcaster_peer_txs], sizeof(uint256_t));
+            if (++broadcaster_peer_txs == 2) {
+                reply = "inv";
+                count = 1;
+            }
+        }
+        if (reply) {
+            cstring* payload = cstr_new_sz(256);
+            ser_varlen(payload, count);
+            uint32_t i;
+            for (i = 0; i < count; i++) {
+                dogecoin_p2p_inv_msg inv;
+                dogecoin_p2p_msg_inv_init(&inv, DOGECOIN_INV_TYPE_TX, broadcaster_peer_hashes[i]);
+                dogecoin_p2p_msg_inv_ser(&inv, payload);
+            }
+            cstring* msg = dogecoin_p2p_message_new(chainparams->netmagic, reply, payload->str, payload->len);
+            bufferevent_write(bev, msg->str, msg->len);
+            cstr_free(msg, true);
+            cstr_free(payload, true);
+        }
+        dogecoin_free(data);
+    }
+}
+
+static void broadcaster_timeout_cb(evutil_socket_t fd, short event, void* ctx)
+{
+    (void)fd;
+    (void)event;
+    dogecoin_broadcaster_stop((dogecoin_broadcaster*)ctx);
+}
+
+void test_broadcaster()
+{
+    const char* raw_hex = "0100000001746007aed61e8531faba1af6610f10a5422c70a2a7eb6ffb51cb7a7b7b5e45b40100000000ffffffff0000000000";
+    unsigned char raw[64];
+    size_t raw_len = 0;
+    utils_hex_to_bin(raw_hex, raw, strlen(raw_hex), &raw_len);
+    dogecoin_tx* txs[3];
+    unsigned int i;
+    for (i = 0; i < 3; i++) {
+        txs[i] = dogecoin_tx_new();
+        u_assert_int_eq(dogecoin_tx_deserialize(raw, raw_len, txs[i], NULL), true);
+        txs[i]->locktime = i + 1;
+    }
+
+    // a connected peer next to a fixed peer that refuses connections
+    dogecoin_broadcaster* broadcaster = dogecoin_broadcaster_new(NULL, "127.0.0.1:1", 2, false);
+    u_assert_not_null(broadcaster);
+    broadcaster->inv_interval_ms = 20;
+    broadcaster->tx_status_cb = broadcaster_status_cb;
+    broadcaster->ctx = broadcaster;
+    dogecoin_node_group* group = broadcaster->group;
+
+    dogecoin_node* node = dogecoin_node_new();
+    dogecoin_node_set_ipport(node, "127.0.0.2:22556");
+    dogecoin_node_group_add_node(group, node);
+    struct bufferevent* pair[2];
+    u_assert_int_eq(bufferevent_pair_new(group->event_base, BEV_OPT_DEFER_CALLBACKS, pair), 0);
+    node->event_bev = pair[0];
+    node->state = NODE_CONNECTED;
+    node->version_handshake = true;
+    bufferevent_setcb(node->event_bev, read_cb, NULL, NULL, node);
+    bufferevent_enable(node->event_bev, EV_READ | EV_WRITE);
+    bufferevent_setcb(pair[1], broadcaster_peer_read_cb, NULL, NULL, (void*)group->chainparams);
+    bufferevent_enable(pair[1], EV_READ | EV_WRITE);
+
+    // submitted twice, tracked once
+    u_assert_int_eq(dogecoin_broadcaster_submit(broadcaster, (const dogecoin_tx* const*)txs, 3), true);
+    u_assert_int_eq(dogecoin_broadcaster_submit(broadcaster, (const dogecoin_tx* const*)txs, 1), true);
+    struct timeval tv = {10, 0};
+    struct event* timeout = evtimer_new(group->event_base, broadcaster_timeout_cb, broadcaster);
+    evtimer_add(timeout, &tv);
+    dogecoin_broadcaster_run(broadcaster);
+    event_free(timeout);
+
+    // one inv for the batch, two transactions served, one seen on the network
+    u_assert_uint32_eq(broadcaster_peer_invs, 1);
+    u_assert_uint32_eq(broadcaster_peer_txs, 2);
+    u_assert_uint32_eq(broadcaster_reports[DOGECOIN_BROADCAST_QUEUED], 3);
+    u_assert_uint32_eq(broadcaster_reports[DOGECOIN_BROADCAST_ANNOUNCED], 3);
+    u_assert_uint32_eq(broadcaster_reports[DOGECOIN_BROADCAST_REQUESTED], 2);
+    u_assert_uint32_eq(broadcaster_reports[DOGECOIN_BROADCAST_RELAYED], 1);
+    u_assert_uint32_eq(broadcaster_reports[DOGECOIN_BROADCAST_EXPIRED], 3);
+    u_assert_uint32_eq(broadcaster_last_status.announced_to, 1);
+    u_assert_uint32_eq(dogecoin_broadcaster_tracked(broadcaster), 0);
+    u_assert_int_eq(dogecoin_broadcaster_submit(broadcaster, (const dogecoin_tx* const*)txs, 1), false);
+    bufferevent_free(pair[1]);
+    dogecoin_broadcaster_free(broadcaster);
+
+    // on its own thread, submissions from this one
+    dogecoin_mem_zero(broadcaster_reports, sizeof(broadcaster_reports));
+    broadcaster = dogecoin_broadcaster_new(NULL, "127.0.0.1:1", 2, false);
+    broadcaster->tx_status_cb = broadcaster_status_cb;
+    broadcaster->ctx = broadcaster;
+    u_assert_int_eq(dogecoin_broadcaster_start(broadcaster), true);
+    u_assert_int_eq(dogecoin_broadcaster_submit_raw(broadcaster, raw, raw_len), true);
+    u_assert_int_eq(dogecoin_broadcaster_submit_raw(broadcaster, raw, raw_len - 1), false);
+    dogecoin_broadcaster_stop(broadcaster);
+    u_assert_uint32_eq(broadcaster_reports[DOGECOIN_BROADCAST_QUEUED], 1);
+    u_assert_uint32_eq(dogecoin_broadcaster_tracked(broadcaster), 1);
+    dogecoin_broadcaster_free(broadcaster);
+
+    for (i = 0; i < 3; i++) {
+        dogecoin_tx_free(txs[i]);
+    }
+}
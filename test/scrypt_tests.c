@@ -27,4 +27,62 @@ void test_scrypt() {
         scrypt_1024_1_1_256_sp_generic((const char*)&inputbytes[0], BEGIN(scrypthash), scratchpad);
         u_assert_str_eq(utils_uint8_to_hex(scrypthash, 32), expected[i]);
     }
+
+    // Test the multi lane kernels with 8 headers (the known inputs, repeated)
+    unsigned char batchinput[SCRYPT_MAX_LANES * 80];
+    unsigned char batchoutput[SCRYPT_MAX_LANES * 32];
+    for (i = 0; i < SCRYPT_MAX_LANES; i++) {
+        unsigned char* parsed = parse_hex(inputhex[i % HASHCOUNT]);
+        memcpy_safe(&batchinput[i * 80], parsed, 80);
+        dogecoin_free(parsed);
+    }
+    char* lanes_scratchpad = dogecoin_malloc(SCRYPT_LANES_SCRATCHPAD_SIZE(SCRYPT_MAX_LANES));
+#if defined(USE_SSE2)
+    scrypt_1024_1_1_256_sp_sse2_4way((const char*)batchinput, (char*)batchoutput, lanes_scratchpad);
+    for (i = 0; i < 4; i++) {
+        u_assert_str_eq(utils_uint8_to_hex(&batchoutput[i * 32], 32), expected[i % HASHCOUNT]);
+    }
+    if (scrypt_cpu_has_avx2()) {
+        scrypt_1024_1_1_256_sp_avx2_8way((const char*)batchinput, (char*)batchoutput, lanes_scratchpad);
+        for (i = 0; i < 8; i++) {
+            u_assert_str_eq(utils_uint8_to_hex(&batchoutput[i * 32], 32), expected[i % HASHCOUNT]);
+        }
+    }
+#endif
+
+    // Test the batch API with a count that doesn't fill all lanes
+    memset(batchoutput, 0, sizeof(batchoutput));
+    scrypt_1024_1_1_256_batch((const char*)batchinput, (char*)batchoutput, 7, scrypt_detect_lanes(), lanes_scratchpad);
+    for (i = 0; i < 7; i++) {
+        u_assert_str_eq(utils_uint8_to_hex(&batchoutput[i * 32], 32), expected[i % HASHCOUNT]);
+    }
+
+    // Every batch size, including partial last batches, matches the scalar hash for each kernel width
+    #define BATCHCOUNT (2 * SCRYPT_MAX_LANES - 1)
+    unsigned char sizedinput[BATCHCOUNT * 80];
+    unsigned char sizedoutput[BATCHCOUNT * 32];
+    unsigned char scalaroutput[BATCHCOUNT * 32];
+    for (i = 0; i < BATCHCOUNT; i++) {
+        unsigned char* parsed = parse_hex(inputhex[i % HASHCOUNT]);
+        memcpy_safe(&sizedinput[i * 80], parsed, 80);
+        dogecoin_free(parsed);
+        sizedinput[i * 80 + 76] ^= (unsigned char)i; // distinct nonces
+        scrypt_1024_1_1_256((const char*)&sizedinput[i * 80], (char*)&scalaroutput[i * 32]);
+    }
+    unsigned int widths[3] = { 1, 4, 8 };
+    unsigned int w;
+    for (w = 0; w < 3; w++) {
+#if defined(USE_SSE2)
+        if (widths[w] == 8 && !scrypt_cpu_has_avx2()) continue;
+#else
+        if (widths[w] > 1) continue;
+#endif
+        int count;
+        for (count = 1; count <= BATCHCOUNT; count++) {
+            memset(sizedoutput, 0, sizeof(sizedoutput));
+            scrypt_1024_1_1_256_batch((const char*)sizedinput, (char*)sizedoutput, count, widths[w], lanes_scratchpad);
+            u_assert_mem_eq(sizedoutput, scalaroutput, count * 32);
+        }
+    }
+    dogecoin_free(lanes_scratchpad);
 }
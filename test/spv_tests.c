@@ -36,8 +36,11 @@
 
 #include <dogecoin/arith_uint256.h>
 #include <dogecoin/block.h>
+#include <dogecoin/blocksync.h>
 #include <dogecoin/headersdb_file.h>
+#include <dogecoin/mem.h>
 #include <dogecoin/net.h>
+#include <dogecoin/serialize.h>
 #include <dogecoin/spv.h>
 #include <dogecoin/utils.h>
 #include <dogecoin/validation.h>
@@ -100,8 +103,9 @@ void test_reorg() {
     // Setup headers database file path for testing
     char* headersfile = "test_headers.db";
 
-    // Unlink the headers database file
+    // Unlink the headers database file and the block progress next to it
     unlink(headersfile);
+    unlink("test_headers_blocks.db");
 
     // Initialize SPV client
     dogecoin_spv_client* client = dogecoin_spv_client_new(chain, false, false, false, false, 8, NULL);
@@ -557,6 +561,12 @@ void test_reorg() {
     dogecoin_free(dogecoin_headers_db_connect_hdr(db, &cbuf_header5_fork_duplicate, false, &connected));
     u_assert_true (!connected);
 
+    // Remember the hashes of the expected main chain
+    uint256_t header1_hash, header2_fork_hash, header5_fork_hash;
+    dogecoin_block_header_hash(header1, header1_hash);
+    dogecoin_block_header_hash(header2_fork, header2_fork_hash);
+    dogecoin_block_header_hash(header5_fork, header5_fork_hash);
+
     // Cleanup
     cstr_free(cbuf_all, true);
     dogecoin_block_header_free(header1);
@@ -578,8 +588,286 @@ void test_reorg() {
     client->sync_completed = test_spv_sync_completed;
     dogecoin_spv_client_load(client, headersfile, false);
 
+    // The reorganized chain is served from the height indexed headers file
+    db = client->headers_db_ctx;
+    dogecoin_blockindex stored;
+    u_assert_int_eq(db->chaintip->height, 5);
+    u_assert_mem_eq(db->chaintip->hash, header5_fork_hash, DOGECOIN_HASH_LENGTH);
+    u_assert_true(dogecoin_headersdb_get_header_at_height(db, 2, &stored));
+    u_assert_int_eq(stored.height, 2);
+    u_assert_mem_eq(stored.hash, header2_fork_hash, DOGECOIN_HASH_LENGTH);
+    u_assert_true(dogecoin_headersdb_get_ancestor(db, db->chaintip, 1, &stored));
+    u_assert_mem_eq(stored.hash, header1_hash, DOGECOIN_HASH_LENGTH);
+    u_assert_true(!dogecoin_headersdb_get_header_at_height(db, 6, &stored));
+
+    // No block was processed, a parallel sync starts above genesis and not above the tip
+    u_assert_int_eq(client->blocks_processed_height, 0);
+    client->blocks_processed_height = 3;
+    client->blocks_processed_dirty = true;
+    dogecoin_spv_client_free(client);
+    client = dogecoin_spv_client_new(chain, false, false, false, false, 8, NULL);
+    dogecoin_spv_client_load(client, headersfile, false);
+    u_assert_int_eq(client->blocks_processed_height, 3);
+
     // Cleanup
     dogecoin_spv_client_free(client);
     remove_all_hashes();
     remove_all_maps();
 }
+
+static void test_append_mainnet_header(cstring* s, uint32_t timestamp, uint32_t nonce, const char* prevblock, const char* merkleroot) {
+    dogecoin_block_header* header = dogecoin_block_header_new();
+    char hex[65];
+    size_t outlen;
+    header->version = 1;
+    header->timestamp = timestamp;
+    header->nonce = nonce;
+    header->bits = 0x1e0ffff0;
+    memcpy(hex, prevblock, sizeof(hex));
+    utils_reverse_hex(hex, 64);
+    utils_hex_to_bin(hex, (uint8_t*) header->prev_block, 64, &outlen);
+    memcpy(hex, merkleroot, sizeof(hex));
+    utils_reverse_hex(hex, 64);
+    utils_hex_to_bin(hex, (uint8_t*) header->merkle_root, 64, &outlen);
+    dogecoin_block_header_serialize(s, header);
+    dogecoin_block_header_free(header);
+}
+
+static long test_file_size(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+static void test_group_commit(dogecoin_bool use_mmap) {
+    const dogecoin_chainparams* chain = &dogecoin_chainparams_main;
+    char* headersfile = "test_headers_batch.db";
+    const long file_hdr_len = 8;
+    unlink(headersfile);
+
+    // the first four mainnet headers
+    cstring* headers = cstr_new_sz(4 * 80);
+    test_append_mainnet_header(headers, 1386474927, 1417875456, "1a91e3dace36e2be3bf030a65679fe821aa1d6ef92e7c9902eb318182c355691", "5f7e779f7600f54e528686e91d5891f3ae226ee907f461692519e549105f521c");
+    test_append_mainnet_header(headers, 1386474933, 3404207872, "82bc68038f6034c0596b6e313729793a887fded6e92a31fbdf70863f89d9bea2", "3b14b76d22a3f2859d73316002bc1b9bfc7f37e2c3393be9b722b62bbd786983");
+    test_append_mainnet_header(headers, 1386474940, 3785361152, "ea5380659e02a68c073369e502125c634b2fb0aaf351b9360c673368c4f20c96", "1e10c28574e3b9d7032329b624ce4ac8064d0e91324aa14634aa2da61146ddfd");
+    test_append_mainnet_header(headers, 1386474943, 151130624, "76f80a8a81e6f6669d340651723b874f97395c4dbda200f8b024df4c6566a92c", "9f69a09b940fc7645b0a261e81a1f777e3e6514989eaf15bbc66759fa49b70c2");
+
+    dogecoin_headers_db* db = dogecoin_headers_db_new(chain, false);
+    db->use_mmap = use_mmap;
+    u_assert_true(dogecoin_headers_db_load(db, headersfile, false));
+
+    // nothing reaches the file until the batch is committed
+    dogecoin_headers_db_begin_batch(db);
+    struct const_buffer buf = {headers->str, headers->len};
+    int i;
+    for (i = 0; i < 4; i++) {
+        dogecoin_bool connected;
+        dogecoin_blockindex* pindex = dogecoin_headers_db_connect_hdr(db, &buf, false, &connected);
+        u_assert_true(connected);
+        u_assert_int_eq(pindex->height, i + 1);
+    }
+    u_assert_int_eq(test_file_size(headersfile), file_hdr_len);
+    u_assert_true(dogecoin_headers_db_commit_batch(db));
+    u_assert_int_eq(test_file_size(headersfile), file_hdr_len + 4 * DOGECOIN_HEADERS_DB_RECORD_SIZE);
+    dogecoin_headers_db_free(db);
+
+    // simulate a torn write: a damaged last record (height indexed files) and a partial trailing record
+    FILE* f = fopen(headersfile, "r+b");
+    uint8_t garbage[DOGECOIN_HEADERS_DB_RECORD_SIZE];
+    memset(garbage, 0, sizeof(garbage));
+    if (use_mmap) {
+        fseek(f, file_hdr_len + 3 * DOGECOIN_HEADERS_DB_RECORD_SIZE, SEEK_SET);
+        fwrite(garbage, DOGECOIN_HEADERS_DB_RECORD_SIZE, 1, f);
+    }
+    fseek(f, 0, SEEK_END);
+    fwrite(garbage, 50, 1, f);
+    fclose(f);
+
+    // reloading keeps the consistent prefix and new records are appended at a record boundary
+    uint32_t expected_height = use_mmap ? 3 : 4;
+    db = dogecoin_headers_db_new(chain, false);
+    u_assert_true(dogecoin_headers_db_load(db, headersfile, false));
+    u_assert_int_eq(db->chaintip->height, expected_height);
+    u_assert_int_eq(test_file_size(headersfile), file_hdr_len + expected_height * DOGECOIN_HEADERS_DB_RECORD_SIZE);
+    if (use_mmap) {
+        struct const_buffer buf4 = {headers->str + 3 * 80, 80};
+        dogecoin_bool connected;
+        dogecoin_headers_db_connect_hdr(db, &buf4, false, &connected);
+        u_assert_true(connected);
+        u_assert_int_eq(test_file_size(headersfile), file_hdr_len + 4 * DOGECOIN_HEADERS_DB_RECORD_SIZE);
+    }
+    dogecoin_headers_db_free(db);
+
+    cstr_free(headers, true);
+    unlink(headersfile);
+}
+
+void test_headers_db_group_commit() {
+    test_group_commit(true);
+    test_group_commit(false);
+}
+
+void test_headers_db_verify_pow_batch() {
+    const dogecoin_chainparams* chain = &dogecoin_chainparams_main;
+
+    // a headers message payload: the first four mainnet headers, each followed by a zero tx count
+    cstring* headers = cstr_new_sz(4 * 81);
+    test_append_mainnet_header(headers, 1386474927, 1417875456, "1a91e3dace36e2be3bf030a65679fe821aa1d6ef92e7c9902eb318182c355691", "5f7e779f7600f54e528686e91d5891f3ae226ee907f461692519e549105f521c");
+    cstr_append_c(headers, 0);
+    test_append_mainnet_header(headers, 1386474933, 3404207872, "82bc68038f6034c0596b6e313729793a887fded6e92a31fbdf70863f89d9bea2", "3b14b76d22a3f2859d73316002bc1b9bfc7f37e2c3393be9b722b62bbd786983");
+    cstr_append_c(headers, 0);
+    test_append_mainnet_header(headers, 1386474940, 3785361152, "ea5380659e02a68c073369e502125c634b2fb0aaf351b9360c673368c4f20c96", "1e10c28574e3b9d7032329b624ce4ac8064d0e91324aa14634aa2da61146ddfd");
+    cstr_append_c(headers, 0);
+    test_append_mainnet_header(headers, 1386474943, 151130624, "76f80a8a81e6f6669d340651723b874f97395c4dbda200f8b024df4c6566a92c", "9f69a09b940fc7645b0a261e81a1f777e3e6514989eaf15bbc66759fa49b70c2");
+    cstr_append_c(headers, 0);
+
+    // the next headers can be requested from the last hash before anything is validated
+    uint256_t last_hash, expected_hash;
+    struct const_buffer payload = {headers->str, headers->len};
+    u_assert_int_eq(dogecoin_headers_message_last_hash(&payload, 4, last_hash), true);
+    dogecoin_dblhash((const uint8_t*)headers->str + 3 * 81, 80, expected_hash);
+    u_assert_mem_eq(last_hash, expected_hash, sizeof(uint256_t));
+    u_assert_uint32_eq(payload.len, headers->len);
+    u_assert_int_eq(dogecoin_headers_message_last_hash(&payload, 5, last_hash), false);
+
+    int pass;
+    for (pass = 0; pass < 2; pass++) {
+        dogecoin_headers_db* db = dogecoin_headers_db_new(chain, true);
+        db->pow_threads = 2;
+        if (pass == 1) {
+            // break the proof of work of the third header (nonce)
+            headers->str[2 * 81 + 76] ^= 0x01;
+        }
+        struct const_buffer buf = {headers->str, headers->len};
+        u_assert_int_eq(dogecoin_headers_db_verify_pow_batch(db, &buf, 4), 4);
+        u_assert_int_eq(buf.len, headers->len);
+
+        int i;
+        for (i = 0; i < 4; i++) {
+            dogecoin_bool connected;
+            dogecoin_blockindex* pindex = dogecoin_headers_db_connect_hdr(db, &buf, false, &connected);
+            deser_skip(&buf, 1);
+            if (pass == 1 && i == 2) {
+                u_assert_true(!connected);
+                dogecoin_free(pindex);
+                break;
+            }
+            u_assert_true(connected);
+            u_assert_int_eq(pindex->height, i + 1);
+        }
+        u_assert_int_eq(db->chaintip->height, pass == 0 ? 4 : 2);
+
+        // already known headers are not verified again
+        buf.p = headers->str;
+        buf.len = headers->len;
+        u_assert_int_eq(dogecoin_headers_db_verify_pow_batch(db, &buf, 2), 0);
+        dogecoin_headers_db_free(db);
+    }
+    cstr_free(headers, true);
+}
+
+static dogecoin_bool test_scheduler_get_header(void *ctx, uint32_t height, dogecoin_blockindex *blockindex) {
+    uint32_t tip = *(uint32_t*)ctx;
+    if (height > tip) return false;
+    dogecoin_mem_zero(blockindex, sizeof(*blockindex));
+    blockindex->height = height;
+    memcpy(blockindex->hash, &height, sizeof(height));
+    return true;
+}
+
+static void test_scheduler_hash(uint32_t height, uint256_t hash) {
+    dogecoin_mem_zero(hash, sizeof(uint256_t));
+    memcpy(hash, &height, sizeof(height));
+}
+
+void test_block_scheduler() {
+    uint32_t tip = 100;
+    dogecoin_block_scheduler* scheduler = dogecoin_block_scheduler_new(11, 4, 8, 30, test_scheduler_get_header, &tip);
+    dogecoin_block_scheduler_set_target(scheduler, tip);
+
+    // two peers get consecutive ranges of their window size
+    cstring* inv = cstr_new_sz(256);
+    u_assert_uint32_eq(dogecoin_block_scheduler_assign(scheduler, 1, 100, 1000, inv), 4);
+    u_assert_uint32_eq(inv->len, 4 * 36);
+    uint256_t hash;
+    test_scheduler_hash(11, hash);
+    u_assert_mem_eq(inv->str + 4, hash, 32);
+    u_assert_uint32_eq(dogecoin_block_scheduler_assign(scheduler, 1, 100, 1000, inv), 0);
+    cstr_resize(inv, 0);
+    u_assert_uint32_eq(dogecoin_block_scheduler_assign(scheduler, 2, 100, 1000, inv), 4);
+    test_scheduler_hash(15, hash);
+    u_assert_mem_eq(inv->str + 4, hash, 32);
+    // the window is full, a third peer has to wait for blocks to be connected
+    u_assert_uint32_eq(dogecoin_block_scheduler_assign(scheduler, 3, 100, 1000, inv), 0);
+    u_assert_uint32_eq(dogecoin_block_scheduler_inflight(scheduler, 1), 4);
+
+    // out of order blocks wait in the reorder buffer
+    dogecoin_blockindex index;
+    uint8_t data[2] = {0xaa, 0xbb};
+    test_scheduler_hash(12, hash);
+    u_assert_int_eq(dogecoin_block_scheduler_block_received(scheduler, 1, hash, data, 2), true);
+    u_assert_is_null(dogecoin_block_scheduler_next(scheduler, &index, NULL));
+    test_scheduler_hash(11, hash);
+    // a reassigned block may come from another peer than the one it was requested from
+    int nodeid = 0;
+    u_assert_int_eq(dogecoin_block_scheduler_block_received(scheduler, 2, hash, data, 1), true);
+    cstring* block = dogecoin_block_scheduler_next(scheduler, &index, &nodeid);
+    u_assert_uint32_eq(index.height, 11);
+    u_assert_int_eq(nodeid, 2);
+    u_assert_uint32_eq(block->len, 1);
+    cstr_free(block, true);
+    block = dogecoin_block_scheduler_next(scheduler, &index, NULL);
+    u_assert_uint32_eq(index.height, 12);
+    u_assert_uint32_eq(block->len, 2);
+    cstr_free(block, true);
+    u_assert_is_null(dogecoin_block_scheduler_next(scheduler, &index, NULL));
+    test_scheduler_hash(200, hash);
+    u_assert_int_eq(dogecoin_block_scheduler_block_received(scheduler, 1, hash, data, 2), false);
+
+    // the window moved, the free slots go to the third peer
+    cstr_resize(inv, 0);
+    u_assert_uint32_eq(dogecoin_block_scheduler_assign(scheduler, 3, 100, 1000, inv), 2);
+    test_scheduler_hash(19, hash);
+    u_assert_mem_eq(inv->str + 4, hash, 32);
+
+    // stalled blocks go back to the pending set, the stalled block is requested first
+    u_assert_uint32_eq(dogecoin_block_scheduler_check_stalls(scheduler, 1029), 0);
+    u_assert_uint32_eq(dogecoin_block_scheduler_check_stalls(scheduler, 1030), 8);
+    cstr_resize(inv, 0);
+    u_assert_uint32_eq(dogecoin_block_scheduler_assign(scheduler, 3, 100, 1030, inv), 4);
+    test_scheduler_hash(13, hash);
+    u_assert_mem_eq(inv->str + 4, hash, 32);
+
+    // a disconnected peer releases its blocks, peers only get heights they have
+    dogecoin_block_scheduler_release_node(scheduler, 3);
+    u_assert_uint32_eq(dogecoin_block_scheduler_inflight(scheduler, 3), 0);
+    cstr_resize(inv, 0);
+    u_assert_uint32_eq(dogecoin_block_scheduler_assign(scheduler, 4, 14, 1030, inv), 2);
+
+    // a reorg drops the blocks above the fork
+    test_scheduler_hash(13, hash);
+    u_assert_int_eq(dogecoin_block_scheduler_block_received(scheduler, 1, hash, data, 2), true);
+    dogecoin_block_scheduler_rewind(scheduler, 13);
+    u_assert_is_null(dogecoin_block_scheduler_next(scheduler, &index, NULL));
+    u_assert_int_eq(dogecoin_block_scheduler_done(scheduler), true);
+    dogecoin_block_scheduler_set_target(scheduler, 14);
+    u_assert_int_eq(dogecoin_block_scheduler_done(scheduler), false);
+    cstr_resize(inv, 0);
+    u_assert_uint32_eq(dogecoin_block_scheduler_assign(scheduler, 1, 100, 1040, inv), 2);
+    test_scheduler_hash(13, hash);
+    u_assert_int_eq(dogecoin_block_scheduler_block_received(scheduler, 1, hash, data, 2), true);
+    test_scheduler_hash(14, hash);
+    u_assert_int_eq(dogecoin_block_scheduler_block_received(scheduler, 1, hash, data, 2), true);
+    block = dogecoin_block_scheduler_next(scheduler, &index, NULL);
+    cstr_free(block, true);
+    block = dogecoin_block_scheduler_next(scheduler, &index, NULL);
+    u_assert_uint32_eq(index.height, 14);
+    cstr_free(block, true);
+    u_assert_int_eq(dogecoin_block_scheduler_done(scheduler), true);
+
+    cstr_free(inv, true);
+    dogecoin_block_scheduler_free(scheduler);
+}
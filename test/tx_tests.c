@@ -816,6 +816,101 @@ void test_tx_serialization()
 
 }
 
+void test_tx_view()
+{
+    unsigned int i;
+    dogecoin_tx_view view;
+    dogecoin_tx_view_init(&view);
+    for (i = 0; i < (sizeof(txvalid) / sizeof(txvalid[0])); i++) {
+        const struct txtest* one_test = &txvalid[i];
+        uint8_t tx_data[sizeof(one_test->hextx) / 2];
+        size_t outlen, consumed = 0;
+        utils_hex_to_bin(one_test->hextx, tx_data, strlen(one_test->hextx), &outlen);
+
+        dogecoin_tx* tx = dogecoin_tx_new();
+        u_assert_int_eq(dogecoin_tx_deserialize(tx_data, outlen, tx, NULL), true);
+
+        // the view is reused for every transaction
+        u_assert_int_eq(dogecoin_tx_view_parse(&view, tx_data, outlen, &consumed), true);
+        u_assert_uint32_eq(consumed, outlen);
+        u_assert_int_eq(view.version, tx->version);
+        u_assert_uint32_eq(view.locktime, tx->locktime);
+        u_assert_uint32_eq(view.vin_count, tx->vin->len);
+        u_assert_uint32_eq(view.vout_count, tx->vout->len);
+
+        size_t j;
+        for (j = 0; j < tx->vin->len; j++) {
+            dogecoin_tx_in* tx_in = vector_idx(tx->vin, j);
+            dogecoin_tx_outpoint prevout;
+            const uint8_t* script;
+            size_t script_len;
+            uint32_t sequence;
+            u_assert_int_eq(dogecoin_tx_view_get_prevout(&view, j, &prevout), true);
+            u_assert_mem_eq(prevout.hash, tx_in->prevout.hash, sizeof(uint256_t));
+            u_assert_uint32_eq(prevout.n, tx_in->prevout.n);
+            u_assert_int_eq(dogecoin_tx_view_get_script_sig(&view, j, &script, &script_len), true);
+            u_assert_uint32_eq(script_len, tx_in->script_sig->len);
+            u_assert_mem_eq(script, tx_in->script_sig->str, script_len);
+            u_assert_int_eq(dogecoin_tx_view_get_sequence(&view, j, &sequence), true);
+            u_assert_uint32_eq(sequence, tx_in->sequence);
+        }
+        for (j = 0; j < tx->vout->len; j++) {
+            dogecoin_tx_out* tx_out = vector_idx(tx->vout, j);
+            const uint8_t* script;
+            size_t script_len;
+            int64_t value;
+            u_assert_int_eq(dogecoin_tx_view_get_value(&view, j, &value), true);
+            u_assert_int_eq(value == tx_out->value, true);
+            u_assert_int_eq(dogecoin_tx_view_get_script_pubkey(&view, j, &script, &script_len), true);
+            u_assert_uint32_eq(script_len, tx_out->script_pubkey->len);
+            u_assert_mem_eq(script, tx_out->script_pubkey->str, script_len);
+        }
+        // out of range access is rejected
+        int64_t value;
+        u_assert_int_eq(dogecoin_tx_view_get_value(&view, view.vout_count, &value), false);
+
+        uint256_t hash_tx, hash_view;
+        dogecoin_tx_hash(tx, hash_tx);
+        dogecoin_tx_view_hash(&view, hash_view);
+        u_assert_mem_eq(hash_tx, hash_view, sizeof(uint256_t));
+
+        dogecoin_tx* tx_view = dogecoin_tx_new();
+        u_assert_int_eq(dogecoin_tx_view_to_tx(&view, tx_view), true);
+        cstring* ser = cstr_new_sz(outlen);
+        dogecoin_tx_serialize(ser, tx_view);
+        u_assert_uint32_eq(ser->len, outlen);
+        u_assert_mem_eq(ser->str, tx_data, outlen);
+        cstr_free(ser, true);
+        dogecoin_tx_free(tx_view);
+
+        // truncated transactions fail to parse
+        u_assert_int_eq(dogecoin_tx_view_parse(&view, tx_data, outlen - 1, &consumed), false);
+        u_assert_uint32_eq(consumed, 0);
+        dogecoin_tx_free(tx);
+    }
+
+    // witness serialization, the txid skips marker, flag and witness stacks
+    const struct txtest* one_test = &txvalid[0];
+    uint8_t tx_data[sizeof(one_test->hextx) / 2];
+    size_t outlen, consumed;
+    utils_hex_to_bin(one_test->hextx, tx_data, strlen(one_test->hextx), &outlen);
+    cstring* wit = cstr_new_sz(outlen + 16);
+    cstr_append_buf(wit, tx_data, 4);
+    cstr_append_buf(wit, "\x00\x01", 2);
+    cstr_append_buf(wit, tx_data + 4, outlen - 8);
+    cstr_append_buf(wit, "\x01\x02\xab\xcd", 4); // one input, one stack item
+    cstr_append_buf(wit, tx_data + outlen - 4, 4);
+    u_assert_int_eq(dogecoin_tx_view_parse(&view, (const unsigned char*)wit->str, wit->len, &consumed), true);
+    u_assert_uint32_eq(consumed, wit->len);
+    uint256_t hash_legacy, hash_wit;
+    dogecoin_tx_view_hash(&view, hash_wit);
+    u_assert_int_eq(dogecoin_tx_view_parse(&view, tx_data, outlen, &consumed), true);
+    dogecoin_tx_view_hash(&view, hash_legacy);
+    u_assert_mem_eq(hash_wit, hash_legacy, sizeof(uint256_t));
+    cstr_free(wit, true);
+    dogecoin_tx_view_free(&view);
+}
+
 void test_tx_sighash_ext()
 {
     //extended sighash tests
@@ -45,6 +45,10 @@ extern void test_bip32();
 extern void test_bip39();
 extern void test_bip44();
 extern void test_block_header();
+extern void test_block_txs_merkle_root();
+extern void test_blockindex_map();
+extern void test_bloom();
+extern void test_merkleblock();
 extern void test_buffer();
 extern void test_chacha20();
 extern void test_cstr();
@@ -69,6 +73,7 @@ extern void test_signmsg_ext();
 extern void test_tpm();
 extern void test_transaction();
 extern void test_tx_serialization();
+extern void test_tx_view();
 extern void test_tx_sighash();
 extern void test_tx_sighash_ext();
 extern void test_tx_negative_version();
@@ -91,6 +96,13 @@ extern void test_examples();
 #ifdef WITH_WALLET
 extern void test_wallet_basics();
 extern void test_wallet();
+extern void test_wallet_prefilter();
+extern void test_wallet_utxo_index();
+extern void test_wallet_handle();
+extern void test_wallet_compact();
+extern void test_wallet_remove_address_utxos();
+extern void test_wallet_fast_load();
+extern void test_wallet_block_undo();
 #endif
 
 #ifdef WITH_TOOLS
@@ -99,9 +111,19 @@ extern void test_tool();
 
 #ifdef WITH_NET
 extern void test_net_basics_plus_download_block();
+extern void test_net_read_framing();
+extern void test_net_send_framing();
+extern void test_net_worker();
+extern void test_net_quit_on_stdin();
+extern void test_addrman();
+extern void test_net_dns_seeds();
+extern void test_broadcaster();
 extern void test_protocol();
 extern void test_net_flag_defined();
 extern void test_reorg();
+extern void test_block_scheduler();
+extern void test_headers_db_group_commit();
+extern void test_headers_db_verify_pow_batch();
 extern void test_spv();
 #else
 extern void test_net_flag_not_defined();
@@ -128,6 +150,10 @@ int main()
     u_run_test(test_bip44);
 #endif
     u_run_test(test_block_header);
+    u_run_test(test_block_txs_merkle_root);
+    u_run_test(test_blockindex_map);
+    u_run_test(test_bloom);
+    u_run_test(test_merkleblock);
     u_run_test(test_buffer);
     u_run_test(test_chacha20);
     u_run_test(test_cstr);
@@ -154,6 +180,7 @@ int main()
 #endif
     u_run_test(test_transaction);
     u_run_test(test_tx_serialization);
+    u_run_test(test_tx_view);
     u_run_test(test_invalid_tx_deser);
     u_run_test(test_tx_sign);
     u_run_test(test_tx_sighash);
@@ -176,6 +203,13 @@ int main()
 #ifdef WITH_WALLET
     u_run_test(test_wallet_basics);
     u_run_test(test_wallet);
+    u_run_test(test_wallet_prefilter);
+    u_run_test(test_wallet_utxo_index);
+    u_run_test(test_wallet_handle);
+    u_run_test(test_wallet_compact);
+    u_run_test(test_wallet_remove_address_utxos);
+    u_run_test(test_wallet_fast_load);
+    u_run_test(test_wallet_block_undo);
 #endif
 
 #ifdef WITH_TOOLS
@@ -185,8 +219,18 @@ int main()
 #ifdef WITH_NET
     u_run_test(test_net_flag_defined);
     u_run_test(test_net_basics_plus_download_block);
+    u_run_test(test_net_read_framing);
+    u_run_test(test_net_send_framing);
+    u_run_test(test_net_worker);
+    u_run_test(test_net_quit_on_stdin);
+    u_run_test(test_addrman);
+    u_run_test(test_net_dns_seeds);
+    u_run_test(test_broadcaster);
     u_run_test(test_protocol);
     u_run_test(test_reorg);
+    u_run_test(test_block_scheduler);
+    u_run_test(test_headers_db_group_commit);
+    u_run_test(test_headers_db_verify_pow_batch);
     u_run_test(test_spv);
 #else
     u_run_test(test_net_flag_not_defined);
@@ -19,6 +19,8 @@ static const char *wallettmpfile = "/tmp/dummy";
 #endif
 #endif
 
+#include <sys/stat.h>
+
 #include <test/utest.h>
 
 #include <logdb/logdb.h>
@@ -256,3 +258,673 @@ void test_wallet_basics()
     dogecoin_wallet_flush(wallet);
     dogecoin_wallet_free(wallet);
 }
+
+void test_wallet_prefilter()
+{
+    unlink(wallettmpfile);
+    dogecoin_wallet *wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    int error;
+    dogecoin_bool created;
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+
+    // an empty wallet never matches
+    uint8_t zero[64] = {0};
+    u_assert_int_eq(dogecoin_wallet_prefilter_match(wallet, zero, sizeof(zero)), false);
+
+    dogecoin_wallet_addr *waddr = dogecoin_wallet_addr_new();
+    size_t outlen = 0;
+    utils_hex_to_bin("e195b669de8e49f955749033fa2d79390732c435", waddr->pubkeyhash, 40, &outlen);
+    dogecoin_btree_tsearch(waddr, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
+    vector_add(wallet->waddr_vector, waddr);
+    wallet->waddr_generation++;
+
+    // the hash160 is found at any offset, but not if it is cut off
+    uint8_t raw[64] = {0};
+    memcpy(raw + 13, waddr->pubkeyhash, sizeof(uint160_t));
+    u_assert_int_eq(dogecoin_wallet_prefilter_match(wallet, raw, sizeof(raw)), true);
+    u_assert_int_eq(dogecoin_wallet_prefilter_match(wallet, raw, 13 + sizeof(uint160_t) - 1), false);
+
+    unsigned int i, matches = 0;
+    for (i = 0; i < sizeof (wallet_txns) / sizeof (wallet_txns[0]); i++) {
+        uint8_t* tx_data = dogecoin_uint8_vla(strlen(wallet_txns[i])/2+2);
+        utils_hex_to_bin(wallet_txns[i], tx_data, strlen(wallet_txns[i]), &outlen);
+
+        dogecoin_wtx* wtx = dogecoin_wallet_wtx_new();
+        dogecoin_tx_deserialize(tx_data, outlen, wtx->tx, NULL);
+
+        // every relevant transaction must pass the pre-filter
+        dogecoin_bool relevant = dogecoin_wallet_is_mine(wallet, wtx->tx) || dogecoin_wallet_is_from_me(wallet, wtx->tx);
+        dogecoin_bool match = dogecoin_wallet_prefilter_match(wallet, tx_data, outlen);
+        u_assert_int_eq(match, relevant);
+        if (match) matches++;
+        dogecoin_free(tx_data);
+
+        dogecoin_wallet_add_wtx_move(wallet, wtx);
+    }
+    u_assert_int_eq(matches > 0, true);
+
+    // txids of known transactions are picked up to catch spends
+    dogecoin_wtx* wtx = vector_idx(wallet->vec_wtxes, 0);
+    memcpy(raw + 5, wtx->tx_hash_cache, sizeof(uint256_t));
+    u_assert_int_eq(dogecoin_wallet_prefilter_match(wallet, raw, 5 + sizeof(uint256_t)), true);
+
+    // swapping an address keeps the address count, the filter still has to follow
+    uint8_t old_raw[sizeof(uint160_t)];
+    memcpy(old_raw, waddr->pubkeyhash, sizeof(uint160_t));
+    char old_addr[35];
+    u_assert_int_eq(dogecoin_p2pkh_addr_from_hash160(waddr->pubkeyhash, &dogecoin_chainparams_main, old_addr, sizeof(old_addr)), true);
+    u_assert_int_eq(dogecoin_wallet_remove_address(wallet, old_addr), true);
+    dogecoin_wallet_addr *swapped = dogecoin_wallet_addr_new();
+    utils_hex_to_bin("1f0a1fd6cb51b0a3a3ba1d9f0b9a8be0d8c2f6a4", swapped->pubkeyhash, 40, &outlen);
+    dogecoin_btree_tsearch(swapped, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
+    vector_add(wallet->waddr_vector, swapped);
+    wallet->waddr_generation++;
+    u_assert_int_eq(dogecoin_wallet_prefilter_match(wallet, old_raw, sizeof(old_raw)), false);
+    u_assert_int_eq(dogecoin_wallet_prefilter_match(wallet, swapped->pubkeyhash, sizeof(uint160_t)), true);
+
+    dogecoin_wallet_free(wallet);
+}
+
+void test_wallet_utxo_index()
+{
+    unlink(wallettmpfile);
+    dogecoin_wallet *wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    int error;
+    dogecoin_bool created;
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+
+    dogecoin_wallet_addr *waddr = dogecoin_wallet_addr_new();
+    size_t outlen = 0;
+    utils_hex_to_bin("e195b669de8e49f955749033fa2d79390732c435", waddr->pubkeyhash, 40, &outlen);
+    dogecoin_btree_tsearch(waddr, &wallet->waddr_rbtree, dogecoin_wallet_addr_compare);
+    vector_add(wallet->waddr_vector, waddr);
+
+    unsigned int i;
+    for (i = 0; i < sizeof (wallet_txns) / sizeof (wallet_txns[0]); i++) {
+        uint8_t* tx_data = dogecoin_uint8_vla(strlen(wallet_txns[i])/2+2);
+        utils_hex_to_bin(wallet_txns[i], tx_data, strlen(wallet_txns[i]), &outlen);
+        dogecoin_wtx* wtx = dogecoin_wallet_wtx_new();
+        dogecoin_tx_deserialize(tx_data, outlen, wtx->tx, NULL);
+        dogecoin_free(tx_data);
+        wtx->height = i + 1;
+        dogecoin_wallet_scrape_utxos(wallet, wtx);
+        // scraping twice must not duplicate utxos
+        dogecoin_wallet_scrape_utxos(wallet, wtx);
+        dogecoin_wallet_add_wtx_move(wallet, wtx);
+    }
+
+    // raw hash160 membership
+    uint160_t other = {0};
+    u_assert_int_eq(dogecoin_wallet_have_key(wallet, waddr->pubkeyhash), true);
+    u_assert_int_eq(dogecoin_wallet_have_key(wallet, other), false);
+
+    // every utxo is reachable through its outpoint and carries the base58 address
+    char p2pkh[P2PKHLEN];
+    dogecoin_p2pkh_addr_from_hash160(waddr->pubkeyhash, &dogecoin_chainparams_main, p2pkh, P2PKHLEN);
+    unsigned int count = 0;
+    dogecoin_utxo* utxo;
+    dogecoin_utxo* tmp;
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+        u_assert_int_eq(find_dogecoin_utxo_by_outpoint(wallet, utxo->txid, utxo->vout) == utxo, true);
+        char utxo_address[P2PKHLEN];
+        u_assert_int_eq(dogecoin_utxo_get_address(utxo, &dogecoin_chainparams_main, utxo_address, sizeof(utxo_address)), true);
+        u_assert_str_eq(utxo_address, p2pkh);
+        u_assert_int_eq(utxo->script_type, DOGECOIN_TX_PUBKEYHASH);
+        u_assert_mem_eq(utxo->hash160, waddr->pubkeyhash, sizeof(uint160_t));
+        count++;
+    }
+    u_assert_int_eq(count > 0, true);
+
+    // strings are only produced on output
+    char script_hex[SCRIPT_PUBKEY_STRINGLEN];
+    char amount_str[KOINU_STRINGLEN];
+    char expected_amount[KOINU_STRINGLEN];
+    utxo = wallet->utxos;
+    u_assert_int_eq(dogecoin_utxo_get_script_pubkey_hex(utxo, script_hex, sizeof(script_hex)), true);
+    u_assert_str_eq(script_hex, "76a914e195b669de8e49f955749033fa2d79390732c43588ac");
+    dogecoin_utxo_get_amount_str(utxo, amount_str);
+    dogecoin_mem_zero(expected_amount, sizeof(expected_amount));
+    koinu_to_coins_str((uint64_t)utxo->koinu, expected_amount);
+    u_assert_str_eq(amount_str, expected_amount);
+    u_assert_int_eq(coins_to_koinu_str(amount_str) == (uint64_t)utxo->koinu, true);
+
+    // running totals match a full pass over the unspent utxos
+    int64_t unspent_total = 0;
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+        if (utxo->spendable) unspent_total += utxo->koinu;
+    }
+    dogecoin_balance balance, address_balance;
+    dogecoin_wallet_utxos_get_balance(wallet, &balance);
+    u_assert_int_eq(balance.total == unspent_total, true);
+    u_assert_int_eq(balance.confirmed == unspent_total, true);
+    u_assert_int_eq(dogecoin_wallet_utxos_get_address_balance(wallet, p2pkh, &address_balance), true);
+    u_assert_int_eq(address_balance.total == unspent_total, true);
+    u_assert_int_eq(dogecoin_wallet_utxos_get_address_balance(wallet, "DUnknownAddress", &address_balance), false);
+    u_assert_int_eq(address_balance.total, 0);
+    uint256_t unknown = {0};
+    unknown[0] = 0xff;
+    u_assert_is_null(find_dogecoin_utxo_by_outpoint(wallet, unknown, 0));
+
+    // spending an indexed outpoint marks it as spent
+    utxo = wallet->utxos;
+    dogecoin_wtx* spend = dogecoin_wallet_wtx_new();
+    dogecoin_tx_in* tx_in = dogecoin_tx_in_new();
+    unsigned int j;
+    for (j = 0; j < sizeof(uint256_t); j++) {
+        tx_in->prevout.hash[j] = utxo->txid[sizeof(uint256_t) - 1 - j];
+    }
+    tx_in->prevout.n = utxo->vout;
+    vector_add(spend->tx->vin, tx_in);
+    u_assert_int_eq(utxo->spendable, true);
+    dogecoin_wallet_scrape_utxos(wallet, spend);
+    u_assert_int_eq(utxo->spendable, false);
+    dogecoin_wallet_wtx_free(spend);
+    dogecoin_wallet_utxos_get_balance(wallet, &balance);
+    u_assert_int_eq(balance.total == unspent_total - utxo->koinu, true);
+    unspent_total = balance.total;
+
+    // the BIP37 filter covers the watched key and the unspent outpoints only
+    dogecoin_bloom_filter* filter = dogecoin_wallet_bloom_filter_new(wallet, 0.0001, 0);
+    u_assert_int_eq(dogecoin_bloom_filter_contains(filter, waddr->pubkeyhash, sizeof(uint160_t)), true);
+    u_assert_int_eq(dogecoin_bloom_filter_contains(filter, other, sizeof(uint160_t)), false);
+    uint8_t outpoint[36];
+    for (j = 0; j < sizeof(uint256_t); j++) {
+        outpoint[j] = utxo->txid[sizeof(uint256_t) - 1 - j];
+    }
+    outpoint[32] = (uint8_t)utxo->vout;
+    outpoint[33] = (uint8_t)(utxo->vout >> 8);
+    outpoint[34] = (uint8_t)(utxo->vout >> 16);
+    outpoint[35] = (uint8_t)(utxo->vout >> 24);
+    u_assert_int_eq(dogecoin_bloom_filter_contains(filter, outpoint, sizeof(outpoint)), false);
+    dogecoin_utxo* unspent = NULL;
+    HASH_ITER(hh, wallet->utxos, unspent, tmp) {
+        if (unspent->spendable) break;
+    }
+    for (j = 0; j < sizeof(uint256_t); j++) {
+        outpoint[j] = unspent->txid[sizeof(uint256_t) - 1 - j];
+    }
+    outpoint[32] = (uint8_t)unspent->vout;
+    outpoint[33] = (uint8_t)(unspent->vout >> 8);
+    outpoint[34] = (uint8_t)(unspent->vout >> 16);
+    outpoint[35] = (uint8_t)(unspent->vout >> 24);
+    u_assert_int_eq(dogecoin_bloom_filter_contains(filter, outpoint, sizeof(outpoint)), true);
+    dogecoin_bloom_filter_free(filter);
+
+    // coinbase outputs stay immature for COINBASE_MATURITY blocks
+    dogecoin_wtx* coinbase = dogecoin_wallet_wtx_new();
+    tx_in = dogecoin_tx_in_new();
+    tx_in->prevout.n = UINT32_MAX;
+    vector_add(coinbase->tx->vin, tx_in);
+    dogecoin_tx_add_p2pkh_hash160_out(coinbase->tx, 1000, waddr->pubkeyhash);
+    coinbase->height = 10;
+    dogecoin_wallet_scrape_utxos(wallet, coinbase);
+    dogecoin_wallet_utxos_update_confirmations(wallet, 108);
+    dogecoin_wallet_utxos_get_balance(wallet, &balance);
+    u_assert_int_eq(balance.immature, 1000);
+    u_assert_int_eq(balance.total == unspent_total + 1000, true);
+    dogecoin_wallet_utxos_update_confirmations(wallet, 109);
+    dogecoin_wallet_utxos_get_balance(wallet, &balance);
+    u_assert_int_eq(balance.immature, 0);
+    u_assert_int_eq(balance.confirmed == unspent_total + 1000, true);
+    dogecoin_wallet_wtx_free(coinbase);
+
+    dogecoin_wallet_free(wallet);
+}
+
+void test_wallet_handle()
+{
+    unlink(wallettmpfile);
+    dogecoin_wallet *wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    int error;
+    dogecoin_bool created;
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+    u_assert_str_eq(wallet->filename, wallettmpfile);
+
+    dogecoin_hdnode node;
+    u_assert_int_eq(dogecoin_hdnode_deserialize("dgub8kXBZ7ymNWy2T7WH3WgpGDv6htHqBEPU8bymfvJeHNJaBT65E2EjemjSx6ggYmaMDfnSrtJWbafCJu2b1voNTARsyhCULtT8d8MH2MQwCqV", &dogecoin_chainparams_main, &node), true);
+    dogecoin_wallet_set_master_key_copy(wallet, &node);
+
+    // watch the address used by the sample transactions
+    uint160_t hash160;
+    size_t outlen = 0;
+    utils_hex_to_bin("e195b669de8e49f955749033fa2d79390732c435", hash160, 40, &outlen);
+    char p2pkh[P2PKHLEN];
+    dogecoin_p2pkh_addr_from_hash160(hash160, &dogecoin_chainparams_main, p2pkh, P2PKHLEN);
+    u_assert_not_null(dogecoin_p2pkh_address_to_wallet(p2pkh, wallet));
+
+    unsigned int i;
+    for (i = 0; i < sizeof (wallet_txns) / sizeof (wallet_txns[0]); i++) {
+        uint8_t* tx_data = dogecoin_uint8_vla(strlen(wallet_txns[i])/2+2);
+        utils_hex_to_bin(wallet_txns[i], tx_data, strlen(wallet_txns[i]), &outlen);
+        dogecoin_wtx* wtx = dogecoin_wallet_wtx_new();
+        dogecoin_tx_deserialize(tx_data, outlen, wtx->tx, NULL);
+        dogecoin_free(tx_data);
+        wtx->height = i + 1;
+        dogecoin_wallet_add_wtx_move(wallet, wtx);
+    }
+    dogecoin_wallet_flush(wallet);
+
+    // the handle picks up the records from the file and keeps its file name
+    u_assert_int_eq(dogecoin_wallet_refresh(wallet), true);
+    u_assert_str_eq(wallet->filename, wallettmpfile);
+
+    unsigned int count = 0;
+    int64_t unspent_total = 0;
+    dogecoin_utxo* utxo;
+    dogecoin_utxo* tmp;
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+        if (!utxo->spendable || memcmp(utxo->hash160, hash160, sizeof(uint160_t)) != 0) continue;
+        count++;
+        // the n-th unspent utxo of the address is served in table order
+        u_assert_int_eq(dogecoin_wallet_address_utxo(wallet, p2pkh, count) == utxo, true);
+        unspent_total += utxo->koinu;
+    }
+    u_assert_int_eq(count > 0, true);
+    u_assert_uint32_eq(dogecoin_wallet_address_utxos_length(wallet, p2pkh), count);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == (uint64_t)unspent_total, true);
+    u_assert_is_null(dogecoin_wallet_address_utxo(wallet, p2pkh, 0));
+    u_assert_is_null(dogecoin_wallet_address_utxo(wallet, p2pkh, count + 1));
+    u_assert_uint32_eq(dogecoin_wallet_address_utxos_length(wallet, "DUnknownAddress"), 0);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, "DUnknownAddress"), 0);
+
+    // the unspent lists follow spends without a reload
+    utxo = dogecoin_wallet_address_utxo(wallet, p2pkh, 1);
+    dogecoin_wtx* spend = dogecoin_wallet_wtx_new();
+    dogecoin_tx_in* tx_in = dogecoin_tx_in_new();
+    unsigned int j;
+    for (j = 0; j < sizeof(uint256_t); j++) {
+        tx_in->prevout.hash[j] = utxo->txid[sizeof(uint256_t) - 1 - j];
+    }
+    tx_in->prevout.n = utxo->vout;
+    vector_add(spend->tx->vin, tx_in);
+    dogecoin_wallet_scrape_utxos(wallet, spend);
+    dogecoin_wallet_wtx_free(spend);
+    u_assert_uint32_eq(dogecoin_wallet_address_utxos_length(wallet, p2pkh), count - 1);
+    u_assert_int_eq(dogecoin_wallet_address_utxo(wallet, p2pkh, 1) != utxo, true);
+
+    // refreshing again reloads the same state without duplicates
+    u_assert_int_eq(dogecoin_wallet_refresh(wallet), true);
+    u_assert_uint32_eq(dogecoin_wallet_address_utxos_length(wallet, p2pkh), count);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == (uint64_t)unspent_total, true);
+
+    // other wallets keep their own utxo table, freeing one leaves the handle intact
+    dogecoin_wallet* other = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    dogecoin_wallet_free(other);
+    u_assert_uint32_eq(dogecoin_wallet_address_utxos_length(wallet, p2pkh), count);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == (uint64_t)unspent_total, true);
+
+    dogecoin_wallet_close(wallet);
+}
+
+static long wallet_file_size(const char* path)
+{
+    struct stat buffer;
+    if (stat(path, &buffer) != 0) return -1;
+    return (long)buffer.st_size;
+}
+
+static uint32_t wallet_file_version(const char* path)
+{
+    uint8_t hdr[8];
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    size_t read = fread(hdr, sizeof(hdr), 1, f);
+    fclose(f);
+    if (read != 1) return 0;
+    return hdr[4] | (hdr[5] << 8) | (hdr[6] << 16) | ((uint32_t)hdr[7] << 24);
+}
+
+void test_wallet_compact()
+{
+    unlink(wallettmpfile);
+    dogecoin_wallet *wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    int error;
+    dogecoin_bool created;
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+
+    dogecoin_hdnode node;
+    u_assert_int_eq(dogecoin_hdnode_deserialize("dgub8kXBZ7ymNWy2T7WH3WgpGDv6htHqBEPU8bymfvJeHNJaBT65E2EjemjSx6ggYmaMDfnSrtJWbafCJu2b1voNTARsyhCULtT8d8MH2MQwCqV", &dogecoin_chainparams_main, &node), true);
+    dogecoin_wallet_set_master_key_copy(wallet, &node);
+
+    uint160_t hash160;
+    size_t outlen = 0;
+    utils_hex_to_bin("e195b669de8e49f955749033fa2d79390732c435", hash160, 40, &outlen);
+    char p2pkh[P2PKHLEN];
+    dogecoin_p2pkh_addr_from_hash160(hash160, &dogecoin_chainparams_main, p2pkh, P2PKHLEN);
+    u_assert_not_null(dogecoin_p2pkh_address_to_wallet(p2pkh, wallet));
+
+    // every transaction gets written twice, the first record is superseded
+    unsigned int i, round;
+    for (round = 0; round < 2; round++) {
+        for (i = 0; i < sizeof (wallet_txns) / sizeof (wallet_txns[0]); i++) {
+            uint8_t* tx_data = dogecoin_uint8_vla(strlen(wallet_txns[i])/2+2);
+            utils_hex_to_bin(wallet_txns[i], tx_data, strlen(wallet_txns[i]), &outlen);
+            dogecoin_wtx* wtx = dogecoin_wallet_wtx_new();
+            dogecoin_tx_deserialize(tx_data, outlen, wtx->tx, NULL);
+            dogecoin_free(tx_data);
+            wtx->height = i + 1;
+            dogecoin_wallet_add_wtx_move(wallet, wtx);
+        }
+    }
+    dogecoin_wallet_flush(wallet);
+    dogecoin_wallet_free(wallet);
+
+    // replaying the log
+    wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+    unsigned int utxo_count = HASH_COUNT(wallet->utxos);
+    unsigned int wtx_count = wallet->vec_wtxes->len;
+    int64_t balance = dogecoin_wallet_get_balance(wallet);
+    uint64_t address_balance = dogecoin_wallet_address_balance(wallet, p2pkh);
+    u_assert_int_eq(utxo_count > 0, true);
+    long log_size = wallet_file_size(wallettmpfile);
+    // a plain log stays readable by version 1 code
+    u_assert_uint32_eq(wallet_file_version(wallettmpfile), 1);
+
+    // compacting keeps the wallet usable and shrinks the file
+    u_assert_int_eq(dogecoin_wallet_compact(wallet), true);
+    u_assert_int_eq(wallet_file_size(wallettmpfile) < log_size, true);
+    u_assert_int_eq(wallet_file_size(wallettmpfile) > 0, true);
+    u_assert_uint32_eq(wallet_file_version(wallettmpfile), 2);
+
+    // records after the snapshot form the new log tail
+    dogecoin_wtx* coinbase = dogecoin_wallet_wtx_new();
+    dogecoin_tx_in* tx_in = dogecoin_tx_in_new();
+    tx_in->prevout.n = UINT32_MAX;
+    vector_add(coinbase->tx->vin, tx_in);
+    dogecoin_tx_add_p2pkh_hash160_out(coinbase->tx, 1000, hash160);
+    coinbase->height = 20;
+    dogecoin_wallet_add_wtx_move(wallet, coinbase);
+    dogecoin_wallet_flush(wallet);
+    dogecoin_wallet_free(wallet);
+
+    // snapshot + tail restore the same state
+    wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+    u_assert_int_eq(created, false);
+    u_assert_not_null(wallet->masterkey);
+    u_assert_uint32_eq(wallet->waddr_vector->len, 1);
+    u_assert_uint32_eq(wallet->vec_wtxes->len, wtx_count + 1);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), utxo_count + 1);
+    u_assert_int_eq(dogecoin_wallet_get_balance(wallet) == balance, true);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == address_balance + 1000, true);
+
+    // removing the address drops its utxos once persisted
+    u_assert_int_eq(dogecoin_wallet_remove_address(wallet, p2pkh), true);
+    u_assert_int_eq(dogecoin_wallet_remove_address(wallet, p2pkh), false);
+    u_assert_uint32_eq(wallet->waddr_vector->len, 0);
+    u_assert_int_eq(dogecoin_wallet_compact(wallet), true);
+    dogecoin_wallet_free(wallet);
+
+    wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+    u_assert_uint32_eq(wallet->waddr_vector->len, 0);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), 0);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh), 0);
+    dogecoin_wallet_free(wallet);
+}
+
+static void wallet_test_pay(dogecoin_wallet* wallet, const uint160_t hash160, int64_t amount, uint32_t n)
+{
+    dogecoin_wtx* wtx = dogecoin_wallet_wtx_new();
+    dogecoin_tx_in* tx_in = dogecoin_tx_in_new();
+    tx_in->prevout.hash[0] = 0xaa;
+    tx_in->prevout.n = n;
+    vector_add(wtx->tx->vin, tx_in);
+    dogecoin_tx_add_p2pkh_hash160_out(wtx->tx, amount, (uint8_t*)hash160);
+    wtx->height = n + 1;
+    dogecoin_wallet_scrape_utxos(wallet, wtx);
+    dogecoin_wallet_wtx_free(wtx);
+}
+
+static void wallet_test_mine(dogecoin_wallet* wallet, const uint160_t hash160, int64_t amount, uint32_t n, dogecoin_blockindex* pindex)
+{
+    dogecoin_tx* tx = dogecoin_tx_new();
+    dogecoin_tx_in* tx_in = dogecoin_tx_in_new();
+    tx_in->prevout.hash[0] = 0xbb;
+    tx_in->prevout.n = n;
+    vector_add(tx->vin, tx_in);
+    dogecoin_tx_add_p2pkh_hash160_out(tx, amount, (uint8_t*)hash160);
+    dogecoin_wallet_check_transaction(wallet, tx, 0, pindex);
+    dogecoin_tx_free(tx);
+}
+
+void test_wallet_remove_address_utxos()
+{
+    unlink(wallettmpfile);
+    dogecoin_wallet *wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    int error;
+    dogecoin_bool created;
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+
+    dogecoin_hdnode node;
+    u_assert_int_eq(dogecoin_hdnode_deserialize("dgub8kXBZ7ymNWy2T7WH3WgpGDv6htHqBEPU8bymfvJeHNJaBT65E2EjemjSx6ggYmaMDfnSrtJWbafCJu2b1voNTARsyhCULtT8d8MH2MQwCqV", &dogecoin_chainparams_main, &node), true);
+    dogecoin_wallet_set_master_key_copy(wallet, &node);
+    uint160_t hash160_a, hash160_b;
+    size_t outlen = 0;
+    utils_hex_to_bin("e195b669de8e49f955749033fa2d79390732c435", hash160_a, 40, &outlen);
+    utils_hex_to_bin("0b4c2fa1a5e3b9f1d4c6e2a8b0f3d5c7e9a1b3c5", hash160_b, 40, &outlen);
+    char p2pkh_a[P2PKHLEN], p2pkh_b[P2PKHLEN];
+    dogecoin_p2pkh_addr_from_hash160(hash160_a, &dogecoin_chainparams_main, p2pkh_a, P2PKHLEN);
+    dogecoin_p2pkh_addr_from_hash160(hash160_b, &dogecoin_chainparams_main, p2pkh_b, P2PKHLEN);
+    u_assert_int_eq(dogecoin_p2pkh_address_to_wallet(p2pkh_a, wallet) != NULL, true);
+    u_assert_int_eq(dogecoin_p2pkh_address_to_wallet(p2pkh_b, wallet) != NULL, true);
+
+    wallet_test_pay(wallet, hash160_a, 100, 0);
+    wallet_test_pay(wallet, hash160_b, 200, 1);
+    wallet_test_pay(wallet, hash160_a, 300, 2);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh_b) == 200, true);
+
+    // the utxos left behind keep their slots when new ones arrive
+    u_assert_int_eq(dogecoin_wallet_remove_address(wallet, p2pkh_a), true);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), 1);
+    wallet_test_pay(wallet, hash160_b, 400, 3);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), 2);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh_b) == 600, true);
+    dogecoin_balance balance;
+    dogecoin_wallet_utxos_get_balance(wallet, &balance);
+    u_assert_int_eq(balance.total == 600, true);
+    u_assert_uint32_eq(dogecoin_wallet_address_utxos_length(wallet, p2pkh_b), 2);
+
+    dogecoin_utxo* utxo;
+    dogecoin_utxo* tmp;
+    int64_t total = 0;
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+        u_assert_int_eq(find_dogecoin_utxo_by_outpoint(wallet, utxo->txid, utxo->vout) == utxo, true);
+        total += utxo->koinu;
+    }
+    u_assert_int_eq(total == 600, true);
+    dogecoin_wallet_free(wallet);
+}
+
+void test_wallet_fast_load()
+{
+    dogecoin_hdnode node;
+    u_assert_int_eq(dogecoin_hdnode_deserialize("dgub8kXBZ7ymNWy2T7WH3WgpGDv6htHqBEPU8bymfvJeHNJaBT65E2EjemjSx6ggYmaMDfnSrtJWbafCJu2b1voNTARsyhCULtT8d8MH2MQwCqV", &dogecoin_chainparams_main, &node), true);
+    uint160_t hash160;
+    size_t outlen = 0;
+    utils_hex_to_bin("e195b669de8e49f955749033fa2d79390732c435", hash160, 40, &outlen);
+    char p2pkh[P2PKHLEN];
+    dogecoin_p2pkh_addr_from_hash160(hash160, &dogecoin_chainparams_main, p2pkh, P2PKHLEN);
+
+    int error;
+    dogecoin_bool created;
+    unsigned int utxo_count = 0;
+    int64_t balance = 0;
+    uint64_t address_balance = 0;
+    int with_deltas;
+    for (with_deltas = 0; with_deltas < 2; with_deltas++) {
+        unlink(wallettmpfile);
+        dogecoin_wallet *wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+        u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+        dogecoin_wallet_set_master_key_copy(wallet, &node);
+        u_assert_not_null(dogecoin_p2pkh_address_to_wallet(p2pkh, wallet));
+
+        unsigned int i;
+        for (i = 0; i < sizeof (wallet_txns) / sizeof (wallet_txns[0]); i++) {
+            uint8_t* tx_data = dogecoin_uint8_vla(strlen(wallet_txns[i])/2+2);
+            utils_hex_to_bin(wallet_txns[i], tx_data, strlen(wallet_txns[i]), &outlen);
+            dogecoin_tx* tx = dogecoin_tx_new();
+            dogecoin_tx_deserialize(tx_data, outlen, tx, NULL);
+            dogecoin_free(tx_data);
+            if (with_deltas) {
+                // writes a tx record followed by its utxo record
+                dogecoin_blockindex* pindex = dogecoin_calloc(1, sizeof(dogecoin_blockindex));
+                pindex->height = i + 1;
+                dogecoin_wallet_check_transaction(wallet, tx, 0, pindex);
+                dogecoin_free(pindex);
+            } else {
+                // tx records only, as written by older versions
+                dogecoin_wtx* wtx = dogecoin_wallet_wtx_new();
+                dogecoin_tx_copy(wtx->tx, tx);
+                wtx->height = i + 1;
+                dogecoin_wallet_add_wtx_move(wallet, wtx);
+            }
+            dogecoin_tx_free(tx);
+        }
+        dogecoin_wallet_flush(wallet);
+        dogecoin_wallet_free(wallet);
+
+        wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+        u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+        u_assert_int_eq(created, false);
+        if (!with_deltas) {
+            utxo_count = HASH_COUNT(wallet->utxos);
+            u_assert_int_eq(utxo_count > 0, true);
+            address_balance = dogecoin_wallet_address_balance(wallet, p2pkh);
+            balance = dogecoin_wallet_get_balance(wallet);
+        } else {
+            // utxo records were replayed, no transaction got deserialized
+            for (i = 0; i < wallet->vec_wtxes->len; i++) {
+                dogecoin_wtx* wtx = vector_idx(wallet->vec_wtxes, i);
+                u_assert_is_null(wtx->tx);
+                u_assert_not_null(wtx->tx_raw);
+            }
+            u_assert_int_eq(wallet->vec_wtxes->len > 0, true);
+            u_assert_uint32_eq(HASH_COUNT(wallet->utxos), utxo_count);
+            u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == address_balance, true);
+
+            // bodies deserialize on first use
+            dogecoin_wtx* wtx = vector_idx(wallet->vec_wtxes, 0);
+            dogecoin_tx* tx = dogecoin_wallet_wtx_get_tx(wtx);
+            u_assert_not_null(tx);
+            u_assert_is_null(wtx->tx_raw);
+            uint256_t hash;
+            dogecoin_tx_hash(tx, hash);
+            u_assert_mem_eq(hash, wtx->tx_hash_cache, sizeof(uint256_t));
+            u_assert_int_eq(dogecoin_wallet_get_balance(wallet) == balance, true);
+
+            // a corrupt body yields no transaction, the raw bytes are kept
+            dogecoin_wtx* corrupt = dogecoin_wallet_wtx_new();
+            dogecoin_tx_free(corrupt->tx);
+            corrupt->tx = NULL;
+            corrupt->tx_raw = cstr_new_buf("\x01\x00\x00", 3);
+            u_assert_is_null(dogecoin_wallet_wtx_get_tx(corrupt));
+            u_assert_not_null(corrupt->tx_raw);
+            u_assert_int_eq(dogecoin_wallet_wtx_get_credit(wallet, corrupt), 0);
+            dogecoin_wallet_wtx_free(corrupt);
+        }
+        dogecoin_wallet_free(wallet);
+    }
+}
+
+void test_wallet_block_undo()
+{
+    unlink(wallettmpfile);
+    dogecoin_wallet *wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    int error;
+    dogecoin_bool created;
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+
+    dogecoin_hdnode node;
+    u_assert_int_eq(dogecoin_hdnode_deserialize("dgub8kXBZ7ymNWy2T7WH3WgpGDv6htHqBEPU8bymfvJeHNJaBT65E2EjemjSx6ggYmaMDfnSrtJWbafCJu2b1voNTARsyhCULtT8d8MH2MQwCqV", &dogecoin_chainparams_main, &node), true);
+    dogecoin_wallet_set_master_key_copy(wallet, &node);
+    uint160_t hash160;
+    size_t outlen = 0;
+    utils_hex_to_bin("e195b669de8e49f955749033fa2d79390732c435", hash160, 40, &outlen);
+    char p2pkh[P2PKHLEN];
+    dogecoin_p2pkh_addr_from_hash160(hash160, &dogecoin_chainparams_main, p2pkh, P2PKHLEN);
+    u_assert_not_null(dogecoin_p2pkh_address_to_wallet(p2pkh, wallet));
+
+    // spread the transactions over three blocks, remember the state after each
+    dogecoin_blockindex blocks[3];
+    unsigned int utxo_counts[3], wtx_counts[3];
+    uint64_t address_balances[3];
+    unsigned int count = sizeof (wallet_txns) / sizeof (wallet_txns[0]);
+    unsigned int b, i;
+    for (b = 0; b < 3; b++) {
+        dogecoin_mem_zero(&blocks[b], sizeof(blocks[b]));
+        blocks[b].height = b + 1;
+        blocks[b].hash[0] = (uint8_t)(b + 1);
+        for (i = b * count / 3; i < (b + 1) * count / 3; i++) {
+            uint8_t* tx_data = dogecoin_uint8_vla(strlen(wallet_txns[i])/2+2);
+            utils_hex_to_bin(wallet_txns[i], tx_data, strlen(wallet_txns[i]), &outlen);
+            dogecoin_tx* tx = dogecoin_tx_new();
+            dogecoin_tx_deserialize(tx_data, outlen, tx, NULL);
+            dogecoin_free(tx_data);
+            dogecoin_wallet_check_transaction(wallet, tx, i, &blocks[b]);
+            dogecoin_tx_free(tx);
+        }
+        utxo_counts[b] = HASH_COUNT(wallet->utxos);
+        wtx_counts[b] = wallet->vec_wtxes->len;
+        address_balances[b] = dogecoin_wallet_address_balance(wallet, p2pkh);
+    }
+    u_assert_int_eq(utxo_counts[2] > utxo_counts[1], true);
+
+    // disconnecting the tip restores the state of the block below
+    dogecoin_wallet_block_disconnected(wallet, &blocks[2]);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), utxo_counts[1]);
+    u_assert_uint32_eq(wallet->vec_wtxes->len, wtx_counts[1]);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == address_balances[1], true);
+    // blocks without wallet changes are ignored
+    dogecoin_wallet_block_disconnected(wallet, &blocks[2]);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), utxo_counts[1]);
+    dogecoin_wallet_free(wallet);
+
+    // the undo record is replayed on load
+    wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), utxo_counts[1]);
+    u_assert_uint32_eq(wallet->vec_wtxes->len, wtx_counts[1]);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == address_balances[1], true);
+
+    // undo data of recent blocks survives compaction
+    u_assert_int_eq(dogecoin_wallet_compact(wallet), true);
+    dogecoin_wallet_free(wallet);
+    wallet = dogecoin_wallet_new(&dogecoin_chainparams_main);
+    u_assert_int_eq(dogecoin_wallet_load(wallet, wallettmpfile, &error, &created, false), true);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), utxo_counts[1]);
+    dogecoin_wallet_block_disconnected(wallet, &blocks[1]);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), utxo_counts[0]);
+    u_assert_uint32_eq(wallet->vec_wtxes->len, wtx_counts[0]);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == address_balances[0], true);
+
+    // a reorged block leaves a gap below an unconfirmed payment
+    uint160_t hash160_other;
+    utils_hex_to_bin("0b4c2fa1a5e3b9f1d4c6e2a8b0f3d5c7e9a1b3c5", hash160_other, 40, &outlen);
+    char p2pkh_other[P2PKHLEN];
+    dogecoin_p2pkh_addr_from_hash160(hash160_other, &dogecoin_chainparams_main, p2pkh_other, P2PKHLEN);
+    u_assert_int_eq(dogecoin_p2pkh_address_to_wallet(p2pkh_other, wallet) != NULL, true);
+    dogecoin_blockindex forks[2];
+    for (b = 0; b < 2; b++) {
+        dogecoin_mem_zero(&forks[b], sizeof(forks[b]));
+        forks[b].height = 2;
+        forks[b].hash[0] = (uint8_t)(0xf0 + b);
+    }
+    wallet_test_mine(wallet, hash160, 700, 0, &forks[0]);
+    wallet_test_pay(wallet, hash160_other, 500, 0);
+    dogecoin_wallet_block_disconnected(wallet, &forks[0]);
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), utxo_counts[0] + 1);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == address_balances[0], true);
+    wallet_test_mine(wallet, hash160, 700, 1, &forks[1]);
+    // the utxo of the replacement block must not take the slot of the payment
+    u_assert_uint32_eq(HASH_COUNT(wallet->utxos), utxo_counts[0] + 2);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh) == address_balances[0] + 700, true);
+    u_assert_int_eq(dogecoin_wallet_address_balance(wallet, p2pkh_other) == 500, true);
+    dogecoin_utxo* utxo;
+    dogecoin_utxo* tmp;
+    HASH_ITER(hh, wallet->utxos, utxo, tmp) {
+        u_assert_int_eq(find_dogecoin_utxo_by_outpoint(wallet, utxo->txid, utxo->vout) == utxo, true);
+    }
+    dogecoin_wallet_free(wallet);
+}